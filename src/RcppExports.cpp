@@ -10,9 +10,92 @@ Rcpp::Rostream<true>&  Rcpp::Rcout = Rcpp::Rcpp_cout_get();
 Rcpp::Rostream<false>& Rcpp::Rcerr = Rcpp::Rcpp_cerr_get();
 #endif
 
+// arrow_reader_create_cpp
+SEXP arrow_reader_create_cpp(SEXP stream, int chunk_size);
+RcppExport SEXP _cgmguru_arrow_reader_create_cpp(SEXP streamSEXP, SEXP chunk_sizeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type stream(streamSEXP);
+    Rcpp::traits::input_parameter< int >::type chunk_size(chunk_sizeSEXP);
+    rcpp_result_gen = Rcpp::wrap(arrow_reader_create_cpp(stream, chunk_size));
+    return rcpp_result_gen;
+END_RCPP
+}
+// arrow_reader_next_cpp
+SEXP arrow_reader_next_cpp(SEXP reader);
+RcppExport SEXP _cgmguru_arrow_reader_next_cpp(SEXP readerSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type reader(readerSEXP);
+    rcpp_result_gen = Rcpp::wrap(arrow_reader_next_cpp(reader));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cohort_cache_write_cpp
+void cohort_cache_write_cpp(DataFrame df, std::string path, std::string gl_storage);
+RcppExport SEXP _cgmguru_cohort_cache_write_cpp(SEXP dfSEXP, SEXP pathSEXP, SEXP gl_storageSEXP) {
+BEGIN_RCPP
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< DataFrame >::type df(dfSEXP);
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< std::string >::type gl_storage(gl_storageSEXP);
+    cohort_cache_write_cpp(df, path, gl_storage);
+    return R_NilValue;
+END_RCPP
+}
+// cohort_cache_open_cpp
+SEXP cohort_cache_open_cpp(std::string path);
+RcppExport SEXP _cgmguru_cohort_cache_open_cpp(SEXP pathSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    rcpp_result_gen = Rcpp::wrap(cohort_cache_open_cpp(path));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cohort_cache_ids_cpp
+CharacterVector cohort_cache_ids_cpp(SEXP cache);
+RcppExport SEXP _cgmguru_cohort_cache_ids_cpp(SEXP cacheSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type cache(cacheSEXP);
+    rcpp_result_gen = Rcpp::wrap(cohort_cache_ids_cpp(cache));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cohort_cache_read_cpp
+DataFrame cohort_cache_read_cpp(SEXP cache, double first_id, double n_ids);
+RcppExport SEXP _cgmguru_cohort_cache_read_cpp(SEXP cacheSEXP, SEXP first_idSEXP, SEXP n_idsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type cache(cacheSEXP);
+    Rcpp::traits::input_parameter< double >::type first_id(first_idSEXP);
+    Rcpp::traits::input_parameter< double >::type n_ids(n_idsSEXP);
+    rcpp_result_gen = Rcpp::wrap(cohort_cache_read_cpp(cache, first_id, n_ids));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cohort_cache_context_cpp
+SEXP cohort_cache_context_cpp(SEXP cache, double first_id, double n_ids);
+RcppExport SEXP _cgmguru_cohort_cache_context_cpp(SEXP cacheSEXP, SEXP first_idSEXP, SEXP n_idsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type cache(cacheSEXP);
+    Rcpp::traits::input_parameter< double >::type first_id(first_idSEXP);
+    Rcpp::traits::input_parameter< double >::type n_ids(n_idsSEXP);
+    rcpp_result_gen = Rcpp::wrap(cohort_cache_context_cpp(cache, first_id, n_ids));
+    return rcpp_result_gen;
+END_RCPP
+}
 // detect_all_events
-RObject detect_all_events(DataFrame df, SEXP reading_minutes, bool sort_time, double inter_gap, bool return_interpolated, std::string summary_metrics_source, SEXP sensor_wear_ndays, SEXP summary_digits);
-RcppExport SEXP _cgmguru_detect_all_events(SEXP dfSEXP, SEXP reading_minutesSEXP, SEXP sort_timeSEXP, SEXP inter_gapSEXP, SEXP return_interpolatedSEXP, SEXP summary_metrics_sourceSEXP, SEXP sensor_wear_ndaysSEXP, SEXP summary_digitsSEXP) {
+RObject detect_all_events(DataFrame df, SEXP reading_minutes, bool sort_time, double inter_gap, bool return_interpolated, std::string summary_metrics_source, SEXP sensor_wear_ndays, SEXP summary_digits, bool interpolated_factor_ids, bool profile, SEXP levels, SEXP metrics);
+RcppExport SEXP _cgmguru_detect_all_events(SEXP dfSEXP, SEXP reading_minutesSEXP, SEXP sort_timeSEXP, SEXP inter_gapSEXP, SEXP return_interpolatedSEXP, SEXP summary_metrics_sourceSEXP, SEXP sensor_wear_ndaysSEXP, SEXP summary_digitsSEXP, SEXP interpolated_factor_idsSEXP, SEXP profileSEXP, SEXP levelsSEXP, SEXP metricsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -24,25 +107,67 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< std::string >::type summary_metrics_source(summary_metrics_sourceSEXP);
     Rcpp::traits::input_parameter< SEXP >::type sensor_wear_ndays(sensor_wear_ndaysSEXP);
     Rcpp::traits::input_parameter< SEXP >::type summary_digits(summary_digitsSEXP);
-    rcpp_result_gen = Rcpp::wrap(detect_all_events(df, reading_minutes, sort_time, inter_gap, return_interpolated, summary_metrics_source, sensor_wear_ndays, summary_digits));
+    Rcpp::traits::input_parameter< bool >::type interpolated_factor_ids(interpolated_factor_idsSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type levels(levelsSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type metrics(metricsSEXP);
+    rcpp_result_gen = Rcpp::wrap(detect_all_events(df, reading_minutes, sort_time, inter_gap, return_interpolated, summary_metrics_source, sensor_wear_ndays, summary_digits, interpolated_factor_ids, profile, levels, metrics));
+    return rcpp_result_gen;
+END_RCPP
+}
+// all_metrics_cpp
+List all_metrics_cpp(DataFrame df, std::vector<std::string> metrics, SEXP reading_minutes, double inter_gap, std::string tz, int conga_n, int modd_lag, int mage_short_ma, int mage_long_ma, std::string mage_direction, double mage_max_gap, std::string summary_metrics_source, SEXP sensor_wear_ndays, SEXP summary_digits);
+RcppExport SEXP _cgmguru_all_metrics_cpp(SEXP dfSEXP, SEXP metricsSEXP, SEXP reading_minutesSEXP, SEXP inter_gapSEXP, SEXP tzSEXP, SEXP conga_nSEXP, SEXP modd_lagSEXP, SEXP mage_short_maSEXP, SEXP mage_long_maSEXP, SEXP mage_directionSEXP, SEXP mage_max_gapSEXP, SEXP summary_metrics_sourceSEXP, SEXP sensor_wear_ndaysSEXP, SEXP summary_digitsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< DataFrame >::type df(dfSEXP);
+    Rcpp::traits::input_parameter< std::vector<std::string> >::type metrics(metricsSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type reading_minutes(reading_minutesSEXP);
+    Rcpp::traits::input_parameter< double >::type inter_gap(inter_gapSEXP);
+    Rcpp::traits::input_parameter< std::string >::type tz(tzSEXP);
+    Rcpp::traits::input_parameter< int >::type conga_n(conga_nSEXP);
+    Rcpp::traits::input_parameter< int >::type modd_lag(modd_lagSEXP);
+    Rcpp::traits::input_parameter< int >::type mage_short_ma(mage_short_maSEXP);
+    Rcpp::traits::input_parameter< int >::type mage_long_ma(mage_long_maSEXP);
+    Rcpp::traits::input_parameter< std::string >::type mage_direction(mage_directionSEXP);
+    Rcpp::traits::input_parameter< double >::type mage_max_gap(mage_max_gapSEXP);
+    Rcpp::traits::input_parameter< std::string >::type summary_metrics_source(summary_metrics_sourceSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type sensor_wear_ndays(sensor_wear_ndaysSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type summary_digits(summary_digitsSEXP);
+    rcpp_result_gen = Rcpp::wrap(all_metrics_cpp(df, metrics, reading_minutes, inter_gap, tz, conga_n, modd_lag, mage_short_ma, mage_long_ma, mage_direction, mage_max_gap, summary_metrics_source, sensor_wear_ndays, summary_digits));
     return rcpp_result_gen;
 END_RCPP
 }
 // detect_between_maxima
-List detect_between_maxima(DataFrame df, DataFrame transform_df);
-RcppExport SEXP _cgmguru_detect_between_maxima(SEXP dfSEXP, SEXP transform_dfSEXP) {
+List detect_between_maxima(DataFrame df, DataFrame transform_df, bool profile);
+RcppExport SEXP _cgmguru_detect_between_maxima(SEXP dfSEXP, SEXP transform_dfSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< DataFrame >::type df(dfSEXP);
     Rcpp::traits::input_parameter< DataFrame >::type transform_df(transform_dfSEXP);
-    rcpp_result_gen = Rcpp::wrap(detect_between_maxima(df, transform_df));
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(detect_between_maxima(df, transform_df, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+// grid_context_detect_between_maxima_cpp
+List grid_context_detect_between_maxima_cpp(SEXP context, DataFrame transform_df, bool profile);
+RcppExport SEXP _cgmguru_grid_context_detect_between_maxima_cpp(SEXP contextSEXP, SEXP transform_dfSEXP, SEXP profileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type context(contextSEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type transform_df(transform_dfSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(grid_context_detect_between_maxima_cpp(context, transform_df, profile));
     return rcpp_result_gen;
 END_RCPP
 }
 // detect_hyperglycemic_events
-List detect_hyperglycemic_events(DataFrame df, SEXP reading_minutes, double dur_length, double end_length, double start_gl, double end_gl, bool sort_time, double inter_gap, bool return_interpolated, bool lv1_excl);
-RcppExport SEXP _cgmguru_detect_hyperglycemic_events(SEXP dfSEXP, SEXP reading_minutesSEXP, SEXP dur_lengthSEXP, SEXP end_lengthSEXP, SEXP start_glSEXP, SEXP end_glSEXP, SEXP sort_timeSEXP, SEXP inter_gapSEXP, SEXP return_interpolatedSEXP, SEXP lv1_exclSEXP) {
+List detect_hyperglycemic_events(DataFrame df, SEXP reading_minutes, double dur_length, double end_length, double start_gl, double end_gl, bool sort_time, double inter_gap, bool return_interpolated, bool lv1_excl, bool interpolated_factor_ids, bool profile);
+RcppExport SEXP _cgmguru_detect_hyperglycemic_events(SEXP dfSEXP, SEXP reading_minutesSEXP, SEXP dur_lengthSEXP, SEXP end_lengthSEXP, SEXP start_glSEXP, SEXP end_glSEXP, SEXP sort_timeSEXP, SEXP inter_gapSEXP, SEXP return_interpolatedSEXP, SEXP lv1_exclSEXP, SEXP interpolated_factor_idsSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -56,13 +181,15 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< double >::type inter_gap(inter_gapSEXP);
     Rcpp::traits::input_parameter< bool >::type return_interpolated(return_interpolatedSEXP);
     Rcpp::traits::input_parameter< bool >::type lv1_excl(lv1_exclSEXP);
-    rcpp_result_gen = Rcpp::wrap(detect_hyperglycemic_events(df, reading_minutes, dur_length, end_length, start_gl, end_gl, sort_time, inter_gap, return_interpolated, lv1_excl));
+    Rcpp::traits::input_parameter< bool >::type interpolated_factor_ids(interpolated_factor_idsSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(detect_hyperglycemic_events(df, reading_minutes, dur_length, end_length, start_gl, end_gl, sort_time, inter_gap, return_interpolated, lv1_excl, interpolated_factor_ids, profile));
     return rcpp_result_gen;
 END_RCPP
 }
 // detect_hypoglycemic_events
-List detect_hypoglycemic_events(DataFrame df, SEXP reading_minutes, double dur_length, double end_length, double start_gl, bool sort_time, double inter_gap, bool return_interpolated, bool lv1_excl);
-RcppExport SEXP _cgmguru_detect_hypoglycemic_events(SEXP dfSEXP, SEXP reading_minutesSEXP, SEXP dur_lengthSEXP, SEXP end_lengthSEXP, SEXP start_glSEXP, SEXP sort_timeSEXP, SEXP inter_gapSEXP, SEXP return_interpolatedSEXP, SEXP lv1_exclSEXP) {
+List detect_hypoglycemic_events(DataFrame df, SEXP reading_minutes, double dur_length, double end_length, double start_gl, bool sort_time, double inter_gap, bool return_interpolated, bool lv1_excl, bool interpolated_factor_ids, bool profile);
+RcppExport SEXP _cgmguru_detect_hypoglycemic_events(SEXP dfSEXP, SEXP reading_minutesSEXP, SEXP dur_lengthSEXP, SEXP end_lengthSEXP, SEXP start_glSEXP, SEXP sort_timeSEXP, SEXP inter_gapSEXP, SEXP return_interpolatedSEXP, SEXP lv1_exclSEXP, SEXP interpolated_factor_idsSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -75,108 +202,302 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< double >::type inter_gap(inter_gapSEXP);
     Rcpp::traits::input_parameter< bool >::type return_interpolated(return_interpolatedSEXP);
     Rcpp::traits::input_parameter< bool >::type lv1_excl(lv1_exclSEXP);
-    rcpp_result_gen = Rcpp::wrap(detect_hypoglycemic_events(df, reading_minutes, dur_length, end_length, start_gl, sort_time, inter_gap, return_interpolated, lv1_excl));
+    Rcpp::traits::input_parameter< bool >::type interpolated_factor_ids(interpolated_factor_idsSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(detect_hypoglycemic_events(df, reading_minutes, dur_length, end_length, start_gl, sort_time, inter_gap, return_interpolated, lv1_excl, interpolated_factor_ids, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+// event_stream_create_cpp
+SEXP event_stream_create_cpp(double reading_minutes, double inter_gap, std::string tz);
+RcppExport SEXP _cgmguru_event_stream_create_cpp(SEXP reading_minutesSEXP, SEXP inter_gapSEXP, SEXP tzSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< double >::type reading_minutes(reading_minutesSEXP);
+    Rcpp::traits::input_parameter< double >::type inter_gap(inter_gapSEXP);
+    Rcpp::traits::input_parameter< std::string >::type tz(tzSEXP);
+    rcpp_result_gen = Rcpp::wrap(event_stream_create_cpp(reading_minutes, inter_gap, tz));
+    return rcpp_result_gen;
+END_RCPP
+}
+// event_stream_update_cpp
+DataFrame event_stream_update_cpp(SEXP stream, DataFrame df);
+RcppExport SEXP _cgmguru_event_stream_update_cpp(SEXP streamSEXP, SEXP dfSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type stream(streamSEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type df(dfSEXP);
+    rcpp_result_gen = Rcpp::wrap(event_stream_update_cpp(stream, df));
+    return rcpp_result_gen;
+END_RCPP
+}
+// event_stream_flush_cpp
+DataFrame event_stream_flush_cpp(SEXP stream);
+RcppExport SEXP _cgmguru_event_stream_flush_cpp(SEXP streamSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type stream(streamSEXP);
+    rcpp_result_gen = Rcpp::wrap(event_stream_flush_cpp(stream));
     return rcpp_result_gen;
 END_RCPP
 }
 // excursion
-List excursion(DataFrame df, double gap);
-RcppExport SEXP _cgmguru_excursion(SEXP dfSEXP, SEXP gapSEXP) {
+List excursion(DataFrame df, double gap, int n_threads, bool profile);
+RcppExport SEXP _cgmguru_excursion(SEXP dfSEXP, SEXP gapSEXP, SEXP n_threadsSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< DataFrame >::type df(dfSEXP);
     Rcpp::traits::input_parameter< double >::type gap(gapSEXP);
-    rcpp_result_gen = Rcpp::wrap(excursion(df, gap));
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(excursion(df, gap, n_threads, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+// grid_context_excursion_cpp
+List grid_context_excursion_cpp(SEXP context, double gap, int n_threads, bool profile);
+RcppExport SEXP _cgmguru_grid_context_excursion_cpp(SEXP contextSEXP, SEXP gapSEXP, SEXP n_threadsSEXP, SEXP profileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type context(contextSEXP);
+    Rcpp::traits::input_parameter< double >::type gap(gapSEXP);
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(grid_context_excursion_cpp(context, gap, n_threads, profile));
     return rcpp_result_gen;
 END_RCPP
 }
 // find_local_maxima
-List find_local_maxima(DataFrame df);
-RcppExport SEXP _cgmguru_find_local_maxima(SEXP dfSEXP) {
+List find_local_maxima(DataFrame df, int n_threads, bool profile);
+RcppExport SEXP _cgmguru_find_local_maxima(SEXP dfSEXP, SEXP n_threadsSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< DataFrame >::type df(dfSEXP);
-    rcpp_result_gen = Rcpp::wrap(find_local_maxima(df));
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(find_local_maxima(df, n_threads, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+// grid_context_local_maxima_cpp
+List grid_context_local_maxima_cpp(SEXP context, int n_threads, bool profile);
+RcppExport SEXP _cgmguru_grid_context_local_maxima_cpp(SEXP contextSEXP, SEXP n_threadsSEXP, SEXP profileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type context(contextSEXP);
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(grid_context_local_maxima_cpp(context, n_threads, profile));
     return rcpp_result_gen;
 END_RCPP
 }
 // find_max_after_hours
-List find_max_after_hours(DataFrame df, DataFrame start_point_df, double hours);
-RcppExport SEXP _cgmguru_find_max_after_hours(SEXP dfSEXP, SEXP start_point_dfSEXP, SEXP hoursSEXP) {
+List find_max_after_hours(DataFrame df, DataFrame start_point_df, double hours, bool profile);
+RcppExport SEXP _cgmguru_find_max_after_hours(SEXP dfSEXP, SEXP start_point_dfSEXP, SEXP hoursSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< DataFrame >::type df(dfSEXP);
     Rcpp::traits::input_parameter< DataFrame >::type start_point_df(start_point_dfSEXP);
     Rcpp::traits::input_parameter< double >::type hours(hoursSEXP);
-    rcpp_result_gen = Rcpp::wrap(find_max_after_hours(df, start_point_df, hours));
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(find_max_after_hours(df, start_point_df, hours, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+// grid_context_find_max_after_hours_cpp
+List grid_context_find_max_after_hours_cpp(SEXP context, DataFrame start_point_df, double hours, bool profile);
+RcppExport SEXP _cgmguru_grid_context_find_max_after_hours_cpp(SEXP contextSEXP, SEXP start_point_dfSEXP, SEXP hoursSEXP, SEXP profileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type context(contextSEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type start_point_df(start_point_dfSEXP);
+    Rcpp::traits::input_parameter< double >::type hours(hoursSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(grid_context_find_max_after_hours_cpp(context, start_point_df, hours, profile));
     return rcpp_result_gen;
 END_RCPP
 }
 // find_max_before_hours
-List find_max_before_hours(DataFrame df, DataFrame start_point_df, double hours);
-RcppExport SEXP _cgmguru_find_max_before_hours(SEXP dfSEXP, SEXP start_point_dfSEXP, SEXP hoursSEXP) {
+List find_max_before_hours(DataFrame df, DataFrame start_point_df, double hours, bool profile);
+RcppExport SEXP _cgmguru_find_max_before_hours(SEXP dfSEXP, SEXP start_point_dfSEXP, SEXP hoursSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< DataFrame >::type df(dfSEXP);
     Rcpp::traits::input_parameter< DataFrame >::type start_point_df(start_point_dfSEXP);
     Rcpp::traits::input_parameter< double >::type hours(hoursSEXP);
-    rcpp_result_gen = Rcpp::wrap(find_max_before_hours(df, start_point_df, hours));
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(find_max_before_hours(df, start_point_df, hours, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+// grid_context_find_max_before_hours_cpp
+List grid_context_find_max_before_hours_cpp(SEXP context, DataFrame start_point_df, double hours, bool profile);
+RcppExport SEXP _cgmguru_grid_context_find_max_before_hours_cpp(SEXP contextSEXP, SEXP start_point_dfSEXP, SEXP hoursSEXP, SEXP profileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type context(contextSEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type start_point_df(start_point_dfSEXP);
+    Rcpp::traits::input_parameter< double >::type hours(hoursSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(grid_context_find_max_before_hours_cpp(context, start_point_df, hours, profile));
     return rcpp_result_gen;
 END_RCPP
 }
 // find_min_after_hours
-List find_min_after_hours(DataFrame df, DataFrame start_point_df, double hours);
-RcppExport SEXP _cgmguru_find_min_after_hours(SEXP dfSEXP, SEXP start_point_dfSEXP, SEXP hoursSEXP) {
+List find_min_after_hours(DataFrame df, DataFrame start_point_df, double hours, bool profile);
+RcppExport SEXP _cgmguru_find_min_after_hours(SEXP dfSEXP, SEXP start_point_dfSEXP, SEXP hoursSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< DataFrame >::type df(dfSEXP);
     Rcpp::traits::input_parameter< DataFrame >::type start_point_df(start_point_dfSEXP);
     Rcpp::traits::input_parameter< double >::type hours(hoursSEXP);
-    rcpp_result_gen = Rcpp::wrap(find_min_after_hours(df, start_point_df, hours));
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(find_min_after_hours(df, start_point_df, hours, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+// grid_context_find_min_after_hours_cpp
+List grid_context_find_min_after_hours_cpp(SEXP context, DataFrame start_point_df, double hours, bool profile);
+RcppExport SEXP _cgmguru_grid_context_find_min_after_hours_cpp(SEXP contextSEXP, SEXP start_point_dfSEXP, SEXP hoursSEXP, SEXP profileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type context(contextSEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type start_point_df(start_point_dfSEXP);
+    Rcpp::traits::input_parameter< double >::type hours(hoursSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(grid_context_find_min_after_hours_cpp(context, start_point_df, hours, profile));
     return rcpp_result_gen;
 END_RCPP
 }
 // find_min_before_hours
-List find_min_before_hours(DataFrame df, DataFrame start_point_df, double hours);
-RcppExport SEXP _cgmguru_find_min_before_hours(SEXP dfSEXP, SEXP start_point_dfSEXP, SEXP hoursSEXP) {
+List find_min_before_hours(DataFrame df, DataFrame start_point_df, double hours, bool profile);
+RcppExport SEXP _cgmguru_find_min_before_hours(SEXP dfSEXP, SEXP start_point_dfSEXP, SEXP hoursSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< DataFrame >::type df(dfSEXP);
     Rcpp::traits::input_parameter< DataFrame >::type start_point_df(start_point_dfSEXP);
     Rcpp::traits::input_parameter< double >::type hours(hoursSEXP);
-    rcpp_result_gen = Rcpp::wrap(find_min_before_hours(df, start_point_df, hours));
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(find_min_before_hours(df, start_point_df, hours, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+// grid_context_find_min_before_hours_cpp
+List grid_context_find_min_before_hours_cpp(SEXP context, DataFrame start_point_df, double hours, bool profile);
+RcppExport SEXP _cgmguru_grid_context_find_min_before_hours_cpp(SEXP contextSEXP, SEXP start_point_dfSEXP, SEXP hoursSEXP, SEXP profileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type context(contextSEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type start_point_df(start_point_dfSEXP);
+    Rcpp::traits::input_parameter< double >::type hours(hoursSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(grid_context_find_min_before_hours_cpp(context, start_point_df, hours, profile));
     return rcpp_result_gen;
 END_RCPP
 }
 // find_new_maxima
-DataFrame find_new_maxima(DataFrame df, DataFrame mod_grid_max_point_df, DataFrame local_maxima_df);
-RcppExport SEXP _cgmguru_find_new_maxima(SEXP dfSEXP, SEXP mod_grid_max_point_dfSEXP, SEXP local_maxima_dfSEXP) {
+DataFrame find_new_maxima(DataFrame df, DataFrame mod_grid_max_point_df, DataFrame local_maxima_df, bool profile);
+RcppExport SEXP _cgmguru_find_new_maxima(SEXP dfSEXP, SEXP mod_grid_max_point_dfSEXP, SEXP local_maxima_dfSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< DataFrame >::type df(dfSEXP);
     Rcpp::traits::input_parameter< DataFrame >::type mod_grid_max_point_df(mod_grid_max_point_dfSEXP);
     Rcpp::traits::input_parameter< DataFrame >::type local_maxima_df(local_maxima_dfSEXP);
-    rcpp_result_gen = Rcpp::wrap(find_new_maxima(df, mod_grid_max_point_df, local_maxima_df));
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(find_new_maxima(df, mod_grid_max_point_df, local_maxima_df, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+// grid_context_find_new_maxima_cpp
+DataFrame grid_context_find_new_maxima_cpp(SEXP context, DataFrame mod_grid_max_point_df, DataFrame local_maxima_df, bool profile);
+RcppExport SEXP _cgmguru_grid_context_find_new_maxima_cpp(SEXP contextSEXP, SEXP mod_grid_max_point_dfSEXP, SEXP local_maxima_dfSEXP, SEXP profileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type context(contextSEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type mod_grid_max_point_df(mod_grid_max_point_dfSEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type local_maxima_df(local_maxima_dfSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(grid_context_find_new_maxima_cpp(context, mod_grid_max_point_df, local_maxima_df, profile));
     return rcpp_result_gen;
 END_RCPP
 }
 // grid
-List grid(DataFrame df, double gap, double threshold);
-RcppExport SEXP _cgmguru_grid(SEXP dfSEXP, SEXP gapSEXP, SEXP thresholdSEXP) {
+List grid(DataFrame df, double gap, double threshold, int n_threads, bool profile);
+RcppExport SEXP _cgmguru_grid(SEXP dfSEXP, SEXP gapSEXP, SEXP thresholdSEXP, SEXP n_threadsSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< DataFrame >::type df(dfSEXP);
     Rcpp::traits::input_parameter< double >::type gap(gapSEXP);
     Rcpp::traits::input_parameter< double >::type threshold(thresholdSEXP);
-    rcpp_result_gen = Rcpp::wrap(grid(df, gap, threshold));
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(grid(df, gap, threshold, n_threads, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+// grid_context_grid_cpp
+List grid_context_grid_cpp(SEXP context, double gap, double threshold, int n_threads, bool profile);
+RcppExport SEXP _cgmguru_grid_context_grid_cpp(SEXP contextSEXP, SEXP gapSEXP, SEXP thresholdSEXP, SEXP n_threadsSEXP, SEXP profileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type context(contextSEXP);
+    Rcpp::traits::input_parameter< double >::type gap(gapSEXP);
+    Rcpp::traits::input_parameter< double >::type threshold(thresholdSEXP);
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(grid_context_grid_cpp(context, gap, threshold, n_threads, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+// grid_context_create_cpp
+SEXP grid_context_create_cpp(DataFrame df);
+RcppExport SEXP _cgmguru_grid_context_create_cpp(SEXP dfSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< DataFrame >::type df(dfSEXP);
+    rcpp_result_gen = Rcpp::wrap(grid_context_create_cpp(df));
+    return rcpp_result_gen;
+END_RCPP
+}
+// grid_context_data_cpp
+DataFrame grid_context_data_cpp(SEXP context);
+RcppExport SEXP _cgmguru_grid_context_data_cpp(SEXP contextSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type context(contextSEXP);
+    rcpp_result_gen = Rcpp::wrap(grid_context_data_cpp(context));
+    return rcpp_result_gen;
+END_RCPP
+}
+// grid_context_reading_minutes_cpp
+SEXP grid_context_reading_minutes_cpp(SEXP context);
+RcppExport SEXP _cgmguru_grid_context_reading_minutes_cpp(SEXP contextSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type context(contextSEXP);
+    rcpp_result_gen = Rcpp::wrap(grid_context_reading_minutes_cpp(context));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -195,8 +516,8 @@ BEGIN_RCPP
 END_RCPP
 }
 // maxima_grid
-List maxima_grid(DataFrame df, double threshold, double gap, double hours);
-RcppExport SEXP _cgmguru_maxima_grid(SEXP dfSEXP, SEXP thresholdSEXP, SEXP gapSEXP, SEXP hoursSEXP) {
+List maxima_grid(DataFrame df, double threshold, double gap, double hours, bool profile);
+RcppExport SEXP _cgmguru_maxima_grid(SEXP dfSEXP, SEXP thresholdSEXP, SEXP gapSEXP, SEXP hoursSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -204,13 +525,59 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< double >::type threshold(thresholdSEXP);
     Rcpp::traits::input_parameter< double >::type gap(gapSEXP);
     Rcpp::traits::input_parameter< double >::type hours(hoursSEXP);
-    rcpp_result_gen = Rcpp::wrap(maxima_grid(df, threshold, gap, hours));
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(maxima_grid(df, threshold, gap, hours, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+// grid_context_maxima_grid_cpp
+List grid_context_maxima_grid_cpp(SEXP context, double threshold, double gap, double hours, bool profile);
+RcppExport SEXP _cgmguru_grid_context_maxima_grid_cpp(SEXP contextSEXP, SEXP thresholdSEXP, SEXP gapSEXP, SEXP hoursSEXP, SEXP profileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type context(contextSEXP);
+    Rcpp::traits::input_parameter< double >::type threshold(thresholdSEXP);
+    Rcpp::traits::input_parameter< double >::type gap(gapSEXP);
+    Rcpp::traits::input_parameter< double >::type hours(hoursSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(grid_context_maxima_grid_cpp(context, threshold, gap, hours, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+// maxima_grid_sweep_cpp
+List maxima_grid_sweep_cpp(DataFrame df, NumericVector threshold, NumericVector gap, NumericVector hours, int n_threads);
+RcppExport SEXP _cgmguru_maxima_grid_sweep_cpp(SEXP dfSEXP, SEXP thresholdSEXP, SEXP gapSEXP, SEXP hoursSEXP, SEXP n_threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< DataFrame >::type df(dfSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type threshold(thresholdSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type gap(gapSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type hours(hoursSEXP);
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(maxima_grid_sweep_cpp(df, threshold, gap, hours, n_threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// grid_context_maxima_grid_sweep_cpp
+List grid_context_maxima_grid_sweep_cpp(SEXP context, NumericVector threshold, NumericVector gap, NumericVector hours, int n_threads);
+RcppExport SEXP _cgmguru_grid_context_maxima_grid_sweep_cpp(SEXP contextSEXP, SEXP thresholdSEXP, SEXP gapSEXP, SEXP hoursSEXP, SEXP n_threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type context(contextSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type threshold(thresholdSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type gap(gapSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type hours(hoursSEXP);
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(grid_context_maxima_grid_sweep_cpp(context, threshold, gap, hours, n_threads));
     return rcpp_result_gen;
 END_RCPP
 }
 // mod_grid
-List mod_grid(DataFrame df, DataFrame grid_point_df, double hours, double gap);
-RcppExport SEXP _cgmguru_mod_grid(SEXP dfSEXP, SEXP grid_point_dfSEXP, SEXP hoursSEXP, SEXP gapSEXP) {
+List mod_grid(DataFrame df, DataFrame grid_point_df, double hours, double gap, int n_threads, bool profile);
+RcppExport SEXP _cgmguru_mod_grid(SEXP dfSEXP, SEXP grid_point_dfSEXP, SEXP hoursSEXP, SEXP gapSEXP, SEXP n_threadsSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -218,7 +585,25 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< DataFrame >::type grid_point_df(grid_point_dfSEXP);
     Rcpp::traits::input_parameter< double >::type hours(hoursSEXP);
     Rcpp::traits::input_parameter< double >::type gap(gapSEXP);
-    rcpp_result_gen = Rcpp::wrap(mod_grid(df, grid_point_df, hours, gap));
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(mod_grid(df, grid_point_df, hours, gap, n_threads, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+// grid_context_mod_grid_cpp
+List grid_context_mod_grid_cpp(SEXP context, DataFrame grid_point_df, double hours, double gap, int n_threads, bool profile);
+RcppExport SEXP _cgmguru_grid_context_mod_grid_cpp(SEXP contextSEXP, SEXP grid_point_dfSEXP, SEXP hoursSEXP, SEXP gapSEXP, SEXP n_threadsSEXP, SEXP profileSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type context(contextSEXP);
+    Rcpp::traits::input_parameter< DataFrame >::type grid_point_df(grid_point_dfSEXP);
+    Rcpp::traits::input_parameter< double >::type hours(hoursSEXP);
+    Rcpp::traits::input_parameter< double >::type gap(gapSEXP);
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(grid_context_mod_grid_cpp(context, grid_point_df, hours, gap, n_threads, profile));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -234,8 +619,8 @@ BEGIN_RCPP
 END_RCPP
 }
 // rebound_events_cpp
-List rebound_events_cpp(DataFrame df, std::string type, std::string data_source, SEXP reading_minutes, bool sort_time, double inter_gap, double rebound_minutes, bool return_interpolated);
-RcppExport SEXP _cgmguru_rebound_events_cpp(SEXP dfSEXP, SEXP typeSEXP, SEXP data_sourceSEXP, SEXP reading_minutesSEXP, SEXP sort_timeSEXP, SEXP inter_gapSEXP, SEXP rebound_minutesSEXP, SEXP return_interpolatedSEXP) {
+List rebound_events_cpp(DataFrame df, std::string type, std::string data_source, SEXP reading_minutes, bool sort_time, double inter_gap, double rebound_minutes, bool return_interpolated, bool interpolated_factor_ids, bool profile);
+RcppExport SEXP _cgmguru_rebound_events_cpp(SEXP dfSEXP, SEXP typeSEXP, SEXP data_sourceSEXP, SEXP reading_minutesSEXP, SEXP sort_timeSEXP, SEXP inter_gapSEXP, SEXP rebound_minutesSEXP, SEXP return_interpolatedSEXP, SEXP interpolated_factor_idsSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -247,13 +632,29 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< double >::type inter_gap(inter_gapSEXP);
     Rcpp::traits::input_parameter< double >::type rebound_minutes(rebound_minutesSEXP);
     Rcpp::traits::input_parameter< bool >::type return_interpolated(return_interpolatedSEXP);
-    rcpp_result_gen = Rcpp::wrap(rebound_events_cpp(df, type, data_source, reading_minutes, sort_time, inter_gap, rebound_minutes, return_interpolated));
+    Rcpp::traits::input_parameter< bool >::type interpolated_factor_ids(interpolated_factor_idsSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(rebound_events_cpp(df, type, data_source, reading_minutes, sort_time, inter_gap, rebound_minutes, return_interpolated, interpolated_factor_ids, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+// subject_fingerprints_cpp
+CharacterVector subject_fingerprints_cpp(SEXP id, NumericVector time, NumericVector gl, RawVector salt);
+RcppExport SEXP _cgmguru_subject_fingerprints_cpp(SEXP idSEXP, SEXP timeSEXP, SEXP glSEXP, SEXP saltSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type id(idSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type time(timeSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type gl(glSEXP);
+    Rcpp::traits::input_parameter< RawVector >::type salt(saltSEXP);
+    rcpp_result_gen = Rcpp::wrap(subject_fingerprints_cpp(id, time, gl, salt));
     return rcpp_result_gen;
 END_RCPP
 }
 // sensor_wear_cpp
-DataFrame sensor_wear_cpp(DataFrame df, SEXP reading_minutes, Nullable<NumericVector> end_date, SEXP ndays);
-RcppExport SEXP _cgmguru_sensor_wear_cpp(SEXP dfSEXP, SEXP reading_minutesSEXP, SEXP end_dateSEXP, SEXP ndaysSEXP) {
+DataFrame sensor_wear_cpp(DataFrame df, SEXP reading_minutes, Nullable<NumericVector> end_date, SEXP ndays, int n_threads);
+RcppExport SEXP _cgmguru_sensor_wear_cpp(SEXP dfSEXP, SEXP reading_minutesSEXP, SEXP end_dateSEXP, SEXP ndaysSEXP, SEXP n_threadsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -261,7 +662,8 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< SEXP >::type reading_minutes(reading_minutesSEXP);
     Rcpp::traits::input_parameter< Nullable<NumericVector> >::type end_date(end_dateSEXP);
     Rcpp::traits::input_parameter< SEXP >::type ndays(ndaysSEXP);
-    rcpp_result_gen = Rcpp::wrap(sensor_wear_cpp(df, reading_minutes, end_date, ndays));
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(sensor_wear_cpp(df, reading_minutes, end_date, ndays, n_threads));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -277,14 +679,15 @@ BEGIN_RCPP
 END_RCPP
 }
 // transform_df
-DataFrame transform_df(DataFrame grid_df, DataFrame maxima_df);
-RcppExport SEXP _cgmguru_transform_df(SEXP grid_dfSEXP, SEXP maxima_dfSEXP) {
+DataFrame transform_df(DataFrame grid_df, DataFrame maxima_df, bool profile);
+RcppExport SEXP _cgmguru_transform_df(SEXP grid_dfSEXP, SEXP maxima_dfSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< DataFrame >::type grid_df(grid_dfSEXP);
     Rcpp::traits::input_parameter< DataFrame >::type maxima_df(maxima_dfSEXP);
-    rcpp_result_gen = Rcpp::wrap(transform_df(grid_df, maxima_df));
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(transform_df(grid_df, maxima_df, profile));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -317,8 +720,8 @@ BEGIN_RCPP
 END_RCPP
 }
 // mage_rcpp_cpp
-DataFrame mage_rcpp_cpp(DataFrame df, std::string version, double sd_multiplier, int short_ma, int long_ma, std::string return_type, std::string direction, std::string tz, double inter_gap, double max_gap);
-RcppExport SEXP _cgmguru_mage_rcpp_cpp(SEXP dfSEXP, SEXP versionSEXP, SEXP sd_multiplierSEXP, SEXP short_maSEXP, SEXP long_maSEXP, SEXP return_typeSEXP, SEXP directionSEXP, SEXP tzSEXP, SEXP inter_gapSEXP, SEXP max_gapSEXP) {
+DataFrame mage_rcpp_cpp(DataFrame df, std::string version, double sd_multiplier, int short_ma, int long_ma, std::string return_type, std::string direction, std::string tz, double inter_gap, double max_gap, bool profile);
+RcppExport SEXP _cgmguru_mage_rcpp_cpp(SEXP dfSEXP, SEXP versionSEXP, SEXP sd_multiplierSEXP, SEXP short_maSEXP, SEXP long_maSEXP, SEXP return_typeSEXP, SEXP directionSEXP, SEXP tzSEXP, SEXP inter_gapSEXP, SEXP max_gapSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -332,35 +735,82 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< std::string >::type tz(tzSEXP);
     Rcpp::traits::input_parameter< double >::type inter_gap(inter_gapSEXP);
     Rcpp::traits::input_parameter< double >::type max_gap(max_gapSEXP);
-    rcpp_result_gen = Rcpp::wrap(mage_rcpp_cpp(df, version, sd_multiplier, short_ma, long_ma, return_type, direction, tz, inter_gap, max_gap));
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(mage_rcpp_cpp(df, version, sd_multiplier, short_ma, long_ma, return_type, direction, tz, inter_gap, max_gap, profile));
+    return rcpp_result_gen;
+END_RCPP
+}
+// mage_ma_sweep_cpp
+DataFrame mage_ma_sweep_cpp(DataFrame df, IntegerVector short_ma, IntegerVector long_ma, std::string direction, std::string tz, double inter_gap, double max_gap);
+RcppExport SEXP _cgmguru_mage_ma_sweep_cpp(SEXP dfSEXP, SEXP short_maSEXP, SEXP long_maSEXP, SEXP directionSEXP, SEXP tzSEXP, SEXP inter_gapSEXP, SEXP max_gapSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< DataFrame >::type df(dfSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type short_ma(short_maSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type long_ma(long_maSEXP);
+    Rcpp::traits::input_parameter< std::string >::type direction(directionSEXP);
+    Rcpp::traits::input_parameter< std::string >::type tz(tzSEXP);
+    Rcpp::traits::input_parameter< double >::type inter_gap(inter_gapSEXP);
+    Rcpp::traits::input_parameter< double >::type max_gap(max_gapSEXP);
+    rcpp_result_gen = Rcpp::wrap(mage_ma_sweep_cpp(df, short_ma, long_ma, direction, tz, inter_gap, max_gap));
     return rcpp_result_gen;
 END_RCPP
 }
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_cgmguru_detect_all_events", (DL_FUNC) &_cgmguru_detect_all_events, 8},
-    {"_cgmguru_detect_between_maxima", (DL_FUNC) &_cgmguru_detect_between_maxima, 2},
-    {"_cgmguru_detect_hyperglycemic_events", (DL_FUNC) &_cgmguru_detect_hyperglycemic_events, 10},
-    {"_cgmguru_detect_hypoglycemic_events", (DL_FUNC) &_cgmguru_detect_hypoglycemic_events, 9},
-    {"_cgmguru_excursion", (DL_FUNC) &_cgmguru_excursion, 2},
-    {"_cgmguru_find_local_maxima", (DL_FUNC) &_cgmguru_find_local_maxima, 1},
-    {"_cgmguru_find_max_after_hours", (DL_FUNC) &_cgmguru_find_max_after_hours, 3},
-    {"_cgmguru_find_max_before_hours", (DL_FUNC) &_cgmguru_find_max_before_hours, 3},
-    {"_cgmguru_find_min_after_hours", (DL_FUNC) &_cgmguru_find_min_after_hours, 3},
-    {"_cgmguru_find_min_before_hours", (DL_FUNC) &_cgmguru_find_min_before_hours, 3},
-    {"_cgmguru_find_new_maxima", (DL_FUNC) &_cgmguru_find_new_maxima, 3},
-    {"_cgmguru_grid", (DL_FUNC) &_cgmguru_grid, 3},
+    {"_cgmguru_arrow_reader_create_cpp", (DL_FUNC) &_cgmguru_arrow_reader_create_cpp, 2},
+    {"_cgmguru_arrow_reader_next_cpp", (DL_FUNC) &_cgmguru_arrow_reader_next_cpp, 1},
+    {"_cgmguru_cohort_cache_write_cpp", (DL_FUNC) &_cgmguru_cohort_cache_write_cpp, 3},
+    {"_cgmguru_cohort_cache_open_cpp", (DL_FUNC) &_cgmguru_cohort_cache_open_cpp, 1},
+    {"_cgmguru_cohort_cache_ids_cpp", (DL_FUNC) &_cgmguru_cohort_cache_ids_cpp, 1},
+    {"_cgmguru_cohort_cache_read_cpp", (DL_FUNC) &_cgmguru_cohort_cache_read_cpp, 3},
+    {"_cgmguru_cohort_cache_context_cpp", (DL_FUNC) &_cgmguru_cohort_cache_context_cpp, 3},
+    {"_cgmguru_detect_all_events", (DL_FUNC) &_cgmguru_detect_all_events, 12},
+    {"_cgmguru_all_metrics_cpp", (DL_FUNC) &_cgmguru_all_metrics_cpp, 14},
+    {"_cgmguru_detect_between_maxima", (DL_FUNC) &_cgmguru_detect_between_maxima, 3},
+    {"_cgmguru_grid_context_detect_between_maxima_cpp", (DL_FUNC) &_cgmguru_grid_context_detect_between_maxima_cpp, 3},
+    {"_cgmguru_detect_hyperglycemic_events", (DL_FUNC) &_cgmguru_detect_hyperglycemic_events, 12},
+    {"_cgmguru_detect_hypoglycemic_events", (DL_FUNC) &_cgmguru_detect_hypoglycemic_events, 11},
+    {"_cgmguru_event_stream_create_cpp", (DL_FUNC) &_cgmguru_event_stream_create_cpp, 3},
+    {"_cgmguru_event_stream_update_cpp", (DL_FUNC) &_cgmguru_event_stream_update_cpp, 2},
+    {"_cgmguru_event_stream_flush_cpp", (DL_FUNC) &_cgmguru_event_stream_flush_cpp, 1},
+    {"_cgmguru_excursion", (DL_FUNC) &_cgmguru_excursion, 4},
+    {"_cgmguru_grid_context_excursion_cpp", (DL_FUNC) &_cgmguru_grid_context_excursion_cpp, 4},
+    {"_cgmguru_find_local_maxima", (DL_FUNC) &_cgmguru_find_local_maxima, 3},
+    {"_cgmguru_grid_context_local_maxima_cpp", (DL_FUNC) &_cgmguru_grid_context_local_maxima_cpp, 3},
+    {"_cgmguru_find_max_after_hours", (DL_FUNC) &_cgmguru_find_max_after_hours, 4},
+    {"_cgmguru_grid_context_find_max_after_hours_cpp", (DL_FUNC) &_cgmguru_grid_context_find_max_after_hours_cpp, 4},
+    {"_cgmguru_find_max_before_hours", (DL_FUNC) &_cgmguru_find_max_before_hours, 4},
+    {"_cgmguru_grid_context_find_max_before_hours_cpp", (DL_FUNC) &_cgmguru_grid_context_find_max_before_hours_cpp, 4},
+    {"_cgmguru_find_min_after_hours", (DL_FUNC) &_cgmguru_find_min_after_hours, 4},
+    {"_cgmguru_grid_context_find_min_after_hours_cpp", (DL_FUNC) &_cgmguru_grid_context_find_min_after_hours_cpp, 4},
+    {"_cgmguru_find_min_before_hours", (DL_FUNC) &_cgmguru_find_min_before_hours, 4},
+    {"_cgmguru_grid_context_find_min_before_hours_cpp", (DL_FUNC) &_cgmguru_grid_context_find_min_before_hours_cpp, 4},
+    {"_cgmguru_find_new_maxima", (DL_FUNC) &_cgmguru_find_new_maxima, 4},
+    {"_cgmguru_grid_context_find_new_maxima_cpp", (DL_FUNC) &_cgmguru_grid_context_find_new_maxima_cpp, 4},
+    {"_cgmguru_grid", (DL_FUNC) &_cgmguru_grid, 5},
+    {"_cgmguru_grid_context_grid_cpp", (DL_FUNC) &_cgmguru_grid_context_grid_cpp, 5},
+    {"_cgmguru_grid_context_create_cpp", (DL_FUNC) &_cgmguru_grid_context_create_cpp, 1},
+    {"_cgmguru_grid_context_data_cpp", (DL_FUNC) &_cgmguru_grid_context_data_cpp, 1},
+    {"_cgmguru_grid_context_reading_minutes_cpp", (DL_FUNC) &_cgmguru_grid_context_reading_minutes_cpp, 1},
     {"_cgmguru_interpolate_cgm_cpp", (DL_FUNC) &_cgmguru_interpolate_cgm_cpp, 4},
-    {"_cgmguru_maxima_grid", (DL_FUNC) &_cgmguru_maxima_grid, 4},
-    {"_cgmguru_mod_grid", (DL_FUNC) &_cgmguru_mod_grid, 4},
+    {"_cgmguru_maxima_grid", (DL_FUNC) &_cgmguru_maxima_grid, 5},
+    {"_cgmguru_grid_context_maxima_grid_cpp", (DL_FUNC) &_cgmguru_grid_context_maxima_grid_cpp, 5},
+    {"_cgmguru_maxima_grid_sweep_cpp", (DL_FUNC) &_cgmguru_maxima_grid_sweep_cpp, 5},
+    {"_cgmguru_grid_context_maxima_grid_sweep_cpp", (DL_FUNC) &_cgmguru_grid_context_maxima_grid_sweep_cpp, 5},
+    {"_cgmguru_mod_grid", (DL_FUNC) &_cgmguru_mod_grid, 6},
+    {"_cgmguru_grid_context_mod_grid_cpp", (DL_FUNC) &_cgmguru_grid_context_mod_grid_cpp, 6},
     {"_cgmguru_orderfast_cpp", (DL_FUNC) &_cgmguru_orderfast_cpp, 1},
-    {"_cgmguru_rebound_events_cpp", (DL_FUNC) &_cgmguru_rebound_events_cpp, 8},
-    {"_cgmguru_sensor_wear_cpp", (DL_FUNC) &_cgmguru_sensor_wear_cpp, 4},
+    {"_cgmguru_rebound_events_cpp", (DL_FUNC) &_cgmguru_rebound_events_cpp, 10},
+    {"_cgmguru_subject_fingerprints_cpp", (DL_FUNC) &_cgmguru_subject_fingerprints_cpp, 4},
+    {"_cgmguru_sensor_wear_cpp", (DL_FUNC) &_cgmguru_sensor_wear_cpp, 5},
     {"_cgmguru_start_finder", (DL_FUNC) &_cgmguru_start_finder, 1},
-    {"_cgmguru_transform_df", (DL_FUNC) &_cgmguru_transform_df, 2},
+    {"_cgmguru_transform_df", (DL_FUNC) &_cgmguru_transform_df, 3},
     {"_cgmguru_conga_rcpp_cpp", (DL_FUNC) &_cgmguru_conga_rcpp_cpp, 4},
     {"_cgmguru_modd_rcpp_cpp", (DL_FUNC) &_cgmguru_modd_rcpp_cpp, 4},
-    {"_cgmguru_mage_rcpp_cpp", (DL_FUNC) &_cgmguru_mage_rcpp_cpp, 10},
+    {"_cgmguru_mage_rcpp_cpp", (DL_FUNC) &_cgmguru_mage_rcpp_cpp, 11},
+    {"_cgmguru_mage_ma_sweep_cpp", (DL_FUNC) &_cgmguru_mage_ma_sweep_cpp, 7},
     {NULL, NULL, 0}
 };
 
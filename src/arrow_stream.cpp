@@ -0,0 +1,457 @@
+#include <Rcpp.h>
+#include "arrow_c_data.h"
+#include "grid_context.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using namespace Rcpp;
+
+// Blocks of whole subjects read from an Arrow C stream of record batches.
+//
+// The stream must deliver each subject's rows together (grouped by id, as
+// Parquet exports written per subject are); a subject may be split across
+// batches. Each block becomes a GridContext whose per-subject spans point
+// straight into the batch buffers when a subject lies in one batch and its
+// column is float64 without nulls, so the GRID family reads those readings
+// in place. Other layouts (timestamp units, integer or float32 glucose,
+// nulls, subjects split over batches) are converted into the context's
+// scratch buffers once. Only the batches behind the current block and the
+// subject still being read are held, so a stream larger than memory is
+// processed block by block.
+namespace {
+
+const char* stream_error(ArrowArrayStream* stream) {
+  const char* message = stream->get_last_error ? stream->get_last_error(stream) : nullptr;
+  return message ? message : "unknown error";
+}
+
+inline bool bit_is_set(const void* bitmap, std::int64_t j) {
+  const std::uint8_t* bits = static_cast<const std::uint8_t*>(bitmap);
+  return (bits[j >> 3] >> (j & 7)) & 1;
+}
+
+inline bool is_valid(const ArrowArray* array, std::int64_t j) {
+  return array->null_count == 0 || array->n_buffers == 0 ||
+    array->buffers[0] == nullptr || bit_is_set(array->buffers[0], j);
+}
+
+// A record batch, released when the last block viewing it is gone
+struct OwnedBatch {
+  ArrowArray array;
+  OwnedBatch() { array.release = nullptr; }
+  ~OwnedBatch() {
+    if (array.release != nullptr) array.release(&array);
+  }
+  OwnedBatch(const OwnedBatch&) = delete;
+  OwnedBatch& operator=(const OwnedBatch&) = delete;
+};
+
+typedef std::shared_ptr<OwnedBatch> BatchPtr;
+
+enum class IdValues { Utf8, LargeUtf8, Int32, Int64 };
+enum class Numbers { Float64, Float32, Int64, Int32, Int16 };
+
+bool parse_id_values(const char* format, IdValues& values) {
+  if (std::strcmp(format, "u") == 0) values = IdValues::Utf8;
+  else if (std::strcmp(format, "U") == 0) values = IdValues::LargeUtf8;
+  else if (std::strcmp(format, "i") == 0) values = IdValues::Int32;
+  else if (std::strcmp(format, "l") == 0) values = IdValues::Int64;
+  else return false;
+  return true;
+}
+
+bool parse_numbers(const char* format, Numbers& numbers) {
+  if (std::strcmp(format, "g") == 0) numbers = Numbers::Float64;
+  else if (std::strcmp(format, "f") == 0) numbers = Numbers::Float32;
+  else if (std::strcmp(format, "l") == 0) numbers = Numbers::Int64;
+  else if (std::strcmp(format, "i") == 0) numbers = Numbers::Int32;
+  else if (std::strcmp(format, "s") == 0) numbers = Numbers::Int16;
+  else return false;
+  return true;
+}
+
+inline double read_number(Numbers numbers, const ArrowArray* array, std::int64_t j) {
+  const void* values = array->buffers[1];
+  switch (numbers) {
+  case Numbers::Float64: return static_cast<const double*>(values)[j];
+  case Numbers::Float32: return static_cast<const float*>(values)[j];
+  case Numbers::Int64: return static_cast<double>(static_cast<const std::int64_t*>(values)[j]);
+  case Numbers::Int32: return static_cast<const std::int32_t*>(values)[j];
+  case Numbers::Int16: return static_cast<const std::int16_t*>(values)[j];
+  }
+  return NA_REAL;
+}
+
+inline std::int64_t read_index(Numbers numbers, const ArrowArray* array, std::int64_t j) {
+  const void* values = array->buffers[1];
+  switch (numbers) {
+  case Numbers::Int64: return static_cast<const std::int64_t*>(values)[j];
+  case Numbers::Int32: return static_cast<const std::int32_t*>(values)[j];
+  case Numbers::Int16: return static_cast<const std::int16_t*>(values)[j];
+  default: return -1;
+  }
+}
+
+void read_label(IdValues values, const ArrowArray* array, std::int64_t j,
+                std::string& out) {
+  switch (values) {
+  case IdValues::Utf8: {
+    const std::int32_t* offsets = static_cast<const std::int32_t*>(array->buffers[1]);
+    const char* data = static_cast<const char*>(array->buffers[2]);
+    out.assign(data + offsets[j], static_cast<std::size_t>(offsets[j + 1] - offsets[j]));
+    return;
+  }
+  case IdValues::LargeUtf8: {
+    const std::int64_t* offsets = static_cast<const std::int64_t*>(array->buffers[1]);
+    const char* data = static_cast<const char*>(array->buffers[2]);
+    out.assign(data + offsets[j], static_cast<std::size_t>(offsets[j + 1] - offsets[j]));
+    return;
+  }
+  case IdValues::Int32:
+    out = std::to_string(static_cast<const std::int32_t*>(array->buffers[1])[j]);
+    return;
+  case IdValues::Int64:
+    out = std::to_string(static_cast<const std::int64_t*>(array->buffers[1])[j]);
+    return;
+  }
+}
+
+// Rows [begin, end) of one batch, all with an id and a time
+struct Piece {
+  BatchPtr batch;
+  std::int64_t begin;
+  std::int64_t end;
+};
+
+struct PendingSubject {
+  std::string label;
+  std::vector<Piece> pieces;
+  std::size_t n_rows = 0;
+};
+
+class ArrowBlockReader {
+public:
+  ArrowBlockReader(ArrowArrayStream* stream, int chunk_size)
+    : stream_(stream), chunk_size_(static_cast<std::size_t>(chunk_size)) {
+    schema_.release = nullptr;
+    if (stream_->get_schema(stream_, &schema_) != 0) {
+      stop(std::string("could not read the Arrow stream schema: ") + stream_error(stream_));
+    }
+    if (std::strcmp(schema_.format, "+s") != 0) {
+      release_schema();
+      stop("the Arrow stream must deliver record batches (struct arrays)");
+    }
+    id_child_ = find_child("id");
+    time_child_ = find_child("time");
+    gl_child_ = find_child("gl");
+    if (id_child_ < 0 || time_child_ < 0 || gl_child_ < 0) {
+      release_schema();
+      stop("the Arrow stream must contain id, time and gl columns");
+    }
+    parse_columns();
+  }
+
+  ~ArrowBlockReader() { release_schema(); }
+
+  ArrowBlockReader(const ArrowBlockReader&) = delete;
+  ArrowBlockReader& operator=(const ArrowBlockReader&) = delete;
+
+  // Next block of up to chunk_size whole subjects, or null at the end
+  std::unique_ptr<cgmguru_grid::GridContext> next_block() {
+    while (!finished_ && complete_subjects() < chunk_size_) {
+      pull_batch();
+    }
+    const std::size_t n_take = std::min(chunk_size_, complete_subjects());
+    if (dropped_rows_ > 0 && !warned_) {
+      warned_ = true;
+      warning("Found missing id or time values in the Arrow stream, removing those rows");
+    }
+    if (n_take == 0) return nullptr;
+
+    std::vector<std::string> labels(n_take);
+    std::vector<cgmguru_columns::DoubleSpan> times(n_take);
+    std::vector<cgmguru_columns::DoubleSpan> gls(n_take);
+    std::vector<std::vector<double>> time_scratch(n_take);
+    std::vector<std::vector<double>> gl_scratch(n_take);
+    std::shared_ptr<std::vector<BatchPtr>> batches =
+      std::make_shared<std::vector<BatchPtr>>();
+
+    for (std::size_t k = 0; k < n_take; ++k) {
+      PendingSubject& subject = subjects_.front();
+      labels[k].swap(subject.label);
+      view_subject(subject, times[k], gls[k], time_scratch[k], gl_scratch[k], *batches);
+      subjects_.pop_front();
+    }
+
+    return std::unique_ptr<cgmguru_grid::GridContext>(new cgmguru_grid::GridContext(
+      labels, times, gls, std::move(time_scratch), std::move(gl_scratch), time_tz_,
+      std::shared_ptr<const void>(batches)));
+  }
+
+private:
+  ArrowArrayStream* stream_;
+  ArrowSchema schema_;
+  std::size_t chunk_size_;
+  int id_child_ = -1;
+  int time_child_ = -1;
+  int gl_child_ = -1;
+
+  IdValues id_values_ = IdValues::Utf8;
+  bool id_dictionary_ = false;
+  Numbers id_index_ = Numbers::Int32;
+  Numbers time_numbers_ = Numbers::Float64;
+  double time_divisor_ = 1.0;
+  std::string time_tz_ = "UTC";
+  Numbers gl_numbers_ = Numbers::Float64;
+
+  std::deque<PendingSubject> subjects_;
+  bool last_open_ = false;
+  bool finished_ = false;
+  bool warned_ = false;
+  std::size_t dropped_rows_ = 0;
+  std::unordered_set<std::string> seen_;
+  std::string label_;
+
+  void release_schema() {
+    if (schema_.release != nullptr) schema_.release(&schema_);
+  }
+
+  int find_child(const char* name) const {
+    for (std::int64_t c = 0; c < schema_.n_children; ++c) {
+      const char* child_name = schema_.children[c]->name;
+      if (child_name != nullptr && std::strcmp(child_name, name) == 0) {
+        return static_cast<int>(c);
+      }
+    }
+    return -1;
+  }
+
+  void parse_columns() {
+    const ArrowSchema* id = schema_.children[id_child_];
+    bool id_ok;
+    if (id->dictionary != nullptr) {
+      id_dictionary_ = true;
+      id_ok = parse_numbers(id->format, id_index_) &&
+        (id_index_ == Numbers::Int16 || id_index_ == Numbers::Int32 ||
+         id_index_ == Numbers::Int64) &&
+        parse_id_values(id->dictionary->format, id_values_);
+    } else {
+      id_ok = parse_id_values(id->format, id_values_);
+    }
+
+    // Timestamps keep their unit and zone in the format, e.g. "tsu:UTC"
+    const char* time = schema_.children[time_child_]->format;
+    bool time_ok = true;
+    if (std::strncmp(time, "ts", 2) == 0 && std::strlen(time) >= 4 && time[3] == ':') {
+      time_numbers_ = Numbers::Int64;
+      switch (time[2]) {
+      case 's': time_divisor_ = 1.0; break;
+      case 'm': time_divisor_ = 1e3; break;
+      case 'u': time_divisor_ = 1e6; break;
+      case 'n': time_divisor_ = 1e9; break;
+      default: time_ok = false;
+      }
+      if (time[4] != '\0') time_tz_ = time + 4;
+    } else {
+      time_ok = std::strcmp(time, "g") == 0;
+    }
+
+    const bool gl_ok = parse_numbers(schema_.children[gl_child_]->format, gl_numbers_);
+    if (!id_ok || !time_ok || !gl_ok) {
+      release_schema();
+      stop("unsupported Arrow column types: id must be a string, integer or "
+           "dictionary of strings, time a timestamp or float64 seconds and gl numeric");
+    }
+  }
+
+  std::size_t complete_subjects() const {
+    return subjects_.size() - (last_open_ ? 1 : 0);
+  }
+
+  // Reads the next batch from the stream and files its rows under subjects
+  void pull_batch() {
+    if (stream_->release == nullptr) {
+      stop("the Arrow stream has been released");
+    }
+    BatchPtr batch = std::make_shared<OwnedBatch>();
+    if (stream_->get_next(stream_, &batch->array) != 0) {
+      stop(std::string("could not read the next Arrow batch: ") + stream_error(stream_));
+    }
+    const ArrowArray* array = &batch->array;
+    if (array->release == nullptr) {
+      finished_ = true;
+      last_open_ = false;
+      return;
+    }
+    if (array->n_children != schema_.n_children) {
+      stop("an Arrow batch does not match the stream schema");
+    }
+
+    const ArrowArray* id = array->children[id_child_];
+    const ArrowArray* time = array->children[time_child_];
+    for (std::int64_t i = 0; i < array->length; ++i) {
+      const std::int64_t row = array->offset + i;
+      if (!is_valid(array, row) || !is_valid(time, time->offset + row) ||
+          !read_id(id, id->offset + row)) {
+        ++dropped_rows_;
+        continue;
+      }
+
+      if (!(last_open_ && subjects_.back().label == label_)) {
+        if (!seen_.insert(label_).second) {
+          stop("the Arrow stream is not grouped by id: rows of \"" + label_ +
+               "\" appear in more than one run");
+        }
+        subjects_.emplace_back();
+        subjects_.back().label = label_;
+        last_open_ = true;
+      }
+
+      PendingSubject& subject = subjects_.back();
+      if (!subject.pieces.empty() && subject.pieces.back().batch == batch &&
+          subject.pieces.back().end == i) {
+        subject.pieces.back().end = i + 1;
+      } else {
+        subject.pieces.push_back({batch, i, i + 1});
+      }
+      ++subject.n_rows;
+    }
+  }
+
+  // Label of the id element j into label_; false for a missing id
+  bool read_id(const ArrowArray* id, std::int64_t j) {
+    if (!is_valid(id, j)) return false;
+    if (!id_dictionary_) {
+      read_label(id_values_, id, j, label_);
+      return true;
+    }
+    const ArrowArray* dictionary = id->dictionary;
+    const std::int64_t index = read_index(id_index_, id, j);
+    if (index < 0 || index >= dictionary->length) {
+      stop("an Arrow id dictionary index is out of range");
+    }
+    const std::int64_t k = dictionary->offset + index;
+    if (!is_valid(dictionary, k)) return false;
+    read_label(id_values_, dictionary, k, label_);
+    return true;
+  }
+
+  // Spans over a subject's readings: in place for a float64 column of one
+  // batch without nulls, otherwise converted into scratch
+  void view_subject(const PendingSubject& subject,
+                    cgmguru_columns::DoubleSpan& time_span,
+                    cgmguru_columns::DoubleSpan& gl_span,
+                    std::vector<double>& time_scratch,
+                    std::vector<double>& gl_scratch,
+                    std::vector<BatchPtr>& batches) const {
+    for (const Piece& piece : subject.pieces) {
+      if (batches.empty() || batches.back() != piece.batch) batches.push_back(piece.batch);
+    }
+
+    if (subject.pieces.size() == 1) {
+      const Piece& piece = subject.pieces.front();
+      const ArrowArray* array = &piece.batch->array;
+      const ArrowArray* time = array->children[time_child_];
+      const ArrowArray* gl = array->children[gl_child_];
+      const std::size_t n = static_cast<std::size_t>(piece.end - piece.begin);
+      const std::int64_t time_first = time->offset + array->offset + piece.begin;
+      const std::int64_t gl_first = gl->offset + array->offset + piece.begin;
+
+      if (time_numbers_ == Numbers::Float64) {
+        time_span = cgmguru_columns::DoubleSpan(
+          static_cast<const double*>(time->buffers[1]) + time_first, n);
+      } else {
+        time_scratch.resize(n);
+        for (std::size_t k = 0; k < n; ++k) {
+          time_scratch[k] = read_number(time_numbers_, time, time_first + k) / time_divisor_;
+        }
+        time_span = cgmguru_columns::DoubleSpan(time_scratch);
+      }
+
+      bool gl_in_place = gl_numbers_ == Numbers::Float64;
+      for (std::size_t k = 0; gl_in_place && k < n; ++k) {
+        gl_in_place = is_valid(gl, gl_first + k);
+      }
+      if (gl_in_place) {
+        gl_span = cgmguru_columns::DoubleSpan(
+          static_cast<const double*>(gl->buffers[1]) + gl_first, n);
+      } else {
+        gl_scratch.resize(n);
+        for (std::size_t k = 0; k < n; ++k) {
+          gl_scratch[k] = is_valid(gl, gl_first + k)
+            ? read_number(gl_numbers_, gl, gl_first + k) : NA_REAL;
+        }
+        gl_span = cgmguru_columns::DoubleSpan(gl_scratch);
+      }
+      return;
+    }
+
+    // A subject split over batches is gathered into one buffer per column
+    time_scratch.clear();
+    gl_scratch.clear();
+    time_scratch.reserve(subject.n_rows);
+    gl_scratch.reserve(subject.n_rows);
+    for (const Piece& piece : subject.pieces) {
+      const ArrowArray* array = &piece.batch->array;
+      const ArrowArray* time = array->children[time_child_];
+      const ArrowArray* gl = array->children[gl_child_];
+      for (std::int64_t i = piece.begin; i < piece.end; ++i) {
+        const std::int64_t time_j = time->offset + array->offset + i;
+        const std::int64_t gl_j = gl->offset + array->offset + i;
+        time_scratch.push_back(read_number(time_numbers_, time, time_j) / time_divisor_);
+        gl_scratch.push_back(is_valid(gl, gl_j) ? read_number(gl_numbers_, gl, gl_j)
+                                                : NA_REAL);
+      }
+    }
+    time_span = cgmguru_columns::DoubleSpan(time_scratch);
+    gl_span = cgmguru_columns::DoubleSpan(gl_scratch);
+  }
+};
+
+ArrowBlockReader* arrow_reader_from_sexp(SEXP reader) {
+  if (TYPEOF(reader) != EXTPTRSXP || R_ExternalPtrAddr(reader) == nullptr) {
+    stop("Arrow reader is no longer valid");
+  }
+  return static_cast<ArrowBlockReader*>(R_ExternalPtrAddr(reader));
+}
+
+} // namespace
+
+// Reader over a nanoarrow_array_stream, which stays referenced by the reader
+// [[Rcpp::export]]
+SEXP arrow_reader_create_cpp(SEXP stream, int chunk_size) {
+  if (TYPEOF(stream) != EXTPTRSXP || !Rf_inherits(stream, "nanoarrow_array_stream")) {
+    stop("stream must be a nanoarrow_array_stream");
+  }
+  ArrowArrayStream* pointer = static_cast<ArrowArrayStream*>(R_ExternalPtrAddr(stream));
+  if (pointer == nullptr || pointer->release == nullptr) {
+    stop("the Arrow stream has been released");
+  }
+  if (chunk_size < 1) {
+    stop("chunk_size must be at least 1");
+  }
+
+  XPtr<ArrowBlockReader> reader(new ArrowBlockReader(pointer, chunk_size), true,
+                                R_NilValue, stream);
+  reader.attr("class") = CharacterVector::create("cgmguru_arrow_reader");
+  return reader;
+}
+
+// Next block as a grid context, or NULL once the stream is exhausted
+// [[Rcpp::export]]
+SEXP arrow_reader_next_cpp(SEXP reader) {
+  std::unique_ptr<cgmguru_grid::GridContext> context =
+    arrow_reader_from_sexp(reader)->next_block();
+  if (!context) return R_NilValue;
+
+  XPtr<cgmguru_grid::GridContext> ptr(context.release(), true);
+  ptr.attr("class") = CharacterVector::create("cgmguru_grid_context");
+  return ptr;
+}
@@ -0,0 +1,555 @@
+#include <Rcpp.h>
+#include "event_preprocessing.h"
+#include "grid_context.h"
+#include "id_grouping.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CGMGURU_HAVE_MMAP 1
+#else
+#include <process.h>
+#endif
+
+using namespace Rcpp;
+
+// Binary cohort cache: one validated CGM data frame, already grouped by id
+// and sorted by time, stored so that later sessions use it without
+// re-validating, re-sorting or re-inferring reading intervals.
+//
+// Layout (native byte order, every section starting on an 8-byte boundary):
+//   header    magic "CGMCOHRT", uint32 byte-order mark, uint32 version,
+//             uint32 glucose storage, uint32 reserved, uint64 rows,
+//             uint64 ids, uint64 timezone length
+//   timezone  bytes of the time column's tzone
+//   labels    per id: uint64 length, then its bytes
+//   offsets   uint64[ids + 1]; id g holds rows offsets[g] .. offsets[g+1]-1
+//   interval  double[ids], each id's median reading interval in minutes as
+//             the event kernels infer it, NaN with fewer than two distinct
+//             times
+//   time      double[rows], seconds since the epoch
+//   gl        double[rows] or, for whole mg/dL values, uint16[rows] with
+//             65535 for missing readings
+//
+// Files are memory-mapped on platforms with mmap, so concurrent readers of
+// one file share its pages, and read into a buffer elsewhere. A grid context
+// over an open cache views the time section, and double glucose, in place.
+namespace {
+
+const char cache_magic[8] = {'C', 'G', 'M', 'C', 'O', 'H', 'R', 'T'};
+const std::uint32_t cache_byte_order = 0x01020304u;
+const std::uint32_t cache_version = 2;
+const std::uint32_t gl_storage_double = 0;
+const std::uint32_t gl_storage_uint16 = 1;
+const std::uint16_t gl_uint16_missing = 65535;
+
+struct CacheHeader {
+  char magic[8];
+  std::uint32_t byte_order;
+  std::uint32_t version;
+  std::uint32_t gl_storage;
+  std::uint32_t reserved;
+  std::uint64_t n_rows;
+  std::uint64_t n_ids;
+  std::uint64_t tz_length;
+};
+
+std::uint64_t padded(std::uint64_t bytes) {
+  return (bytes + 7) & ~static_cast<std::uint64_t>(7);
+}
+
+// Temporary file a cache is written to before it is renamed over path;
+// the process id and a per-process counter keep concurrent writers of one
+// path, in other sessions or on other threads, from sharing it
+std::string temporary_path(const std::string& path) {
+  static std::atomic<unsigned long> counter(0);
+#if defined(_WIN32)
+  const long pid = static_cast<long>(_getpid());
+#else
+  const long pid = static_cast<long>(::getpid());
+#endif
+  return path + ".tmp" + std::to_string(pid) + "." + std::to_string(counter++);
+}
+
+class CacheWriter {
+public:
+  explicit CacheWriter(const std::string& path) : out_(path.c_str(), std::ios::binary) {
+    if (!out_) stop("cannot open '" + path + "' for writing");
+  }
+
+  void write(const void* data, std::uint64_t bytes) {
+    out_.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+    position_ += bytes;
+  }
+
+  void align() {
+    static const char zeros[8] = {0};
+    write(zeros, padded(position_) - position_);
+  }
+
+  void close(const std::string& path) {
+    out_.close();
+    if (!out_) stop("failed to write '" + path + "'");
+  }
+
+private:
+  std::ofstream out_;
+  std::uint64_t position_ = 0;
+};
+
+// Read-only view of a cache file, mapped when possible
+class CacheFile {
+public:
+  explicit CacheFile(const std::string& path) : path_(path) {
+#ifdef CGMGURU_HAVE_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) stop("cannot open '" + path + "'");
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+      ::close(fd);
+      stop("cannot read '" + path + "'");
+    }
+    size_ = static_cast<std::uint64_t>(info.st_size);
+    if (size_ > 0) {
+      void* mapped = ::mmap(nullptr, static_cast<size_t>(size_), PROT_READ, MAP_SHARED, fd, 0);
+      if (mapped == MAP_FAILED) {
+        ::close(fd);
+        stop("cannot map '" + path + "'");
+      }
+      mapped_ = mapped;
+      data_ = static_cast<const char*>(mapped);
+    }
+    ::close(fd);
+#else
+    std::ifstream in(path.c_str(), std::ios::binary | std::ios::ate);
+    if (!in) stop("cannot open '" + path + "'");
+    size_ = static_cast<std::uint64_t>(in.tellg());
+    buffer_.resize(static_cast<size_t>(size_));
+    in.seekg(0);
+    if (size_ > 0 && !in.read(buffer_.data(), static_cast<std::streamsize>(size_))) {
+      stop("cannot read '" + path + "'");
+    }
+    data_ = buffer_.data();
+#endif
+  }
+
+  ~CacheFile() {
+#ifdef CGMGURU_HAVE_MMAP
+    if (mapped_ != nullptr) ::munmap(mapped_, static_cast<size_t>(size_));
+#endif
+  }
+
+  CacheFile(const CacheFile&) = delete;
+  CacheFile& operator=(const CacheFile&) = delete;
+
+  // Next bytes of the file; stops on a truncated file
+  const char* take(std::uint64_t bytes) {
+    if (bytes > size_ - position_) {
+      stop("'" + path_ + "' is truncated or not a cgmguru cohort cache");
+    }
+    const char* at = data_ + position_;
+    position_ += bytes;
+    return at;
+  }
+
+  void align() { take(padded(position_) - position_); }
+  std::uint64_t remaining() const { return size_ - position_; }
+  bool at_end() const { return position_ == size_; }
+
+private:
+  std::string path_;
+  const char* data_ = nullptr;
+  std::uint64_t size_ = 0;
+  std::uint64_t position_ = 0;
+#ifdef CGMGURU_HAVE_MMAP
+  void* mapped_ = nullptr;
+#else
+  std::vector<char> buffer_;
+#endif
+};
+
+std::string time_tzone(const NumericVector& time) {
+  RObject tz_attr = time.attr("tzone");
+  if (!tz_attr.isNULL()) {
+    CharacterVector tz_cv = as<CharacterVector>(tz_attr);
+    if (tz_cv.size() > 0 && !CharacterVector::is_na(tz_cv[0])) {
+      return as<std::string>(tz_cv[0]);
+    }
+  }
+  return "";
+}
+
+// Reading interval of one id's time-sorted rows, inferred as the event
+// kernels do, or NaN when the id has fewer than two distinct times
+double stored_reading_minutes(const NumericVector& time, const std::vector<int>& rows,
+                              std::vector<double>& diffs) {
+  for (size_t i = 1; i < rows.size(); ++i) {
+    if (time[rows[i]] > time[rows[i - 1]]) {
+      return cgmguru_events::median_positive_diff_minutes(time, rows, diffs);
+    }
+  }
+  return std::numeric_limits<double>::quiet_NaN();
+}
+
+} // namespace
+
+// [[Rcpp::export]]
+void cohort_cache_write_cpp(DataFrame df, std::string path, std::string gl_storage = "double") {
+  std::uint32_t storage;
+  if (gl_storage == "double") {
+    storage = gl_storage_double;
+  } else if (gl_storage == "uint16") {
+    storage = gl_storage_uint16;
+  } else {
+    stop("gl_storage must be \"double\" or \"uint16\"");
+  }
+
+  SEXP id = df["id"];
+  NumericVector time = df["time"];
+  NumericVector gl = df["gl"];
+  const int n = df.nrows();
+  const cgmguru_ids::IdGroups groups = cgmguru_ids::group_rows_by_id(id, n);
+
+  // Rows in id order, each id's rows by time with missing times last
+  std::vector<int> order;
+  order.reserve(n);
+  std::vector<std::uint64_t> offsets(1, 0);
+  offsets.reserve(groups.size() + 1);
+  for (size_t g = 0; g < groups.size(); ++g) {
+    const size_t first = order.size();
+    order.insert(order.end(), groups.group_begin(g), groups.group_end(g));
+    std::stable_sort(order.begin() + first, order.end(), [&](int lhs, int rhs) {
+      const double a = time[lhs];
+      const double b = time[rhs];
+      if (std::isnan(a)) return false;
+      if (std::isnan(b)) return true;
+      return a < b;
+    });
+    offsets.push_back(order.size());
+  }
+
+  std::vector<double> reading_minutes(groups.size());
+  {
+    std::vector<int> rows;
+    std::vector<double> diffs;
+    for (size_t g = 0; g < groups.size(); ++g) {
+      rows.assign(order.begin() + offsets[g], order.begin() + offsets[g + 1]);
+      reading_minutes[g] = stored_reading_minutes(time, rows, diffs);
+    }
+  }
+
+  std::vector<double> sorted_time(n);
+  for (int i = 0; i < n; ++i) sorted_time[i] = time[order[i]];
+
+  std::vector<double> gl_double;
+  std::vector<std::uint16_t> gl_uint16;
+  if (storage == gl_storage_uint16) {
+    gl_uint16.resize(n);
+    for (int i = 0; i < n; ++i) {
+      const double value = gl[order[i]];
+      if (std::isnan(value)) {
+        gl_uint16[i] = gl_uint16_missing;
+      } else if (value >= 0 && value < gl_uint16_missing && value == std::floor(value)) {
+        gl_uint16[i] = static_cast<std::uint16_t>(value);
+      } else {
+        stop("gl_storage = \"uint16\" needs whole glucose values between 0 and 65534");
+      }
+    }
+  } else {
+    gl_double.resize(n);
+    for (int i = 0; i < n; ++i) gl_double[i] = gl[order[i]];
+  }
+
+  const std::string tz = time_tzone(time);
+  CacheHeader header;
+  std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+  header.byte_order = cache_byte_order;
+  header.version = cache_version;
+  header.gl_storage = storage;
+  header.reserved = 0;
+  header.n_rows = static_cast<std::uint64_t>(n);
+  header.n_ids = static_cast<std::uint64_t>(groups.size());
+  header.tz_length = tz.size();
+
+  // Written next to the target and renamed, so readers never map a partial file
+  const std::string tmp_path = temporary_path(path);
+  {
+    CacheWriter writer(tmp_path);
+    writer.write(&header, sizeof(header));
+    writer.write(tz.data(), tz.size());
+    writer.align();
+    for (const std::string& label : groups.labels) {
+      const std::uint64_t length = label.size();
+      writer.write(&length, sizeof(length));
+      writer.write(label.data(), length);
+    }
+    writer.align();
+    writer.write(offsets.data(), offsets.size() * sizeof(std::uint64_t));
+    writer.write(reading_minutes.data(), reading_minutes.size() * sizeof(double));
+    writer.write(sorted_time.data(), sorted_time.size() * sizeof(double));
+    if (storage == gl_storage_uint16) {
+      writer.write(gl_uint16.data(), gl_uint16.size() * sizeof(std::uint16_t));
+    } else {
+      writer.write(gl_double.data(), gl_double.size() * sizeof(double));
+    }
+    writer.align();
+    writer.close(tmp_path);
+  }
+#if defined(_WIN32)
+  // rename() replaces an existing target atomically on POSIX but fails on
+  // Windows, so there the old file is removed first
+  std::remove(path.c_str());
+#endif
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+    stop("cannot replace '" + path + "'");
+  }
+}
+
+namespace {
+
+// Header, timezone, labels and id offsets of an open cache; the file is left
+// positioned at the time column
+struct CacheIndex {
+  CacheHeader header;
+  std::string tz;
+  CharacterVector labels;
+  std::vector<std::uint64_t> offsets;
+  std::vector<double> reading_minutes;
+};
+
+CacheIndex read_cache_index(CacheFile& file, const std::string& path) {
+  CacheIndex index;
+  CacheHeader& header = index.header;
+  std::memcpy(&header, file.take(sizeof(header)), sizeof(header));
+  if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0) {
+    stop("'" + path + "' is not a cgmguru cohort cache");
+  }
+  if (header.byte_order != cache_byte_order) {
+    stop("'" + path + "' was written on a machine with a different byte order");
+  }
+  if (header.version != cache_version) {
+    stop("'" + path + "' has cohort cache version " + std::to_string(header.version) +
+         "; this cgmguru reads version " + std::to_string(cache_version));
+  }
+  if (header.gl_storage != gl_storage_double && header.gl_storage != gl_storage_uint16) {
+    stop("'" + path + "' uses an unknown glucose storage");
+  }
+  // Sizes are checked against the file before anything is allocated
+  if (header.n_rows > file.remaining() / sizeof(double) || header.n_ids > header.n_rows) {
+    stop("'" + path + "' is truncated or not a cgmguru cohort cache");
+  }
+  if (header.n_rows > static_cast<std::uint64_t>(R_XLEN_T_MAX)) {
+    stop("'" + path + "' is too large");
+  }
+
+  index.tz = std::string(file.take(header.tz_length), header.tz_length);
+  file.align();
+
+  index.labels = CharacterVector(static_cast<R_xlen_t>(header.n_ids));
+  for (std::uint64_t g = 0; g < header.n_ids; ++g) {
+    std::uint64_t length;
+    std::memcpy(&length, file.take(sizeof(length)), sizeof(length));
+    const char* bytes = file.take(length);
+    SET_STRING_ELT(index.labels, static_cast<R_xlen_t>(g),
+                   Rf_mkCharLenCE(bytes, static_cast<int>(length), CE_UTF8));
+  }
+  file.align();
+
+  index.offsets.resize(header.n_ids + 1);
+  std::memcpy(index.offsets.data(),
+              file.take(index.offsets.size() * sizeof(std::uint64_t)),
+              index.offsets.size() * sizeof(std::uint64_t));
+  if (index.offsets.front() != 0 || index.offsets.back() != header.n_rows ||
+      !std::is_sorted(index.offsets.begin(), index.offsets.end())) {
+    stop("'" + path + "' has inconsistent id offsets");
+  }
+
+  index.reading_minutes.resize(header.n_ids);
+  std::memcpy(index.reading_minutes.data(),
+              file.take(index.reading_minutes.size() * sizeof(double)),
+              index.reading_minutes.size() * sizeof(double));
+  return index;
+}
+
+// An open cache: its index and the time and glucose sections, which stay
+// mapped while the cache or any grid context built over it is alive
+struct CohortCache {
+  explicit CohortCache(const std::string& path)
+    : file(path), index(read_cache_index(file, path)) {
+    const std::uint64_t n_rows = index.header.n_rows;
+    time_bytes = file.take(n_rows * sizeof(double));
+    gl_bytes = file.take(n_rows * (index.header.gl_storage == gl_storage_uint16
+                                     ? sizeof(std::uint16_t) : sizeof(double)));
+    file.align();
+    if (!file.at_end()) {
+      stop("'" + path + "' has trailing data; it may be damaged");
+    }
+  }
+
+  // Rows of ids first_id .. first_id + n_ids - 1 (0-based; n_ids < 0 runs
+  // to the last id), as [begin, end) id and row ranges
+  void id_range(double first_id, double n_ids, std::uint64_t& id_begin,
+                std::uint64_t& id_end) const {
+    if (!(first_id >= 0) || first_id != std::floor(first_id) ||
+        first_id > static_cast<double>(index.header.n_ids)) {
+      stop("first_id must be a whole number between 0 and the number of ids");
+    }
+    id_begin = static_cast<std::uint64_t>(first_id);
+    id_end = (n_ids < 0)
+      ? index.header.n_ids
+      : std::min<std::uint64_t>(index.header.n_ids,
+                                id_begin + static_cast<std::uint64_t>(std::floor(n_ids)));
+  }
+
+  // Sections start on 8-byte boundaries of a page-aligned mapping (or of an
+  // operator new buffer), so the time section can be read as doubles
+  const double* time_values() const {
+    return reinterpret_cast<const double*>(time_bytes);
+  }
+
+  double gl_value(std::uint64_t row) const {
+    if (index.header.gl_storage == gl_storage_uint16) {
+      std::uint16_t value;
+      std::memcpy(&value, gl_bytes + row * sizeof(std::uint16_t), sizeof(value));
+      return value == gl_uint16_missing ? NA_REAL : static_cast<double>(value);
+    }
+    return reinterpret_cast<const double*>(gl_bytes)[row];
+  }
+
+  CacheFile file;
+  CacheIndex index;
+  const char* time_bytes = nullptr;
+  const char* gl_bytes = nullptr;
+};
+
+typedef std::shared_ptr<const CohortCache> CohortCachePtr;
+
+const CohortCachePtr& cohort_cache_from_sexp(SEXP cache) {
+  if (TYPEOF(cache) != EXTPTRSXP || R_ExternalPtrAddr(cache) == nullptr) {
+    stop("cohort cache is no longer open");
+  }
+  return *static_cast<CohortCachePtr*>(R_ExternalPtrAddr(cache));
+}
+
+} // namespace
+
+// Opens a cache for cohort_cache_ids_cpp(), cohort_cache_read_cpp() and
+// cohort_cache_context_cpp(); the file stays mapped until the handle and
+// every context made from it are garbage collected
+// [[Rcpp::export]]
+SEXP cohort_cache_open_cpp(std::string path) {
+  XPtr<CohortCachePtr> ptr(new CohortCachePtr(std::make_shared<const CohortCache>(path)),
+                           true);
+  ptr.attr("class") = CharacterVector::create("cgmguru_cohort_cache");
+  return ptr;
+}
+
+// Subject ids of a cache in stored (sorted) order
+// [[Rcpp::export]]
+CharacterVector cohort_cache_ids_cpp(SEXP cache) {
+  return cohort_cache_from_sexp(cache)->index.labels;
+}
+
+// Copies n_ids subjects starting at the first_id-th (0-based; n_ids < 0 reads
+// to the last subject) into a tibble
+// [[Rcpp::export]]
+DataFrame cohort_cache_read_cpp(SEXP cache, double first_id = 0, double n_ids = -1) {
+  const CohortCache& opened = *cohort_cache_from_sexp(cache);
+  const CacheIndex& index = opened.index;
+  const std::vector<std::uint64_t>& offsets = index.offsets;
+  std::uint64_t id_begin, id_end;
+  opened.id_range(first_id, n_ids, id_begin, id_end);
+  const std::uint64_t row_begin = offsets[id_begin];
+  const std::uint64_t row_end = offsets[id_end];
+  const R_xlen_t n = static_cast<R_xlen_t>(row_end - row_begin);
+
+  // Rows of one id share the id's CHARSXP
+  CharacterVector id(n);
+  for (std::uint64_t g = id_begin; g < id_end; ++g) {
+    SEXP label = STRING_ELT(index.labels, static_cast<R_xlen_t>(g));
+    for (std::uint64_t i = offsets[g]; i < offsets[g + 1]; ++i) {
+      SET_STRING_ELT(id, static_cast<R_xlen_t>(i - row_begin), label);
+    }
+  }
+
+  NumericVector time(n);
+  std::memcpy(time.begin(), opened.time_values() + row_begin, n * sizeof(double));
+  time.attr("class") = CharacterVector::create("POSIXct", "POSIXt");
+  time.attr("tzone") = index.tz;
+
+  NumericVector gl(n);
+  for (R_xlen_t i = 0; i < n; ++i) {
+    gl[i] = opened.gl_value(row_begin + static_cast<std::uint64_t>(i));
+  }
+
+  DataFrame out = DataFrame::create(
+    _["id"] = id,
+    _["time"] = time,
+    _["gl"] = gl,
+    _["stringsAsFactors"] = false
+  );
+  out.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+  return out;
+}
+
+// Grid context over n_ids subjects starting at the first_id-th. Times, and
+// glucose stored as doubles, are read from the mapped file in place; uint16
+// glucose is widened into the context once. Each subject carries its stored
+// reading interval.
+// [[Rcpp::export]]
+SEXP cohort_cache_context_cpp(SEXP cache, double first_id = 0, double n_ids = -1) {
+  const CohortCachePtr& opened = cohort_cache_from_sexp(cache);
+  const CacheIndex& index = opened->index;
+  const std::vector<std::uint64_t>& offsets = index.offsets;
+  std::uint64_t id_begin, id_end;
+  opened->id_range(first_id, n_ids, id_begin, id_end);
+
+  const std::size_t n_subjects = static_cast<std::size_t>(id_end - id_begin);
+  const bool gl_in_place = index.header.gl_storage == gl_storage_double;
+  std::vector<std::string> labels(n_subjects);
+  std::vector<cgmguru_columns::DoubleSpan> times(n_subjects);
+  std::vector<cgmguru_columns::DoubleSpan> gls(n_subjects);
+  std::vector<std::vector<double>> time_scratch(n_subjects);
+  std::vector<std::vector<double>> gl_scratch(n_subjects);
+  std::vector<double> reading_minutes(n_subjects);
+  for (std::size_t k = 0; k < n_subjects; ++k) {
+    const std::uint64_t g = id_begin + k;
+    const std::uint64_t first = offsets[g];
+    const std::size_t size = static_cast<std::size_t>(offsets[g + 1] - first);
+    labels[k] = CHAR(STRING_ELT(index.labels, static_cast<R_xlen_t>(g)));
+    times[k] = cgmguru_columns::DoubleSpan(opened->time_values() + first, size);
+    if (gl_in_place) {
+      gls[k] = cgmguru_columns::DoubleSpan(
+        reinterpret_cast<const double*>(opened->gl_bytes) + first, size);
+    } else {
+      gl_scratch[k].resize(size);
+      for (std::size_t i = 0; i < size; ++i) gl_scratch[k][i] = opened->gl_value(first + i);
+      gls[k] = cgmguru_columns::DoubleSpan(gl_scratch[k]);
+    }
+    reading_minutes[k] = index.reading_minutes[static_cast<std::size_t>(g)];
+  }
+
+  XPtr<cgmguru_grid::GridContext> ptr(
+    new cgmguru_grid::GridContext(labels, times, gls, std::move(time_scratch),
+                                  std::move(gl_scratch), index.tz, opened,
+                                  std::move(reading_minutes)),
+    true);
+  ptr.attr("class") = CharacterVector::create("cgmguru_grid_context");
+  return ptr;
+}
@@ -0,0 +1,64 @@
+#ifndef CGMGURU_COLUMN_VIEW_H
+#define CGMGURU_COLUMN_VIEW_H
+
+#include <cstddef>
+#include <vector>
+
+// Read-only, non-owning views over numeric data-frame columns.
+//
+// The per-id kernels used to receive their own copy of every subject's time
+// and glucose values. When a subject's rows already sit in one consecutive
+// block of the input (the usual layout of exported CGM files, which are
+// written grouped by id), the kernel can read the R column buffer in place
+// instead, so only unsorted inputs pay for a gather. Nothing here calls the
+// R API, so views can be created and read on worker threads.
+namespace cgmguru_columns {
+
+class DoubleSpan {
+public:
+  DoubleSpan() = default;
+  DoubleSpan(const double* data, std::size_t size) : data_(data), size_(size) {}
+  // Implicit so kernels taking a span still accept owned buffers
+  DoubleSpan(const std::vector<double>& values)
+    : data_(values.data()), size_(values.size()) {}
+
+  const double* data() const { return data_; }
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const double* begin() const { return data_; }
+  const double* end() const { return data_ + size_; }
+  const double& operator[](std::size_t i) const { return data_[i]; }
+  const double& front() const { return data_[0]; }
+  const double& back() const { return data_[size_ - 1]; }
+
+private:
+  const double* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+// True when the (increasing) row indices form one run of consecutive rows
+inline bool rows_are_contiguous(const int* rows_begin, const int* rows_end) {
+  const std::ptrdiff_t n = rows_end - rows_begin;
+  return n == 0 || rows_end[-1] - rows_begin[0] == n - 1;
+}
+
+// Values of column at the given rows. Contiguous rows are viewed in place;
+// otherwise they are gathered into scratch, which must outlive the span.
+inline DoubleSpan column_rows(const double* column,
+                              const int* rows_begin,
+                              const int* rows_end,
+                              std::vector<double>& scratch) {
+  const std::size_t n = static_cast<std::size_t>(rows_end - rows_begin);
+  if (rows_are_contiguous(rows_begin, rows_end)) {
+    return DoubleSpan(n == 0 ? column : column + rows_begin[0], n);
+  }
+  scratch.resize(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    scratch[i] = column[rows_begin[i]];
+  }
+  return DoubleSpan(scratch);
+}
+
+} // namespace cgmguru_columns
+
+#endif // CGMGURU_COLUMN_VIEW_H
@@ -1,6 +1,9 @@
 #include "id_based_calculator.h"
 #include "event_preprocessing.h"
 #include "rebound_events_core.h"
+#include "sensor_wear.h"
+#include "string_table.h"
+#include "variability_metrics.h"
 #include <algorithm>
 #include <cctype>
 #include <cmath>
@@ -13,44 +16,52 @@ using namespace std;
 // with type and level categorization as requested by user
 class EnhancedUnifiedEventsCalculator : public IdBasedCalculator {
 private:
-  // Structure to hold event data with type and level information
+  // Structure to hold event data with type and level information. Ids, types
+  // and levels repeat over many rows, so rows hold codes into interned tables.
   struct UnifiedEventData {
-    std::vector<std::string> ids;
-    std::vector<std::string> types;      // "hypo" or "hyper"
-    std::vector<std::string> levels;     // "lv1", "lv2", "extended", "lv1_excl"
+    cgmguru_strings::StringTable id_table;
+    cgmguru_strings::StringTable type_table;   // "hypo" or "hyper"
+    cgmguru_strings::StringTable level_table;  // "lv1", "lv2", "extended", "lv1_excl", "rebound"
+    std::vector<int> id_codes;
+    std::vector<int> type_codes;
+    std::vector<int> level_codes;
     std::vector<int> total_episodes;
     std::vector<double> avg_episodes_per_day;
     std::vector<double> avg_episode_duration;
 
     void reserve(size_t capacity) {
-      ids.reserve(capacity);
-      types.reserve(capacity);
-      levels.reserve(capacity);
+      id_codes.reserve(capacity);
+      type_codes.reserve(capacity);
+      level_codes.reserve(capacity);
       total_episodes.reserve(capacity);
       avg_episodes_per_day.reserve(capacity);
       avg_episode_duration.reserve(capacity);
     }
 
     void clear() {
-      ids.clear();
-      types.clear();
-      levels.clear();
+      id_table.clear();
+      type_table.clear();
+      level_table.clear();
+      id_codes.clear();
+      type_codes.clear();
+      level_codes.clear();
       total_episodes.clear();
       avg_episodes_per_day.clear();
       avg_episode_duration.clear();
     }
 
-    void add_entry(const std::string& id, const std::string& type, const std::string& level,
+    // Codes come from id_table, type_table and level_table
+    void add_entry(int id_code, int type_code, int level_code,
                    int episodes, double per_day, double duration) {
-      ids.push_back(id);
-      types.push_back(type);
-      levels.push_back(level);
+      id_codes.push_back(id_code);
+      type_codes.push_back(type_code);
+      level_codes.push_back(level_code);
       total_episodes.push_back(episodes);
       avg_episodes_per_day.push_back(per_day);
       avg_episode_duration.push_back(duration);
     }
 
-    size_t size() const { return ids.size(); }
+    size_t size() const { return id_codes.size(); }
   };
 
   UnifiedEventData unified_data;
@@ -81,9 +92,134 @@ private:
     int digits = 2;
   };
 
+  // Which per-subject kernels have to run for the selected outputs. Level 1
+  // exclusive counts need the Level 1 and Level 2 statistics of their type,
+  // and each rebound type starts from the opposite type's Level 1 labels.
+  struct KernelPlan {
+    bool hypo_lv1_labels = true;
+    bool hypo_lv1_stats = true;
+    bool hypo_lv2 = true;
+    bool hypo_extended = true;
+    bool hyper_lv1_labels = true;
+    bool hyper_lv1_stats = true;
+    bool hyper_lv2 = true;
+    bool hyper_extended = true;
+    bool hypo_rebound = true;
+    bool hyper_rebound = true;
+    bool summary_metrics = true;
+    bool sensor_wear = true;
+  };
+
   std::map<std::string, CGMSummaryMetrics> cgm_summary_by_id;
   std::map<std::string, std::map<std::string, EventSummaryValues>> event_summary_by_id;
   RoundingOptions summary_rounding;
+  // Selected event type+level combinations (in all_event_combinations()
+  // order) and summary metric columns; everything unless narrowed by
+  // select_outputs()
+  std::vector<std::pair<std::string, std::string>> selected_events =
+    all_event_combinations();
+  std::set<std::string> selected_metrics = {
+    summary_metric_names().begin(), summary_metric_names().end()
+  };
+  KernelPlan kernel_plan;
+
+  // All consensus and rebound event type+level combinations
+  static const std::vector<std::pair<std::string, std::string>>& all_event_combinations() {
+    static const std::vector<std::pair<std::string, std::string>> combinations = {
+      {"hypo", "lv1"},       // detectHypoglycemicEvents(start_gl=70, dur_length=15)
+      {"hypo", "lv2"},       // detectHypoglycemicEvents(start_gl=54, dur_length=15)
+      {"hypo", "extended"},  // detectHypoglycemicEvents() default
+      {"hypo", "lv1_excl"},  // detectLevel1HypoglycemicEvents()
+      {"hypo", "rebound"},   // Level 1 hyperglycemia followed by <70 mg/dL
+      {"hyper", "lv1"},      // detectHyperglycemicEvents(start_gl=181, dur_length=15)
+      {"hyper", "lv2"},      // detectHyperglycemicEvents(start_gl=251, dur_length=15)
+      {"hyper", "extended"}, // detectHyperglycemicEvents() default
+      {"hyper", "lv1_excl"}, // detectLevel1HyperglycemicEvents()
+      {"hyper", "rebound"}   // Level 1 hypoglycemia followed by >180 mg/dL
+    };
+    return combinations;
+  }
+
+  // subject_summary metric columns, in output order
+  static const std::vector<std::string>& summary_metric_names() {
+    static const std::vector<std::string> names = {
+      "TIR", "TITR", "TBR70", "TBR54", "TAR180", "TAR250", "CV", "SD",
+      "mean_glucose", "GMI", "uGMI", "GRI", "sensor_wear_percent"
+    };
+    return names;
+  }
+
+  // Narrows the outputs to the requested levels ("hypo_lv2", ...) and
+  // metrics; NULL keeps all of them
+  void select_outputs(SEXP levels_sexp, SEXP metrics_sexp) {
+    selected_events.clear();
+    if (levels_sexp == R_NilValue) {
+      selected_events = all_event_combinations();
+    } else {
+      std::set<std::string> requested = parse_selection(
+        levels_sexp, "levels", event_combination_keys());
+      for (const auto& event_combo : all_event_combinations()) {
+        if (requested.count(event_combo.first + "_" + event_combo.second) > 0) {
+          selected_events.push_back(event_combo);
+        }
+      }
+    }
+
+    selected_metrics = metrics_sexp == R_NilValue
+      ? std::set<std::string>(summary_metric_names().begin(), summary_metric_names().end())
+      : parse_selection(metrics_sexp, "metrics", summary_metric_names());
+
+    std::set<std::string> keys;
+    for (const auto& event_combo : selected_events) {
+      keys.insert(event_combo.first + "_" + event_combo.second);
+    }
+    KernelPlan plan;
+    plan.hypo_lv1_stats = keys.count("hypo_lv1") > 0 || keys.count("hypo_lv1_excl") > 0;
+    plan.hypo_lv2 = keys.count("hypo_lv2") > 0 || keys.count("hypo_lv1_excl") > 0;
+    plan.hypo_extended = keys.count("hypo_extended") > 0;
+    plan.hyper_lv1_stats = keys.count("hyper_lv1") > 0 || keys.count("hyper_lv1_excl") > 0;
+    plan.hyper_lv2 = keys.count("hyper_lv2") > 0 || keys.count("hyper_lv1_excl") > 0;
+    plan.hyper_extended = keys.count("hyper_extended") > 0;
+    plan.hypo_rebound = keys.count("hypo_rebound") > 0;
+    plan.hyper_rebound = keys.count("hyper_rebound") > 0;
+    plan.hypo_lv1_labels = plan.hypo_lv1_stats || plan.hyper_rebound;
+    plan.hyper_lv1_labels = plan.hyper_lv1_stats || plan.hypo_rebound;
+    plan.sensor_wear = selected_metrics.count("sensor_wear_percent") > 0;
+    plan.summary_metrics = selected_metrics.size() > (plan.sensor_wear ? 1u : 0u);
+    kernel_plan = plan;
+  }
+
+  static std::vector<std::string> event_combination_keys() {
+    std::vector<std::string> keys;
+    for (const auto& event_combo : all_event_combinations()) {
+      keys.push_back(event_combo.first + "_" + event_combo.second);
+    }
+    return keys;
+  }
+
+  // Character selection where every element must be one of allowed
+  static std::set<std::string> parse_selection(SEXP selection_sexp,
+                                               const std::string& name,
+                                               const std::vector<std::string>& allowed) {
+    std::string allowed_list;
+    for (const std::string& value : allowed) {
+      allowed_list += (allowed_list.empty() ? "" : ", ") + value;
+    }
+    if (TYPEOF(selection_sexp) != STRSXP) {
+      stop(name + " must be NULL or a character vector of: " + allowed_list);
+    }
+    CharacterVector selection(selection_sexp);
+    std::set<std::string> out;
+    for (R_xlen_t i = 0; i < selection.size(); ++i) {
+      if (selection[i] == NA_STRING ||
+          std::find(allowed.begin(), allowed.end(),
+                    as<std::string>(selection[i])) == allowed.end()) {
+        stop(name + " must be NULL or a character vector of: " + allowed_list);
+      }
+      out.insert(as<std::string>(selection[i]));
+    }
+    return out;
+  }
 
   inline double round_summary_value(double value) const {
     if (NumericVector::is_na(value) || !std::isfinite(value)) return value;
@@ -119,14 +255,12 @@ private:
   inline int calculate_min_readings(double reading_minutes, double dur_length) const {
     const double tolerance_minutes = 0.1;
     const double effective_duration = std::max(0.0, dur_length - tolerance_minutes);
-    return static_cast<int>(std::ceil(effective_duration / reading_minutes));
-  }
-
-  inline bool duration_met(int reading_count, double duration_minutes,
-                           double reading_minutes) const {
-    const double tolerance_minutes = 0.1;
-    return static_cast<double>(reading_count) * reading_minutes +
-      tolerance_minutes >= duration_minutes;
+    const double readings = std::ceil(effective_duration / reading_minutes);
+    // Saturate instead of casting an infinite or out-of-range count
+    if (!(readings < static_cast<double>(std::numeric_limits<int>::max()))) {
+      return std::numeric_limits<int>::max();
+    }
+    return static_cast<int>(readings);
   }
 
   CGMSummaryMetrics calculate_cgm_summary_metrics(
@@ -387,27 +521,21 @@ private:
   }
 
   // HYPERGLYCEMIC EVENTS - Enhanced with improved logic from detect_hyperglycemic_events.cpp
-  IntegerVector calculate_hyperglycemic_events(const NumericVector& time_subset,
-                                             const NumericVector& glucose_subset,
-                                             int min_readings,
-                                             double dur_length = 120,
-                                             double end_length = 15,
-                                             double start_gl = 250,
-                                             double end_gl = 180,
-                                             double reading_minutes = 5.0) {
+  // Marks the episodes of one segment of n_subset readings: bands and events
+  // are positioned at the segment's first reading
+  void calculate_hyperglycemic_events(const cgmguru_events::GlucoseBands& bands,
+                                      int n_subset,
+                                      int* events,
+                                      int min_readings,
+                                      double dur_length = 120,
+                                      double end_length = 15,
+                                      double reading_minutes = 5.0) {
     (void)min_readings;
-    const int n_subset = time_subset.length();
-    IntegerVector events(n_subset, 0);
-
-    if (n_subset == 0) return events;
+    if (n_subset == 0) return;
 
-    std::vector<bool> valid_glucose(n_subset);
-    std::vector<double> glucose_values(n_subset);
-
-    for (int i = 0; i < n_subset; ++i) {
-      valid_glucose[i] = !NumericVector::is_na(glucose_subset[i]);
-      glucose_values[i] = valid_glucose[i] ? glucose_subset[i] : 0.0;
-    }
+    // Whole-reading counts that meet each duration, fixed for this call
+    const int dur_readings = cgmguru_events::readings_needed(dur_length, reading_minutes);
+    const int end_readings = cgmguru_events::readings_needed(end_length, reading_minutes);
 
     // Phase 1: Find core definitions (start and end points within core)
     struct CoreEvent {
@@ -423,20 +551,20 @@ private:
 
     // Phase 1: Find continuous core definitions using whole grid-point counts.
     for (int i = 0; i < n_subset; ++i) {
-      if (!valid_glucose[i]) continue;
+      if (!bands.valid(i)) continue;
 
       if (!in_core) {
-        if (glucose_values[i] > start_gl) {
+        if (bands.past_start(i)) {
           core_start = i;
           core_end = i;
           core_valid_hyper_count = 1;
           in_core = true;
         }
-      } else if (glucose_values[i] > start_gl) {
+      } else if (bands.past_start(i)) {
         core_end = i;
         ++core_valid_hyper_count;
       } else {
-        if (duration_met(core_valid_hyper_count, dur_length, reading_minutes)) {
+        if (core_valid_hyper_count >= dur_readings) {
           core_events.push_back({core_start, core_end});
         }
         in_core = false;
@@ -448,7 +576,7 @@ private:
 
     // Handle case where core continues until end of data
     if (in_core && core_start != -1) {
-      if (duration_met(core_valid_hyper_count, dur_length, reading_minutes)) {
+      if (core_valid_hyper_count >= dur_readings) {
         core_events.push_back({core_start, core_end});
       }
     }
@@ -475,9 +603,9 @@ private:
             bool recovery_found_between = false;
             
             for (int i = last_event_end_idx + 1; i < event_start_idx; ++i) {
-              if (!valid_glucose[i]) continue;
+              if (!bands.valid(i)) continue;
               
-              if (glucose_values[i] <= end_gl) {
+              if (!bands.past_end(i)) {
                 recovery_found_between = true;
                 break;
               }
@@ -494,19 +622,19 @@ private:
           // Look for recovery starting from the end of core definition
           int recovery_scan_start = event_end_idx + 1;
           for (int i = recovery_scan_start; i < n_subset; ++i) {
-            if (!valid_glucose[i]) continue;
+            if (!bands.valid(i)) continue;
             
-            if (glucose_values[i] <= end_gl) {
+            if (!bands.past_end(i)) {
               // Candidate recovery - check whole recovery reading count.
               int recovery_end_idx = -1;
               int recovery_count = 0;
               for (int k = i; k < n_subset; ++k) {
-                if (!valid_glucose[k]) continue;
-                if (glucose_values[k] > end_gl) {
+                if (!bands.valid(k)) continue;
+                if (bands.past_end(k)) {
                   break;
                 }
                 ++recovery_count;
-                if (duration_met(recovery_count, end_length, reading_minutes)) {
+                if (recovery_count >= end_readings) {
                   recovery_end_idx = k; // end of recovery period
                   break;
                 }
@@ -533,36 +661,28 @@ private:
       
     }
 
-    return events;
   }
 
   // WINDOW-BASED HYPERGLYCEMIC EVENTS - For extended level detection
-  IntegerVector calculate_hyperglycemic_events_window(const NumericVector& time_subset,
-                                                    const NumericVector& glucose_subset,
-                                                    int min_readings,
-                                                    double dur_length = 120,
-                                                    double end_length = 15,
-                                                    double start_gl = 250,
-                                                    double end_gl = 180,
-                                                    double reading_minutes = 5.0) {
+  // Same segment layout as calculate_hyperglycemic_events; time_subset points
+  // at the segment's first time
+  void calculate_hyperglycemic_events_window(const cgmguru_events::GlucoseBands& bands,
+                                             const double* time_subset,
+                                             int n_subset,
+                                             int* events,
+                                             int min_readings,
+                                             double dur_length = 120,
+                                             double end_length = 15,
+                                             double reading_minutes = 5.0) {
     (void)min_readings;
-    const int n_subset = time_subset.length();
-    IntegerVector events(n_subset, 0);
-
-    if (n_subset == 0) return events;
-
-    std::vector<bool> valid_glucose(n_subset);
-    std::vector<double> glucose_values(n_subset);
+    if (n_subset == 0) return;
 
-    for (int i = 0; i < n_subset; ++i) {
-        valid_glucose[i] = !NumericVector::is_na(glucose_subset[i]);
-        glucose_values[i] = valid_glucose[i] ? glucose_subset[i] : 0.0;
-    }
-
-    // Default extended hyperglycemia is 90 minutes within a 120-minute window.
-    const double window_duration = dur_length;
-    const double required_duration = dur_length * 3.0 / 4.0;
-    const double tolerance_minutes = 0.1;
+    // Default extended hyperglycemia is 90 minutes within a 120-minute window,
+    // both counted in whole readings once for this call.
+    const int window_readings = cgmguru_events::readings_within(dur_length, reading_minutes);
+    const int required_readings =
+      cgmguru_events::readings_needed(dur_length * 3.0 / 4.0, reading_minutes);
+    const int end_readings = cgmguru_events::readings_needed(end_length, reading_minutes);
 
     // Phase 1: Find core definitions using sliding window approach
     struct CoreEvent {
@@ -573,16 +693,14 @@ private:
 
     // Slide window across time series
     for (int window_start = 0; window_start < n_subset; ++window_start) {
-        if (!valid_glucose[window_start]) continue;
+        if (!bands.valid(window_start)) continue;
         
         // Find window end using whole grid-point counts.
         int window_end = window_start;
         
         for (int j = window_start; j < n_subset; ++j) {
             const int window_count = j - window_start + 1;
-            if (valid_glucose[j] &&
-                static_cast<double>(window_count) * reading_minutes <=
-                  window_duration + tolerance_minutes) {
+            if (bands.valid(j) && window_count <= window_readings) {
                 window_end = j;
             } else {
                 break;
@@ -598,9 +716,9 @@ private:
         int last_hyper_idx = -1;
         
         for (int i = window_start; i <= window_end; ++i) {
-            if (!valid_glucose[i]) continue;
+            if (!bands.valid(i)) continue;
             
-            if (glucose_values[i] > start_gl) {
+            if (bands.past_start(i)) {
                 if (first_hyper_idx == -1) {
                     first_hyper_idx = i;
                 }
@@ -610,7 +728,7 @@ private:
         }
         
         // Check if window meets criteria: > start_gl for at least 90 minutes
-        if (duration_met(valid_hyper_count, required_duration, reading_minutes)) {
+        if (valid_hyper_count >= required_readings) {
             
             // Check if this window overlaps significantly with existing events
             bool is_new_event = true;
@@ -654,9 +772,9 @@ private:
                 bool recovery_found_between = false;
                 
                 for (int i = last_event_end_idx + 1; i < event_start_idx; ++i) {
-                    if (!valid_glucose[i]) continue;
+                    if (!bands.valid(i)) continue;
                     
-                    if (glucose_values[i] <= end_gl) {
+                    if (!bands.past_end(i)) {
                         recovery_found_between = true;
                         break;
                     }
@@ -673,19 +791,19 @@ private:
             // Look for recovery starting from the end of core definition
             int recovery_scan_start = event_end_idx + 1;
             for (int i = recovery_scan_start; i < n_subset; ++i) {
-                if (!valid_glucose[i]) continue;
+                if (!bands.valid(i)) continue;
                 
-                if (glucose_values[i] <= end_gl) {
+                if (!bands.past_end(i)) {
                     // Candidate recovery - check whole recovery reading count.
                     int recovery_end_idx = -1;
                     int recovery_count = 0;
                     for (int k = i; k < n_subset; ++k) {
-                        if (!valid_glucose[k]) continue;
-                        if (glucose_values[k] > end_gl) {
+                        if (!bands.valid(k)) continue;
+                        if (bands.past_end(k)) {
                             break;
                         }
                         ++recovery_count;
-                        if (duration_met(recovery_count, end_length, reading_minutes)) {
+                        if (recovery_count >= end_readings) {
                             recovery_end_idx = k; // end of recovery period
                             break;
                         }
@@ -711,54 +829,45 @@ private:
         }
     }
 
-    return events;
   }
 
   // HYPOGLYCEMIC EVENTS - Updated to match detect_hypoglycemic_events.cpp exactly
-  IntegerVector calculate_hypoglycemic_events(const NumericVector& time_subset,
-                                            const NumericVector& glucose_subset,
-                                            int min_readings,
-                                            double dur_length = 120,
-                                            double end_length = 15,
-                                            double start_gl = 70,
-                                            double reading_minutes = 5.0) {
+  // Same segment layout as calculate_hyperglycemic_events
+  void calculate_hypoglycemic_events(const cgmguru_events::GlucoseBands& bands,
+                                     int n_subset,
+                                     int* events,
+                                     int min_readings,
+                                     double dur_length = 120,
+                                     double end_length = 15,
+                                     double reading_minutes = 5.0) {
     (void)min_readings;
-    const int n_subset = time_subset.length();
-    IntegerVector events(n_subset, 0);
-
-    if (n_subset == 0) return events;
+    if (n_subset == 0) return;
 
-    // Pre-allocate vectors for better performance
-    std::vector<bool> valid_glucose(n_subset);
-    std::vector<double> glucose_values(n_subset);
-
-    // Single pass to identify valid glucose readings and cache values
-    for (int i = 0; i < n_subset; ++i) {
-      valid_glucose[i] = !NumericVector::is_na(glucose_subset[i]);
-      glucose_values[i] = valid_glucose[i] ? glucose_subset[i] : 0.0;
-    }
+    // Whole-reading counts that meet each duration, fixed for this call
+    const int dur_readings = cgmguru_events::readings_needed(dur_length, reading_minutes);
+    const int end_readings = cgmguru_events::readings_needed(end_length, reading_minutes);
 
     bool in_hypo_event = false;
     int event_start = -1;
     int hypo_count = 0; // retained but duration will be authoritative
 
     for (int i = 0; i < n_subset; ++i) {
-      if (!valid_glucose[i]) continue;
+      if (!bands.valid(i)) continue;
 
       if (!in_hypo_event) {
         // Looking for event start
-        if (glucose_values[i] < start_gl) {
+        if (bands.past_start(i)) {
           hypo_count = 1;
           event_start = i;
           in_hypo_event = true;
         }
       } else {
         // Currently in hypoglycemic event
-        if (glucose_values[i] < start_gl) {
+        if (bands.past_start(i)) {
           hypo_count++;
         } else { // glucose >= 70 (recovery candidate)
           // 1) Validate low-phase by whole-number readings on the interpolated grid.
-          if (!duration_met(hypo_count, dur_length, reading_minutes)) {
+          if (hypo_count < dur_readings) {
             // Not enough consecutive low readings yet; CANCEL the event
             // because glucose exceeded threshold before meeting duration requirement
             in_hypo_event = false;
@@ -769,12 +878,12 @@ private:
             int recovery_end_idx = -1;
             int recovery_count = 0;
             for (int k = i; k < n_subset; ++k) {
-              if (!valid_glucose[k]) continue;
-              if (glucose_values[k] < start_gl) {
+              if (!bands.valid(k)) continue;
+              if (bands.past_start(k)) {
                 break;
               }
               ++recovery_count;
-              if (duration_met(recovery_count, end_length, reading_minutes)) {
+              if (recovery_count >= end_readings) {
                 recovery_end_idx = k;
                 break;
               }
@@ -798,18 +907,20 @@ private:
     }
 
     if (in_hypo_event && event_start != -1 &&
-        duration_met(hypo_count, dur_length, reading_minutes)) {
+        hypo_count >= dur_readings) {
       events[event_start] = 2;
       if (n_subset - 1 != event_start) {
         events[n_subset - 1] = -1;
       }
     }
 
-    return events;
   }
 
+  // The kernels run on each gap-free segment in place; levels classifies the
+  // subject's readings once for every level
   IntegerVector calculate_segmented_hypoglycemic_events(
       const cgmguru_events::PreparedIDData& prepared,
+      const cgmguru_events::GlucoseLevels& levels,
       int min_readings,
       double dur_length,
       double end_length,
@@ -818,18 +929,10 @@ private:
     IntegerVector events(prepared.time.length(), 0);
 
     for (const auto& segment : prepared.segments) {
-      NumericVector segment_time =
-        cgmguru_events::slice_numeric(prepared.time, segment.start, segment.end);
-      NumericVector segment_glucose =
-        cgmguru_events::slice_numeric(prepared.glucose, segment.start, segment.end);
-
-      IntegerVector segment_events = calculate_hypoglycemic_events(
-        segment_time, segment_glucose, min_readings, dur_length, end_length,
-        start_gl, reading_minutes);
-
-      for (int i = 0; i < segment_events.length(); ++i) {
-        events[segment.start + i] = segment_events[i];
-      }
+      calculate_hypoglycemic_events(
+        levels.below(start_gl, segment.start), segment.end - segment.start + 1,
+        events.begin() + segment.start, min_readings, dur_length, end_length,
+        reading_minutes);
     }
 
     return events;
@@ -837,6 +940,7 @@ private:
 
   IntegerVector calculate_segmented_hyperglycemic_events(
       const cgmguru_events::PreparedIDData& prepared,
+      const cgmguru_events::GlucoseLevels& levels,
       int min_readings,
       double dur_length,
       double end_length,
@@ -847,91 +951,78 @@ private:
     IntegerVector events(prepared.time.length(), 0);
 
     for (const auto& segment : prepared.segments) {
-      NumericVector segment_time =
-        cgmguru_events::slice_numeric(prepared.time, segment.start, segment.end);
-      NumericVector segment_glucose =
-        cgmguru_events::slice_numeric(prepared.glucose, segment.start, segment.end);
-
-      IntegerVector segment_events = window_based
-        ? calculate_hyperglycemic_events_window(segment_time, segment_glucose,
-            min_readings, dur_length, end_length, start_gl, end_gl, reading_minutes)
-        : calculate_hyperglycemic_events(segment_time, segment_glucose,
-            min_readings, dur_length, end_length, start_gl, end_gl, reading_minutes);
-
-      for (int i = 0; i < segment_events.length(); ++i) {
-        events[segment.start + i] = segment_events[i];
+      const cgmguru_events::GlucoseBands bands =
+        levels.above(start_gl, end_gl, segment.start);
+      const int n_segment = segment.end - segment.start + 1;
+      if (window_based) {
+        calculate_hyperglycemic_events_window(
+          bands, prepared.time.begin() + segment.start, n_segment,
+          events.begin() + segment.start, min_readings, dur_length, end_length,
+          reading_minutes);
+      } else {
+        calculate_hyperglycemic_events(
+          bands, n_segment, events.begin() + segment.start, min_readings,
+          dur_length, end_length, reading_minutes);
       }
     }
 
     return events;
   }
 
+  // Episodes of one type+level in each segment, read from its start (2) and
+  // confirmation (-1) markers. Each end is moved back to the last reading
+  // still on the event side of reporting_threshold.
+  typedef std::vector<std::vector<cgmguru_rebound::LevelOneEvent>> SegmentEpisodes;
 
-
-
+  SegmentEpisodes episodes_by_segment(
+      const std::string& event_type,
+      const IntegerVector& events,
+      const NumericVector& glucose,
+      const std::vector<cgmguru_events::SegmentRange>& segments,
+      double reporting_threshold) const {
+    SegmentEpisodes out;
+    out.reserve(segments.size());
+    for (const auto& segment : segments) {
+      out.push_back(level_one_events_from_labels(event_type, events, glucose,
+                                                 segment, reporting_threshold));
+    }
+    return out;
+  }
 
   // Process events and collect statistics with type and level
   void process_events_for_type_level(const std::string& current_id,
                                     const std::string& event_type,
                                     const std::string& event_level,
-                                    const IntegerVector& events,
+                                    const SegmentEpisodes& episodes,
                                     const NumericVector& time_subset,
                                     const NumericVector& glucose_subset,
-                                    const std::vector<cgmguru_events::SegmentRange>& segments,
-                                    double reporting_threshold,
                                     double reading_minutes) {
 
     // Create composite key for event type + level
     std::string event_key = event_type + "_" + event_level;
+    if (time_subset.length() == 0) return;
+    IDEventStatistics& stats = all_statistics[event_key][current_id];
 
     // Calculate total days for this ID and event type (only once)
-    if (time_subset.length() > 0 && all_statistics[event_key][current_id].total_days == 0.0) {
-      all_statistics[event_key][current_id].total_days =
-        cgmguru_events::recording_days(glucose_subset, reading_minutes);
+    if (stats.total_days == 0.0) {
+      stats.total_days = cgmguru_events::recording_days(glucose_subset, reading_minutes);
     }
 
-    auto record_event = [&](int start_idx, int marker_end_idx) {
-      int end_idx_for_metrics = start_idx;
-      for (int r = marker_end_idx; r >= start_idx; --r) {
-        if (NumericVector::is_na(glucose_subset[r])) continue;
-        bool is_event_range = (event_type == "hypo")
-          ? glucose_subset[r] < reporting_threshold
-          : glucose_subset[r] > reporting_threshold;
-        if (is_event_range) {
-          end_idx_for_metrics = r;
-          break;
-        }
-      }
-
-      if (event_type == "hypo") {
-        double dur_below_54 = calculate_duration_below_54(time_subset, glucose_subset,
-                                                          start_idx, end_idx_for_metrics,
-                                                          reading_minutes);
-        all_statistics[event_key][current_id].episode_durations.push_back(dur_below_54);
-      }
-
-      all_statistics[event_key][current_id].episode_times.push_back(time_subset[start_idx]);
-      all_statistics[event_key][current_id].start_indices.push_back(start_idx + 1);
-      all_statistics[event_key][current_id].end_indices.push_back(end_idx_for_metrics + 1);
-    };
-
-    // Process events within each contiguous segment. Some valid episodes end at
+    // Episodes are kept per contiguous segment. Some valid episodes end at
     // the segment boundary without a recovery marker, especially in sparse
-    // 15-minute traces. Resetting at segment boundaries prevents the next
+    // 15-minute traces; reading markers per segment prevents the next
     // segment's start marker from swallowing that open episode.
-    for (const auto& segment : segments) {
-      int start_idx = -1;
-      for (int i = segment.start; i <= segment.end; ++i) {
-        if (events[i] == 2) {
-          start_idx = i;
-        } else if (events[i] == -1 && start_idx != -1) {
-          record_event(start_idx, i);
-          start_idx = -1;
+    for (const auto& segment_episodes : episodes) {
+      for (const cgmguru_rebound::LevelOneEvent& episode : segment_episodes) {
+        if (event_type == "hypo") {
+          stats.episode_durations.push_back(
+            calculate_duration_below_54(time_subset, glucose_subset,
+                                        episode.start_idx, episode.end_idx,
+                                        reading_minutes));
         }
-      }
-
-      if (start_idx != -1) {
-        record_event(start_idx, segment.end);
+        stats.episode_times.push_back(time_subset[episode.start_idx]);
+        stats.start_indices.push_back(episode.start_idx + 1);
+        stats.end_indices.push_back(episode.end_idx + 1);
       }
     }
   }
@@ -1025,9 +1116,9 @@ private:
     }
 
     DataFrame df = DataFrame::create(
-      _["id"] = wrap(unified_data.ids),
-      _["type"] = wrap(unified_data.types),
-      _["level"] = wrap(unified_data.levels),
+      _["id"] = unified_data.id_table.character(unified_data.id_codes),
+      _["type"] = unified_data.type_table.character(unified_data.type_codes),
+      _["level"] = unified_data.level_table.character(unified_data.level_codes),
       _["total_episodes"] = wrap(unified_data.total_episodes),
       _["avg_ep_per_day"] = wrap(unified_data.avg_episodes_per_day),
       _["avg_minutes_below_54_per_episode"] = wrap(unified_data.avg_episode_duration)
@@ -1100,20 +1191,27 @@ private:
       column_names.push_back(name);
     };
 
+    // Summary metric columns are kept only when selected
+    auto add_metric_column = [&](const std::string& name, const std::vector<double>& values) {
+      if (selected_metrics.count(name) > 0) {
+        add_column(name, wrap(values));
+      }
+    };
+
     add_column("id", wrap(ids));
-    add_column("TIR", wrap(tir_values));
-    add_column("TITR", wrap(titr_values));
-    add_column("TBR70", wrap(tbr70_values));
-    add_column("TBR54", wrap(tbr54_values));
-    add_column("TAR180", wrap(tar180_values));
-    add_column("TAR250", wrap(tar250_values));
-    add_column("CV", wrap(cv_values));
-    add_column("SD", wrap(sd_values));
-    add_column("mean_glucose", wrap(mean_glucose_values));
-    add_column("GMI", wrap(gmi_values));
-    add_column("uGMI", wrap(ugmi_values));
-    add_column("GRI", wrap(gri_values));
-    add_column("sensor_wear_percent", wrap(sensor_wear_values));
+    add_metric_column("TIR", tir_values);
+    add_metric_column("TITR", titr_values);
+    add_metric_column("TBR70", tbr70_values);
+    add_metric_column("TBR54", tbr54_values);
+    add_metric_column("TAR180", tar180_values);
+    add_metric_column("TAR250", tar250_values);
+    add_metric_column("CV", cv_values);
+    add_metric_column("SD", sd_values);
+    add_metric_column("mean_glucose", mean_glucose_values);
+    add_metric_column("GMI", gmi_values);
+    add_metric_column("uGMI", ugmi_values);
+    add_metric_column("GRI", gri_values);
+    add_metric_column("sensor_wear_percent", sensor_wear_values);
 
     for (const auto& event_combo : event_combinations) {
       const std::string prefix = event_combo.first + "_" + event_combo.second;
@@ -1146,206 +1244,206 @@ private:
     return df;
   }
 
-public:
-  EnhancedUnifiedEventsCalculator() {
-    unified_data.reserve(800); // Reserve for 8 event types * ~100 IDs
-  }
-
-  // Enhanced main calculation method that implements the consensus event groups
-  // plus rebound summaries.
-  RObject calculate_all_events(const DataFrame& df,
-                               SEXP reading_minutes_sexp = R_NilValue,
-                               bool sort_time = false,
-                               double inter_gap = 45,
-                               bool return_interpolated = false,
-                               std::string summary_metrics_source = "raw",
-                               SEXP sensor_wear_ndays_sexp = R_NilValue,
-                               SEXP summary_digits_sexp = R_NilValue) {
-    if (summary_metrics_source != "raw" &&
-        summary_metrics_source != "preprocessed") {
-      stop("summary_metrics_source must be 'raw' or 'preprocessed'");
-    }
-    const bool use_preprocessed_summary_metrics =
-      summary_metrics_source == "preprocessed";
-    const double sensor_wear_ndays =
-      parse_sensor_wear_ndays(sensor_wear_ndays_sexp);
-    summary_rounding = parse_summary_digits(summary_digits_sexp);
-
-    // Clear previous results
+  void clear_results() {
     unified_data.clear();
     all_statistics.clear();
     cgm_summary_by_id.clear();
     event_summary_by_id.clear();
     interpolated_data.clear();
+  }
 
-    // Extract columns from DataFrame
-    int n = df.nrows();
-    StringVector id = df["id"];
-    NumericVector time = df["time"];
-    NumericVector glucose = df["gl"];
-
-    // Fallback default timezone from time's tzone attribute or UTC
-    std::string default_tz = "UTC";
-    RObject tz_attr = time.attr("tzone");
-    if (!tz_attr.isNULL()) {
-      CharacterVector tz_attr_cv = as<CharacterVector>(tz_attr);
-      if (tz_attr_cv.size() > 0 && !CharacterVector::is_na(tz_attr_cv[0])) {
-        default_tz = as<std::string>(tz_attr_cv[0]);
-      }
-    }
-
-    // Group by ID, then optionally sort only the per-id index vectors.
-    group_by_id(id, n);
-    cgmguru_events::sort_or_validate_id_indices(id_indices, time, sort_time);
-    if (return_interpolated) {
-      interpolated_data.reserve_rows(static_cast<size_t>(n), id_indices.size(), false);
-    }
-
-    // Process each ID separately for all consensus and rebound event types.
-    for (auto const& id_pair : id_indices) {
-      std::string current_id = id_pair.first;
-      const std::vector<int>& indices = id_pair.second;
-
-      double reading_minutes =
-        cgmguru_events::reading_minutes_for_id(reading_minutes_sexp, time, indices, n);
-      const double sensor_wear_reading_minutes = reading_minutes;
-      reading_minutes =
-        cgmguru_events::iglu_day_grid_reading_minutes(reading_minutes);
-      int min_readings_120 = calculate_min_readings(reading_minutes, 120);
-      int min_readings_15 = calculate_min_readings(reading_minutes, 15);
-
-      cgmguru_events::PreparedIDData prepared =
-        cgmguru_events::prepare_id_data(time, glucose, indices, reading_minutes,
-                                        inter_gap, default_tz, true, true);
-      if (return_interpolated) {
-        interpolated_data.append(current_id, prepared, false);
-      }
-      CGMSummaryMetrics cgm_summary = use_preprocessed_summary_metrics ?
+  // Summary metrics, consensus events and rebounds for one subject. prepared
+  // must come from prepare_id_data(..., align_to_iglu_day_grid = true,
+  // drop_missing_rows = true); its reading_minutes is the day-grid interval.
+  void process_prepared_id(const std::string& current_id,
+                           const NumericVector& time,
+                           const NumericVector& glucose,
+                           const std::vector<int>& indices,
+                           const cgmguru_events::PreparedIDData& prepared,
+                           double sensor_wear_reading_minutes,
+                           bool use_preprocessed_summary_metrics,
+                           double sensor_wear_ndays) {
+    const double reading_minutes = prepared.reading_minutes;
+    int min_readings_120 = calculate_min_readings(reading_minutes, 120);
+    int min_readings_15 = calculate_min_readings(reading_minutes, 15);
+    const int profile_subject = profiler.subject(current_id);
+
+    const KernelPlan& plan = kernel_plan;
+
+    CGMSummaryMetrics cgm_summary;
+    if (plan.summary_metrics) {
+      cgmguru_profile::ScopedStage stage(profiler, "summary_metrics", profile_subject);
+      cgm_summary = use_preprocessed_summary_metrics ?
         calculate_cgm_summary_metrics(prepared.glucose) :
         calculate_cgm_summary_metrics(glucose, indices);
+    }
+    if (plan.sensor_wear) {
+      cgmguru_profile::ScopedStage stage(profiler, "sensor_wear", profile_subject);
       cgm_summary.sensor_wear =
         calculate_sensor_wear_percent(time, glucose, indices,
                                       sensor_wear_reading_minutes,
                                       sensor_wear_ndays);
-      cgm_summary_by_id[current_id] = cgm_summary;
+    }
+    cgm_summary_by_id[current_id] = cgm_summary;
+
+    // Every consensus level reads its threshold sides from one classification
+    // byte per reading
+    const bool any_level = plan.hypo_lv1_labels || plan.hypo_lv2 ||
+      plan.hypo_extended || plan.hyper_lv1_labels || plan.hyper_lv2 ||
+      plan.hyper_extended;
+    const cgmguru_events::GlucoseLevels levels(
+      any_level ? prepared.glucose : NumericVector(0)
+    );
 
-      // Calculate the consensus event types:
+    // Calculate the consensus event types:
 
-      // 1. detectHypoglycemicEvents(dataset,start_gl = 70,dur_length=15,end_length=15) # type : hypo, level = lv1
+    // 1. detectHypoglycemicEvents(dataset,start_gl = 70,dur_length=15,end_length=15) # type : hypo, level = lv1
+    SegmentEpisodes hypo_lv1_episodes;
+    if (plan.hypo_lv1_labels) {
+      cgmguru_profile::ScopedStage stage(profiler, "hypo_lv1", profile_subject);
       IntegerVector hypo_lv1_events = calculate_segmented_hypoglycemic_events(
-        prepared, min_readings_15, 15, 15, 70, reading_minutes);
-      process_events_for_type_level(current_id, "hypo", "lv1", hypo_lv1_events,
-                                    prepared.time, prepared.glucose, prepared.segments,
-                                    70, reading_minutes);
+        prepared, levels, min_readings_15, 15, 15, 70, reading_minutes);
+      hypo_lv1_episodes = episodes_by_segment("hypo", hypo_lv1_events, prepared.glucose,
+                                              prepared.segments, 70);
+      if (plan.hypo_lv1_stats) {
+        process_events_for_type_level(current_id, "hypo", "lv1", hypo_lv1_episodes,
+                                      prepared.time, prepared.glucose, reading_minutes);
+      }
+    }
 
-      // 2. detectHypoglycemicEvents(dataset,start_gl = 54,dur_length=15,end_length=15) # type : hypo, level = lv2
+    // 2. detectHypoglycemicEvents(dataset,start_gl = 54,dur_length=15,end_length=15) # type : hypo, level = lv2
+    if (plan.hypo_lv2) {
+      cgmguru_profile::ScopedStage stage(profiler, "hypo_lv2", profile_subject);
       IntegerVector hypo_lv2_events = calculate_segmented_hypoglycemic_events(
-        prepared, min_readings_15, 15, 15, 54, reading_minutes);
-      process_events_for_type_level(current_id, "hypo", "lv2", hypo_lv2_events,
-                                    prepared.time, prepared.glucose, prepared.segments,
-                                    54, reading_minutes);
+        prepared, levels, min_readings_15, 15, 15, 54, reading_minutes);
+      process_events_for_type_level(current_id, "hypo", "lv2",
+                                    episodes_by_segment("hypo", hypo_lv2_events,
+                                                        prepared.glucose,
+                                                        prepared.segments, 54),
+                                    prepared.time, prepared.glucose, reading_minutes);
+    }
 
-      // 3. detectHypoglycemicEvents(dataset) # type : hypo, level = extended (default: <70 mg/dL, 120 min)
+    // 3. detectHypoglycemicEvents(dataset) # type : hypo, level = extended (default: <70 mg/dL, 120 min)
+    if (plan.hypo_extended) {
+      cgmguru_profile::ScopedStage stage(profiler, "hypo_extended", profile_subject);
       const double extended_hypo_duration = 120.0 + reading_minutes;
       IntegerVector hypo_extended_events = calculate_segmented_hypoglycemic_events(
-        prepared, min_readings_120, extended_hypo_duration, 15, 70,
+        prepared, levels, min_readings_120, extended_hypo_duration, 15, 70,
         reading_minutes);
-      process_events_for_type_level(current_id, "hypo", "extended", hypo_extended_events,
-                                    prepared.time, prepared.glucose, prepared.segments,
-                                    70, reading_minutes);
+      process_events_for_type_level(current_id, "hypo", "extended",
+                                    episodes_by_segment("hypo", hypo_extended_events,
+                                                        prepared.glucose,
+                                                        prepared.segments, 70),
+                                    prepared.time, prepared.glucose, reading_minutes);
+    }
 
-      // 4. detectLevel1HypoglycemicEvents(dataset) # type : hypo, level = lv1_excl (54-69 mg/dL)
-      // Note: lv1_excl metrics will be calculated as average of lv1 and lv2 after processing all events
+    // 4. detectLevel1HypoglycemicEvents(dataset) # type : hypo, level = lv1_excl (54-69 mg/dL)
+    // Note: lv1_excl metrics will be calculated as average of lv1 and lv2 after processing all events
 
-      // 5. detectHyperglycemicEvents(dataset, start_gl = 180, dur_length=15, end_length=15, end_gl=180)
-      //    # type : hyper, level = lv1
+    // 5. detectHyperglycemicEvents(dataset, start_gl = 180, dur_length=15, end_length=15, end_gl=180)
+    //    # type : hyper, level = lv1
+    SegmentEpisodes hyper_lv1_episodes;
+    if (plan.hyper_lv1_labels) {
+      cgmguru_profile::ScopedStage stage(profiler, "hyper_lv1", profile_subject);
       IntegerVector hyper_lv1_events = calculate_segmented_hyperglycemic_events(
-        prepared, min_readings_15, 15, 15, 180, 180, reading_minutes, false);
-      process_events_for_type_level(current_id, "hyper", "lv1", hyper_lv1_events,
-                                    prepared.time, prepared.glucose, prepared.segments,
-                                    180, reading_minutes);
+        prepared, levels, min_readings_15, 15, 15, 180, 180, reading_minutes, false);
+      hyper_lv1_episodes = episodes_by_segment("hyper", hyper_lv1_events,
+                                               prepared.glucose, prepared.segments, 180);
+      if (plan.hyper_lv1_stats) {
+        process_events_for_type_level(current_id, "hyper", "lv1", hyper_lv1_episodes,
+                                      prepared.time, prepared.glucose, reading_minutes);
+      }
+    }
 
-      // 6. detectHyperglycemicEvents(dataset, start_gl = 250, dur_length=15, end_length=15, end_gl=250)
-      //    # type : hyper, level = lv2
+    // 6. detectHyperglycemicEvents(dataset, start_gl = 250, dur_length=15, end_length=15, end_gl=250)
+    //    # type : hyper, level = lv2
+    if (plan.hyper_lv2) {
+      cgmguru_profile::ScopedStage stage(profiler, "hyper_lv2", profile_subject);
       IntegerVector hyper_lv2_events = calculate_segmented_hyperglycemic_events(
-        prepared, min_readings_15, 15, 15, 250, 250, reading_minutes, false);
-      process_events_for_type_level(current_id, "hyper", "lv2", hyper_lv2_events,
-                                    prepared.time, prepared.glucose, prepared.segments,
-                                    250, reading_minutes);
+        prepared, levels, min_readings_15, 15, 15, 250, 250, reading_minutes, false);
+      process_events_for_type_level(current_id, "hyper", "lv2",
+                                    episodes_by_segment("hyper", hyper_lv2_events,
+                                                        prepared.glucose,
+                                                        prepared.segments, 250),
+                                    prepared.time, prepared.glucose, reading_minutes);
+    }
 
-      // 7. detectHyperglycemicEvents(dataset) # type : hyper, level = extended
-      //    # (default: >250 mg/dL, 120 min) - using window-based approach
+    // 7. detectHyperglycemicEvents(dataset) # type : hyper, level = extended
+    //    # (default: >250 mg/dL, 120 min) - using window-based approach
+    if (plan.hyper_extended) {
+      cgmguru_profile::ScopedStage stage(profiler, "hyper_extended", profile_subject);
       IntegerVector hyper_extended_events = calculate_segmented_hyperglycemic_events(
-        prepared, min_readings_120, 120, 15, 250, 180, reading_minutes, true);
+        prepared, levels, min_readings_120, 120, 15, 250, 180, reading_minutes, true);
       process_events_for_type_level(current_id, "hyper", "extended",
-                                   hyper_extended_events, prepared.time,
-                                   prepared.glucose, prepared.segments,
-                                   180, reading_minutes);
-
-      // 8. detectLevel1HyperglycemicEvents(dataset) # type : hyper, level = lv1_excl
-      //    # (181-250 mg/dL)
-      // Note: lv1_excl metrics will be calculated as average of lv1 and lv2 after processing all events
-
-      // 9-10. Rebound events. The initial event must be a cgmguru Level 1
-      // event; the opposite rebound side only needs a threshold crossing
-      // within 120 minutes in the same segment. Reuse the Level 1 labels
-      // calculated above so detect_all_events does not repeat Level 1 scans.
-      for (const auto& segment : prepared.segments) {
-        std::vector<cgmguru_rebound::ReboundEvent> rebound_events;
-        std::vector<cgmguru_rebound::LevelOneEvent> initial_hyper_events =
-          level_one_events_from_labels(
-            "hyper", hyper_lv1_events, prepared.glucose, segment, 180.0);
-        std::vector<cgmguru_rebound::LevelOneEvent> initial_hypo_events =
-          level_one_events_from_labels(
-            "hypo", hypo_lv1_events, prepared.glucose, segment, 70.0);
+                                    episodes_by_segment("hyper", hyper_extended_events,
+                                                        prepared.glucose,
+                                                        prepared.segments, 180),
+                                    prepared.time, prepared.glucose, reading_minutes);
+    }
 
+    // 8. detectLevel1HyperglycemicEvents(dataset) # type : hyper, level = lv1_excl
+    //    # (181-250 mg/dL)
+    // Note: lv1_excl metrics will be calculated as average of lv1 and lv2 after processing all events
+
+    // 9-10. Rebound events. The initial event must be a cgmguru Level 1
+    // event; the opposite rebound side only needs a threshold crossing
+    // within 120 minutes in the same segment. The Level 1 episodes found
+    // above are reused, so their labels are not scanned again.
+    if (!plan.hypo_rebound && !plan.hyper_rebound) return;
+    cgmguru_profile::ScopedStage rebound_stage(profiler, "rebound", profile_subject);
+    for (size_t s = 0; s < prepared.segments.size(); ++s) {
+      const cgmguru_events::SegmentRange& segment = prepared.segments[s];
+      std::vector<cgmguru_rebound::ReboundEvent> rebound_events;
+      if (plan.hypo_rebound) {
         cgmguru_rebound::append_rebounds_after_initial_events(
-          initial_hyper_events, prepared.time, prepared.glucose, segment,
+          hyper_lv1_episodes[s], prepared.time, prepared.glucose, segment,
           "hypo", 120.0, rebound_events);
+      }
+      if (plan.hyper_rebound) {
         cgmguru_rebound::append_rebounds_after_initial_events(
-          initial_hypo_events, prepared.time, prepared.glucose, segment,
+          hypo_lv1_episodes[s], prepared.time, prepared.glucose, segment,
           "hyper", 120.0, rebound_events);
+      }
 
-        for (const cgmguru_rebound::ReboundEvent& rebound_event : rebound_events) {
-          const std::string event_key = rebound_event.type + std::string("_rebound");
-          IDEventStatistics& stats = all_statistics[event_key][current_id];
-          if (stats.total_days == 0.0) {
-            stats.total_days = cgmguru_events::recording_days(prepared.glucose,
-                                                              reading_minutes);
-          }
-          stats.episode_times.push_back(prepared.time[rebound_event.bridge_start_idx]);
-          stats.start_indices.push_back(rebound_event.bridge_start_idx + 1);
-          stats.end_indices.push_back(rebound_event.rebound_idx + 1);
+      for (const cgmguru_rebound::ReboundEvent& rebound_event : rebound_events) {
+        const std::string event_key = rebound_event.type + std::string("_rebound");
+        IDEventStatistics& stats = all_statistics[event_key][current_id];
+        if (stats.total_days == 0.0) {
+          stats.total_days = cgmguru_events::recording_days(prepared.glucose,
+                                                            reading_minutes);
         }
+        stats.episode_times.push_back(prepared.time[rebound_event.bridge_start_idx]);
+        stats.start_indices.push_back(rebound_event.bridge_start_idx + 1);
+        stats.end_indices.push_back(rebound_event.rebound_idx + 1);
       }
     }
+  }
 
-
-
+  // Subject and event summary tibbles for every id in id_indices
+  List summarize_events() {
     // Create unified results sorted by ID and event type+level combinations
     std::set<std::string> unique_ids;
     for (auto const& id_pair : id_indices) {
       unique_ids.insert(id_pair.first);
     }
 
-    // Define all consensus and rebound event type+level combinations.
-    std::vector<std::pair<std::string, std::string>> event_combinations = {
-      {"hypo", "lv1"},       // detectHypoglycemicEvents(start_gl=70, dur_length=15)
-      {"hypo", "lv2"},       // detectHypoglycemicEvents(start_gl=54, dur_length=15)
-      {"hypo", "extended"},  // detectHypoglycemicEvents() default
-      {"hypo", "lv1_excl"},  // detectLevel1HypoglycemicEvents()
-      {"hypo", "rebound"},   // Level 1 hyperglycemia followed by <70 mg/dL
-      {"hyper", "lv1"},      // detectHyperglycemicEvents(start_gl=181, dur_length=15)
-      {"hyper", "lv2"},      // detectHyperglycemicEvents(start_gl=251, dur_length=15)
-      {"hyper", "extended"}, // detectHyperglycemicEvents() default
-      {"hyper", "lv1_excl"}, // detectLevel1HyperglycemicEvents()
-      {"hyper", "rebound"}   // Level 1 hypoglycemia followed by >180 mg/dL
-    };
+    const std::vector<std::pair<std::string, std::string>>& event_combinations =
+      selected_events;
+
+    std::vector<int> combination_type_codes;
+    std::vector<int> combination_level_codes;
+    combination_type_codes.reserve(event_combinations.size());
+    combination_level_codes.reserve(event_combinations.size());
+    for (const auto& event_combo : event_combinations) {
+      combination_type_codes.push_back(unified_data.type_table.intern(event_combo.first));
+      combination_level_codes.push_back(unified_data.level_table.intern(event_combo.second));
+    }
 
     for (const std::string& id_str : unique_ids) {
-      for (const auto& event_combo : event_combinations) {
-        std::string event_type = event_combo.first;
-        std::string event_level = event_combo.second;
+      const int id_code = unified_data.id_table.intern(id_str);
+      for (size_t combo_idx = 0; combo_idx < event_combinations.size(); ++combo_idx) {
+        const std::string& event_type = event_combinations[combo_idx].first;
+        const std::string& event_level = event_combinations[combo_idx].second;
         std::string event_key = event_type + "_" + event_level;
 
         int event_count = 0;
@@ -1391,7 +1489,8 @@ public:
         double rounded_episodes_per_day = round_summary_value(episodes_per_day);
         double rounded_avg_duration = round_summary_value(avg_duration);
 
-        unified_data.add_entry(id_str, event_type, event_level,
+        unified_data.add_entry(id_code, combination_type_codes[combo_idx],
+                               combination_level_codes[combo_idx],
                                event_count,
                                rounded_episodes_per_day,
                                rounded_avg_duration);
@@ -1405,14 +1504,324 @@ public:
     DataFrame subject_summary =
       create_cgm_summary_metrics_df(unique_ids, event_combinations);
 
-    List result = List::create(
+    return List::create(
       _["subject_summary"] = subject_summary,
       _["glycemic_event_summary"] = glycemic_event_summary
     );
+  }
+
+public:
+  EnhancedUnifiedEventsCalculator() {
+    unified_data.reserve(800); // Reserve for 8 event types * ~100 IDs
+  }
+
+  // Enhanced main calculation method that implements the consensus event groups
+  // plus rebound summaries.
+  RObject calculate_all_events(const DataFrame& df,
+                               SEXP reading_minutes_sexp = R_NilValue,
+                               bool sort_time = false,
+                               double inter_gap = 45,
+                               bool return_interpolated = false,
+                               std::string summary_metrics_source = "raw",
+                               SEXP sensor_wear_ndays_sexp = R_NilValue,
+                               SEXP summary_digits_sexp = R_NilValue,
+                               bool interpolated_factor_ids = false,
+                               SEXP levels_sexp = R_NilValue,
+                               SEXP metrics_sexp = R_NilValue) {
+    profiler.clear();
+    if (summary_metrics_source != "raw" &&
+        summary_metrics_source != "preprocessed") {
+      stop("summary_metrics_source must be 'raw' or 'preprocessed'");
+    }
+    const bool use_preprocessed_summary_metrics =
+      summary_metrics_source == "preprocessed";
+    const double sensor_wear_ndays =
+      parse_sensor_wear_ndays(sensor_wear_ndays_sexp);
+    summary_rounding = parse_summary_digits(summary_digits_sexp);
+    select_outputs(levels_sexp, metrics_sexp);
+
+    // Clear previous results
+    clear_results();
+
+    // Extract columns from DataFrame
+    int n = df.nrows();
+    StringVector id = df["id"];
+    NumericVector time = df["time"];
+    NumericVector glucose = df["gl"];
+
+    // Fallback default timezone from time's tzone attribute or UTC
+    std::string default_tz = "UTC";
+    RObject tz_attr = time.attr("tzone");
+    if (!tz_attr.isNULL()) {
+      CharacterVector tz_attr_cv = as<CharacterVector>(tz_attr);
+      if (tz_attr_cv.size() > 0 && !CharacterVector::is_na(tz_attr_cv[0])) {
+        default_tz = as<std::string>(tz_attr_cv[0]);
+      }
+    }
+
+    // Group by ID, then optionally sort only the per-id index vectors.
+    group_by_id(id, n);
+    {
+      cgmguru_profile::ScopedStage stage(profiler, "sort_or_validate");
+      cgmguru_events::sort_or_validate_id_indices(id_indices, time, sort_time);
+    }
+    if (return_interpolated) {
+      interpolated_data.reserve_rows(static_cast<size_t>(n), id_indices.size(), false);
+    }
+
+    // Reused by every subject to infer its reading interval
+    std::vector<double> interval_scratch;
+    // Process each ID separately for all consensus and rebound event types.
+    for (auto const& id_pair : id_indices) {
+      std::string current_id = id_pair.first;
+      const std::vector<int>& indices = id_pair.second;
+
+      double reading_minutes =
+        cgmguru_events::reading_minutes_for_id(reading_minutes_sexp, time, indices, n,
+                                               interval_scratch);
+      const double sensor_wear_reading_minutes = reading_minutes;
+      reading_minutes =
+        cgmguru_events::iglu_day_grid_reading_minutes(reading_minutes);
+
+      cgmguru_events::PreparedIDData prepared;
+      {
+        cgmguru_profile::ScopedStage stage(profiler, "prepare_id_data",
+                                           profiler.subject(current_id));
+        prepared = cgmguru_events::prepare_id_data(time, glucose, indices, reading_minutes,
+                                                   inter_gap, default_tz, true, true);
+      }
+      if (return_interpolated) {
+        interpolated_data.append(current_id, prepared, false);
+      }
+      process_prepared_id(current_id, time, glucose, indices, prepared,
+                          sensor_wear_reading_minutes,
+                          use_preprocessed_summary_metrics, sensor_wear_ndays);
+    }
 
+    List result;
+    {
+      cgmguru_profile::ScopedStage stage(profiler, "summarize_events");
+      result = summarize_events();
+    }
     if (return_interpolated) {
+      cgmguru_profile::ScopedStage stage(profiler, "interpolated_data");
       result["interpolated_data"] =
-        interpolated_data.to_dataframe(default_tz, false);
+        interpolated_data.to_dataframe(default_tz, false, interpolated_factor_ids);
+    }
+
+    return result;
+  }
+
+  // Fused report pipeline: each subject is grouped and interpolated once and
+  // the grid is shared by every requested metric. A grid is built per
+  // distinct day-grid interval, so events, CONGA and MODD share one grid when
+  // reading_minutes is inferred, and MAGE-ma shares it for 5-minute data.
+  List calculate_all_metrics(const DataFrame& df,
+                             const std::vector<std::string>& metrics,
+                             SEXP reading_minutes_sexp,
+                             double inter_gap,
+                             const std::string& tz,
+                             int conga_n,
+                             int modd_lag,
+                             int mage_short_ma,
+                             int mage_long_ma,
+                             const std::string& mage_direction,
+                             double mage_max_gap,
+                             const std::string& summary_metrics_source,
+                             SEXP sensor_wear_ndays_sexp,
+                             SEXP summary_digits_sexp) {
+    if (metrics.empty()) {
+      stop("metrics must name at least one metric");
+    }
+    bool want_events = false;
+    bool want_conga = false;
+    bool want_modd = false;
+    bool want_mage = false;
+    bool want_sensor_wear = false;
+    for (const std::string& metric : metrics) {
+      if (metric == "events") {
+        want_events = true;
+      } else if (metric == "conga") {
+        want_conga = true;
+      } else if (metric == "modd") {
+        want_modd = true;
+      } else if (metric == "mage") {
+        want_mage = true;
+      } else if (metric == "sensor_wear") {
+        want_sensor_wear = true;
+      } else {
+        stop("metrics must contain only 'events', 'conga', 'modd', 'mage', or 'sensor_wear'");
+      }
+    }
+    if (summary_metrics_source != "raw" &&
+        summary_metrics_source != "preprocessed") {
+      stop("summary_metrics_source must be 'raw' or 'preprocessed'");
+    }
+    if (mage_direction != "avg" && mage_direction != "service" &&
+        mage_direction != "max" && mage_direction != "plus" &&
+        mage_direction != "minus") {
+      stop("mage_direction must be one of 'avg', 'service', 'max', 'plus', or 'minus'");
+    }
+    if (want_mage && mage_short_ma >= mage_long_ma) {
+      warning("The short moving average window size should be smaller than the long moving average window size for correct MAGE calculation. Swapping automatically.");
+      std::swap(mage_short_ma, mage_long_ma);
+    }
+    const bool use_preprocessed_summary_metrics =
+      summary_metrics_source == "preprocessed";
+    const double sensor_wear_ndays =
+      parse_sensor_wear_ndays(sensor_wear_ndays_sexp);
+    summary_rounding = parse_summary_digits(summary_digits_sexp);
+    select_outputs(R_NilValue, R_NilValue);
+
+    clear_results();
+
+    if (!df.containsElementNamed("id") ||
+        !df.containsElementNamed("time") ||
+        !df.containsElementNamed("gl")) {
+      stop("all_metrics requires columns 'id', 'time', and 'gl'");
+    }
+    const int n = df.nrows();
+    NumericVector time = df["time"];
+    NumericVector glucose = df["gl"];
+    const std::string tzone =
+      cgmguru_variability::timezone_from_time_or_arg(time, tz);
+
+    // One grouping for every metric: rows with missing id, time or gl are
+    // dropped and each subject is sorted by time
+    id_indices = cgmguru_variability::valid_id_indices(df);
+
+    cgmguru_sensor_wear::SensorWearOptions sensor_wear_options;
+    sensor_wear_options.reading_minutes = reading_minutes_sexp;
+    sensor_wear_options.ndays = sensor_wear_ndays;
+    sensor_wear_options.full_length = n;
+
+    const size_t n_ids = id_indices.size();
+    std::vector<std::string> out_ids;
+    std::vector<double> out_conga;
+    std::vector<double> out_modd;
+    std::vector<double> out_mage;
+    std::vector<cgmguru_sensor_wear::SensorWearRow> out_sensor_wear;
+    out_ids.reserve(n_ids);
+    out_conga.reserve(n_ids);
+    out_modd.reserve(n_ids);
+    out_mage.reserve(n_ids);
+    out_sensor_wear.reserve(n_ids);
+
+    std::vector<double> interval_scratch;
+    for (auto const& id_pair : id_indices) {
+      const std::string& current_id = id_pair.first;
+      const std::vector<int>& indices = id_pair.second;
+      out_ids.push_back(current_id);
+
+      // Interval inferred from this subject's timestamps, shared by the
+      // event and CONGA/MODD grids so it is computed at most once
+      double inferred_minutes = NA_REAL;
+      auto inferred_reading_minutes = [&]() {
+        if (NumericVector::is_na(inferred_minutes)) {
+          inferred_minutes = cgmguru_events::median_positive_diff_minutes(
+            time, indices, interval_scratch
+          );
+        }
+        return inferred_minutes;
+      };
+
+      // Full (uncompacted) day grids of this subject keyed by interval
+      std::map<double, cgmguru_events::PreparedIDData> grids;
+      auto grid_for = [&](double grid_minutes)
+          -> const cgmguru_events::PreparedIDData& {
+        auto found = grids.find(grid_minutes);
+        if (found == grids.end()) {
+          found = grids.emplace(
+            grid_minutes,
+            cgmguru_events::prepare_id_data(time, glucose, indices, grid_minutes,
+                                            inter_gap, tzone, true, false)
+          ).first;
+        }
+        return found->second;
+      };
+
+      if (want_events) {
+        const double sensor_wear_reading_minutes =
+          reading_minutes_sexp == R_NilValue
+            ? inferred_reading_minutes()
+            : cgmguru_events::reading_minutes_for_id(reading_minutes_sexp, time,
+                                                     indices, n, interval_scratch);
+        cgmguru_events::PreparedIDData prepared = grid_for(
+          cgmguru_events::iglu_day_grid_reading_minutes(sensor_wear_reading_minutes)
+        );
+        cgmguru_events::compact_non_missing_rows(prepared);
+        process_prepared_id(current_id, time, glucose, indices, prepared,
+                            sensor_wear_reading_minutes,
+                            use_preprocessed_summary_metrics, sensor_wear_ndays);
+      }
+
+      if (want_conga || want_modd) {
+        double conga = NA_REAL;
+        double modd = R_NaN;
+        if (indices.size() >= 2) {
+          const cgmguru_events::PreparedIDData& prepared = grid_for(
+            cgmguru_variability::day_grid_reading_minutes(inferred_reading_minutes(),
+                                                          inter_gap)
+          );
+          if (want_conga) {
+            conga = cgmguru_variability::conga_from_prepared(prepared, conga_n);
+          }
+          if (want_modd) {
+            modd = cgmguru_variability::modd_from_prepared(prepared, modd_lag);
+          }
+        }
+        out_conga.push_back(conga);
+        out_modd.push_back(modd);
+      }
+
+      if (want_mage) {
+        out_mage.push_back(cgmguru_variability::mage_ma_from_prepared(
+          grid_for(5.0), mage_short_ma, mage_long_ma, mage_max_gap,
+          mage_direction
+        ));
+      }
+
+      if (want_sensor_wear) {
+        out_sensor_wear.push_back(cgmguru_sensor_wear::sensor_wear_for_id(
+          time, glucose, indices, sensor_wear_options
+        ));
+      }
+    }
+
+    List result;
+    if (want_events) {
+      List events = summarize_events();
+      result["subject_summary"] = events["subject_summary"];
+      result["glycemic_event_summary"] = events["glycemic_event_summary"];
+    }
+    if (want_conga) {
+      DataFrame conga_df = DataFrame::create(
+        _["id"] = wrap(out_ids),
+        _["CONGA"] = wrap(out_conga)
+      );
+      conga_df.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+      result["conga"] = conga_df;
+    }
+    if (want_modd) {
+      DataFrame modd_df = DataFrame::create(
+        _["id"] = wrap(out_ids),
+        _["MODD"] = wrap(out_modd)
+      );
+      modd_df.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+      result["modd"] = modd_df;
+    }
+    if (want_mage) {
+      DataFrame mage_df = DataFrame::create(
+        _["id"] = wrap(out_ids),
+        _["MAGE"] = wrap(out_mage)
+      );
+      mage_df.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+      result["mage"] = mage_df;
+    }
+    if (want_sensor_wear) {
+      result["sensor_wear"] = cgmguru_sensor_wear::sensor_wear_rows_to_dataframe(
+        out_ids, out_sensor_wear, tzone
+      );
     }
 
     return result;
@@ -1427,10 +1836,45 @@ RObject detect_all_events(DataFrame df,
                           bool return_interpolated = false,
                           std::string summary_metrics_source = "raw",
                           SEXP sensor_wear_ndays = R_NilValue,
-                          SEXP summary_digits = R_NilValue) {
+                          SEXP summary_digits = R_NilValue,
+                          bool interpolated_factor_ids = false,
+                          bool profile = false,
+                          SEXP levels = R_NilValue,
+                          SEXP metrics = R_NilValue) {
+  EnhancedUnifiedEventsCalculator calculator;
+  calculator.enable_profiling(profile);
+  RObject result = calculator.calculate_all_events(df, reading_minutes, sort_time,
+                                                   inter_gap, return_interpolated,
+                                                   summary_metrics_source,
+                                                   sensor_wear_ndays, summary_digits,
+                                                   interpolated_factor_ids,
+                                                   levels, metrics);
+  if (profile) {
+    result.attr("profile") = calculator.profile_table();
+  }
+  return result;
+}
+
+// [[Rcpp::export]]
+List all_metrics_cpp(DataFrame df,
+                     std::vector<std::string> metrics,
+                     SEXP reading_minutes = R_NilValue,
+                     double inter_gap = 45,
+                     std::string tz = "",
+                     int conga_n = 24,
+                     int modd_lag = 1,
+                     int mage_short_ma = 5,
+                     int mage_long_ma = 32,
+                     std::string mage_direction = "avg",
+                     double mage_max_gap = 180,
+                     std::string summary_metrics_source = "raw",
+                     SEXP sensor_wear_ndays = R_NilValue,
+                     SEXP summary_digits = R_NilValue) {
   EnhancedUnifiedEventsCalculator calculator;
-  return calculator.calculate_all_events(df, reading_minutes, sort_time,
-                                         inter_gap, return_interpolated,
-                                         summary_metrics_source,
-                                         sensor_wear_ndays, summary_digits);
+  return calculator.calculate_all_metrics(df, metrics, reading_minutes,
+                                          inter_gap, tz, conga_n, modd_lag,
+                                          mage_short_ma, mage_long_ma,
+                                          mage_direction, mage_max_gap,
+                                          summary_metrics_source,
+                                          sensor_wear_ndays, summary_digits);
 }
@@ -1,5 +1,8 @@
+#include "grid_context.h"
 #include "id_based_calculator.h"
 
+#include <memory>
+
 using namespace Rcpp;
 using namespace std;
 
@@ -30,8 +33,8 @@ private:
 
   // Detect between maxima for a single ID
   void detect_between_maxima_for_id(const std::string& current_id,
-                                    const NumericVector& original_time_subset,
-                                    const NumericVector& original_gl_subset,
+                                    cgmguru_columns::DoubleSpan original_time_subset,
+                                    cgmguru_columns::DoubleSpan original_gl_subset,
                                     const NumericVector& grid_time_subset,
                                     const NumericVector& grid_gl_subset,
                                     const NumericVector& maxima_time_subset,
@@ -67,7 +70,7 @@ private:
 
       if (same_maxima_time) {
         // Find maximum between these two GRID times
-        for (int j = 0; j < original_time_subset.size(); ++j) {
+        for (int j = 0; j < static_cast<int>(original_time_subset.size()); ++j) {
           double time_point = original_time_subset[j];
           double gl_value = original_gl_subset[j];
 
@@ -220,23 +223,11 @@ private:
     return df;
   }
 
-public:
-  List calculate(const DataFrame& original_df,
-                 const DataFrame& transform_df) {
+  List calculate_between_maxima(const cgmguru_grid::GridContext& context,
+                                const DataFrame& transform_df) {
 
     clear_results();
 
-    // Extract columns from original DataFrame
-    StringVector original_id = original_df["id"];
-    NumericVector original_time = original_df["time"];
-    NumericVector original_gl = original_df["gl"];
-    // Optional timezone column on original
-    bool has_original_tz_col = original_df.containsElementNamed("tz");
-    CharacterVector original_tz_col;
-    if (has_original_tz_col) {
-      original_tz_col = original_df["tz"];
-    }
-
     // Extract columns from transform  DataFrame
     StringVector summary_id = transform_df["id"];
     NumericVector summary_grid_time = transform_df["grid_time"];
@@ -250,19 +241,9 @@ public:
       summary_tz_col = transform_df["tz"];
     }
 
-    // Default timezone from original_time's tzone attribute or UTC
-    std::string default_tz = "UTC";
-    RObject tz_attr = original_time.attr("tzone");
-    if (!tz_attr.isNULL()) {
-      CharacterVector tz_attr_cv = as<CharacterVector>(tz_attr);
-      if (tz_attr_cv.size() > 0 && !CharacterVector::is_na(tz_attr_cv[0])) {
-        default_tz = as<std::string>(tz_attr_cv[0]);
-      }
-    }
-
-    // Group original data by ID
-    int n_original = original_df.nrows();
-    group_by_id(original_id, n_original);
+    // Default timezone and the original data grouped by ID come from the context
+    const std::string& default_tz = context.default_tz();
+    use_id_grouping(context.groups());
 
     // Create a map for transform data by ID
     std::map<std::string, std::vector<int>> summary_id_indices;
@@ -274,17 +255,11 @@ public:
 
     // Build per-id timezone map, preferring original tz column, then summary tz column, else default
     std::map<std::string, std::string> id_timezones;
+    std::size_t tz_pos = 0;
     for (auto const& id_pair : id_indices) {
       const std::string& current_id = id_pair.first;
-      const std::vector<int>& original_indices = id_pair.second;
-      std::string tz_for_id = default_tz;
-      if (has_original_tz_col && !original_indices.empty()) {
-        int idx = original_indices.front();
-        if (idx >= 0 && idx < original_tz_col.size() && !CharacterVector::is_na(original_tz_col[idx])) {
-          tz_for_id = as<std::string>(original_tz_col[idx]);
-        }
-      }
-      if ((tz_for_id.empty() || (!has_original_tz_col)) && summary_id_indices.count(current_id) > 0 && has_summary_tz_col) {
+      std::string tz_for_id = context.subject_tz(tz_pos++);
+      if (!context.has_tz_column() && summary_id_indices.count(current_id) > 0 && has_summary_tz_col) {
         const std::vector<int>& summary_indices = summary_id_indices[current_id];
         if (!summary_indices.empty()) {
           int sidx = summary_indices.front();
@@ -298,19 +273,19 @@ public:
     }
 
     // Calculate for each ID separately
+    std::size_t group_pos = 0;
     for (auto const& id_pair : id_indices) {
       std::string current_id = id_pair.first;
-      const std::vector<int>& original_indices = id_pair.second;
+      const std::size_t k = group_pos++;
+      cgmguru_profile::ScopedStage stage(profiler, "between_maxima", profiler.subject(current_id));
 
       // Keep every subject represented in episode_counts, even if this ID has
       // no transform rows or no between-maxima results.
       result_counts_per_id[current_id] = 0;
 
-      // Extract original data subset for this ID
-      NumericVector original_time_subset(original_indices.size());
-      NumericVector original_gl_subset(original_indices.size());
-      extract_id_subset(current_id, original_indices, original_time, original_gl,
-                        original_time_subset, original_gl_subset);
+      // The context views this ID's original data in place when its rows are contiguous
+      cgmguru_columns::DoubleSpan original_time_subset = context.subject_time(k);
+      cgmguru_columns::DoubleSpan original_gl_subset = context.subject_gl(k);
 
       // Extract transform data for this ID
       if (summary_id_indices.count(current_id) > 0) {
@@ -358,6 +333,9 @@ public:
       }
     }
 
+    // The output tables run to the end of the call
+    cgmguru_profile::ScopedStage output_stage(profiler, "output_tables");
+
     // Create output structures
     DataFrame result_df = create_result_df();
     // Override POSIXct vectors' tzone to default; attach per-id mapping separately
@@ -409,11 +387,48 @@ public:
       _["episode_counts"] = episode_counts_df
     );
   }
+
+public:
+  List calculate(const DataFrame& original_df,
+                 const DataFrame& transform_df) {
+    profiler.clear();
+    std::unique_ptr<cgmguru_grid::GridContext> context;
+    {
+      cgmguru_profile::ScopedStage stage(profiler, "grid_context");
+      context.reset(new cgmguru_grid::GridContext(original_df));
+    }
+    return calculate_between_maxima(*context, transform_df);
+  }
+
+  List calculate(const cgmguru_grid::GridContext& context,
+                 const DataFrame& transform_df) {
+    profiler.clear();
+    return calculate_between_maxima(context, transform_df);
+  }
 };
 
 // [[Rcpp::export]]
 List detect_between_maxima(DataFrame df,
-                         DataFrame transform_df) {
+                         DataFrame transform_df,
+                         bool profile = false) {
   BetweenMaximaCalculator calculator;
-  return calculator.calculate(df, transform_df);
+  calculator.enable_profiling(profile);
+  List result = calculator.calculate(df, transform_df);
+  if (profile) {
+    result.attr("profile") = calculator.profile_table();
+  }
+  return result;
+}
+
+// [[Rcpp::export]]
+List grid_context_detect_between_maxima_cpp(SEXP context, DataFrame transform_df,
+                                            bool profile = false) {
+  BetweenMaximaCalculator calculator;
+  calculator.enable_profiling(profile);
+  List result = calculator.calculate(*cgmguru_grid::grid_context_from_sexp(context),
+                                     transform_df);
+  if (profile) {
+    result.attr("profile") = calculator.profile_table();
+  }
+  return result;
 }
@@ -9,38 +9,38 @@ class OptimizedHyperglycemicEventsCalculator : public IdBasedCalculator {
 private:
   // Pre-allocated event storage with better memory layout
   struct EventData {
-    std::vector<std::string> ids;
+    // Subject ids are interned; each event keeps its subject's code
+    cgmguru_strings::StringTable id_table;
+    std::vector<int> id_codes;
     std::vector<double> start_times;
     std::vector<double> end_times;
     std::vector<double> start_glucose;
     std::vector<double> end_glucose;
     std::vector<int> start_indices;
     std::vector<int> end_indices;
-    std::vector<std::string> timezones;
 
     void reserve(size_t capacity) {
-      ids.reserve(capacity);
+      id_codes.reserve(capacity);
       start_times.reserve(capacity);
       end_times.reserve(capacity);
       start_glucose.reserve(capacity);
       end_glucose.reserve(capacity);
       start_indices.reserve(capacity);
       end_indices.reserve(capacity);
-      timezones.reserve(capacity);
     }
 
     void clear() {
-      ids.clear();
+      id_table.clear();
+      id_codes.clear();
       start_times.clear();
       end_times.clear();
       start_glucose.clear();
       end_glucose.clear();
       start_indices.clear();
       end_indices.clear();
-      timezones.clear();
     }
 
-    size_t size() const { return ids.size(); }
+    size_t size() const { return id_codes.size(); }
   };
 
   EventData total_event_data;
@@ -68,14 +68,12 @@ private:
   inline int calculate_min_readings(double reading_minutes, double dur_length = 120) const {
     const double tolerance_minutes = 0.1;
     const double effective_duration = std::max(0.0, dur_length - tolerance_minutes);
-    return static_cast<int>(std::ceil(effective_duration / reading_minutes));
-  }
-
-  inline bool duration_met(int reading_count, double duration_minutes,
-                           double reading_minutes) const {
-    const double tolerance_minutes = 0.1;
-    return static_cast<double>(reading_count) * reading_minutes +
-      tolerance_minutes >= duration_minutes;
+    const double readings = std::ceil(effective_duration / reading_minutes);
+    // Saturate instead of casting an infinite or out-of-range count
+    if (!(readings < static_cast<double>(std::numeric_limits<int>::max()))) {
+      return std::numeric_limits<int>::max();
+    }
+    return static_cast<int>(readings);
   }
 
 
@@ -103,13 +101,13 @@ private:
       );
     }
 
-    std::vector<bool> valid_glucose(n_subset);
-    std::vector<double> glucose_values(n_subset);
+    // Presence and threshold side of each reading, compared once
+    const cgmguru_events::GlucoseBands bands =
+      cgmguru_events::GlucoseBands::above(glucose_subset, start_gl, end_gl);
 
-    for (int i = 0; i < n_subset; ++i) {
-      valid_glucose[i] = !NumericVector::is_na(glucose_subset[i]);
-      glucose_values[i] = valid_glucose[i] ? glucose_subset[i] : 0.0;
-    }
+    // Whole-reading counts that meet each duration, fixed for this call
+    const int dur_readings = cgmguru_events::readings_needed(dur_length, reading_minutes);
+    const int end_readings = cgmguru_events::readings_needed(end_length, reading_minutes);
 
 
     // Phase 1: Find core definitions (start and end points within core)
@@ -126,20 +124,20 @@ private:
 
     // Phase 1: Find continuous core definitions using whole grid-point counts.
     for (int i = 0; i < n_subset; ++i) {
-      if (!valid_glucose[i]) continue;
+      if (!bands.valid(i)) continue;
 
       if (!in_core) {
-        if (glucose_values[i] > start_gl) {
+        if (bands.past_start(i)) {
           core_start = i;
           core_end = i;
           core_valid_hyper_count = 1;
           in_core = true;
         }
-      } else if (glucose_values[i] > start_gl) {
+      } else if (bands.past_start(i)) {
         core_end = i;
         ++core_valid_hyper_count;
       } else {
-        if (duration_met(core_valid_hyper_count, dur_length, reading_minutes)) {
+        if (core_valid_hyper_count >= dur_readings) {
           core_events.push_back({core_start, core_end});
         }
         in_core = false;
@@ -151,7 +149,7 @@ private:
 
     // Handle case where core continues until end of data
     if (in_core && core_start != -1) {
-      if (duration_met(core_valid_hyper_count, dur_length, reading_minutes)) {
+      if (core_valid_hyper_count >= dur_readings) {
         core_events.push_back({core_start, core_end});
       }
     }
@@ -178,9 +176,9 @@ private:
             bool recovery_found_between = false;
             
             for (int i = last_event_end_idx + 1; i < event_start_idx; ++i) {
-              if (!valid_glucose[i]) continue;
+              if (!bands.valid(i)) continue;
               
-              if (glucose_values[i] <= end_gl) {
+              if (!bands.past_end(i)) {
                 recovery_found_between = true;
                 break;
               }
@@ -201,23 +199,23 @@ private:
           bool event_finalized = false;
           
           for (int i = recovery_scan_start; i < n_subset && !event_finalized; ++i) {
-            if (!valid_glucose[i]) continue;
+            if (!bands.valid(i)) continue;
             
-            if (glucose_values[i] <= end_gl) {
+            if (!bands.past_end(i)) {
               // Candidate recovery start - check whole recovery reading count.
               int recovery_end_idx = -1;
               int recovery_count = 0;
               
               for (int k = i; k < n_subset; k++) {
-                if (!valid_glucose[k]) continue;
+                if (!bands.valid(k)) continue;
                 
                 // Check if glucose rises above end_gl (recovery broken)
-                if (glucose_values[k] > end_gl) {
+                if (bands.past_end(k)) {
                   break; // Recovery broken, exit inner loop to continue searching
                 }
 
                 ++recovery_count;
-                if (duration_met(recovery_count, end_length, reading_minutes)) {
+                if (recovery_count >= end_readings) {
                   recovery_end_idx = k; // end of recovery period
                   break;
                 }
@@ -227,7 +225,7 @@ private:
               if (recovery_end_idx != -1) {
                 int reported_end_idx = event_end_idx;
                 for (int r = i - 1; r >= event_start_idx; --r) {
-                  if (valid_glucose[r]) {
+                  if (bands.valid(r)) {
                     reported_end_idx = r;
                     break;
                   }
@@ -284,18 +282,16 @@ private:
       );
     }
 
-    std::vector<bool> valid_glucose(n_subset);
-    std::vector<double> glucose_values(n_subset);
+    // Presence and threshold side of each reading, compared once
+    const cgmguru_events::GlucoseBands bands =
+      cgmguru_events::GlucoseBands::above(glucose_subset, start_gl, end_gl);
 
-    for (int i = 0; i < n_subset; ++i) {
-        valid_glucose[i] = !NumericVector::is_na(glucose_subset[i]);
-        glucose_values[i] = valid_glucose[i] ? glucose_subset[i] : 0.0;
-    }
-
-    // Default extended hyperglycemia is 90 minutes within a 120-minute window.
-    const double window_duration = dur_length;
-    const double required_duration = dur_length * 3.0 / 4.0;
-    const double tolerance_minutes = 0.1;
+    // Default extended hyperglycemia is 90 minutes within a 120-minute window,
+    // both counted in whole readings once for this call.
+    const int window_readings = cgmguru_events::readings_within(dur_length, reading_minutes);
+    const int required_readings =
+      cgmguru_events::readings_needed(dur_length * 3.0 / 4.0, reading_minutes);
+    const int end_readings = cgmguru_events::readings_needed(end_length, reading_minutes);
 
     // Phase 1: Find core definitions using sliding window approach
     struct CoreEvent {
@@ -306,16 +302,14 @@ private:
 
     // Slide window across time series
     for (int window_start = 0; window_start < n_subset; ++window_start) {
-        if (!valid_glucose[window_start]) continue;
+        if (!bands.valid(window_start)) continue;
         
         // Find window end using whole grid-point counts.
         int window_end = window_start;
         
         for (int j = window_start; j < n_subset; ++j) {
             const int window_count = j - window_start + 1;
-            if (valid_glucose[j] &&
-                static_cast<double>(window_count) * reading_minutes <=
-                  window_duration + tolerance_minutes) {
+            if (bands.valid(j) && window_count <= window_readings) {
                 window_end = j;
             } else {
                 break;
@@ -331,9 +325,9 @@ private:
         int last_hyper_idx = -1;
         
         for (int i = window_start; i <= window_end; ++i) {
-            if (!valid_glucose[i]) continue;
+            if (!bands.valid(i)) continue;
             
-            if (glucose_values[i] > start_gl) {
+            if (bands.past_start(i)) {
                 if (first_hyper_idx == -1) {
                     first_hyper_idx = i;
                 }
@@ -344,7 +338,7 @@ private:
         }
         
         // Check if window meets criteria: > start_gl for at least 90 minutes
-        if (duration_met(valid_hyper_count, required_duration, reading_minutes)) {
+        if (valid_hyper_count >= required_readings) {
 
             
             // Check if this window overlaps significantly with existing events
@@ -390,9 +384,9 @@ private:
                     bool recovery_found_between = false;
                     
                     for (int i = last_event_end_idx + 1; i < event_start_idx; ++i) {
-                        if (!valid_glucose[i]) continue;
+                        if (!bands.valid(i)) continue;
                         
-                        if (glucose_values[i] <= end_gl) {
+                        if (!bands.past_end(i)) {
                             recovery_found_between = true;
                             break;
                         }
@@ -413,23 +407,23 @@ private:
                 bool event_finalized = false;
                 
                 for (int i = recovery_scan_start; i < n_subset && !event_finalized; ++i) {
-                    if (!valid_glucose[i]) continue;
+                    if (!bands.valid(i)) continue;
                     
-                    if (glucose_values[i] <= end_gl) {
+                    if (!bands.past_end(i)) {
                         // Candidate recovery start - check whole recovery reading count.
                         int recovery_end_idx = -1;
                         int recovery_count = 0;
                         
                         for (int k = i; k < n_subset; k++) {
-                            if (!valid_glucose[k]) continue;
+                            if (!bands.valid(k)) continue;
                             
                             // Check if glucose rises above end_gl (recovery broken)
-                            if (glucose_values[k] > end_gl) {
+                            if (bands.past_end(k)) {
                                 break; // Recovery broken, exit inner loop to continue searching
                             }
 
                             ++recovery_count;
-                            if (duration_met(recovery_count, end_length, reading_minutes)) {
+                            if (recovery_count >= end_readings) {
                                 recovery_end_idx = k; // end of recovery period
                                 break;
                             }
@@ -439,7 +433,7 @@ private:
                         if (recovery_end_idx != -1) {
                             int reported_end_idx = event_end_idx;
                             for (int r = i - 1; r >= event_start_idx; --r) {
-                                if (valid_glucose[r]) {
+                                if (bands.valid(r)) {
                                     reported_end_idx = r;
                                     break;
                                 }
@@ -504,13 +498,14 @@ private:
 
     // Pre-allocate for expected events in this ID
     size_t estimated_events = event_starts.size();
-    if (total_event_data.size() + estimated_events > total_event_data.ids.capacity()) {
+    if (total_event_data.size() + estimated_events > total_event_data.id_codes.capacity()) {
       // Grow capacity efficiently
-      size_t new_capacity = std::max(total_event_data.ids.capacity() * 2,
+      size_t new_capacity = std::max(total_event_data.id_codes.capacity() * 2,
                                    total_event_data.size() + estimated_events);
       total_event_data.reserve(new_capacity);
     }
 
+    const int id_code = total_event_data.id_table.intern(current_id);
     for (size_t event_idx = 0; event_idx < event_starts.size(); ++event_idx) {
       int start_idx = event_starts[event_idx];
       int end_idx_for_metrics = reported_ends[event_idx];
@@ -518,7 +513,7 @@ private:
       if (start_idx >= 0 && start_idx < time_subset.length() &&
           end_idx_for_metrics >= start_idx && end_idx_for_metrics < time_subset.length()) {
         // Store in total_event_data
-        total_event_data.ids.push_back(current_id);
+        total_event_data.id_codes.push_back(id_code);
         total_event_data.start_times.push_back(time_subset[start_idx]);
         total_event_data.start_glucose.push_back(glucose_subset[start_idx]);
         total_event_data.end_times.push_back(time_subset[end_idx_for_metrics]);
@@ -526,7 +521,6 @@ private:
         total_event_data.start_indices.push_back(interpolated_row_offset + start_idx + 1);
         total_event_data.end_indices.push_back(interpolated_row_offset + end_idx_for_metrics + 1);
 
-        total_event_data.timezones.push_back(output_tzone);
 
         id_statistics[current_id].episode_times.push_back(time_subset[start_idx]);
       }
@@ -544,8 +538,8 @@ private:
     // Create POSIXct time vectors efficiently
     NumericVector start_time_vec = wrap(total_event_data.start_times);
     start_time_vec.attr("class") = CharacterVector::create("POSIXct", "POSIXt");
-    // Only set tzone attribute if all events share the same timezone
-    std::string tz0 = total_event_data.timezones.empty() ? output_tzone : total_event_data.timezones[0];
+    // Every event is reported in the output timezone
+    std::string tz0 = output_tzone;
     start_time_vec.attr("tzone") = tz0;
 
     NumericVector end_time_vec = wrap(total_event_data.end_times);
@@ -554,7 +548,7 @@ private:
 
 
     DataFrame df = DataFrame::create(
-      _["id"] = wrap(total_event_data.ids),
+      _["id"] = total_event_data.id_table.character(total_event_data.id_codes),
       _["start_time"] = start_time_vec,
       _["start_glucose"] = wrap(total_event_data.start_glucose),
       _["end_time"] = end_time_vec,
@@ -580,8 +574,13 @@ private:
     }
 
     // Count confirmed events collected from the interpolated grid
-    for (const std::string& event_id : total_event_data.ids) {
-      id_event_counts[event_id]++;
+    std::vector<int> counts_by_code(total_event_data.id_table.size(), 0);
+    for (int id_code : total_event_data.id_codes) {
+      ++counts_by_code[id_code];
+    }
+    for (size_t code = 0; code < counts_by_code.size(); ++code) {
+      id_event_counts[total_event_data.id_table.label(static_cast<int>(code))] +=
+        counts_by_code[code];
     }
 
     // Create vectors for DataFrame
@@ -650,7 +649,9 @@ public:
                                 bool sort_time = false,
                                 double inter_gap = 45,
                                 bool return_interpolated = true,
-                                bool lv1_excl = false) {
+                                bool lv1_excl = false,
+                                bool interpolated_factor_ids = false) {
+    profiler.clear();
     // Clear previous results
     total_event_data.clear();
     id_statistics.clear();
@@ -676,7 +677,10 @@ public:
 
     // --- Step 2: Group, optionally sort, and validate time order ---
     group_by_id(id, n);
-    cgmguru_events::sort_or_validate_id_indices(id_indices, time, sort_time);
+    {
+      cgmguru_profile::ScopedStage stage(profiler, "sort_or_validate");
+      cgmguru_events::sort_or_validate_id_indices(id_indices, time, sort_time);
+    }
 
     std::vector<std::string> unique_ids;
     unique_ids.reserve(id_indices.size());
@@ -685,6 +689,8 @@ public:
       interpolated_data.reserve_rows(static_cast<size_t>(n), id_indices.size(), false);
     }
 
+    // Reused by every subject to infer its reading interval
+    std::vector<double> interval_scratch;
     // Calculate hyperglycemic events for each ID separately to ensure proper boundaries
     for (auto const& id_pair : id_indices) {
       std::string current_id = id_pair.first;
@@ -692,20 +698,27 @@ public:
       unique_ids.push_back(current_id);
 
       double id_reading_minutes =
-        cgmguru_events::reading_minutes_for_id(reading_minutes_sexp, time, indices, n);
+        cgmguru_events::reading_minutes_for_id(reading_minutes_sexp, time, indices, n,
+                                               interval_scratch);
       id_reading_minutes =
         cgmguru_events::iglu_day_grid_reading_minutes(id_reading_minutes);
       const int min_readings = calculate_min_readings(id_reading_minutes, dur_length);
 
-      cgmguru_events::PreparedIDData prepared =
-        cgmguru_events::prepare_id_data(time, glucose, indices, id_reading_minutes,
-                                        inter_gap, output_tzone, true, true);
+      const int profile_subject = profiler.subject(current_id);
+      cgmguru_events::PreparedIDData prepared;
+      {
+        cgmguru_profile::ScopedStage stage(profiler, "prepare_id_data", profile_subject);
+        prepared = cgmguru_events::prepare_id_data(time, glucose, indices, id_reading_minutes,
+                                                   inter_gap, output_tzone, true, true);
+      }
       const int current_interpolated_row_offset = interpolated_row_offset;
       interpolated_row_offset += prepared.time.length();
       if (return_interpolated) {
         interpolated_data.append(current_id, prepared, false);
       }
 
+      // Detection and episode bookkeeping run to the end of this subject
+      cgmguru_profile::ScopedStage events_stage(profiler, "hyper_events", profile_subject);
       IntegerVector hyper_events_subset(prepared.time.length(), 0);
       std::vector<int> event_starts;
       std::vector<int> reported_ends;
@@ -780,8 +793,13 @@ public:
     }
 
     // --- Step 3: Create output structures ---
-    DataFrame hyper_events_total_df = create_hyper_events_total_df();
-    DataFrame events_total_df = create_events_total_df(unique_ids);
+    DataFrame hyper_events_total_df;
+    DataFrame events_total_df;
+    {
+      cgmguru_profile::ScopedStage stage(profiler, "summarize_events");
+      hyper_events_total_df = create_hyper_events_total_df();
+      events_total_df = create_events_total_df(unique_ids);
+    }
 
     List result = List::create(
       _["events_total"] = events_total_df,
@@ -789,7 +807,9 @@ public:
     );
 
     if (return_interpolated) {
-      result["interpolated_data"] = interpolated_data.to_dataframe(output_tzone, false);
+      cgmguru_profile::ScopedStage stage(profiler, "interpolated_data");
+      result["interpolated_data"] = interpolated_data.to_dataframe(output_tzone, false,
+                                                                  interpolated_factor_ids);
     }
 
     return result;
@@ -806,10 +826,18 @@ List detect_hyperglycemic_events(DataFrame df,
                               bool sort_time = false,
                               double inter_gap = 45,
                               bool return_interpolated = true,
-                              bool lv1_excl = false) {
+                              bool lv1_excl = false,
+                              bool interpolated_factor_ids = false,
+                              bool profile = false) {
   OptimizedHyperglycemicEventsCalculator calculator;
-  return calculator.calculate_with_parameters(df, reading_minutes, dur_length,
-                                              end_length, start_gl, end_gl,
-                                              sort_time, inter_gap,
-                                              return_interpolated, lv1_excl);
+  calculator.enable_profiling(profile);
+  List result = calculator.calculate_with_parameters(df, reading_minutes, dur_length,
+                                                     end_length, start_gl, end_gl,
+                                                     sort_time, inter_gap,
+                                                     return_interpolated, lv1_excl,
+                                                     interpolated_factor_ids);
+  if (profile) {
+    result.attr("profile") = calculator.profile_table();
+  }
+  return result;
 }
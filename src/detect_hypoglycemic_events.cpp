@@ -9,7 +9,9 @@ class OptimizedHypoglycemicEventsCalculator : public IdBasedCalculator {
 private:
   // Pre-allocated event storage with better memory layout
   struct EventData {
-    std::vector<std::string> ids;
+    // Subject ids are interned; each event keeps its subject's code
+    cgmguru_strings::StringTable id_table;
+    std::vector<int> id_codes;
     std::vector<double> start_times;
     std::vector<double> end_times;
     std::vector<double> start_glucose;
@@ -17,10 +19,9 @@ private:
     std::vector<int> start_indices;
     std::vector<int> end_indices;
     std::vector<double> duration_below_54_minutes;
-    std::vector<std::string> timezones;
 
     void reserve(size_t capacity) {
-      ids.reserve(capacity);
+      id_codes.reserve(capacity);
       start_times.reserve(capacity);
       end_times.reserve(capacity);
       start_glucose.reserve(capacity);
@@ -28,11 +29,11 @@ private:
       start_indices.reserve(capacity);
       end_indices.reserve(capacity);
       duration_below_54_minutes.reserve(capacity);
-      timezones.reserve(capacity);
     }
 
     void clear() {
-      ids.clear();
+      id_table.clear();
+      id_codes.clear();
       start_times.clear();
       end_times.clear();
       start_glucose.clear();
@@ -40,10 +41,9 @@ private:
       start_indices.clear();
       end_indices.clear();
       duration_below_54_minutes.clear();
-      timezones.clear();
     }
 
-    size_t size() const { return ids.size(); }
+    size_t size() const { return id_codes.size(); }
   };
 
   EventData total_event_data;
@@ -69,14 +69,12 @@ private:
   inline int calculate_min_readings(double reading_minutes, double dur_length = 120) const {
     const double tolerance_minutes = 0.1;
     const double effective_duration = std::max(0.0, dur_length - tolerance_minutes);
-    return static_cast<int>(std::ceil(effective_duration / reading_minutes));
-  }
-
-  inline bool duration_met(int reading_count, double duration_minutes,
-                           double reading_minutes) const {
-    const double tolerance_minutes = 0.1;
-    return static_cast<double>(reading_count) * reading_minutes +
-      tolerance_minutes >= duration_minutes;
+    const double readings = std::ceil(effective_duration / reading_minutes);
+    // Saturate instead of casting an infinite or out-of-range count
+    if (!(readings < static_cast<double>(std::numeric_limits<int>::max()))) {
+      return std::numeric_limits<int>::max();
+    }
+    return static_cast<int>(readings);
   }
 
   // Helper function to calculate duration below 54 mg/dL and average glucose during whole episode
@@ -131,15 +129,13 @@ private:
       );
     }
 
-    // Pre-allocate vectors for better performance
-    std::vector<bool> valid_glucose(n_subset);
-    std::vector<double> glucose_values(n_subset);
+    // Presence and threshold side of each reading, compared once
+    const cgmguru_events::GlucoseBands bands =
+      cgmguru_events::GlucoseBands::below(glucose_subset, start_gl);
 
-    // Single pass to identify valid glucose readings and cache values
-    for (int i = 0; i < n_subset; ++i) {
-      valid_glucose[i] = !NumericVector::is_na(glucose_subset[i]);
-      glucose_values[i] = valid_glucose[i] ? glucose_subset[i] : 0.0;
-    }
+    // Whole-reading counts that meet each duration, fixed for this call
+    const int dur_readings = cgmguru_events::readings_needed(dur_length, reading_minutes);
+    const int end_readings = cgmguru_events::readings_needed(end_length, reading_minutes);
 
     bool in_hypo_event = false;
     int event_start = -1;
@@ -147,11 +143,11 @@ private:
     int last_hypo_idx = -1; // last index where glucose < start_gl
 
     for (int i = 0; i < n_subset; ++i) {
-      if (!valid_glucose[i]) continue;
+      if (!bands.valid(i)) continue;
 
       if (!in_hypo_event) {
         // Looking for event start
-        if (glucose_values[i] < start_gl) {
+        if (bands.past_start(i)) {
           hypo_count = 1;
           event_start = i;
           last_hypo_idx = i;
@@ -159,12 +155,12 @@ private:
         }
       } else {
         // Currently in hypoglycemic event
-        if (glucose_values[i] < start_gl) {
+        if (bands.past_start(i)) {
           hypo_count++;
           last_hypo_idx = i;
         } else { // glucose >= 70 (recovery candidate)
           // 1) Validate low-phase by whole-number readings on the interpolated grid.
-          if (!duration_met(hypo_count, dur_length, reading_minutes)) {
+          if (hypo_count < dur_readings) {
             // Not enough consecutive low readings yet; CANCEL the event
             // because glucose exceeded threshold before meeting duration requirement
             in_hypo_event = false;
@@ -176,12 +172,12 @@ private:
             int recovery_end_idx = -1;
             int recovery_count = 0;
             for (int k = i; k < n_subset; ++k) {
-              if (!valid_glucose[k]) continue;
-              if (glucose_values[k] < start_gl) {
+              if (!bands.valid(k)) continue;
+              if (bands.past_start(k)) {
                 break;
               }
               ++recovery_count;
-              if (duration_met(recovery_count, end_length, reading_minutes)) {
+              if (recovery_count >= end_readings) {
                 recovery_end_idx = k; // end of recovery period
                 break;
               }
@@ -217,7 +213,7 @@ private:
     // iglu-compatible behavior: a qualifying event that reaches the segment end
     // is counted even without confirmed recovery.
     if (in_hypo_event && event_start != -1 &&
-        duration_met(hypo_count, dur_length, reading_minutes)) {
+        hypo_count >= dur_readings) {
       const int marker_end_idx = n_subset - 1;
       const int reported_end_idx =
         (last_hypo_idx >= event_start) ? last_hypo_idx : event_start;
@@ -277,13 +273,15 @@ private:
 
     // Pre-allocate for expected events in this ID
     size_t estimated_events = event_starts.size();
-    if (total_event_data.size() + estimated_events > total_event_data.ids.capacity()) {
+    if (total_event_data.size() + estimated_events > total_event_data.id_codes.capacity()) {
       // Grow capacity efficiently
-      size_t new_capacity = std::max(total_event_data.ids.capacity() * 2,
+      size_t new_capacity = std::max(total_event_data.id_codes.capacity() * 2,
                                    total_event_data.size() + estimated_events);
       total_event_data.reserve(new_capacity);
     }
 
+    const int id_code = total_event_data.id_table.intern(current_id);
+
     // Process events using pre-calculated bounds and metrics
     for (size_t event_idx = 0; event_idx < event_starts.size(); ++event_idx) {
       int start_idx = event_starts[event_idx];
@@ -295,7 +293,7 @@ private:
           end_idx >= 0 && end_idx < time_subset.length()) {
         
         // Store in total_event_data
-        total_event_data.ids.push_back(current_id);
+        total_event_data.id_codes.push_back(id_code);
         total_event_data.start_times.push_back(time_subset[start_idx]);
         total_event_data.start_glucose.push_back(glucose_subset[start_idx]);
         total_event_data.end_times.push_back(time_subset[end_idx]);
@@ -303,7 +301,6 @@ private:
         total_event_data.start_indices.push_back(interpolated_row_offset + start_idx + 1);
         total_event_data.end_indices.push_back(interpolated_row_offset + end_idx + 1);
         total_event_data.duration_below_54_minutes.push_back(duration_below_54);
-        total_event_data.timezones.push_back(output_tzone);
 
         id_statistics[current_id].episode_times.push_back(time_subset[start_idx]);
       }
@@ -321,7 +318,7 @@ private:
     // Create POSIXct time vectors efficiently
     NumericVector start_time_vec = wrap(total_event_data.start_times);
     start_time_vec.attr("class") = CharacterVector::create("POSIXct", "POSIXt");
-    // Use a single tzone attribute only if uniform across events
+    // Every event is reported in the output timezone
 
     std::string tz0 = output_tzone;
 
@@ -333,7 +330,7 @@ private:
 
 
     DataFrame df = DataFrame::create(
-      _["id"] = wrap(total_event_data.ids),
+      _["id"] = total_event_data.id_table.character(total_event_data.id_codes),
       _["start_time"] = start_time_vec,
       _["start_glucose"] = wrap(total_event_data.start_glucose),
       _["end_time"] = end_time_vec,
@@ -360,8 +357,13 @@ private:
     }
 
     // Count confirmed events collected from the interpolated grid
-    for (const std::string& event_id : total_event_data.ids) {
-      id_event_counts[event_id]++;
+    std::vector<int> counts_by_code(total_event_data.id_table.size(), 0);
+    for (int id_code : total_event_data.id_codes) {
+      ++counts_by_code[id_code];
+    }
+    for (size_t code = 0; code < counts_by_code.size(); ++code) {
+      id_event_counts[total_event_data.id_table.label(static_cast<int>(code))] +=
+        counts_by_code[code];
     }
 
     // Create vectors for DataFrame
@@ -426,7 +428,9 @@ public:
                                 bool sort_time = false,
                                 double inter_gap = 45,
                                 bool return_interpolated = true,
-                                bool lv1_excl = false) {
+                                bool lv1_excl = false,
+                                bool interpolated_factor_ids = false) {
+    profiler.clear();
     // Clear previous results
     total_event_data.clear();
     id_statistics.clear();
@@ -451,7 +455,10 @@ public:
 
     // --- Step 2: Group, optionally sort, and validate time order ---
     group_by_id(id, n);
-    cgmguru_events::sort_or_validate_id_indices(id_indices, time, sort_time);
+    {
+      cgmguru_profile::ScopedStage stage(profiler, "sort_or_validate");
+      cgmguru_events::sort_or_validate_id_indices(id_indices, time, sort_time);
+    }
 
     std::vector<std::string> unique_ids;
     unique_ids.reserve(id_indices.size());
@@ -460,6 +467,8 @@ public:
       interpolated_data.reserve_rows(static_cast<size_t>(n), id_indices.size(), false);
     }
 
+    // Reused by every subject to infer its reading interval
+    std::vector<double> interval_scratch;
     // Calculate hypoglycemic events for each ID separately to ensure proper boundaries
     for (auto const& id_pair : id_indices) {
       std::string current_id = id_pair.first;
@@ -467,7 +476,8 @@ public:
       unique_ids.push_back(current_id);
 
       double id_reading_minutes =
-        cgmguru_events::reading_minutes_for_id(reading_minutes_sexp, time, indices, n);
+        cgmguru_events::reading_minutes_for_id(reading_minutes_sexp, time, indices, n,
+                                               interval_scratch);
       id_reading_minutes =
         cgmguru_events::iglu_day_grid_reading_minutes(id_reading_minutes);
       double event_dur_length = dur_length;
@@ -478,15 +488,21 @@ public:
       const int min_readings =
         calculate_min_readings(id_reading_minutes, event_dur_length);
 
-      cgmguru_events::PreparedIDData prepared =
-        cgmguru_events::prepare_id_data(time, glucose, indices, id_reading_minutes,
-                                        inter_gap, output_tzone, true, true);
+      const int profile_subject = profiler.subject(current_id);
+      cgmguru_events::PreparedIDData prepared;
+      {
+        cgmguru_profile::ScopedStage stage(profiler, "prepare_id_data", profile_subject);
+        prepared = cgmguru_events::prepare_id_data(time, glucose, indices, id_reading_minutes,
+                                                   inter_gap, output_tzone, true, true);
+      }
       const int current_interpolated_row_offset = interpolated_row_offset;
       interpolated_row_offset += prepared.time.length();
       if (return_interpolated) {
         interpolated_data.append(current_id, prepared, false);
       }
 
+      // Detection and episode bookkeeping run to the end of this subject
+      cgmguru_profile::ScopedStage events_stage(profiler, "hypo_events", profile_subject);
       IntegerVector hypo_events_subset(prepared.time.length(), 0);
       std::vector<int> event_starts;
       std::vector<int> event_ends;
@@ -561,8 +577,13 @@ public:
     }
 
     // --- Step 3: Create output structures ---
-    DataFrame hypo_events_total_df = create_hypo_events_total_df();
-    DataFrame events_total_df = create_events_total_df(unique_ids);
+    DataFrame hypo_events_total_df;
+    DataFrame events_total_df;
+    {
+      cgmguru_profile::ScopedStage stage(profiler, "summarize_events");
+      hypo_events_total_df = create_hypo_events_total_df();
+      events_total_df = create_events_total_df(unique_ids);
+    }
 
     List result = List::create(
       _["events_total"] = events_total_df,
@@ -570,7 +591,9 @@ public:
     );
 
     if (return_interpolated) {
-      result["interpolated_data"] = interpolated_data.to_dataframe(output_tzone, false);
+      cgmguru_profile::ScopedStage stage(profiler, "interpolated_data");
+      result["interpolated_data"] = interpolated_data.to_dataframe(output_tzone, false,
+                                                                  interpolated_factor_ids);
     }
 
     return result;
@@ -586,10 +609,17 @@ List detect_hypoglycemic_events(DataFrame df,
                              bool sort_time = false,
                              double inter_gap = 45,
                              bool return_interpolated = true,
-                             bool lv1_excl = false) {
+                             bool lv1_excl = false,
+                             bool interpolated_factor_ids = false,
+                             bool profile = false) {
   OptimizedHypoglycemicEventsCalculator calculator;
-  return calculator.calculate_with_parameters(df, reading_minutes, dur_length,
-                                              end_length, start_gl, sort_time,
-                                              inter_gap, return_interpolated,
-                                              lv1_excl);
+  calculator.enable_profiling(profile);
+  List result = calculator.calculate_with_parameters(df, reading_minutes, dur_length,
+                                                     end_length, start_gl, sort_time,
+                                                     inter_gap, return_interpolated,
+                                                     lv1_excl, interpolated_factor_ids);
+  if (profile) {
+    result.attr("profile") = calculator.profile_table();
+  }
+  return result;
 }
@@ -2,8 +2,11 @@
 #define CGMGURU_EVENT_PREPROCESSING_H
 
 #include <Rcpp.h>
+#include "string_table.h"
+#include "timezone_rules.h"
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <map>
 #include <string>
@@ -24,71 +27,48 @@ struct PreparedIDData {
   double reading_minutes = 5.0;
 };
 
+// Interpolated grid rows collected subject by subject for the
+// interpolated_data output.
+//
+// The store keeps a reference to each subject's prepared time and glucose
+// vectors instead of copying their rows. Once every subject is in, the total
+// size is known: each output column is allocated once at that size, filled
+// from the chunks, and the chunks of that column are dropped before the next
+// column is allocated, so at most one extra column of chunks is alive while
+// the result is built. Ids are interned and stored as runs of codes, then
+// written either as a character column or as a factor (integer codes plus
+// levels).
 struct InterpolatedDataStore {
   struct IDRun {
-    std::string id;
+    int id_code;
     size_t length;
   };
 
+  struct Chunk {
+    Rcpp::NumericVector time;
+    Rcpp::NumericVector glucose;
+    Rcpp::IntegerVector segment;
+    double reading_minutes;
+  };
+
+  cgmguru_strings::StringTable id_table;
   std::vector<IDRun> id_runs;
-  std::vector<double> times;
-  std::vector<double> glucose;
-  std::vector<int> segments;
-  std::vector<double> reading_minutes;
+  std::vector<Chunk> chunks;
+  size_t n_rows = 0;
   bool metadata_available = true;
 
   void clear() {
+    id_table.clear();
     id_runs.clear();
-    times.clear();
-    glucose.clear();
-    segments.clear();
-    reading_minutes.clear();
+    chunks.clear();
+    n_rows = 0;
     metadata_available = true;
   }
 
-  void reserve_rows(size_t row_capacity, size_t run_capacity,
-                    bool include_metadata = true) {
+  void reserve_rows(size_t /* row_capacity */, size_t run_capacity,
+                    bool /* include_metadata */ = true) {
     id_runs.reserve(run_capacity);
-    times.reserve(row_capacity);
-    glucose.reserve(row_capacity);
-    if (include_metadata) {
-      segments.reserve(row_capacity);
-      reading_minutes.reserve(row_capacity);
-    }
-  }
-
-  static size_t grown_capacity(size_t current_capacity, size_t target_capacity) {
-    if (current_capacity >= target_capacity) {
-      return current_capacity;
-    }
-    size_t new_capacity = current_capacity == 0 ? target_capacity : current_capacity;
-    while (new_capacity < target_capacity) {
-      const size_t next_capacity = new_capacity + std::max<size_t>(new_capacity, 1024);
-      if (next_capacity <= new_capacity) {
-        return target_capacity;
-      }
-      new_capacity = next_capacity;
-    }
-    return new_capacity;
-  }
-
-  void reserve_for_append(size_t additional_rows, bool include_metadata) {
-    const size_t target_rows = times.size() + additional_rows;
-    const size_t target_runs = id_runs.size() + 1;
-
-    if (id_runs.capacity() < target_runs) {
-      id_runs.reserve(grown_capacity(id_runs.capacity(), target_runs));
-    }
-    if (times.capacity() < target_rows) {
-      const size_t new_capacity = grown_capacity(times.capacity(), target_rows);
-      times.reserve(new_capacity);
-      glucose.reserve(new_capacity);
-    }
-    if (include_metadata && segments.capacity() < target_rows) {
-      const size_t new_capacity = grown_capacity(segments.capacity(), target_rows);
-      segments.reserve(new_capacity);
-      reading_minutes.reserve(new_capacity);
-    }
+    chunks.reserve(run_capacity);
   }
 
   void append(const std::string& id, const PreparedIDData& prepared,
@@ -98,69 +78,111 @@ struct InterpolatedDataStore {
       return;
     }
 
-    reserve_for_append(static_cast<size_t>(n), include_metadata);
-
-    if (!id_runs.empty() && id_runs.back().id == id) {
+    const int id_code = id_table.intern(id);
+    if (!id_runs.empty() && id_runs.back().id_code == id_code) {
       id_runs.back().length += static_cast<size_t>(n);
     } else {
-      id_runs.push_back({id, static_cast<size_t>(n)});
+      id_runs.push_back({id_code, static_cast<size_t>(n)});
     }
 
     if (!include_metadata) {
       metadata_available = false;
     }
 
-    for (int i = 0; i < n; ++i) {
-      times.push_back(prepared.time[i]);
-      glucose.push_back(prepared.glucose[i]);
-      if (include_metadata) {
-        segments.push_back(prepared.segment[i]);
-        reading_minutes.push_back(prepared.reading_minutes);
-      }
-    }
+    // The prepared vectors are not written to after preparation, so sharing
+    // them is safe; segments are only kept when metadata is requested
+    chunks.push_back({prepared.time, prepared.glucose,
+                      include_metadata ? prepared.segment : Rcpp::IntegerVector(0),
+                      prepared.reading_minutes});
+    n_rows += static_cast<size_t>(n);
   }
 
+  // Builds the data frame and empties the store
   Rcpp::DataFrame to_dataframe(const std::string& tzone,
-                               bool include_metadata = true) const {
-    const R_xlen_t n = static_cast<R_xlen_t>(times.size());
-    Rcpp::CharacterVector id_vec(n);
-    R_xlen_t out_pos = 0;
-    for (const IDRun& run : id_runs) {
-      Rcpp::String id_string(run.id);
-      for (size_t i = 0; i < run.length; ++i) {
-        id_vec[out_pos++] = id_string;
-      }
+                               bool include_metadata = true,
+                               bool ids_as_factor = false) {
+    if (include_metadata && !metadata_available) {
+      Rcpp::stop("interpolated metadata was not stored");
     }
+    const R_xlen_t n = static_cast<R_xlen_t>(n_rows);
 
-    Rcpp::NumericVector time_vec = Rcpp::wrap(times);
+    Rcpp::NumericVector time_vec(n);
+    double* time_out = time_vec.begin();
+    for (Chunk& chunk : chunks) {
+      time_out = std::copy(chunk.time.begin(), chunk.time.end(), time_out);
+      chunk.time = Rcpp::NumericVector(0);
+    }
     time_vec.attr("class") = Rcpp::CharacterVector::create("POSIXct", "POSIXt");
     time_vec.attr("tzone") = tzone;
 
+    Rcpp::NumericVector gl_vec(n);
+    double* gl_out = gl_vec.begin();
+    for (Chunk& chunk : chunks) {
+      gl_out = std::copy(chunk.glucose.begin(), chunk.glucose.end(), gl_out);
+      chunk.glucose = Rcpp::NumericVector(0);
+    }
+
+    Rcpp::RObject id_vec = ids_as_factor ? id_factor(n) : id_character(n);
+
+    Rcpp::DataFrame df;
     if (!include_metadata) {
-      Rcpp::DataFrame df = Rcpp::DataFrame::create(
+      df = Rcpp::DataFrame::create(
+        Rcpp::_["id"] = id_vec,
+        Rcpp::_["time"] = time_vec,
+        Rcpp::_["gl"] = gl_vec
+      );
+    } else {
+      Rcpp::IntegerVector segment_vec(n);
+      Rcpp::NumericVector minutes_vec(n);
+      R_xlen_t out_pos = 0;
+      for (Chunk& chunk : chunks) {
+        const R_xlen_t chunk_rows = chunk.segment.size();
+        std::copy(chunk.segment.begin(), chunk.segment.end(),
+                  segment_vec.begin() + out_pos);
+        std::fill(minutes_vec.begin() + out_pos,
+                  minutes_vec.begin() + out_pos + chunk_rows, chunk.reading_minutes);
+        out_pos += chunk_rows;
+      }
+      df = Rcpp::DataFrame::create(
         Rcpp::_["id"] = id_vec,
         Rcpp::_["time"] = time_vec,
-        Rcpp::_["gl"] = Rcpp::wrap(glucose)
+        Rcpp::_["gl"] = gl_vec,
+        Rcpp::_["segment"] = segment_vec,
+        Rcpp::_["reading_minutes"] = minutes_vec
       );
-      df.attr("class") = Rcpp::CharacterVector::create("tbl_df", "tbl", "data.frame");
-      return df;
     }
+    df.attr("class") = Rcpp::CharacterVector::create("tbl_df", "tbl", "data.frame");
+    clear();
+    return df;
+  }
 
-    if (!metadata_available ||
-        segments.size() != times.size() ||
-        reading_minutes.size() != times.size()) {
-      Rcpp::stop("interpolated metadata was not stored");
+private:
+  // One CHARSXP per subject, shared by all of its rows
+  Rcpp::CharacterVector id_character(R_xlen_t n) const {
+    Rcpp::CharacterVector labels = id_table.levels();
+    Rcpp::CharacterVector id_vec(n);
+    R_xlen_t out_pos = 0;
+    for (const IDRun& run : id_runs) {
+      SEXP id_string = STRING_ELT(labels, run.id_code);
+      for (size_t i = 0; i < run.length; ++i) {
+        SET_STRING_ELT(id_vec, out_pos++, id_string);
+      }
     }
+    return id_vec;
+  }
 
-    Rcpp::DataFrame df = Rcpp::DataFrame::create(
-      Rcpp::_["id"] = id_vec,
-      Rcpp::_["time"] = time_vec,
-      Rcpp::_["gl"] = Rcpp::wrap(glucose),
-      Rcpp::_["segment"] = Rcpp::wrap(segments),
-      Rcpp::_["reading_minutes"] = Rcpp::wrap(reading_minutes)
-    );
-    df.attr("class") = Rcpp::CharacterVector::create("tbl_df", "tbl", "data.frame");
-    return df;
+  // Levels in the order the subjects appear in the output
+  Rcpp::IntegerVector id_factor(R_xlen_t n) const {
+    Rcpp::IntegerVector codes(n);
+    R_xlen_t out_pos = 0;
+    for (const IDRun& run : id_runs) {
+      std::fill(codes.begin() + out_pos,
+                codes.begin() + out_pos + static_cast<R_xlen_t>(run.length), run.id_code + 1);
+      out_pos += static_cast<R_xlen_t>(run.length);
+    }
+    codes.attr("levels") = id_table.levels();
+    codes.attr("class") = "factor";
+    return codes;
   }
 };
 
@@ -168,6 +190,177 @@ inline bool is_na(double value) {
   return Rcpp::NumericVector::is_na(value);
 }
 
+// The detectors' whole-reading duration rule: count readings on the grid
+// meet duration_minutes when count * reading_minutes + 0.1 >= duration_minutes.
+// The rule only gets truer as the count grows, so for one duration it holds
+// from a single count on. Kernels look that count up once per call and then
+// compare integers per reading. The cut-off is located with the same
+// floating-point expression, so the answers are identical to evaluating the
+// rule for every reading. Durations no int count can reach (infinite, NaN or
+// beyond INT_MAX readings) and unusable intervals return INT_MAX, which no
+// run of readings meets.
+inline int readings_needed(double duration_minutes, double reading_minutes) {
+  const int never = std::numeric_limits<int>::max();
+  if (!std::isfinite(reading_minutes) || reading_minutes <= 0.0) return never;
+  const double tolerance_minutes = 0.1;
+  const double estimate =
+    std::ceil((duration_minutes - tolerance_minutes) / reading_minutes);
+  if (std::isnan(estimate) || estimate >= static_cast<double>(never) - 1.0) {
+    return never;
+  }
+  auto met = [&](int count) {
+    return static_cast<double>(count) * reading_minutes + tolerance_minutes >=
+      duration_minutes;
+  };
+  int count = estimate > 0.0 ? static_cast<int>(estimate) : 0;
+  while (count > 0 && met(count - 1)) --count;
+  while (count < never && !met(count)) ++count;
+  return count;
+}
+
+// Largest count with count * reading_minutes <= window_minutes + 0.1: the
+// readings that fit in a window of the extended hyperglycemia kernel.
+// Windows longer than INT_MAX readings return INT_MAX; NaN windows and
+// unusable intervals fit none.
+inline int readings_within(double window_minutes, double reading_minutes) {
+  const int all = std::numeric_limits<int>::max();
+  if (!std::isfinite(reading_minutes) || reading_minutes <= 0.0) return 0;
+  const double tolerance_minutes = 0.1;
+  const double estimate =
+    std::floor((window_minutes + tolerance_minutes) / reading_minutes);
+  if (std::isnan(estimate)) return 0;
+  if (estimate >= static_cast<double>(all) - 1.0) return all;
+  auto fits = [&](int count) {
+    return static_cast<double>(count) * reading_minutes <=
+      window_minutes + tolerance_minutes;
+  };
+  int count = estimate > 0.0 ? static_cast<int>(estimate) : 0;
+  while (count > 0 && !fits(count)) --count;
+  while (count < all && fits(count + 1)) ++count;
+  return count;
+}
+
+// One byte per reading for the event scans.
+//
+// The level detectors only ever ask whether a reading is present and on
+// which side of the start and end thresholds it lies. GlucoseBands makes
+// those comparisons once per reading, in double precision, and keeps the
+// answers as bit flags, so the scans walk a byte per reading instead of a
+// double plus a validity flag. The thresholds are fixed for a detector call,
+// which is why the flags replace the values without changing any result.
+// Missing readings compare as 0 mg/dL, as the detectors' cached values did.
+class GlucoseBands {
+public:
+  // Hyperglycemia: past start means glucose > start_gl, past end > end_gl
+  static GlucoseBands above(const Rcpp::NumericVector& glucose, double start_gl,
+                            double end_gl) {
+    GlucoseBands bands(glucose.length());
+    for (R_xlen_t i = 0; i < glucose.length(); ++i) {
+      const bool valid = !is_na(glucose[i]);
+      const double value = valid ? glucose[i] : 0.0;
+      bands.storage_[i] = static_cast<std::uint8_t>(
+        (valid ? VALID : 0) | (value > start_gl ? PAST_START : 0) |
+        (value > end_gl ? PAST_END : 0)
+      );
+    }
+    return bands;
+  }
+
+  // Hypoglycemia: past start means glucose < start_gl
+  static GlucoseBands below(const Rcpp::NumericVector& glucose, double start_gl) {
+    GlucoseBands bands(glucose.length());
+    for (R_xlen_t i = 0; i < glucose.length(); ++i) {
+      const bool valid = !is_na(glucose[i]);
+      const double value = valid ? glucose[i] : 0.0;
+      bands.storage_[i] = static_cast<std::uint8_t>(
+        (valid ? VALID : 0) | (value < start_gl ? PAST_START : 0)
+      );
+    }
+    return bands;
+  }
+
+  // Moving keeps the vector's buffer, so a view into it stays valid
+  GlucoseBands(GlucoseBands&&) = default;
+  GlucoseBands(const GlucoseBands&) = delete;
+  GlucoseBands& operator=(const GlucoseBands&) = delete;
+
+  bool valid(int i) const { return (flags_[i] & VALID) != 0; }
+  bool past_start(int i) const { return (flags_[i] & start_mask_) != 0; }
+  bool past_end(int i) const { return (flags_[i] & end_mask_) != 0; }
+
+private:
+  friend class GlucoseLevels;
+
+  static const std::uint8_t VALID = 1;
+  static const std::uint8_t PAST_START = 2;
+  static const std::uint8_t PAST_END = 4;
+
+  explicit GlucoseBands(R_xlen_t n)
+    : storage_(static_cast<size_t>(n), 0), flags_(storage_.data()),
+      start_mask_(PAST_START), end_mask_(PAST_END) {}
+
+  GlucoseBands(const std::uint8_t* flags, std::uint8_t start_mask,
+               std::uint8_t end_mask)
+    : flags_(flags), start_mask_(start_mask), end_mask_(end_mask) {}
+
+  std::vector<std::uint8_t> storage_;
+  const std::uint8_t* flags_;
+  std::uint8_t start_mask_;
+  std::uint8_t end_mask_;
+};
+
+// The sides of all consensus thresholds (54 and 70 mg/dL below, 180 and
+// 250 mg/dL above) for each reading, classified in one pass. The six level
+// detectors of detect_all_events take their bands from here instead of each
+// comparing the subject's glucose again. Bit 0 is the same validity flag as
+// in GlucoseBands, so a band is a view with the level's bits as masks.
+class GlucoseLevels {
+public:
+  explicit GlucoseLevels(const Rcpp::NumericVector& glucose)
+    : flags_(static_cast<size_t>(glucose.length()), 0) {
+    for (R_xlen_t i = 0; i < glucose.length(); ++i) {
+      const bool valid = !is_na(glucose[i]);
+      const double value = valid ? glucose[i] : 0.0;
+      flags_[i] = static_cast<std::uint8_t>(
+        (valid ? GlucoseBands::VALID : 0) |
+        (value < 54.0 ? BELOW_54 : 0) | (value < 70.0 ? BELOW_70 : 0) |
+        (value > 180.0 ? ABOVE_180 : 0) | (value > 250.0 ? ABOVE_250 : 0)
+      );
+    }
+  }
+
+  // Bands of GlucoseBands::below(glucose, start_gl) from reading offset on
+  GlucoseBands below(double start_gl, int offset) const {
+    return GlucoseBands(flags_.data() + offset, below_bit(start_gl), 0);
+  }
+
+  // Bands of GlucoseBands::above(glucose, start_gl, end_gl) from offset on
+  GlucoseBands above(double start_gl, double end_gl, int offset) const {
+    return GlucoseBands(flags_.data() + offset, above_bit(start_gl),
+                        above_bit(end_gl));
+  }
+
+private:
+  static const std::uint8_t BELOW_54 = 2;
+  static const std::uint8_t BELOW_70 = 4;
+  static const std::uint8_t ABOVE_180 = 8;
+  static const std::uint8_t ABOVE_250 = 16;
+
+  static std::uint8_t below_bit(double threshold) {
+    if (threshold == 54.0) return BELOW_54;
+    if (threshold == 70.0) return BELOW_70;
+    Rcpp::stop("GlucoseLevels has no band below this threshold");
+  }
+
+  static std::uint8_t above_bit(double threshold) {
+    if (threshold == 180.0) return ABOVE_180;
+    if (threshold == 250.0) return ABOVE_250;
+    Rcpp::stop("GlucoseLevels has no band above this threshold");
+  }
+
+  std::vector<std::uint8_t> flags_;
+};
+
 inline void sort_or_validate_id_indices(std::map<std::string, std::vector<int>>& id_indices,
                                         const Rcpp::NumericVector& time,
                                         bool sort_time) {
@@ -189,11 +382,13 @@ inline void sort_or_validate_id_indices(std::map<std::string, std::vector<int>>&
   }
 }
 
+// Median positive interval between consecutive readings in minutes,
+// rounded to whole minutes. diffs is scratch space that callers reuse across
+// subjects; the median is selected in place rather than fully sorted.
 inline double median_positive_diff_minutes(const Rcpp::NumericVector& time,
-                                           const std::vector<int>& indices) {
-  std::vector<double> diffs;
-  diffs.reserve(indices.size() > 0 ? indices.size() - 1 : 0);
-
+                                           const std::vector<int>& indices,
+                                           std::vector<double>& diffs) {
+  diffs.clear();
   for (size_t i = 1; i < indices.size(); ++i) {
     const double prev_time = time[indices[i - 1]];
     const double current_time = time[indices[i]];
@@ -209,49 +404,67 @@ inline double median_positive_diff_minutes(const Rcpp::NumericVector& time,
     Rcpp::stop("reading_minutes could not be inferred: each id needs at least two distinct time points or an explicit reading_minutes value");
   }
 
-  std::sort(diffs.begin(), diffs.end());
   const size_t n = diffs.size();
-  const double median = (n % 2 == 1)
-    ? diffs[n / 2]
-    : (diffs[n / 2 - 1] + diffs[n / 2]) / 2.0;
+  std::nth_element(diffs.begin(), diffs.begin() + n / 2, diffs.end());
+  double median = diffs[n / 2];
+  if (n % 2 == 0) {
+    // Everything left of the upper middle value is no larger than it
+    median = (*std::max_element(diffs.begin(), diffs.begin() + n / 2) + median) / 2.0;
+  }
 
   const double rounded = std::round(median);
   return rounded > 0.0 ? rounded : median;
 }
 
+inline double median_positive_diff_minutes(const Rcpp::NumericVector& time,
+                                           const std::vector<int>& indices) {
+  std::vector<double> diffs;
+  diffs.reserve(indices.size() > 0 ? indices.size() - 1 : 0);
+  return median_positive_diff_minutes(time, indices, diffs);
+}
+
 inline double reading_minutes_for_id(SEXP reading_minutes_sexp,
                                      const Rcpp::NumericVector& time,
                                      const std::vector<int>& indices,
-                                     int full_length) {
+                                     int full_length,
+                                     std::vector<double>& diffs) {
   if (reading_minutes_sexp == R_NilValue) {
-    return median_positive_diff_minutes(time, indices);
+    return median_positive_diff_minutes(time, indices, diffs);
   }
 
   if (TYPEOF(reading_minutes_sexp) == INTSXP) {
-    Rcpp::IntegerVector reading_minutes_int = Rcpp::as<Rcpp::IntegerVector>(reading_minutes_sexp);
-    if (reading_minutes_int.length() == 1) {
-      return static_cast<double>(reading_minutes_int[0]);
+    const R_xlen_t length = Rf_xlength(reading_minutes_sexp);
+    if (length == 1) {
+      return static_cast<double>(INTEGER(reading_minutes_sexp)[0]);
     }
-    if (reading_minutes_int.length() != full_length) {
+    if (length != full_length) {
       Rcpp::stop("reading_minutes vector length must match data length");
     }
-    return static_cast<double>(reading_minutes_int[indices[0]]);
+    return static_cast<double>(INTEGER(reading_minutes_sexp)[indices[0]]);
   }
 
   if (TYPEOF(reading_minutes_sexp) == REALSXP) {
-    Rcpp::NumericVector reading_minutes_num = Rcpp::as<Rcpp::NumericVector>(reading_minutes_sexp);
-    if (reading_minutes_num.length() == 1) {
-      return reading_minutes_num[0];
+    const R_xlen_t length = Rf_xlength(reading_minutes_sexp);
+    if (length == 1) {
+      return REAL(reading_minutes_sexp)[0];
     }
-    if (reading_minutes_num.length() != full_length) {
+    if (length != full_length) {
       Rcpp::stop("reading_minutes vector length must match data length");
     }
-    return reading_minutes_num[indices[0]];
+    return REAL(reading_minutes_sexp)[indices[0]];
   }
 
   Rcpp::stop("reading_minutes must be numeric or integer");
 }
 
+inline double reading_minutes_for_id(SEXP reading_minutes_sexp,
+                                     const Rcpp::NumericVector& time,
+                                     const std::vector<int>& indices,
+                                     int full_length) {
+  std::vector<double> diffs;
+  return reading_minutes_for_id(reading_minutes_sexp, time, indices, full_length, diffs);
+}
+
 inline double recording_days(const Rcpp::NumericVector& glucose, double reading_minutes) {
   int valid_count = 0;
   for (int i = 0; i < glucose.length(); ++i) {
@@ -351,7 +564,9 @@ inline void compact_non_missing_rows(PreparedIDData& prepared) {
   }
 }
 
-inline double local_midnight(double time_value, const std::string& tzone) {
+// R-side conversion, kept for zones or DST edge cases the native resolver
+// declines (see cgmguru_tz::local_midnight)
+inline double local_midnight_r(double time_value, const std::string& tzone) {
   Rcpp::Environment base = Rcpp::Environment::base_env();
   Rcpp::Function as_posixlt = base["as.POSIXlt"];
   Rcpp::Function as_posixct = base["as.POSIXct"];
@@ -370,6 +585,16 @@ inline double local_midnight(double time_value, const std::string& tzone) {
   return out[0];
 }
 
+inline double local_midnight(double time_value, const std::string& tzone) {
+  const std::string tz = tzone.empty() ? "UTC" : tzone;
+  std::shared_ptr<const cgmguru_tz::TimeZoneRules> zone = cgmguru_tz::find_zone(tz);
+  double midnight = 0.0;
+  if (zone && cgmguru_tz::local_midnight(*zone, time_value, midnight)) {
+    return midnight;
+  }
+  return local_midnight_r(time_value, tz);
+}
+
 inline PreparedIDData prepare_id_data(const Rcpp::NumericVector& time,
                                       const Rcpp::NumericVector& glucose,
                                       const std::vector<int>& indices,
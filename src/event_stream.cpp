@@ -0,0 +1,177 @@
+#include <Rcpp.h>
+#include "event_stream.h"
+#include "id_grouping.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace Rcpp;
+
+namespace {
+
+struct EventStream {
+  double reading_minutes;
+  double inter_gap;
+  std::string tz;
+  std::map<std::string, cgmguru_stream::SubjectStream> subjects;
+};
+
+struct LabelledChange {
+  std::string id;
+  cgmguru_stream::EpisodeChange change;
+};
+
+EventStream* event_stream_from_sexp(SEXP stream) {
+  if (TYPEOF(stream) != EXTPTRSXP || R_ExternalPtrAddr(stream) == nullptr) {
+    stop("event stream is no longer valid; create a new one with event_stream()");
+  }
+  return static_cast<EventStream*>(R_ExternalPtrAddr(stream));
+}
+
+NumericVector posixct_column(const std::vector<double>& values,
+                             const std::string& tz) {
+  NumericVector out = wrap(values);
+  out.attr("class") = CharacterVector::create("POSIXct", "POSIXt");
+  out.attr("tzone") = tz;
+  return out;
+}
+
+DataFrame changes_to_dataframe(const std::vector<LabelledChange>& changes,
+                               const std::string& tz) {
+  const size_t n = changes.size();
+  std::vector<std::string> ids(n), types(n), levels(n), statuses(n);
+  std::vector<double> start_times(n), end_times(n);
+  LogicalVector recovered(n);
+
+  for (size_t i = 0; i < n; ++i) {
+    const cgmguru_stream::EpisodeChange& change = changes[i].change;
+    ids[i] = changes[i].id;
+    types[i] = cgmguru_stream::level_type(change.level);
+    levels[i] = cgmguru_stream::level_name(change.level);
+    statuses[i] = change.closed ? "closed" : "opened";
+    start_times[i] = change.start_time;
+    end_times[i] = change.closed ? change.end_time : NA_REAL;
+    recovered[i] = change.closed ? static_cast<int>(change.recovered) : NA_LOGICAL;
+  }
+
+  DataFrame out = DataFrame::create(
+    _["id"] = wrap(ids),
+    _["type"] = wrap(types),
+    _["level"] = wrap(levels),
+    _["status"] = wrap(statuses),
+    _["start_time"] = posixct_column(start_times, tz),
+    _["end_time"] = posixct_column(end_times, tz),
+    _["recovered"] = recovered
+  );
+  out.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+  return out;
+}
+
+} // namespace
+
+// [[Rcpp::export]]
+SEXP event_stream_create_cpp(double reading_minutes = 5,
+                             double inter_gap = 45,
+                             std::string tz = "UTC") {
+  if (!(reading_minutes > 0)) {
+    stop("reading_minutes must be a positive number");
+  }
+  if (!(inter_gap >= 0)) {
+    stop("inter_gap must be a non-negative number");
+  }
+
+  EventStream* stream = new EventStream();
+  stream->reading_minutes =
+    cgmguru_events::iglu_day_grid_reading_minutes(reading_minutes);
+  stream->inter_gap = inter_gap;
+  stream->tz = tz.empty() ? "UTC" : tz;
+
+  XPtr<EventStream> ptr(stream, true);
+  ptr.attr("class") = CharacterVector::create("cgmguru_event_stream");
+  return ptr;
+}
+
+// [[Rcpp::export]]
+DataFrame event_stream_update_cpp(SEXP stream, DataFrame df) {
+  EventStream* state = event_stream_from_sexp(stream);
+
+  if (!df.containsElementNamed("id") || !df.containsElementNamed("time") ||
+      !df.containsElementNamed("gl")) {
+    stop("df must contain id, time and gl columns");
+  }
+  SEXP id = df["id"];
+  NumericVector time = df["time"];
+  NumericVector glucose = df["gl"];
+  const R_xlen_t n = time.size();
+
+  const double* time_ptr = time.begin();
+  const double* gl_ptr = glucose.begin();
+  cgmguru_ids::IdGroups groups = cgmguru_ids::group_rows_by_id(
+    id, n, true, [&](R_xlen_t i) {
+      return !cgmguru_events::is_na(time_ptr[i]) &&
+        !cgmguru_events::is_na(gl_ptr[i]);
+    }
+  );
+
+  // Validate every subject before touching any state, so a rejected batch
+  // leaves the stream exactly as it was
+  for (size_t g = 0; g < groups.size(); ++g) {
+    auto found = state->subjects.find(groups.labels[g]);
+    double previous = found == state->subjects.end() ?
+      NA_REAL : found->second.last_time();
+    for (const int* row = groups.group_begin(g); row != groups.group_end(g); ++row) {
+      const double t = time_ptr[*row];
+      if (!cgmguru_events::is_na(previous) && t < previous - 1e-7) {
+        stop("time must be nondecreasing within each id and must not precede "
+             "readings already sent to the stream (id '" +
+             groups.labels[g] + "')");
+      }
+      previous = t;
+    }
+  }
+
+  std::vector<LabelledChange> changes;
+  std::vector<cgmguru_stream::EpisodeChange> subject_changes;
+  for (size_t g = 0; g < groups.size(); ++g) {
+    const std::string& label = groups.labels[g];
+    auto found = state->subjects.find(label);
+    if (found == state->subjects.end()) {
+      const double first_time = time_ptr[*groups.group_begin(g)];
+      const double origin = cgmguru_events::local_midnight(first_time, state->tz) +
+        state->reading_minutes * 60.0;
+      found = state->subjects.emplace(
+        label,
+        cgmguru_stream::SubjectStream(origin, state->reading_minutes,
+                                      state->inter_gap)
+      ).first;
+    }
+
+    subject_changes.clear();
+    for (const int* row = groups.group_begin(g); row != groups.group_end(g); ++row) {
+      found->second.add_reading(time_ptr[*row], gl_ptr[*row], subject_changes);
+    }
+    for (const cgmguru_stream::EpisodeChange& change : subject_changes) {
+      changes.push_back({label, change});
+    }
+  }
+
+  return changes_to_dataframe(changes, state->tz);
+}
+
+// [[Rcpp::export]]
+DataFrame event_stream_flush_cpp(SEXP stream) {
+  EventStream* state = event_stream_from_sexp(stream);
+
+  std::vector<LabelledChange> changes;
+  std::vector<cgmguru_stream::EpisodeChange> subject_changes;
+  for (auto& subject : state->subjects) {
+    subject_changes.clear();
+    subject.second.close_segment(subject_changes);
+    for (const cgmguru_stream::EpisodeChange& change : subject_changes) {
+      changes.push_back({subject.first, change});
+    }
+  }
+
+  return changes_to_dataframe(changes, state->tz);
+}
@@ -0,0 +1,515 @@
+#ifndef CGMGURU_EVENT_STREAM_H
+#define CGMGURU_EVENT_STREAM_H
+
+#include "event_preprocessing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Incremental versions of the detect_all_events consensus level detectors.
+//
+// Each subject keeps the state of its iglu day grid (last source reading and
+// next grid point) and of every level state machine, so appending readings
+// only touches the new grid points. Within a gap-free segment the machines
+// follow the batch kernels in detect_all_events.cpp: an episode is "opened"
+// once its duration requirement is met and "closed" when the end_length
+// recovery is confirmed, or when the segment ends at a gap or on flush.
+// Nothing here calls the R API.
+namespace cgmguru_stream {
+
+enum EventLevel {
+  HYPO_LV1 = 0,
+  HYPO_LV2,
+  HYPO_EXTENDED,
+  HYPER_LV1,
+  HYPER_LV2,
+  HYPER_EXTENDED,
+  N_EVENT_LEVELS
+};
+
+inline const char* level_type(int level) {
+  return level <= HYPO_EXTENDED ? "hypo" : "hyper";
+}
+
+inline const char* level_name(int level) {
+  switch (level) {
+  case HYPO_LV1:
+  case HYPER_LV1:
+    return "lv1";
+  case HYPO_LV2:
+  case HYPER_LV2:
+    return "lv2";
+  default:
+    return "extended";
+  }
+}
+
+struct GridPoint {
+  long long index;  // position within the current segment
+  double time;
+  double glucose;
+};
+
+struct EpisodeChange {
+  int level;
+  bool closed;
+  bool recovered;
+  double start_time;
+  double end_time;  // reported end as in events_detailed; NA_REAL while opened
+};
+
+// Hypoglycemia: calculate_hypoglycemic_events
+class HypoDetector {
+public:
+  HypoDetector(int level, double start_gl, double dur_length,
+               double end_length, double reporting_gl, double reading_minutes)
+    : level_(level), start_gl_(start_gl),
+      dur_readings_(cgmguru_events::readings_needed(dur_length, reading_minutes)),
+      end_readings_(cgmguru_events::readings_needed(end_length, reading_minutes)),
+      reporting_gl_(reporting_gl) {}
+
+  void push(const GridPoint& point, std::vector<EpisodeChange>& out) {
+    const double gl = point.glucose;
+    if (!in_event_) {
+      if (gl < start_gl_) {
+        in_event_ = true;
+        opened_ = false;
+        low_count_ = 1;
+        recovery_count_ = 0;
+        start_time_ = point.time;
+        last_in_range_time_ = point.time;
+        open_if_met(out);
+      }
+      return;
+    }
+
+    if (gl < start_gl_) {
+      ++low_count_;
+      recovery_count_ = 0;
+      if (gl < reporting_gl_) last_in_range_time_ = point.time;
+      open_if_met(out);
+      return;
+    }
+
+    if (!opened_) {
+      // Recovered before the low phase lasted dur_length: not an episode
+      in_event_ = false;
+      return;
+    }
+
+    ++recovery_count_;
+    if (recovery_count_ >= end_readings_) {
+      out.push_back({level_, true, true, start_time_, last_in_range_time_});
+      in_event_ = false;
+    }
+  }
+
+  void close_segment(std::vector<EpisodeChange>& out) {
+    if (in_event_ && opened_) {
+      out.push_back({level_, true, false, start_time_, last_in_range_time_});
+    }
+    in_event_ = false;
+  }
+
+private:
+  void open_if_met(std::vector<EpisodeChange>& out) {
+    if (!opened_ && low_count_ >= dur_readings_) {
+      opened_ = true;
+      out.push_back({level_, false, false, start_time_, NA_REAL});
+    }
+  }
+
+  int level_;
+  double start_gl_;
+  int dur_readings_;
+  int end_readings_;
+  double reporting_gl_;
+
+  bool in_event_ = false;
+  bool opened_ = false;
+  int low_count_ = 0;
+  int recovery_count_ = 0;
+  double start_time_ = NA_REAL;
+  double last_in_range_time_ = NA_REAL;
+};
+
+// Level 1/2 hyperglycemia: calculate_hyperglycemic_events. A core run above
+// start_gl opens the episode once it lasts dur_length; later cores before a
+// confirmed recovery are merged into it. As in the batch kernel, an episode
+// still open when its segment ends is reported up to the end of the core
+// that opened it.
+class HyperDetector {
+public:
+  HyperDetector(int level, double start_gl, double end_gl, double dur_length,
+                double end_length, double reporting_gl, double reading_minutes)
+    : level_(level), start_gl_(start_gl), end_gl_(end_gl),
+      dur_readings_(cgmguru_events::readings_needed(dur_length, reading_minutes)),
+      end_readings_(cgmguru_events::readings_needed(end_length, reading_minutes)),
+      reporting_gl_(reporting_gl) {}
+
+  void push(const GridPoint& point, std::vector<EpisodeChange>& out) {
+    const double gl = point.glucose;
+    if (opened_) {
+      if (gl > reporting_gl_) last_in_range_time_ = point.time;
+      if (in_core_ && gl > start_gl_) {
+        core_end_time_ = point.time;
+      } else {
+        in_core_ = false;
+      }
+      if (gl > end_gl_) {
+        recovery_count_ = 0;
+        return;
+      }
+      ++recovery_count_;
+      if (recovery_count_ >= end_readings_) {
+        out.push_back({level_, true, true, start_time_, last_in_range_time_});
+        opened_ = false;
+      }
+      return;
+    }
+
+    if (gl <= start_gl_) {
+      in_core_ = false;
+      return;
+    }
+
+    if (!in_core_) {
+      in_core_ = true;
+      core_count_ = 0;
+      start_time_ = point.time;
+      last_in_range_time_ = point.time;
+    }
+    ++core_count_;
+    if (gl > reporting_gl_) last_in_range_time_ = point.time;
+    if (core_count_ >= dur_readings_) {
+      opened_ = true;
+      core_end_time_ = point.time;
+      recovery_count_ = 0;
+      out.push_back({level_, false, false, start_time_, NA_REAL});
+    }
+  }
+
+  void close_segment(std::vector<EpisodeChange>& out) {
+    if (opened_) {
+      out.push_back({level_, true, false, start_time_, core_end_time_});
+    }
+    opened_ = false;
+    in_core_ = false;
+  }
+
+private:
+  int level_;
+  double start_gl_;
+  double end_gl_;
+  int dur_readings_;
+  int end_readings_;
+  double reporting_gl_;
+
+  bool in_core_ = false;
+  bool opened_ = false;
+  int core_count_ = 0;
+  int recovery_count_ = 0;
+  double start_time_ = NA_REAL;
+  double core_end_time_ = NA_REAL;
+  double last_in_range_time_ = NA_REAL;
+};
+
+// Extended hyperglycemia: calculate_hyperglycemic_events_window. A window of
+// dur_length minutes starting at grid point W can only be judged once its
+// last point has arrived, so the detector keeps the last window of points and
+// evaluates the window that just completed on every push. Windows cut short
+// by the end of a segment are evaluated when the segment closes, and an
+// episode still open then is reported up to the end of its opening core.
+class HyperWindowDetector {
+public:
+  HyperWindowDetector(int level, double start_gl, double end_gl,
+                      double dur_length, double end_length, double reporting_gl,
+                      double reading_minutes)
+    : level_(level), start_gl_(start_gl), end_gl_(end_gl),
+      window_points_(std::max(1, cgmguru_events::readings_within(dur_length,
+                                                                  reading_minutes))),
+      window_readings_(cgmguru_events::readings_needed(dur_length * 3.0 / 4.0,
+                                                       reading_minutes)),
+      end_readings_(cgmguru_events::readings_needed(end_length, reading_minutes)),
+      reporting_gl_(reporting_gl) {}
+
+  void push(const GridPoint& point, std::vector<EpisodeChange>& out) {
+    buffer_.push_back(point);
+    while (static_cast<long long>(buffer_.size()) > window_points_) {
+      buffer_.pop_front();
+    }
+
+    if (opened_) {
+      advance_recovery(point, out);
+    }
+
+    const long long window_start = point.index - window_points_ + 1;
+    if (window_start >= 0) {
+      evaluate_window(window_start, point.index, out);
+    }
+  }
+
+  void close_segment(std::vector<EpisodeChange>& out) {
+    if (!buffer_.empty()) {
+      const long long segment_end = buffer_.back().index;
+      const long long first_short =
+        std::max(buffer_.front().index, segment_end - window_points_ + 2);
+      for (long long w = first_short; w < segment_end; ++w) {
+        evaluate_window(w, segment_end, out);
+      }
+    }
+    if (opened_) {
+      out.push_back({level_, true, false, start_time_, core_end_time_});
+    }
+    opened_ = false;
+    last_close_index_ = -1;
+    buffer_.clear();
+    cores_.clear();
+  }
+
+private:
+  struct CoreEvent {
+    long long start_idx;
+    long long end_idx;
+    double start_time;
+    double end_time;
+  };
+
+  const GridPoint& at(long long index) const {
+    return buffer_[static_cast<size_t>(index - buffer_.front().index)];
+  }
+
+  void advance_recovery(const GridPoint& point, std::vector<EpisodeChange>& out) {
+    if (point.glucose > reporting_gl_) last_in_range_time_ = point.time;
+    if (point.glucose > end_gl_) {
+      recovery_count_ = 0;
+      return;
+    }
+    ++recovery_count_;
+    if (recovery_count_ >= end_readings_) {
+      out.push_back({level_, true, true, start_time_, last_in_range_time_});
+      opened_ = false;
+      last_close_index_ = point.index;
+    }
+  }
+
+  void evaluate_window(long long window_start, long long window_end,
+                       std::vector<EpisodeChange>& out) {
+    if (window_end <= window_start) return;
+
+    int hyper_count = 0;
+    long long first_hyper = -1;
+    long long last_hyper = -1;
+    for (long long i = window_start; i <= window_end; ++i) {
+      if (at(i).glucose > start_gl_) {
+        if (first_hyper < 0) first_hyper = i;
+        last_hyper = i;
+        ++hyper_count;
+      }
+    }
+    if (hyper_count < window_readings_) {
+      return;
+    }
+
+    // Cores that ended before this window can never overlap a later one
+    const double window_start_time = at(window_start).time;
+    const double window_end_time = at(window_end).time;
+    while (!cores_.empty() && cores_.front().end_time <= window_start_time) {
+      cores_.pop_front();
+    }
+    const double window_duration = window_end_time - window_start_time;
+    for (const CoreEvent& existing : cores_) {
+      const double overlap = std::min(window_end_time, existing.end_time) -
+        std::max(window_start_time, existing.start_time);
+      if (overlap > 0.5 * std::min(window_duration,
+                                   existing.end_time - existing.start_time)) {
+        return;
+      }
+    }
+
+    const CoreEvent core = {first_hyper, last_hyper, at(first_hyper).time,
+                            at(last_hyper).time};
+    cores_.push_back(core);
+
+    // Cores found before the open episode recovers are merged into it
+    if (opened_ || core.start_idx <= last_close_index_) return;
+
+    opened_ = true;
+    recovery_count_ = 0;
+    start_time_ = core.start_time;
+    core_end_time_ = core.end_time;
+    last_in_range_time_ = core.start_time;
+    for (long long i = core.start_idx; i <= core.end_idx; ++i) {
+      if (at(i).glucose > reporting_gl_) last_in_range_time_ = at(i).time;
+    }
+    out.push_back({level_, false, false, start_time_, NA_REAL});
+
+    const long long newest = buffer_.back().index;
+    for (long long i = core.end_idx + 1; i <= newest && opened_; ++i) {
+      advance_recovery(at(i), out);
+    }
+  }
+
+  int level_;
+  double start_gl_;
+  double end_gl_;
+  long long window_points_;
+  int window_readings_;
+  int end_readings_;
+  double reporting_gl_;
+
+  std::deque<GridPoint> buffer_;
+  std::deque<CoreEvent> cores_;
+  bool opened_ = false;
+  int recovery_count_ = 0;
+  long long last_close_index_ = -1;
+  double start_time_ = NA_REAL;
+  double core_end_time_ = NA_REAL;
+  double last_in_range_time_ = NA_REAL;
+};
+
+// All consensus levels of one subject, fed one grid point at a time. The grid
+// interval is fixed for the subject, so every detector turns its durations
+// into reading counts (readings_needed() and readings_within() in
+// event_preprocessing.h) once here and compares integers on each push.
+class LevelDetectors {
+public:
+  explicit LevelDetectors(double reading_minutes)
+    : hypo_lv1_(HYPO_LV1, 70, 15, 15, 70, reading_minutes),
+      hypo_lv2_(HYPO_LV2, 54, 15, 15, 54, reading_minutes),
+      hypo_extended_(HYPO_EXTENDED, 70, 120 + reading_minutes, 15, 70, reading_minutes),
+      hyper_lv1_(HYPER_LV1, 180, 180, 15, 15, 180, reading_minutes),
+      hyper_lv2_(HYPER_LV2, 250, 250, 15, 15, 250, reading_minutes),
+      hyper_extended_(HYPER_EXTENDED, 250, 180, 120, 15, 180, reading_minutes) {}
+
+  void push(const GridPoint& point, std::vector<EpisodeChange>& out) {
+    hypo_lv1_.push(point, out);
+    hypo_lv2_.push(point, out);
+    hypo_extended_.push(point, out);
+    hyper_lv1_.push(point, out);
+    hyper_lv2_.push(point, out);
+    hyper_extended_.push(point, out);
+  }
+
+  void close_segment(std::vector<EpisodeChange>& out) {
+    hypo_lv1_.close_segment(out);
+    hypo_lv2_.close_segment(out);
+    hypo_extended_.close_segment(out);
+    hyper_lv1_.close_segment(out);
+    hyper_lv2_.close_segment(out);
+    hyper_extended_.close_segment(out);
+  }
+
+private:
+  HypoDetector hypo_lv1_;
+  HypoDetector hypo_lv2_;
+  HypoDetector hypo_extended_;
+  HyperDetector hyper_lv1_;
+  HyperDetector hyper_lv2_;
+  HyperWindowDetector hyper_extended_;
+};
+
+// Resamples one subject's readings onto the iglu day grid used by
+// prepare_id_data and feeds the grid points to its level detectors. The grid
+// origin (first local midnight plus one interval) is fixed by the caller from
+// the first reading.
+class SubjectStream {
+public:
+  SubjectStream(double grid_origin, double reading_minutes, double inter_gap)
+    : grid_origin_(grid_origin),
+      dt_seconds_(reading_minutes * 60.0),
+      time_epsilon_(std::max(1e-7, reading_minutes * 60.0 * 1e-6)),
+      inter_gap_(inter_gap),
+      detectors_(reading_minutes) {}
+
+  double last_time() const { return started_ ? last_time_ : NA_REAL; }
+
+  // time must not be earlier than last_time(); duplicates are ignored
+  void add_reading(double time, double glucose, std::vector<EpisodeChange>& out) {
+    if (started_ && std::fabs(time - last_time_) < 1e-7) return;
+
+    if (!started_) {
+      started_ = true;
+      next_grid_ = first_grid_at_or_after(time - time_epsilon_);
+    } else if ((time - last_time_) / 60.0 > inter_gap_ + 1e-7) {
+      // Every grid point strictly inside a long gap is missing
+      const long long resume = first_grid_at_or_after(time - time_epsilon_);
+      if (resume > next_grid_ &&
+          grid_time(next_grid_) < time - time_epsilon_) {
+        close_segment(out);
+      }
+      next_grid_ = std::max(next_grid_, resume);
+    }
+
+    while (grid_time(next_grid_) <= time + time_epsilon_) {
+      const double target = grid_time(next_grid_);
+      double value = NA_REAL;
+      if (std::fabs(target - time) <= time_epsilon_) {
+        value = glucose;
+      } else if (has_previous_ && std::fabs(target - last_time_) <= time_epsilon_) {
+        value = last_glucose_;
+      } else if (has_previous_ && target > last_time_ && target < time &&
+                 (time - last_time_) / 60.0 <= inter_gap_ + 1e-7) {
+        const double fraction = (target - last_time_) / (time - last_time_);
+        value = last_glucose_ + fraction * (glucose - last_glucose_);
+      }
+      push_grid_point(target, value, out);
+      ++next_grid_;
+    }
+
+    has_previous_ = true;
+    last_time_ = time;
+    last_glucose_ = glucose;
+  }
+
+  void close_segment(std::vector<EpisodeChange>& out) {
+    if (segment_points_ > 0) {
+      detectors_.close_segment(out);
+    }
+    segment_points_ = 0;
+  }
+
+private:
+  double grid_time(long long k) const {
+    return grid_origin_ + static_cast<double>(k) * dt_seconds_;
+  }
+
+  long long first_grid_at_or_after(double time) const {
+    long long k = static_cast<long long>(std::ceil((time - grid_origin_) /
+                                                   dt_seconds_));
+    if (k < 0) k = 0;
+    while (k > 0 && grid_time(k - 1) >= time) --k;
+    while (grid_time(k) < time) ++k;
+    return k;
+  }
+
+  void push_grid_point(double time, double glucose,
+                       std::vector<EpisodeChange>& out) {
+    if (Rcpp::NumericVector::is_na(glucose)) {
+      close_segment(out);
+      return;
+    }
+    detectors_.push({segment_points_, time, glucose}, out);
+    ++segment_points_;
+  }
+
+  double grid_origin_;
+  double dt_seconds_;
+  double time_epsilon_;
+  double inter_gap_;
+  LevelDetectors detectors_;
+
+  bool started_ = false;
+  bool has_previous_ = false;
+  double last_time_ = 0.0;
+  double last_glucose_ = 0.0;
+  long long next_grid_ = 0;
+  long long segment_points_ = 0;
+};
+
+} // namespace cgmguru_stream
+
+#endif // CGMGURU_EVENT_STREAM_H
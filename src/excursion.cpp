@@ -1,6 +1,10 @@
+#include "grid_context.h"
 #include "id_based_calculator.h"
+#include "parallel_executor.h"
+#include "window_search.h"
 
 #include <cmath>
+#include <memory>
 
 using namespace Rcpp;
 using namespace std;
@@ -18,41 +22,50 @@ private:
   std::vector<int> total_episode_indices;
   std::vector<int> total_episode_maxima_indices;
 
-  // Calculate Excursion for a single ID
-  IntegerVector calculate_excursion_for_id(const NumericVector& time_subset,
-                                     const NumericVector& gl_subset,
-                                     double gap) {
-    int n_subset = time_subset.length();
-    IntegerVector excursion_subset(n_subset, 0);
-
-    if (n_subset < 4) return excursion_subset; // Need at least 4 points
-
-    IntegerVector excursion(n_subset, 0);
-    bool condition_met = false;
+  // Calculate Excursion for a single ID (plain buffers only; runs on worker threads)
+  //
+  // A reading j >= 3 starts an excursion when it and the previous reading are
+  // at least 70 mg/dL and some reading in the following 2 hours rises more
+  // than 70 mg/dL above it; the start then marks every reading within gap
+  // minutes of it, and marked readings are not tested again. The 2-hour
+  // maximum comes from a monotonic deque and marks are kept in a difference
+  // array, so each reading is visited a constant number of times when time
+  // is sorted. Window edges use the same "elapsed <= limit" tests as the
+  // original nested scans, so rounding cannot move them.
+  std::vector<int> calculate_excursion_for_id(cgmguru_columns::DoubleSpan time_subset,
+                                              cgmguru_columns::DoubleSpan gl_subset,
+                                              double gap) const {
+    int n_subset = static_cast<int>(time_subset.size());
+    std::vector<int> excursion(n_subset, 0);
+
+    if (n_subset < 4) return excursion; // Need at least 4 points
+
+    const bool time_sorted = cgmguru_window::is_nondecreasing(time_subset);
+    cgmguru_window::ElapsedWindowEnd peak_window_end(time_subset, 7200, time_sorted);
+    cgmguru_window::ElapsedWindowEnd mark_window_end(time_subset, gap * 60, time_sorted);
+    cgmguru_window::WindowExtreme<cgmguru_window::Greater> peak(gl_subset, R_NegInf, true);
+
+    // Marked windows still open at j; mark_delta[l] closes them at l
+    std::vector<int> mark_delta(n_subset + 1, 0);
+    int open_marks = 0;
     for (int j = 0; j < n_subset; ++j) {
-        if (j < 3 || NumericVector::is_na(gl_subset[j])) {
-          excursion[j] = 0;
-        } else {
-          if (excursion[j] != 1) {
-          if (j == 0) {
-            excursion[j] = 0;
-          } else if (NumericVector::is_na(gl_subset[j - 1]) ||
-                     NumericVector::is_na(gl_subset[j])) { // Corrected check for NA
-            excursion[j] = 0;
-          } else if (gl_subset[j - 1] < 70 || gl_subset[j] < 70) {
-            excursion[j] = 0;
-          } else {
-            condition_met = false;
-            for (int k = j + 1; k < n_subset && (time_subset[k] - time_subset[j]) <= 7200; ++k) {
-              if (gl_subset[k] > gl_subset[j] + 70) {
-                condition_met = true;
-              }
-              if (condition_met) {
-                for (int l = j; l < n_subset && (time_subset[l] - time_subset[j]) <= gap*60; ++l) {
-                  excursion[l] = 1;
-                }
-              }
-            }
+      open_marks += mark_delta[j];
+      if (j < 3 || NumericVector::is_na(gl_subset[j])) {
+        excursion[j] = 0;
+      } else if (open_marks > 0) {
+        excursion[j] = 1;
+      } else if (NumericVector::is_na(gl_subset[j - 1]) ||
+                 gl_subset[j - 1] < 70 || gl_subset[j] < 70) {
+        excursion[j] = 0;
+      } else {
+        const int peak_end = peak_window_end(j, j + 1);
+        const int peak_pos = peak.query(j + 1, peak_end);
+        if (peak_pos >= 0 && gl_subset[peak_pos] > gl_subset[j] + 70) {
+          const int mark_end = mark_window_end(j, j);
+          if (mark_end >= j) {
+            mark_delta[mark_end + 1] -= 1;
+            open_marks += 1;
+            excursion[j] = 1;
           }
         }
       }
@@ -61,8 +74,8 @@ private:
     return excursion;
   }
 
-  void find_peak_within_two_hours(const NumericVector& time_subset,
-                                  const NumericVector& gl_subset,
+  void find_peak_within_two_hours(cgmguru_columns::DoubleSpan time_subset,
+                                  cgmguru_columns::DoubleSpan gl_subset,
                                   const std::vector<int>& original_indices,
                                   int start_pos,
                                   double& maxima_time,
@@ -74,7 +87,8 @@ private:
     time_to_peak_min = NA_REAL;
     maxima_index = NA_INTEGER;
 
-    if (start_pos < 0 || start_pos >= time_subset.length() ||
+    const int n_subset = static_cast<int>(time_subset.size());
+    if (start_pos < 0 || start_pos >= n_subset ||
         NumericVector::is_na(time_subset[start_pos])) {
       return;
     }
@@ -84,7 +98,7 @@ private:
     double best_gl = R_NegInf;
     int best_pos = -1;
 
-    for (int i = start_pos; i < time_subset.length(); ++i) {
+    for (int i = start_pos; i < n_subset; ++i) {
       if (NumericVector::is_na(time_subset[i])) {
         continue;
       }
@@ -113,15 +127,15 @@ private:
 
   // Enhanced episode processing that also stores data for total DataFrame
   void process_episodes_with_total(const std::string& current_id,
-                                 const IntegerVector& result_subset,
-                                 const NumericVector& time_subset,
-                                 const NumericVector& gl_subset) {
+                                 const std::vector<int>& result_subset,
+                                 cgmguru_columns::DoubleSpan time_subset,
+                                 cgmguru_columns::DoubleSpan gl_subset) {
     // First do the standard episode processing
     process_episodes(current_id, result_subset, time_subset, gl_subset);
 
     // Then collect data for total DataFrame
     const std::vector<int>& indices = id_indices[current_id];
-    for (int i = 0; i < result_subset.length(); ++i) {
+    for (int i = 0; i < static_cast<int>(result_subset.size()); ++i) {
       bool is_episode_start = (result_subset[i] == 1) &&
                              (i == 0 || result_subset[i-1] == 0);
 
@@ -186,8 +200,7 @@ private:
     return df;
   }
 
-public:
-  List calculate(const DataFrame& df, double gap) {
+  List calculate_excursion(const cgmguru_grid::GridContext& context, double gap, int n_threads) {
     // Clear total episode storage
     total_episode_ids.clear();
     total_episode_times.clear();
@@ -198,68 +211,49 @@ public:
     total_episode_indices.clear();
     total_episode_maxima_indices.clear();
 
-    // --- Step 1: Extract columns from DataFrame ---
-    int n = df.nrows();
-    StringVector id = df["id"];
-    NumericVector time = df["time"];
-    NumericVector gl = df["gl"];
-    // Optional timezone column
-    bool has_tz_col = df.containsElementNamed("tz");
-    CharacterVector tz_col;
-    if (has_tz_col) {
-      tz_col = df["tz"];
-    }
-
-    // Default timezone from time's tzone attribute or UTC
-    std::string default_tz = "UTC";
-    RObject tz_attr = time.attr("tzone");
-    if (!tz_attr.isNULL()) {
-      CharacterVector tz_attr_cv = as<CharacterVector>(tz_attr);
-      if (tz_attr_cv.size() > 0 && !CharacterVector::is_na(tz_attr_cv[0])) {
-        default_tz = as<std::string>(tz_attr_cv[0]);
-      }
-    }
+    // --- Step 1: Rows and the default timezone come from the context ---
+    int n = context.n_rows();
+    const std::string& default_tz = context.default_tz();
 
     // --- Step 2: Separate calculation by ID ---
-    group_by_id(id, n);
-    std::map<std::string, IntegerVector> id_excursion_results;
+    use_id_grouping(context.groups());
 
     // Build per-id timezone map
     std::map<std::string, std::string> id_timezones;
 
-    // Calculate excursion for each ID separately
-    for (auto const& id_pair : id_indices) {
-      std::string current_id = id_pair.first;
-      const std::vector<int>& indices = id_pair.second;
-
-      // Extract subset data for this ID
-      NumericVector time_subset(indices.size());
-      NumericVector gl_subset(indices.size());
-      extract_id_subset(current_id, indices, time, gl, time_subset, gl_subset);
-
-      // Assign timezone for this id (first row's tz if available; else default)
-      std::string tz_for_id = default_tz;
-      if (has_tz_col && !indices.empty()) {
-        int idx0 = indices.front();
-        if (idx0 >= 0 && idx0 < tz_col.size() && !CharacterVector::is_na(tz_col[idx0])) {
-          tz_for_id = as<std::string>(tz_col[idx0]);
-        }
-      }
-      if (tz_for_id.empty()) tz_for_id = default_tz;
-      id_timezones[current_id] = tz_for_id;
+    // Calculate excursion for each ID separately; the kernels only see the
+    // context's per-subject buffers so they can be spread over worker threads
+    std::vector<const IdGroup*> groups = ordered_id_groups();
+    std::vector<cgmguru_columns::DoubleSpan> time_subsets(groups.size());
+    std::vector<cgmguru_columns::DoubleSpan> gl_subsets(groups.size());
+    std::vector<std::vector<int>> excursion_subsets(groups.size());
+
+    {
+      cgmguru_profile::ScopedStage stage(profiler, "excursion_marks");
+      cgmguru_parallel::parallel_for(groups.size(), n_threads, [&](std::size_t k) {
+        time_subsets[k] = context.subject_time(k);
+        gl_subsets[k] = context.subject_gl(k);
+        excursion_subsets[k] = calculate_excursion_for_id(time_subsets[k], gl_subsets[k], gap);
+      });
+    }
 
-      // Calculate excursion for this ID
-      IntegerVector excursion_subset = calculate_excursion_for_id(time_subset, gl_subset, gap);
+    // Episode bookkeeping stays serial and in map order
+    for (std::size_t k = 0; k < groups.size(); ++k) {
+      const std::string& current_id = groups[k]->first;
+      cgmguru_profile::ScopedStage stage(profiler, "episodes", profiler.subject(current_id));
 
-      // Store result
-      id_excursion_results[current_id] = excursion_subset;
+      // First row's tz if available; else default
+      id_timezones[current_id] = context.subject_tz(k);
 
       // Process episodes for this ID (both standard and total)
-      process_episodes_with_total(current_id, excursion_subset, time_subset, gl_subset);
+      process_episodes_with_total(current_id, excursion_subsets[k], time_subsets[k], gl_subsets[k]);
     }
 
+    // Merging and the output tables run to the end of the call
+    cgmguru_profile::ScopedStage output_stage(profiler, "output_tables");
+
     // --- Step 3: Merge results back to original order ---
-    IntegerVector excursion_final = merge_results(id_excursion_results, n);
+    IntegerVector excursion_final = merge_ordered_results(excursion_subsets, n);
 
     // --- Step 4: Create output structures ---
     DataFrame counts_df = create_episode_counts_df();
@@ -305,10 +299,44 @@ public:
       _["episode_start"] = episode_start_total_df
     );
   }
+
+public:
+  List calculate(const DataFrame& df, double gap, int n_threads = 1) {
+    profiler.clear();
+    std::unique_ptr<cgmguru_grid::GridContext> context;
+    {
+      cgmguru_profile::ScopedStage stage(profiler, "grid_context");
+      context.reset(new cgmguru_grid::GridContext(df));
+    }
+    return calculate_excursion(*context, gap, n_threads);
+  }
+
+  List calculate(const cgmguru_grid::GridContext& context, double gap, int n_threads = 1) {
+    profiler.clear();
+    return calculate_excursion(context, gap, n_threads);
+  }
 };
 
 // [[Rcpp::export]]
-List excursion(DataFrame df, double gap = 15) {
+List excursion(DataFrame df, double gap = 15, int n_threads = 1, bool profile = false) {
   ExcursionCalculator calculator;
-  return calculator.calculate(df, gap);
+  calculator.enable_profiling(profile);
+  List result = calculator.calculate(df, gap, n_threads);
+  if (profile) {
+    result.attr("profile") = calculator.profile_table();
+  }
+  return result;
+}
+
+// [[Rcpp::export]]
+List grid_context_excursion_cpp(SEXP context, double gap = 15, int n_threads = 1,
+                                bool profile = false) {
+  ExcursionCalculator calculator;
+  calculator.enable_profiling(profile);
+  List result = calculator.calculate(*cgmguru_grid::grid_context_from_sexp(context), gap,
+                                     n_threads);
+  if (profile) {
+    result.attr("profile") = calculator.profile_table();
+  }
+  return result;
 }
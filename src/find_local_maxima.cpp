@@ -1,124 +1,55 @@
+#include "grid_context.h"
 #include "id_based_calculator.h"
 
+#include <memory>
+
 using namespace Rcpp;
 using namespace std;
 
 // LocalMaxima-specific calculator class
 class LocalMaximaCalculator : public IdBasedCalculator {
 private:
-  // Find local maxima for a single ID - returns binary vector
-  IntegerVector find_local_maxima_for_id(const NumericVector& gl_subset) {
-    int n_subset = gl_subset.length();
-    IntegerVector local_maxima_binary(n_subset, 0); // Initialize with 0s
-
-    if (n_subset < 5) return local_maxima_binary; // Need at least 5 points for the algorithm
-
-    // Calculate differences (equivalent to diff() in R)
-    NumericVector differ_glucose(n_subset - 1);
-    for (int i = 0; i < n_subset - 1; ++i) {
-      if (NumericVector::is_na(gl_subset[i]) || NumericVector::is_na(gl_subset[i+1])) {
-        differ_glucose[i] = NA_REAL;
-      } else {
-        differ_glucose[i] = gl_subset[i+1] - gl_subset[i];
-      }
-    }
-
-    // Find local maxima following your R logic
-    // For i in 1:(nrow(grad_df)-2), but we skip i==1,2,3 (in R indexing)
-    // In C++ 0-based indexing: skip i==0,1,2 and check from i=3 to n_subset-3
-    for (int i = 3; i < n_subset - 2; ++i) {
-      // Check if we have valid differences at all required positions
-      if (!NumericVector::is_na(differ_glucose[i-2]) &&
-          !NumericVector::is_na(differ_glucose[i-1]) &&
-          !NumericVector::is_na(differ_glucose[i]) &&
-          !NumericVector::is_na(differ_glucose[i+1])) {
-
-        // Apply the condition:
-        // differ_glucose[i-2]>=0 & differ_glucose[i-1]>=0 &
-        // differ_glucose[i]<=0 & differ_glucose[i+1]<=0
-        if (differ_glucose[i-2] >= 0 &&
-            differ_glucose[i-1] >= 0 &&
-            differ_glucose[i] <= 0 &&
-            differ_glucose[i+1] <= 0) {
-          local_maxima_binary[i] = 1; // Mark as local maximum
-        }
-      }
-    }
-
-    return local_maxima_binary;
-  }
-
-public:
-  List calculate(const DataFrame& df) {
-    // --- Step 1: Extract columns from DataFrame ---
-    int n = df.nrows();
-    StringVector id = df["id"];
-    NumericVector time = df["time"];
-    NumericVector gl = df["gl"];
-    // Optional timezone column
-    bool has_tz_col = df.containsElementNamed("tz");
-    CharacterVector tz_col;
-    if (has_tz_col) {
-      tz_col = df["tz"];
-    }
-
-    // Default timezone from time's tzone attribute or UTC
-    std::string default_tz = "UTC";
-    RObject tz_attr = time.attr("tzone");
-    if (!tz_attr.isNULL()) {
-      CharacterVector tz_attr_cv = as<CharacterVector>(tz_attr);
-      if (tz_attr_cv.size() > 0 && !CharacterVector::is_na(tz_attr_cv[0])) {
-        default_tz = as<std::string>(tz_attr_cv[0]);
-      }
-    }
+  List calculate_local_maxima(cgmguru_grid::GridContext& context, int n_threads) {
+    // --- Step 1: Rows, grouping and timezones come from the context ---
+    int n = context.n_rows();
+    const std::string& default_tz = context.default_tz();
 
     // --- Step 2: Separate calculation by ID ---
-    group_by_id(id, n);
-    std::map<std::string, IntegerVector> id_maxima_results;
+    use_id_grouping(context.groups());
     // Build per-id timezone map
     std::map<std::string, std::string> id_timezones;
 
-    // Find local maxima for each ID separately
-    for (auto const& id_pair : id_indices) {
-      std::string current_id = id_pair.first;
-      const std::vector<int>& indices = id_pair.second;
-
-      // Extract subset data for this ID
-      NumericVector time_subset(indices.size());
-      NumericVector gl_subset(indices.size());
-      extract_id_subset(current_id, indices, time, gl, time_subset, gl_subset);
-
-      // Assign timezone for this id (first row's tz if available; else default)
-      std::string tz_for_id = default_tz;
-      if (has_tz_col && !indices.empty()) {
-        int idx0 = indices.front();
-        if (idx0 >= 0 && idx0 < tz_col.size() && !CharacterVector::is_na(tz_col[idx0])) {
-          tz_for_id = as<std::string>(tz_col[idx0]);
-        }
-      }
-      if (tz_for_id.empty()) tz_for_id = default_tz;
-      id_timezones[current_id] = tz_for_id;
-
-      // Find local maxima for this ID
-      IntegerVector maxima_subset = find_local_maxima_for_id(gl_subset);
+    // Local maxima for each ID (local_maxima_marks() in grid_engine.h); the
+    // kernels only see plain buffers so they can be spread over worker
+    // threads, and a reused context computes them once
+    std::vector<const IdGroup*> groups = ordered_id_groups();
+    const std::vector<std::vector<int>>* maxima = nullptr;
+    {
+      cgmguru_profile::ScopedStage stage(profiler, "local_maxima");
+      maxima = &context.local_maxima(n_threads);
+    }
+    const std::vector<std::vector<int>>& maxima_subsets = *maxima;
 
-      // Store result
-      id_maxima_results[current_id] = maxima_subset;
+    for (std::size_t k = 0; k < groups.size(); ++k) {
+      id_timezones[groups[k]->first] = context.subject_tz(k);
     }
 
+    // Merging and the output tables run to the end of the call
+    cgmguru_profile::ScopedStage output_stage(profiler, "output_tables");
+
     // --- Step 3: Merge results back to original order ---
-    IntegerVector local_maxima_final = merge_results(id_maxima_results, n);
+    IntegerVector local_maxima_final = merge_ordered_results(maxima_subsets, n);
 
     // --- Step 4: Create results organized by ID (optional, for backward compatibility) ---
     List result_by_id = List::create();
-    for (auto const& id_pair : id_indices) {
-      std::string current_id = id_pair.first;
-      const std::vector<int>& indices = id_pair.second;
-      IntegerVector maxima_subset = id_maxima_results[current_id];
+    for (std::size_t k = 0; k < groups.size(); ++k) {
+      const std::string& current_id = groups[k]->first;
+      const std::vector<int>& indices = groups[k]->second;
+      const std::vector<int>& maxima_subset = maxima_subsets[k];
 
       // Convert binary vector to indices for this ID
       std::vector<int> local_maxima_indices;
-      for (int i = 0; i < maxima_subset.length(); ++i) {
+      for (size_t i = 0; i < maxima_subset.size(); ++i) {
         if (maxima_subset[i] == 1) {
           local_maxima_indices.push_back(indices[i] + 1); // R-style 1-based indexing
         }
@@ -133,11 +64,14 @@ public:
     std::vector<double> merged_gls;
     std::vector<int> merged_id_indices;
 
+    // Selected rows are read back through their subject and position
+    const std::vector<int> row_positions = id_grouping.row_positions();
     for (int i = 0; i < n; ++i) {
       if (local_maxima_final[i] == 1) {
-        merged_ids.push_back(as<std::string>(id[i]));
-        merged_times.push_back(time[i]);
-        merged_gls.push_back(gl[i]);
+        const int g = id_grouping.row_group[i];
+        merged_ids.push_back(id_grouping.labels[g]);
+        merged_times.push_back(context.subject_time(g)[row_positions[i]]);
+        merged_gls.push_back(context.subject_gl(g)[row_positions[i]]);
         merged_id_indices.push_back(i + 1); // R-style 1-based indexing
       }
     }
@@ -193,10 +127,42 @@ public:
       _["merged_results"] = merged_results
     );
   }
+
+public:
+  List calculate(const DataFrame& df, int n_threads = 1) {
+    profiler.clear();
+    std::unique_ptr<cgmguru_grid::GridContext> context;
+    {
+      cgmguru_profile::ScopedStage stage(profiler, "grid_context");
+      context.reset(new cgmguru_grid::GridContext(df));
+    }
+    return calculate_local_maxima(*context, n_threads);
+  }
+
+  List calculate(cgmguru_grid::GridContext& context, int n_threads = 1) {
+    profiler.clear();
+    return calculate_local_maxima(context, n_threads);
+  }
 };
 
 // [[Rcpp::export]]
-List find_local_maxima(DataFrame df) {
+List find_local_maxima(DataFrame df, int n_threads = 1, bool profile = false) {
+  LocalMaximaCalculator calculator;
+  calculator.enable_profiling(profile);
+  List result = calculator.calculate(df, n_threads);
+  if (profile) {
+    result.attr("profile") = calculator.profile_table();
+  }
+  return result;
+}
+
+// [[Rcpp::export]]
+List grid_context_local_maxima_cpp(SEXP context, int n_threads = 1, bool profile = false) {
   LocalMaximaCalculator calculator;
-  return calculator.calculate(df);
+  calculator.enable_profiling(profile);
+  List result = calculator.calculate(*cgmguru_grid::grid_context_from_sexp(context), n_threads);
+  if (profile) {
+    result.attr("profile") = calculator.profile_table();
+  }
+  return result;
 }
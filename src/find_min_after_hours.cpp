@@ -1,4 +1,8 @@
+#include "grid_context.h"
 #include "id_based_calculator.h"
+#include "window_search.h"
+
+#include <memory>
 
 using namespace Rcpp;
 using namespace std;
@@ -13,15 +17,18 @@ private:
   std::vector<int> total_episode_indices;
 
   // Calculate min after hours for a single ID
-  IntegerVector calculate_min_after_hours_for_id(const NumericVector& time_subset,
-                                                const NumericVector& gl_subset,
-                                                const IntegerVector& start_points_subset,
-                                                double hours) {
-    int n_subset = time_subset.length();
+  std::vector<int> calculate_min_after_hours_for_id(cgmguru_columns::DoubleSpan time_subset,
+                                                   cgmguru_columns::DoubleSpan gl_subset,
+                                                   const std::vector<int>& start_points_subset,
+                                                   double hours) const {
+    int n_subset = static_cast<int>(time_subset.size());
     std::vector<int> min_indices; // Store R indices (1-based) instead of binary vector
-    int n_starts = start_points_subset.size();
-    int start_index, end_index, gl_min_point, j, next_start_index;
-    double min_value, window_last_time, next_point_time;
+    int n_starts = static_cast<int>(start_points_subset.size());
+    int start_index, end_index, gl_min_point, next_start_index;
+    double window_last_time, next_point_time;
+    const bool time_sorted = cgmguru_window::is_nondecreasing(time_subset);
+    // Ties go to the earliest index, as in the original forward scan
+    cgmguru_window::WindowExtreme<cgmguru_window::Less> extreme(gl_subset, R_PosInf, true);
 
     for (int i = 0; i < n_starts; ++i) {
       start_index = start_points_subset[i] - 1; // Convert to 0-based indexing
@@ -32,17 +39,13 @@ private:
       }
 
       end_index = 0;
-      min_value = R_PosInf;
       gl_min_point = start_index;
       window_last_time = time_subset[start_index] + (hours * 60 * 60); // Adding hours in seconds
 
       if (i == n_starts - 1) {
         // Last start point
-        j = start_index;
-        while (j < n_subset && time_subset[j] <= window_last_time) {
-          j++;
-        }
-        end_index = j - 1;
+        end_index = cgmguru_window::forward_window_end(time_subset, start_index,
+                                                       window_last_time, time_sorted);
       } else {
         // Not the last start point
         next_start_index = start_points_subset[i + 1] - 1;
@@ -51,27 +54,19 @@ private:
           if ((next_point_time - time_subset[start_index]) < (hours * 60 * 60)) {
             end_index = next_start_index;
           } else {
-            j = start_index;
-            while (j < n_subset && time_subset[j] <= window_last_time) {
-              j++;
-            }
-            end_index = j - 1;
+            end_index = cgmguru_window::forward_window_end(time_subset, start_index,
+                                                           window_last_time, time_sorted);
           }
         } else {
-          j = start_index;
-          while (j < n_subset && time_subset[j] <= window_last_time) {
-            j++;
-          }
-          end_index = j - 1;
+          end_index = cgmguru_window::forward_window_end(time_subset, start_index,
+                                                         window_last_time, time_sorted);
         }
       }
 
       // Find minimum in the range
-      for (int j = start_index; j <= end_index && j < n_subset; ++j) {
-        if (!NumericVector::is_na(gl_subset[j]) && gl_subset[j] < min_value) {
-          min_value = gl_subset[j];
-          gl_min_point = j;
-        }
+      const int best = extreme.query(start_index, end_index);
+      if (best >= 0) {
+        gl_min_point = best;
       }
 
       // Store the minimum point index (convert to 1-based R index)
@@ -80,20 +75,20 @@ private:
       }
     }
 
-    return wrap(min_indices);
+    return min_indices;
   }
 
   // Enhanced episode processing that also stores data for total DataFrame
   void process_episodes_with_total(const std::string& current_id,
-                                 const IntegerVector& binary_result,
-                                 const NumericVector& time_subset,
-                                 const NumericVector& gl_subset) {
+                                 const std::vector<int>& binary_result,
+                                 cgmguru_columns::DoubleSpan time_subset,
+                                 cgmguru_columns::DoubleSpan gl_subset) {
     // First do the standard episode processing
     process_episodes(current_id, binary_result, time_subset, gl_subset);
 
     // Then collect data for total DataFrame
     const std::vector<int>& indices = id_indices[current_id];
-    for (int i = 0; i < binary_result.length(); ++i) {
+    for (int i = 0; i < static_cast<int>(binary_result.size()); ++i) {
       bool is_episode_start = (binary_result[i] == 1) &&
                              (i == 0 || binary_result[i-1] == 0);
 
@@ -129,102 +124,66 @@ private:
     return df;
   }
 
-public:
-  List calculate(const DataFrame& df, const IntegerVector& start_point, double hours) {
+  List calculate_hours(const cgmguru_grid::GridContext& context, const IntegerVector& start_point,
+                       double hours) {
     // Clear total episode storage
     total_episode_ids.clear();
     total_episode_times.clear();
     total_episode_gls.clear();
     total_episode_indices.clear();
 
-    // --- Step 1: Extract columns from DataFrame ---
-    int n = df.nrows();
-    StringVector id = df["id"];
-    NumericVector time = df["time"];
-    NumericVector gl = df["gl"];
-    // Optional timezone column
-    bool has_tz_col = df.containsElementNamed("tz");
-    CharacterVector tz_col;
-    if (has_tz_col) {
-      tz_col = df["tz"];
-    }
-
-    // Default timezone from time's tzone attribute or UTC
-    std::string default_tz = "UTC";
-    RObject tz_attr = time.attr("tzone");
-    if (!tz_attr.isNULL()) {
-      CharacterVector tz_attr_cv = as<CharacterVector>(tz_attr);
-      if (tz_attr_cv.size() > 0 && !CharacterVector::is_na(tz_attr_cv[0])) {
-        default_tz = as<std::string>(tz_attr_cv[0]);
-      }
-    }
-
-    // --- Step 2: Group start points by ID ---
-    std::map<std::string, std::vector<int>> id_start_points;
-    std::string current_id;
-
-    // Group start points by ID
-    for (int i = 0; i < start_point.size(); ++i) {
-      int idx = start_point[i] - 1; // Convert to 0-based indexing
-      if (idx >= 0 && idx < n) {
-        current_id = as<std::string>(id[idx]);
-        id_start_points[current_id].push_back(start_point[i]); // Keep 1-based for consistency
+    // --- Step 1: Rows and the default timezone come from the context ---
+    int n = context.n_rows();
+    const std::string& default_tz = context.default_tz();
+
+    // --- Step 2: Group rows and route start points by ID ---
+    use_id_grouping(context.groups());
+    // Every start point goes to its ID as a 1-based subset position in one
+    // pass, instead of searching the ID's rows for each start point
+    std::vector<std::vector<int>> id_start_points(id_grouping.size());
+    {
+      const std::vector<int> row_positions = id_grouping.row_positions();
+      for (int i = 0; i < start_point.size(); ++i) {
+        if (start_point[i] == NA_INTEGER) continue;
+        const int row = start_point[i] - 1; // Convert to 0-based indexing
+        if (row < 0 || row >= n || id_grouping.row_group[row] < 0) continue;
+        id_start_points[id_grouping.row_group[row]].push_back(row_positions[row] + 1);
       }
     }
 
     // --- Step 3: Separate calculation by ID ---
-    group_by_id(id, n);
-    std::map<std::string, IntegerVector> id_min_results;
-    int original_idx, subset_idx;
-    std::vector<int> start_points_for_id;
+    std::string current_id;
+    std::map<std::string, std::vector<int>> id_min_results;
+    std::size_t group_pos = 0;
     // Build per-id timezone map
     std::map<std::string, std::string> id_timezones;
     // Calculate min after hours for each ID separately
     for (auto const& id_pair : id_indices) {
       current_id = id_pair.first;
       const std::vector<int>& indices = id_pair.second;
+      const std::size_t k = group_pos++;
+      cgmguru_profile::ScopedStage stage(profiler, "window_search", profiler.subject(current_id));
 
-      // Extract subset data for this ID
-      NumericVector time_subset(indices.size());
-      NumericVector gl_subset(indices.size());
-      extract_id_subset(current_id, indices, time, gl, time_subset, gl_subset);
-
-      // Assign timezone for this id (first row's tz if available; else default)
-      std::string tz_for_id = default_tz;
-      if (has_tz_col && !indices.empty()) {
-        int idx0 = indices.front();
-        if (idx0 >= 0 && idx0 < tz_col.size() && !CharacterVector::is_na(tz_col[idx0])) {
-          tz_for_id = as<std::string>(tz_col[idx0]);
-        }
-      }
-      if (tz_for_id.empty()) tz_for_id = default_tz;
-      id_timezones[current_id] = tz_for_id;
-
-      // Get start points for this ID and convert to subset indices
-      start_points_for_id.clear();
-      if (id_start_points.find(current_id) != id_start_points.end()) {
-        for (int sp : id_start_points[current_id]) {
-          original_idx = sp - 1; // Convert to 0-based
-          // Find corresponding index in subset
-          auto it = std::find(indices.begin(), indices.end(), original_idx);
-          if (it != indices.end()) {
-            subset_idx = std::distance(indices.begin(), it) + 1; // Convert to 1-based for subset
-            start_points_for_id.push_back(subset_idx);
-          }
-        }
-      }
+      // The context views this ID's data in place when its rows are contiguous
+      cgmguru_columns::DoubleSpan time_subset = context.subject_time(k);
+      cgmguru_columns::DoubleSpan gl_subset = context.subject_gl(k);
+
+      // First row's tz if available; else default
+      id_timezones[current_id] = context.subject_tz(k);
+
+      // Start points of this ID as 1-based subset indices
+      const std::vector<int>& start_points_for_id = id_start_points[k];
 
-      IntegerVector start_points_subset = wrap(start_points_for_id);
 
       // Calculate min after hours for this ID (returns subset indices)
-      IntegerVector min_result_subset = calculate_min_after_hours_for_id(
-        time_subset, gl_subset, start_points_subset, hours);
+      std::vector<int> min_result_subset = calculate_min_after_hours_for_id(
+        time_subset, gl_subset, start_points_for_id, hours);
 
       // Convert subset indices back to original DataFrame indices
-      IntegerVector min_result_original(min_result_subset.size());
-      for (int i = 0; i < min_result_subset.size(); ++i) {
+      std::vector<int> min_result_original(min_result_subset.size());
+      for (size_t i = 0; i < min_result_subset.size(); ++i) {
         int subset_idx = min_result_subset[i] - 1; // Convert to 0-based
-        if (subset_idx >= 0 && subset_idx < indices.size()) {
+        if (subset_idx >= 0 && subset_idx < static_cast<int>(indices.size())) {
           min_result_original[i] = indices[subset_idx] + 1; // Convert to 1-based R index
         }
       }
@@ -233,10 +192,10 @@ public:
       id_min_results[current_id] = min_result_original;
 
       // Create binary vector for episode processing (needed for process_episodes function)
-      IntegerVector binary_result(indices.size(), 0);
-      for (int i = 0; i < min_result_subset.size(); ++i) {
+      std::vector<int> binary_result(indices.size(), 0);
+      for (size_t i = 0; i < min_result_subset.size(); ++i) {
         int subset_idx = min_result_subset[i] - 1; // Convert to 0-based
-        if (subset_idx >= 0 && subset_idx < binary_result.size()) {
+        if (subset_idx >= 0 && subset_idx < static_cast<int>(binary_result.size())) {
           binary_result[subset_idx] = 1;
         }
       }
@@ -245,11 +204,14 @@ public:
       process_episodes_with_total(current_id, binary_result, time_subset, gl_subset);
     }
 
+    // Merging and the output tables run to the end of the call
+    cgmguru_profile::ScopedStage output_stage(profiler, "output_tables");
+
     // --- Step 4: Combine all results ---
     std::vector<int> all_min_indices;
     for (auto const& id_pair : id_min_results) {
-      const IntegerVector& indices = id_pair.second;
-      for (int i = 0; i < indices.size(); ++i) {
+      const std::vector<int>& indices = id_pair.second;
+      for (size_t i = 0; i < indices.size(); ++i) {
         all_min_indices.push_back(indices[i]);
       }
     }
@@ -295,11 +257,47 @@ public:
       _["episode_start"] = episode_start_total_df
     );
   }
+
+public:
+  List calculate(const DataFrame& df, const IntegerVector& start_point, double hours) {
+    profiler.clear();
+    std::unique_ptr<cgmguru_grid::GridContext> context;
+    {
+      cgmguru_profile::ScopedStage stage(profiler, "grid_context");
+      context.reset(new cgmguru_grid::GridContext(df));
+    }
+    return calculate_hours(*context, start_point, hours);
+  }
+
+  List calculate(const cgmguru_grid::GridContext& context, const IntegerVector& start_point,
+                 double hours) {
+    profiler.clear();
+    return calculate_hours(context, start_point, hours);
+  }
 };
 
 // [[Rcpp::export]]
-List find_min_after_hours(DataFrame df, DataFrame start_point_df, double hours) {
+List find_min_after_hours(DataFrame df, DataFrame start_point_df, double hours, bool profile = false) {
   IntegerVector start_point = as<IntegerVector>(start_point_df[0]);
   FindMinAfterHoursCalculator calculator;
-  return calculator.calculate(df, start_point, hours);
+  calculator.enable_profiling(profile);
+  List result = calculator.calculate(df, start_point, hours);
+  if (profile) {
+    result.attr("profile") = calculator.profile_table();
+  }
+  return result;
+}
+
+// [[Rcpp::export]]
+List grid_context_find_min_after_hours_cpp(SEXP context, DataFrame start_point_df, double hours,
+                                           bool profile = false) {
+  IntegerVector start_point = as<IntegerVector>(start_point_df[0]);
+  FindMinAfterHoursCalculator calculator;
+  calculator.enable_profiling(profile);
+  List result = calculator.calculate(*cgmguru_grid::grid_context_from_sexp(context), start_point,
+                                     hours);
+  if (profile) {
+    result.attr("profile") = calculator.profile_table();
+  }
+  return result;
 }
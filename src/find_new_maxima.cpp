@@ -1,5 +1,8 @@
+#include "grid_context.h"
 #include "id_based_calculator.h"
 
+#include <memory>
+
 using namespace Rcpp;
 using namespace std;
 
@@ -7,11 +10,11 @@ using namespace std;
 class NewMaximaCalculator : public IdBasedCalculator {
 private:
   // Find new maxima for a single ID
-  IntegerVector calculate_new_maxima_for_id(const NumericVector& time_subset,
-                                           const NumericVector& gl_subset,
+  IntegerVector calculate_new_maxima_for_id(cgmguru_columns::DoubleSpan time_subset,
+                                           cgmguru_columns::DoubleSpan gl_subset,
                                            const IntegerVector& mod_grid_max_point_subset,
                                            const IntegerVector& local_maxima_subset) {
-    int n_subset = time_subset.length();
+    int n_subset = static_cast<int>(time_subset.size());
     IntegerVector maxima_point(n_subset, 0); // Initialize all to 0
 
     for(int i = 0; i < mod_grid_max_point_subset.size(); i++) {
@@ -42,7 +45,7 @@ private:
       if(new_maxima_points.empty()) {
         maxima_point[mod_index] = 1;
       } else {
-        NumericVector values_to_compare;
+        std::vector<double> values_to_compare;
 
         for(int k : new_maxima_points) {
           values_to_compare.push_back(gl_subset[k]);
@@ -52,14 +55,14 @@ private:
         // Find the index of the maximum value
         int max_index = 0;
         double max_value = values_to_compare[0];
-        for(int idx = 1; idx < values_to_compare.size(); idx++) {
+        for(int idx = 1; idx < static_cast<int>(values_to_compare.size()); idx++) {
           if(values_to_compare[idx] > max_value) {
             max_value = values_to_compare[idx];
             max_index = idx;
           }
         }
 
-        if(max_index == (values_to_compare.size() - 1)) {
+        if(max_index == static_cast<int>(values_to_compare.size()) - 1) {
           maxima_point[mod_index] = 1;
         } else {
           maxima_point[new_maxima_points[max_index]] = 1;
@@ -91,55 +94,39 @@ private:
     return wrap(subset_indices);
   }
 
-public:
-  DataFrame calculate(const DataFrame& df,
-                     const IntegerVector& mod_grid_max_point,
-                     const IntegerVector& local_maxima) {
-    // --- Step 0: Input validation ---
-    if (df.nrows() == 0) {
-      // Return empty DataFrame with correct structure
-      NumericVector empty_time = NumericVector::create();
-      empty_time.attr("class") = CharacterVector::create("POSIXct");
-      // Default to UTC in empty case as we have no tz info
-      empty_time.attr("tzone") = "UTC";
-
-      DataFrame empty_df = DataFrame::create(
-        _["id"] = CharacterVector::create(),
-        _["time"] = empty_time,
-        _["gl"] = NumericVector::create(),
-        _["index"] = IntegerVector::create()
-      );
-      empty_df.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
-      return empty_df;
-    }
+  // Empty result with the output structure
+  static DataFrame empty_result() {
+    NumericVector empty_time = NumericVector::create();
+    empty_time.attr("class") = CharacterVector::create("POSIXct");
+    // Default to UTC in empty case as we have no tz info
+    empty_time.attr("tzone") = "UTC";
+
+    DataFrame empty_df = DataFrame::create(
+      _["id"] = CharacterVector::create(),
+      _["time"] = empty_time,
+      _["gl"] = NumericVector::create(),
+      _["index"] = IntegerVector::create()
+    );
+    empty_df.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+    return empty_df;
+  }
 
-    // --- Step 1: Extract columns from DataFrame ---
-    int n = df.nrows();
-    StringVector id = df["id"];
-    NumericVector time = df["time"];
-    NumericVector gl = df["gl"];
-
-    // Optional timezone column
-    bool has_tz_col = df.containsElementNamed("tz");
-    CharacterVector tz_col;
-    if (has_tz_col) {
-      tz_col = df["tz"];
+  DataFrame calculate_new_maxima(const cgmguru_grid::GridContext& context,
+                                 const IntegerVector& mod_grid_max_point,
+                                 const IntegerVector& local_maxima) {
+    if (context.n_rows() == 0) {
+      return empty_result();
     }
 
-    // Default timezone from time's tzone attribute or UTC
-    std::string default_tz = "UTC";
-    RObject tz_attr = time.attr("tzone");
-    if (!tz_attr.isNULL()) {
-      CharacterVector tz_attr_cv = as<CharacterVector>(tz_attr);
-      if (tz_attr_cv.size() > 0 && !CharacterVector::is_na(tz_attr_cv[0])) {
-        default_tz = as<std::string>(tz_attr_cv[0]);
-      }
-    }
+    // --- Step 1: Rows and the default timezone come from the context ---
+    int n = context.n_rows();
+    const std::string& default_tz = context.default_tz();
 
     // --- Step 2: Initialize and separate calculation by ID ---
-    group_by_id(id, n); // This clears id_indices and rebuilds it
+    use_id_grouping(context.groups()); // This clears id_indices and rebuilds it
     std::map<std::string, IntegerVector> id_maxima_results;
     id_maxima_results.clear(); // Explicit clear for safety
+    std::size_t group_pos = 0;
 
     // Calculate new maxima for each ID separately
     // Build per-id timezone map
@@ -147,25 +134,18 @@ public:
     for (auto const& id_pair : id_indices) {
       std::string current_id = id_pair.first;
       const std::vector<int>& indices = id_pair.second;
+      const std::size_t k = group_pos++;
 
       // Skip empty ID groups
       if (indices.empty()) continue;
+      cgmguru_profile::ScopedStage stage(profiler, "new_maxima", profiler.subject(current_id));
 
-      // Extract subset data for this ID
-      NumericVector time_subset(indices.size());
-      NumericVector gl_subset(indices.size());
-      extract_id_subset(current_id, indices, time, gl, time_subset, gl_subset);
-
-      // Assign timezone for this id (first row's tz if available; else default)
-      std::string tz_for_id = default_tz;
-      if (has_tz_col && !indices.empty()) {
-        int idx0 = indices.front();
-        if (idx0 >= 0 && idx0 < tz_col.size() && !CharacterVector::is_na(tz_col[idx0])) {
-          tz_for_id = as<std::string>(tz_col[idx0]);
-        }
-      }
-      if (tz_for_id.empty()) tz_for_id = default_tz;
-      id_timezones[current_id] = tz_for_id;
+      // The context views this ID's data in place when its rows are contiguous
+      cgmguru_columns::DoubleSpan time_subset = context.subject_time(k);
+      cgmguru_columns::DoubleSpan gl_subset = context.subject_gl(k);
+
+      // First row's tz if available; else default
+      id_timezones[current_id] = context.subject_tz(k);
 
       // Convert global indices to subset indices for this ID
       IntegerVector mod_grid_max_point_subset = convert_to_subset_indices(mod_grid_max_point, indices);
@@ -179,6 +159,9 @@ public:
       id_maxima_results[current_id] = maxima_subset;
     }
 
+    // Merging and the output table run to the end of the call
+    cgmguru_profile::ScopedStage output_stage(profiler, "output_tables");
+
     // --- Step 3: Merge results back to original order ---
     IntegerVector maxima_final = merge_results(id_maxima_results, n);
 
@@ -196,11 +179,14 @@ public:
     result_gls.reserve(estimated_size);
     result_indices.reserve(estimated_size);
 
+    // Selected rows are read back through their subject and position
+    const std::vector<int> row_positions = id_grouping.row_positions();
     for (int i = 0; i < n; ++i) {
       if (maxima_final[i] == 1) {
-        result_ids.push_back(as<std::string>(id[i]));
-        result_times.push_back(time[i]);
-        result_gls.push_back(gl[i]);
+        const int g = id_grouping.row_group[i];
+        result_ids.push_back(id_grouping.labels[g]);
+        result_times.push_back(context.subject_time(g)[row_positions[i]]);
+        result_gls.push_back(context.subject_gl(g)[row_positions[i]]);
         result_indices.push_back(i + 1); // R-style 1-based indexing
       }
     }
@@ -254,10 +240,35 @@ public:
 
     return result_df;
   }
+
+public:
+  DataFrame calculate(const DataFrame& df,
+                     const IntegerVector& mod_grid_max_point,
+                     const IntegerVector& local_maxima) {
+    profiler.clear();
+    // --- Step 0: Input validation ---
+    if (df.nrows() == 0) {
+      return empty_result();
+    }
+    std::unique_ptr<cgmguru_grid::GridContext> context;
+    {
+      cgmguru_profile::ScopedStage stage(profiler, "grid_context");
+      context.reset(new cgmguru_grid::GridContext(df));
+    }
+    return calculate_new_maxima(*context, mod_grid_max_point, local_maxima);
+  }
+
+  DataFrame calculate(const cgmguru_grid::GridContext& context,
+                     const IntegerVector& mod_grid_max_point,
+                     const IntegerVector& local_maxima) {
+    profiler.clear();
+    return calculate_new_maxima(context, mod_grid_max_point, local_maxima);
+  }
 };
 
 // [[Rcpp::export]]
-DataFrame find_new_maxima(DataFrame df, DataFrame mod_grid_max_point_df, DataFrame local_maxima_df) {
+DataFrame find_new_maxima(DataFrame df, DataFrame mod_grid_max_point_df, DataFrame local_maxima_df,
+                          bool profile = false) {
   // Extract max_indices from the DataFrame
   IntegerVector mod_grid_max_point = as<IntegerVector>(mod_grid_max_point_df[0]);
   
@@ -265,5 +276,25 @@ DataFrame find_new_maxima(DataFrame df, DataFrame mod_grid_max_point_df, DataFra
   IntegerVector local_maxima = as<IntegerVector>(local_maxima_df[0]);
   
   NewMaximaCalculator calculator;
-  return calculator.calculate(df, mod_grid_max_point, local_maxima);
+  calculator.enable_profiling(profile);
+  DataFrame result = calculator.calculate(df, mod_grid_max_point, local_maxima);
+  if (profile) {
+    result.attr("profile") = calculator.profile_table();
+  }
+  return result;
+}
+
+// [[Rcpp::export]]
+DataFrame grid_context_find_new_maxima_cpp(SEXP context, DataFrame mod_grid_max_point_df,
+                                           DataFrame local_maxima_df, bool profile = false) {
+  IntegerVector mod_grid_max_point = as<IntegerVector>(mod_grid_max_point_df[0]);
+  IntegerVector local_maxima = as<IntegerVector>(local_maxima_df[0]);
+  NewMaximaCalculator calculator;
+  calculator.enable_profiling(profile);
+  DataFrame result = calculator.calculate(*cgmguru_grid::grid_context_from_sexp(context),
+                                          mod_grid_max_point, local_maxima);
+  if (profile) {
+    result.attr("profile") = calculator.profile_table();
+  }
+  return result;
 }
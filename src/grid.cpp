@@ -1,3 +1,4 @@
+#include "grid_context.h"
 #include "id_based_calculator.h"
 
 using namespace Rcpp;
@@ -12,61 +13,17 @@ private:
   std::vector<double> total_episode_gls;
   std::vector<int> total_episode_indices;
 
-  // Calculate GRID for a single ID
-  IntegerVector calculate_grid_for_id(const NumericVector& time_subset,
-                                     const NumericVector& gl_subset,
-                                     double gap,
-                                     double threshold) {
-    int n_subset = time_subset.length();
-    IntegerVector grid_subset(n_subset, 0);
-
-    if (n_subset < 4) return grid_subset; // Need at least 4 points
-
-    double rate1, rate2, rate3;
-
-    for (int j = 3; j < n_subset; ++j) {
-      // Check for NA values
-      if (NumericVector::is_na(gl_subset[j]) ||
-          NumericVector::is_na(gl_subset[j-1]) ||
-          NumericVector::is_na(gl_subset[j-2]) ||
-          NumericVector::is_na(gl_subset[j-3])) {
-        continue;
-      }
-
-      // Calculate rates (mg/dL per hour)
-      rate1 = (gl_subset[j] - gl_subset[j-1]) / ((time_subset[j] - time_subset[j-1]) / 3600.0);
-      rate2 = (gl_subset[j-1] - gl_subset[j-2]) / ((time_subset[j-1] - time_subset[j-2]) / 3600.0);
-      rate3 = (gl_subset[j-2] - gl_subset[j-3]) / ((time_subset[j-2] - time_subset[j-3]) / 3600.0);
-
-      // Apply GRID criteria
-      if (rate1 >= 95 && rate2 >= 95 && threshold <= gl_subset[j-2]) {
-        // Mark points within gap window
-        for (int k = j; k < n_subset && (time_subset[k] - time_subset[j]) <= gap*60; ++k) {
-          if (k >= 2) grid_subset[k-2] = 1;
-        }
-      } else if ((rate2 >= 90 && rate3 >= 90 && threshold <= gl_subset[j-3]) ||
-                 (rate3 >= 90 && rate1 >= 90 && threshold <= gl_subset[j-3])) {
-        // Mark points within gap window
-        for (int k = j; k < n_subset && (time_subset[k] - time_subset[j]) <= gap*60; ++k) {
-          if (k >= 3) grid_subset[k-3] = 1;
-        }
-      }
-    }
-
-    return grid_subset;
-  }
-
   // Enhanced episode processing that also stores data for total DataFrame
   void process_episodes_with_total(const std::string& current_id,
-                                 const IntegerVector& grid_subset,
-                                 const NumericVector& time_subset,
-                                 const NumericVector& gl_subset) {
+                                 const std::vector<int>& grid_subset,
+                                 cgmguru_columns::DoubleSpan time_subset,
+                                 cgmguru_columns::DoubleSpan gl_subset) {
     // First do the standard episode processing
     process_episodes(current_id, grid_subset, time_subset, gl_subset);
 
     // Then collect data for total DataFrame
     const std::vector<int>& indices = id_indices[current_id];
-    for (int i = 0; i < grid_subset.length(); ++i) {
+    for (size_t i = 0; i < grid_subset.size(); ++i) {
       bool is_episode_start = (grid_subset[i] == 1) &&
                              (i == 0 || grid_subset[i-1] == 0);
 
@@ -102,75 +59,49 @@ private:
     return df;
   }
 
-public:
-  List calculate(const DataFrame& df, double gap, double threshold) {
+  List calculate_grid(cgmguru_grid::GridContext& context, double gap, double threshold,
+                      int n_threads) {
     // Clear total episode storage
     total_episode_ids.clear();
     total_episode_times.clear();
     total_episode_gls.clear();
     total_episode_indices.clear();
 
-    // --- Step 1: Extract columns from DataFrame ---
-    int n = df.nrows();
-    StringVector id = df["id"];
-    NumericVector time = df["time"];
-    NumericVector gl = df["gl"];
-    // Optional timezone column
-    bool has_tz_col = df.containsElementNamed("tz");
-    CharacterVector tz_col;
-    if (has_tz_col) {
-      tz_col = df["tz"];
-    }
-
-    // Default timezone from time's tzone attribute or UTC
-    std::string default_tz = "UTC";
-    RObject tz_attr = time.attr("tzone");
-    if (!tz_attr.isNULL()) {
-      CharacterVector tz_attr_cv = as<CharacterVector>(tz_attr);
-      if (tz_attr_cv.size() > 0 && !CharacterVector::is_na(tz_attr_cv[0])) {
-        default_tz = as<std::string>(tz_attr_cv[0]);
-      }
-    }
+    // --- Step 1: Columns, grouping and timezones come from the context ---
+    int n = context.n_rows();
+    const std::string& default_tz = context.default_tz();
 
     // --- Step 2: Separate calculation by ID ---
-    group_by_id(id, n);
-    std::map<std::string, IntegerVector> id_grid_results;
+    use_id_grouping(context.groups());
     // Build per-id timezone map
     std::map<std::string, std::string> id_timezones;
 
-    // Calculate GRID for each ID separately
-    for (auto const& id_pair : id_indices) {
-      std::string current_id = id_pair.first;
-      const std::vector<int>& indices = id_pair.second;
-
-      // Extract subset data for this ID
-      NumericVector time_subset(indices.size());
-      NumericVector gl_subset(indices.size());
-      extract_id_subset(current_id, indices, time, gl, time_subset, gl_subset);
-
-      // Assign timezone for this id (first row's tz if available; else default)
-      std::string tz_for_id = default_tz;
-      if (has_tz_col && !indices.empty()) {
-        int idx0 = indices.front();
-        if (idx0 >= 0 && idx0 < tz_col.size() && !CharacterVector::is_na(tz_col[idx0])) {
-          tz_for_id = as<std::string>(tz_col[idx0]);
-        }
-      }
-      if (tz_for_id.empty()) tz_for_id = default_tz;
-      id_timezones[current_id] = tz_for_id;
-
-      // Calculate GRID for this ID
-      IntegerVector grid_subset = calculate_grid_for_id(time_subset, gl_subset, gap, threshold);
+    // GRID marks for each ID; the kernels only see plain buffers so they can
+    // be spread over worker threads, and a reused context computes them once
+    std::vector<const IdGroup*> groups = ordered_id_groups();
+    const std::vector<std::vector<int>>* marks = nullptr;
+    {
+      cgmguru_profile::ScopedStage stage(profiler, "grid_marks");
+      marks = &context.grid_marks(gap, threshold, false, n_threads);
+    }
+    const std::vector<std::vector<int>>& grid_subsets = *marks;
 
-      // Store result
-      id_grid_results[current_id] = grid_subset;
+    // Episode bookkeeping stays serial and in map order
+    for (std::size_t k = 0; k < groups.size(); ++k) {
+      const std::string& current_id = groups[k]->first;
+      cgmguru_profile::ScopedStage stage(profiler, "episodes", profiler.subject(current_id));
+      id_timezones[current_id] = context.subject_tz(k);
 
       // Process episodes for this ID (both standard and total)
-      process_episodes_with_total(current_id, grid_subset, time_subset, gl_subset);
+      process_episodes_with_total(current_id, grid_subsets[k],
+                                  context.subject_time(k), context.subject_gl(k));
     }
 
+    // Merging and the output tables run to the end of the call
+    cgmguru_profile::ScopedStage output_stage(profiler, "output_tables");
+
     // --- Step 3: Merge results back to original order ---
-    IntegerVector grid_final = merge_results(id_grid_results, n);
+    IntegerVector grid_final = merge_ordered_results(grid_subsets, n);
 
     // --- Step 4: Create output structures ---
     DataFrame counts_df = create_episode_counts_df();
@@ -214,10 +145,48 @@ public:
 
     );
   }
+
+public:
+  List calculate(const DataFrame& df, double gap, double threshold, int n_threads = 1) {
+    profiler.clear();
+    std::unique_ptr<cgmguru_grid::GridContext> context;
+    {
+      cgmguru_profile::ScopedStage stage(profiler, "grid_context");
+      context.reset(new cgmguru_grid::GridContext(df));
+    }
+    return calculate_grid(*context, gap, threshold, n_threads);
+  }
+
+  List calculate(cgmguru_grid::GridContext& context, double gap, double threshold,
+                 int n_threads = 1) {
+    profiler.clear();
+    return calculate_grid(context, gap, threshold, n_threads);
+  }
 };
 
+// Attaches the calculator's stage timings when profile is set
+static List with_profile(List result, const GridCalculator& calculator, bool profile) {
+  if (profile) {
+    result.attr("profile") = calculator.profile_table();
+  }
+  return result;
+}
+
+// [[Rcpp::export]]
+List grid(DataFrame df, double gap = 15, double threshold = 130, int n_threads = 1,
+          bool profile = false) {
+  GridCalculator calculator;
+  calculator.enable_profiling(profile);
+  return with_profile(calculator.calculate(df, gap, threshold, n_threads),
+                      calculator, profile);
+}
+
 // [[Rcpp::export]]
-List grid(DataFrame df, double gap = 15, double threshold = 130) {
+List grid_context_grid_cpp(SEXP context, double gap = 15, double threshold = 130,
+                           int n_threads = 1, bool profile = false) {
   GridCalculator calculator;
-  return calculator.calculate(df, gap, threshold);
+  calculator.enable_profiling(profile);
+  return with_profile(calculator.calculate(*cgmguru_grid::grid_context_from_sexp(context),
+                                           gap, threshold, n_threads),
+                      calculator, profile);
 }
@@ -0,0 +1,50 @@
+#include <Rcpp.h>
+#include "grid_context.h"
+
+using namespace Rcpp;
+
+namespace cgmguru_grid {
+
+GridContext* grid_context_from_sexp(SEXP context) {
+  if (TYPEOF(context) != EXTPTRSXP || R_ExternalPtrAddr(context) == nullptr) {
+    stop("GRID context is no longer valid; create a new one with grid_context()");
+  }
+  return static_cast<GridContext*>(R_ExternalPtrAddr(context));
+}
+
+} // namespace cgmguru_grid
+
+// [[Rcpp::export]]
+SEXP grid_context_create_cpp(DataFrame df) {
+  if (!df.containsElementNamed("id") || !df.containsElementNamed("time") ||
+      !df.containsElementNamed("gl")) {
+    stop("df must contain id, time and gl columns");
+  }
+
+  XPtr<cgmguru_grid::GridContext> ptr(new cgmguru_grid::GridContext(df), true);
+  ptr.attr("class") = CharacterVector::create("cgmguru_grid_context");
+  return ptr;
+}
+
+// [[Rcpp::export]]
+DataFrame grid_context_data_cpp(SEXP context) {
+  return cgmguru_grid::grid_context_from_sexp(context)->data();
+}
+
+// Known reading interval of every row in data() order, or NULL unless the
+// context knows the interval of every subject (a context over a cohort cache)
+// [[Rcpp::export]]
+SEXP grid_context_reading_minutes_cpp(SEXP context) {
+  const cgmguru_grid::GridContext* ctx = cgmguru_grid::grid_context_from_sexp(context);
+  const cgmguru_ids::IdGroups& groups = ctx->groups();
+  if (groups.empty()) return R_NilValue;
+  NumericVector out(ctx->n_rows());
+  for (std::size_t g = 0; g < groups.size(); ++g) {
+    const double minutes = ctx->subject_reading_minutes(g);
+    if (std::isnan(minutes)) return R_NilValue;
+    for (const int* row = groups.group_begin(g); row != groups.group_end(g); ++row) {
+      out[*row] = minutes;
+    }
+  }
+  return out;
+}
@@ -0,0 +1,256 @@
+#ifndef CGMGURU_GRID_CONTEXT_H
+#define CGMGURU_GRID_CONTEXT_H
+
+#include <Rcpp.h>
+#include "column_view.h"
+#include "grid_engine.h"
+#include "id_grouping.h"
+#include "parallel_executor.h"
+
+#include <cmath>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Shared inputs of the GRID family: one data frame grouped by id, each
+// subject's time/glucose values, and the GRID and local maxima marks computed
+// from them.
+//
+// grid(), find_local_maxima() and maxima_grid() all start by grouping the rows,
+// viewing every subject's readings and running the same per-subject kernels.
+// A GridContext does that work once. The functions build a temporary context
+// for plain data frames, so their results do not depend on whether a context
+// is reused; grid_context() keeps one alive behind an external pointer so that
+// later calls skip the grouping and any marks already computed. GRID marks are
+// cached per (gap, threshold) pair, local maxima once per subject, and no R
+// objects are created until a stage function builds its own output.
+namespace cgmguru_grid {
+
+class GridContext {
+public:
+  explicit GridContext(const Rcpp::DataFrame& df)
+    : data_(df), id_(df["id"]), time_(df["time"]), gl_(df["gl"]) {
+    n_rows_ = df.nrows();
+    groups_ = cgmguru_ids::group_rows_by_id(id_, n_rows_);
+
+    // Default timezone from time's tzone attribute or UTC
+    Rcpp::RObject tz_attr = time_.attr("tzone");
+    if (!tz_attr.isNULL()) {
+      Rcpp::CharacterVector tz_attr_cv = Rcpp::as<Rcpp::CharacterVector>(tz_attr);
+      if (tz_attr_cv.size() > 0 && !Rcpp::CharacterVector::is_na(tz_attr_cv[0])) {
+        default_tz_ = Rcpp::as<std::string>(tz_attr_cv[0]);
+      }
+    }
+    const bool has_tz_col = df.containsElementNamed("tz");
+    has_tz_column_ = has_tz_col;
+    Rcpp::CharacterVector tz_col;
+    if (has_tz_col) {
+      tz_col = df["tz"];
+    }
+
+    const std::size_t n_groups = groups_.size();
+    time_scratch_.resize(n_groups);
+    gl_scratch_.resize(n_groups);
+    times_.resize(n_groups);
+    gls_.resize(n_groups);
+    subject_tz_.assign(n_groups, default_tz_);
+    local_maxima_.resize(n_groups);
+    has_local_maxima_.assign(n_groups, 0);
+    for (std::size_t g = 0; g < n_groups; ++g) {
+      // Subjects stored in one block of rows are viewed in place
+      times_[g] = cgmguru_columns::column_rows(time_.begin(), groups_.group_begin(g),
+                                               groups_.group_end(g), time_scratch_[g]);
+      gls_[g] = cgmguru_columns::column_rows(gl_.begin(), groups_.group_begin(g),
+                                             groups_.group_end(g), gl_scratch_[g]);
+
+      // First row's tz if available; else default
+      if (has_tz_col && groups_.group_size(g) > 0) {
+        const int idx0 = *groups_.group_begin(g);
+        if (idx0 >= 0 && idx0 < tz_col.size() && !Rcpp::CharacterVector::is_na(tz_col[idx0])) {
+          subject_tz_[g] = Rcpp::as<std::string>(tz_col[idx0]);
+        }
+      }
+      if (subject_tz_[g].empty()) subject_tz_[g] = default_tz_;
+    }
+  }
+
+  // Context over readings held outside R, such as Arrow record batches
+  // (arrow_stream.cpp). Subject k of labels, in input order, has the
+  // readings times[k] / gls[k]; they point either into time_scratch[k] /
+  // gl_scratch[k] or into memory owned by keep_alive. The rows are numbered
+  // subject by subject in input order. R columns are built only when a stage
+  // asks for data(), and are not kept. reading_minutes, when given, holds
+  // each subject's known reading interval (NaN where unknown), such as the
+  // intervals stored in a cohort cache.
+  GridContext(const std::vector<std::string>& labels,
+              const std::vector<cgmguru_columns::DoubleSpan>& times,
+              const std::vector<cgmguru_columns::DoubleSpan>& gls,
+              std::vector<std::vector<double>> time_scratch,
+              std::vector<std::vector<double>> gl_scratch,
+              const std::string& default_tz,
+              std::shared_ptr<const void> keep_alive,
+              const std::vector<double>& reading_minutes = std::vector<double>())
+    : id_(R_NilValue), has_data_(false), keep_alive_(std::move(keep_alive)) {
+    // Kept verbatim, as the tzone of a data frame is: "" means local time
+    default_tz_ = default_tz;
+
+    const std::size_t n_subjects = labels.size();
+    std::vector<int> row_code;
+    for (std::size_t k = 0; k < n_subjects; ++k) {
+      row_code.insert(row_code.end(), times[k].size(), static_cast<int>(k));
+    }
+    n_rows_ = static_cast<int>(row_code.size());
+    cgmguru_ids::detail::finalize_groups(groups_, row_code, labels);
+
+    // Buffers keep their addresses when moved, so the spans stay valid
+    time_scratch_ = std::move(time_scratch);
+    gl_scratch_ = std::move(gl_scratch);
+    const std::size_t n_groups = groups_.size();
+    times_.resize(n_groups);
+    gls_.resize(n_groups);
+    if (!reading_minutes.empty()) {
+      reading_minutes_.assign(n_groups, std::nan(""));
+    }
+    std::size_t first_row = 0;
+    for (std::size_t k = 0; k < n_subjects; ++k) {
+      if (times[k].size() == 0) continue;
+      const int g = groups_.row_group[first_row];
+      times_[g] = times[k];
+      gls_[g] = gls[k];
+      if (!reading_minutes.empty()) reading_minutes_[g] = reading_minutes[k];
+      first_row += times[k].size();
+    }
+    subject_tz_.assign(n_groups, default_tz_);
+    local_maxima_.resize(n_groups);
+    has_local_maxima_.assign(n_groups, 0);
+  }
+
+  // Spans point into data_ and the scratch buffers, so the context is pinned
+  GridContext(const GridContext&) = delete;
+  GridContext& operator=(const GridContext&) = delete;
+
+  // Rows as an id/time/gl data frame. A context over outside readings builds
+  // it on each call without keeping it, so the copy is released with the
+  // result of the stage that asked for it
+  Rcpp::DataFrame data() const { return has_data_ ? data_ : build_data(); }
+  int n_rows() const { return n_rows_; }
+  const std::string& default_tz() const { return default_tz_; }
+
+  const cgmguru_ids::IdGroups& groups() const { return groups_; }
+  std::size_t size() const { return groups_.size(); }
+  cgmguru_columns::DoubleSpan subject_time(std::size_t g) const { return times_[g]; }
+  cgmguru_columns::DoubleSpan subject_gl(std::size_t g) const { return gls_[g]; }
+  const std::string& subject_tz(std::size_t g) const { return subject_tz_[g]; }
+  // Whether subject_tz() came from a tz column rather than the default
+  bool has_tz_column() const { return has_tz_column_; }
+  // Known reading interval of a subject in minutes, NaN when none was given
+  double subject_reading_minutes(std::size_t g) const {
+    return reading_minutes_.empty() ? std::nan("") : reading_minutes_[g];
+  }
+
+  // GRID marks of every subject (grid_marks() in grid_engine.h), computed on
+  // first use for each (gap, threshold, skip_nonpositive_intervals)
+  const std::vector<std::vector<int>>& grid_marks(double gap, double threshold,
+                                                  bool skip_nonpositive_intervals,
+                                                  int n_threads = 1) {
+    // NaN parameters cannot be ordered as map keys; they share one slot that
+    // is recomputed on every call
+    const bool cacheable = !std::isnan(gap) && !std::isnan(threshold);
+    const GridKey key(gap, threshold, skip_nonpositive_intervals);
+    if (cacheable) {
+      auto found = grid_marks_.find(key);
+      if (found != grid_marks_.end()) return found->second;
+    }
+
+    std::vector<std::vector<int>> marks(size());
+    cgmguru_parallel::parallel_for(size(), n_threads, [&](std::size_t g) {
+      marks[g] = cgmguru_grid::grid_marks(times_[g], gls_[g], gap, threshold,
+                                          skip_nonpositive_intervals);
+    });
+    if (!cacheable) {
+      uncached_grid_marks_ = std::move(marks);
+      return uncached_grid_marks_;
+    }
+    return grid_marks_.emplace(key, std::move(marks)).first->second;
+  }
+
+  // Local maxima marks of one subject (local_maxima_marks() in grid_engine.h)
+  const std::vector<int>& local_maxima(std::size_t g) {
+    if (!has_local_maxima_[g]) {
+      local_maxima_[g] = cgmguru_grid::local_maxima_marks(gls_[g]);
+      has_local_maxima_[g] = 1;
+    }
+    return local_maxima_[g];
+  }
+
+  // Local maxima marks of every subject; missing ones are filled in parallel
+  const std::vector<std::vector<int>>& local_maxima(int n_threads) {
+    cgmguru_parallel::parallel_for(size(), n_threads, [&](std::size_t g) {
+      if (!has_local_maxima_[g]) {
+        local_maxima_[g] = cgmguru_grid::local_maxima_marks(gls_[g]);
+        has_local_maxima_[g] = 1;
+      }
+    });
+    return local_maxima_;
+  }
+
+private:
+  typedef std::tuple<double, double, bool> GridKey;
+
+  // Builds the id/time/gl data frame of a context made from outside readings.
+  // The rows of a subject share one CHARSXP for its label.
+  Rcpp::DataFrame build_data() const {
+    Rcpp::CharacterVector id(n_rows_);
+    Rcpp::NumericVector time(n_rows_);
+    Rcpp::NumericVector gl(n_rows_);
+    for (std::size_t g = 0; g < groups_.size(); ++g) {
+      const std::string& label = groups_.labels[g];
+      // Outside labels (cohort caches, Arrow) are UTF-8. The CHARSXP is
+      // protected by id from its first use; nothing allocates in between.
+      SEXP label_char = Rf_mkCharLenCE(label.data(), static_cast<int>(label.size()), CE_UTF8);
+      const int* rows = groups_.group_begin(g);
+      for (int k = 0; k < groups_.group_size(g); ++k) {
+        SET_STRING_ELT(id, rows[k], label_char);
+        time[rows[k]] = times_[g][k];
+        gl[rows[k]] = gls_[g][k];
+      }
+    }
+    time.attr("class") = Rcpp::CharacterVector::create("POSIXct", "POSIXt");
+    time.attr("tzone") = default_tz_;
+    return Rcpp::DataFrame::create(Rcpp::_["id"] = id, Rcpp::_["time"] = time,
+                                   Rcpp::_["gl"] = gl,
+                                   Rcpp::_["stringsAsFactors"] = false);
+  }
+
+  Rcpp::DataFrame data_;
+  SEXP id_;
+  Rcpp::NumericVector time_;
+  Rcpp::NumericVector gl_;
+  bool has_data_ = true;
+  std::shared_ptr<const void> keep_alive_;
+  int n_rows_ = 0;
+  std::string default_tz_ = "UTC";
+  bool has_tz_column_ = false;
+
+  cgmguru_ids::IdGroups groups_;
+  std::vector<std::vector<double>> time_scratch_;
+  std::vector<std::vector<double>> gl_scratch_;
+  std::vector<cgmguru_columns::DoubleSpan> times_;
+  std::vector<cgmguru_columns::DoubleSpan> gls_;
+  std::vector<std::string> subject_tz_;
+  std::vector<double> reading_minutes_;
+
+  std::map<GridKey, std::vector<std::vector<int>>> grid_marks_;
+  std::vector<std::vector<int>> uncached_grid_marks_;
+  std::vector<std::vector<int>> local_maxima_;
+  std::vector<char> has_local_maxima_;
+};
+
+// Context behind an external pointer made by grid_context_create_cpp()
+GridContext* grid_context_from_sexp(SEXP context);
+
+} // namespace cgmguru_grid
+
+#endif // CGMGURU_GRID_CONTEXT_H
@@ -0,0 +1,227 @@
+#ifndef CGMGURU_GRID_ENGINE_H
+#define CGMGURU_GRID_ENGINE_H
+
+#include "column_view.h"
+#include "window_search.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// GRID detection and local maxima shared by grid(), find_local_maxima() and
+// maxima_grid(), plus the range marking that mod_grid() uses for its gap
+// windows.
+//
+// GRID looks at the three rises ending at each reading j. Rate i (between
+// readings i and i + 1) is rate1 at j = i + 1, rate2 at j = i + 2 and rate3
+// at j = i + 3, so the rates and their 90/95 mg/dL/h threshold tests are
+// computed once per interval instead of three times per reading. Episodes are
+// collected as index ranges and filled once at the end, so overlapping gap
+// windows are not written again and again. Nothing here calls the R API, so
+// the kernels can run on worker threads.
+namespace cgmguru_grid {
+
+// Threshold flags of one rate
+const std::uint8_t RATE_AT_LEAST_90 = 1;
+const std::uint8_t RATE_AT_LEAST_95 = 2;
+
+// Union of index ranges, kept as a difference array and filled once
+class RangeMarks {
+public:
+  explicit RangeMarks(int n) : delta_(static_cast<std::size_t>(n) + 1, 0) {}
+
+  // Marks [first, last]; empty ranges are ignored
+  void mark(int first, int last) {
+    const int n = static_cast<int>(delta_.size()) - 1;
+    if (first < 0) first = 0;
+    if (last > n - 1) last = n - 1;
+    if (first > last) return;
+    delta_[first] += 1;
+    delta_[last + 1] -= 1;
+  }
+
+  // 1 for every marked index, 0 elsewhere
+  std::vector<int> fill() const {
+    const std::size_t n = delta_.size() - 1;
+    std::vector<int> marks(n, 0);
+    int open = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      open += delta_[i];
+      marks[i] = open > 0 ? 1 : 0;
+    }
+    return marks;
+  }
+
+private:
+  std::vector<int> delta_;
+};
+
+// flags[i] gets RATE_AT_LEAST_90 / RATE_AT_LEAST_95 for rate[i]; NaN rates
+// get neither. Vectorised for AVX2 and AArch64 NEON when the compiler targets
+// them, with a scalar loop for everything else.
+inline void classify_rates(const double* rate, std::size_t n, std::uint8_t* flags) {
+  std::size_t i = 0;
+#if defined(__AVX2__)
+  const __m256d at_90 = _mm256_set1_pd(90.0);
+  const __m256d at_95 = _mm256_set1_pd(95.0);
+  for (; i + 4 <= n; i += 4) {
+    const __m256d r = _mm256_loadu_pd(rate + i);
+    const int ge_90 = _mm256_movemask_pd(_mm256_cmp_pd(r, at_90, _CMP_GE_OQ));
+    const int ge_95 = _mm256_movemask_pd(_mm256_cmp_pd(r, at_95, _CMP_GE_OQ));
+    for (int lane = 0; lane < 4; ++lane) {
+      flags[i + lane] = static_cast<std::uint8_t>(
+        ((ge_90 >> lane) & 1) * RATE_AT_LEAST_90 + ((ge_95 >> lane) & 1) * RATE_AT_LEAST_95
+      );
+    }
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  const float64x2_t at_90 = vdupq_n_f64(90.0);
+  const float64x2_t at_95 = vdupq_n_f64(95.0);
+  for (; i + 2 <= n; i += 2) {
+    const float64x2_t r = vld1q_f64(rate + i);
+    const uint64x2_t ge_90 = vcgeq_f64(r, at_90);
+    const uint64x2_t ge_95 = vcgeq_f64(r, at_95);
+    for (int lane = 0; lane < 2; ++lane) {
+      const std::uint64_t lane_90 = lane == 0 ? vgetq_lane_u64(ge_90, 0) : vgetq_lane_u64(ge_90, 1);
+      const std::uint64_t lane_95 = lane == 0 ? vgetq_lane_u64(ge_95, 0) : vgetq_lane_u64(ge_95, 1);
+      flags[i + lane] = static_cast<std::uint8_t>(
+        (lane_90 ? RATE_AT_LEAST_90 : 0) | (lane_95 ? RATE_AT_LEAST_95 : 0)
+      );
+    }
+  }
+#endif
+  for (; i < n; ++i) {
+    flags[i] = static_cast<std::uint8_t>(
+      (rate[i] >= 90 ? RATE_AT_LEAST_90 : 0) | (rate[i] >= 95 ? RATE_AT_LEAST_95 : 0)
+    );
+  }
+}
+
+// Rate classes and usable flags of one subject's intervals, the part of GRID
+// that depends on neither gap nor threshold.
+//
+// Interval i (readings i and i + 1) is usable when both readings are
+// non-missing and, with skip_nonpositive_intervals, its length is positive.
+// flags[i] holds the 90/95 mg/dL/h classes of its rate.
+struct GridRates {
+  std::vector<std::uint8_t> flags;
+  std::vector<std::uint8_t> usable;
+};
+
+inline GridRates grid_rates(cgmguru_columns::DoubleSpan time,
+                            cgmguru_columns::DoubleSpan gl,
+                            bool skip_nonpositive_intervals) {
+  GridRates rates;
+  const int n = static_cast<int>(time.size());
+  if (n < 4) return rates;
+
+  // Per-interval rates (mg/dL per hour) and whether an interval may be used
+  const int n_intervals = n - 1;
+  std::vector<double> rate(n_intervals);
+  rates.usable.resize(n_intervals);
+  for (int i = 0; i < n_intervals; ++i) {
+    const double hours = (time[i + 1] - time[i]) / 3600.0;
+    rate[i] = (gl[i + 1] - gl[i]) / hours;
+    rates.usable[i] = !std::isnan(gl[i]) && !std::isnan(gl[i + 1]) &&
+      !(skip_nonpositive_intervals && hours <= 0);
+  }
+  rates.flags.resize(n_intervals);
+  classify_rates(rate.data(), rate.size(), rates.flags.data());
+  return rates;
+}
+
+// GRID marks (1 = inside a GRID episode) for one subject's readings, given
+// the subject's grid_rates().
+//
+// Reading j >= 3 with four non-missing readings j-3..j triggers when
+// rate1 and rate2 are at least 95 and gl[j-2] >= threshold (the episode then
+// starts at j-2), or when rate3 and either rate2 or rate1 are at least 90
+// and gl[j-3] >= threshold (start j-3). Each reading within gap minutes
+// after j extends the episode by one reading. Parameter sweeps compute the
+// rates once and call this for every (gap, threshold).
+inline std::vector<int> grid_marks(const GridRates& rates,
+                                   cgmguru_columns::DoubleSpan time,
+                                   cgmguru_columns::DoubleSpan gl,
+                                   double gap,
+                                   double threshold) {
+  const int n = static_cast<int>(time.size());
+  if (n < 4) return std::vector<int>(n, 0);
+
+  const std::vector<std::uint8_t>& flags = rates.flags;
+  const std::vector<std::uint8_t>& usable = rates.usable;
+  RangeMarks marks(n);
+  cgmguru_window::ElapsedWindowEnd gap_window_end(
+    time, gap * 60, cgmguru_window::is_nondecreasing(time)
+  );
+  for (int j = 3; j < n; ++j) {
+    if (!usable[j - 1] || !usable[j - 2] || !usable[j - 3]) continue;
+
+    const std::uint8_t rate1 = flags[j - 1];
+    const std::uint8_t rate2 = flags[j - 2];
+    const std::uint8_t rate3 = flags[j - 3];
+    int shift = 0;
+    if ((rate1 & rate2 & RATE_AT_LEAST_95) && threshold <= gl[j - 2]) {
+      shift = 2;
+    } else if ((((rate2 & rate3) | (rate3 & rate1)) & RATE_AT_LEAST_90) &&
+               threshold <= gl[j - 3]) {
+      shift = 3;
+    }
+    if (shift == 0) continue;
+
+    // Readings k within gap minutes of j mark k - shift
+    const int last = gap_window_end(j, j);
+    marks.mark(j - shift, last - shift);
+  }
+
+  return marks.fill();
+}
+
+// GRID marks computed from scratch. skip_nonpositive_intervals additionally
+// ignores readings whose three intervals are not all strictly increasing in
+// time, as maxima_grid() always has.
+inline std::vector<int> grid_marks(cgmguru_columns::DoubleSpan time,
+                                   cgmguru_columns::DoubleSpan gl,
+                                   double gap,
+                                   double threshold,
+                                   bool skip_nonpositive_intervals) {
+  return grid_marks(grid_rates(time, gl, skip_nonpositive_intervals),
+                    time, gl, gap, threshold);
+}
+
+// Local maxima marks (1 = local maximum) for one subject's glucose values.
+//
+// Reading i (3 <= i < n - 2) is a maximum when the two rises before it are
+// non-negative and the two changes after it are non-positive; any missing
+// reading among i-2..i+2 rules it out. Subjects with fewer than five
+// readings have no maxima.
+inline std::vector<int> local_maxima_marks(cgmguru_columns::DoubleSpan gl) {
+  const int n = static_cast<int>(gl.size());
+  std::vector<int> marks(n, 0);
+  if (n < 5) return marks;
+
+  std::vector<double> diff(n - 1);
+  for (int i = 0; i < n - 1; ++i) {
+    diff[i] = (std::isnan(gl[i]) || std::isnan(gl[i + 1])) ? NAN : gl[i + 1] - gl[i];
+  }
+  for (int i = 3; i < n - 2; ++i) {
+    if (std::isnan(diff[i - 2]) || std::isnan(diff[i - 1]) ||
+        std::isnan(diff[i]) || std::isnan(diff[i + 1])) {
+      continue;
+    }
+    if (diff[i - 2] >= 0 && diff[i - 1] >= 0 && diff[i] <= 0 && diff[i + 1] <= 0) {
+      marks[i] = 1;
+    }
+  }
+  return marks;
+}
+
+} // namespace cgmguru_grid
+
+#endif // CGMGURU_GRID_ENGINE_H
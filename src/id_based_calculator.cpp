@@ -2,12 +2,15 @@
 
 
 // Group indices by ID
-void IdBasedCalculator::group_by_id(const StringVector& id, int n) {
-  id_indices.clear();
-  for (int i = 0; i < n; ++i) {
-    std::string current_id = as<std::string>(id[i]);
-    id_indices[current_id].push_back(i);
-  }
+void IdBasedCalculator::group_by_id(SEXP id, int n) {
+  cgmguru_profile::ScopedStage stage(profiler, "group_by_id");
+  id_grouping = cgmguru_ids::group_rows_by_id(id, n);
+  id_indices = id_grouping.to_map();
+}
+
+void IdBasedCalculator::use_id_grouping(const cgmguru_ids::IdGroups& groups) {
+  id_grouping = groups;
+  id_indices = id_grouping.to_map();
 }
 
 // Extract subset data for a specific ID
@@ -23,6 +26,24 @@ void IdBasedCalculator::extract_id_subset(const std::string& current_id,
   }
 }
 
+// Snapshot id_indices in map order
+std::vector<const IdBasedCalculator::IdGroup*> IdBasedCalculator::ordered_id_groups() const {
+  std::vector<const IdGroup*> groups;
+  groups.reserve(id_indices.size());
+  for (auto const& id_pair : id_indices) {
+    groups.push_back(&id_pair);
+  }
+  return groups;
+}
+
+// Column values of one id without copying when its rows are contiguous
+cgmguru_columns::DoubleSpan IdBasedCalculator::id_column_rows(std::size_t k,
+                                                              const double* column,
+                                                              std::vector<double>& scratch) const {
+  return cgmguru_columns::column_rows(column, id_grouping.group_begin(k),
+                                      id_grouping.group_end(k), scratch);
+}
+
 // Count episodes and find start times for a specific ID
 void IdBasedCalculator::process_episodes(const std::string& current_id,
                      const IntegerVector& result_subset,
@@ -48,6 +69,43 @@ void IdBasedCalculator::process_episodes(const std::string& current_id,
 
 }
 
+void IdBasedCalculator::process_episodes(const std::string& current_id,
+                     const std::vector<int>& result_subset,
+                     cgmguru_columns::DoubleSpan time_subset,
+                     cgmguru_columns::DoubleSpan gl_subset) {
+  int episode_count = 0;
+  std::vector<double> episode_time;
+  std::vector<double> episode_gl;
+  for (size_t i = 0; i < result_subset.size(); ++i) {
+    bool is_episode_start = (result_subset[i] == 1) &&
+                           (i == 0 || result_subset[i-1] == 0);
+
+    if (is_episode_start) {
+      episode_count++;
+      episode_time.push_back(time_subset[i]);
+      episode_gl.push_back(gl_subset[i]);
+    }
+  }
+
+  episode_counts[current_id] = episode_count;
+  episode_time_formatted[current_id] = episode_time;
+  episode_gl_values[current_id] = episode_gl;
+}
+
+// Merge per-id results (ordered like id_indices) back to original order
+IntegerVector IdBasedCalculator::merge_ordered_results(const std::vector<std::vector<int>>& ordered_results, int n) {
+  IntegerVector final_result(n, 0);
+  size_t k = 0;
+  for (auto const& id_pair : id_indices) {
+    const std::vector<int>& indices = id_pair.second;
+    const std::vector<int>& result_subset = ordered_results[k++];
+    for (size_t i = 0; i < indices.size(); ++i) {
+      final_result[indices[i]] = result_subset[i];
+    }
+  }
+  return final_result;
+}
+
 // Create episode counts DataFrame
 DataFrame IdBasedCalculator::create_episode_counts_df() {
   std::vector<std::string> ids_for_df;
@@ -2,6 +2,9 @@
 #define ID_BASED_CALCULATOR_H
 
 #include <Rcpp.h>
+#include "column_view.h"
+#include "id_grouping.h"
+#include "stage_profiler.h"
 #include <string>
 #include <map>
 #include <vector>
@@ -13,15 +16,24 @@ using namespace std;
 // Base class for ID-based calculations
 class IdBasedCalculator {
 protected:
+  typedef std::map<std::string, std::vector<int>>::value_type IdGroup;
+
   std::map<std::string, std::vector<int>> id_indices;
+  // CSR grouping behind id_indices (same group order)
+  cgmguru_ids::IdGroups id_grouping;
   std::map<std::string, int> episode_counts;
   std::map<std::string, std::vector<double>> episode_time_formatted;
   std::map<std::string, std::vector<double>> episode_gl_values;
   // Default timezone to apply to POSIXct outputs created by base helpers
   std::string default_output_tz = "UTC";
+  // Stage timings, recorded only when enabled with enable_profiling()
+  cgmguru_profile::StageProfiler profiler;
+
+  // Group indices by ID (character or factor id column)
+  void group_by_id(SEXP id, int n);
 
-  // Group indices by ID
-  void group_by_id(const StringVector& id, int n);
+  // Reuse a grouping made elsewhere (e.g. by a GridContext)
+  void use_id_grouping(const cgmguru_ids::IdGroups& groups);
 
   // Extract subset data for a specific ID
   void extract_id_subset(const std::string& current_id,
@@ -31,16 +43,33 @@ protected:
                          NumericVector& time_subset,
                          NumericVector& gl_subset);
 
+  // id_indices entries in map order, so per-id work can be dispatched by position
+  std::vector<const IdGroup*> ordered_id_groups() const;
+
+  // Column values of the k-th id in ordered_id_groups() order, read in place
+  // when its rows are contiguous and otherwise gathered into scratch
+  cgmguru_columns::DoubleSpan id_column_rows(std::size_t k,
+                                             const double* column,
+                                             std::vector<double>& scratch) const;
+
   // Count episodes and find start times for a specific ID
   void process_episodes(const std::string& current_id,
                        const IntegerVector& result_subset,
                        const NumericVector& time_subset,
                        const NumericVector& gl_subset);
 
+  void process_episodes(const std::string& current_id,
+                       const std::vector<int>& result_subset,
+                       cgmguru_columns::DoubleSpan time_subset,
+                       cgmguru_columns::DoubleSpan gl_subset);
+
   // Merge results back to original order
   template<typename T>
   T merge_results(const std::map<std::string, T>& id_results, int n);
 
+  // Merge per-id results stored in ordered_id_groups() order
+  IntegerVector merge_ordered_results(const std::vector<std::vector<int>>& ordered_results, int n);
+
   // Create episode counts DataFrame
   DataFrame create_episode_counts_df();
 
@@ -54,6 +83,10 @@ public:
   virtual ~IdBasedCalculator() = default;
   // Set the default output timezone for time vectors constructed by base helpers
   inline void set_default_output_tz(const std::string& tz) { if (!tz.empty()) default_output_tz = tz; }
+  // Record per-stage timings during later calculations
+  inline void enable_profiling(bool enabled = true) { profiler.set_enabled(enabled); }
+  // Recorded stages as a tibble (stage, id, seconds, heap_bytes)
+  inline DataFrame profile_table() const { return profiler.to_dataframe(); }
 };
 
 // Template function implementation (must be in header)
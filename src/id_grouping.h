@@ -0,0 +1,207 @@
+#ifndef CGMGURU_ID_GROUPING_H
+#define CGMGURU_ID_GROUPING_H
+
+#include <Rcpp.h>
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One-pass grouping of rows by subject id.
+//
+// Rows are keyed on the CHARSXP pointer of a character id column (R interns
+// strings, so equal ids share a pointer) or on the integer code of a factor,
+// so no std::string is built per row. Consecutive rows with the same key skip
+// the hash lookup entirely, which makes already-sorted input a single linear
+// scan. Labels are materialised once per distinct id and sorted with
+// std::string ordering, so groups come out in exactly the order a
+// std::map<std::string, ...> keyed on the ids would produce.
+namespace cgmguru_ids {
+
+struct IdGroups {
+  // Distinct id labels in lexicographic (std::map) order
+  std::vector<std::string> labels;
+  // CSR layout: rows of group g are rows[offsets[g]] .. rows[offsets[g + 1] - 1]
+  std::vector<int> offsets;
+  // 0-based row indices, in input order within each group
+  std::vector<int> rows;
+  // Group of every input row, or -1 when the row was dropped
+  std::vector<int> row_group;
+  // True when every group occupies one contiguous block of input rows and the
+  // blocks appear in label order (rows[k] == rows[0] + k for every k)
+  bool contiguous = true;
+
+  size_t size() const { return labels.size(); }
+  bool empty() const { return labels.empty(); }
+
+  int group_size(size_t g) const { return offsets[g + 1] - offsets[g]; }
+  const int* group_begin(size_t g) const { return rows.data() + offsets[g]; }
+  const int* group_end(size_t g) const { return rows.data() + offsets[g + 1]; }
+
+  std::vector<int> group_rows(size_t g) const {
+    return std::vector<int>(group_begin(g), group_end(g));
+  }
+
+  // Position of every input row within its group, or -1 when the row was
+  // dropped, so a global row index maps to (row_group[i], position) in O(1)
+  std::vector<int> row_positions() const {
+    std::vector<int> positions(row_group.size(), -1);
+    for (size_t g = 0; g < labels.size(); ++g) {
+      for (int k = offsets[g]; k < offsets[g + 1]; ++k) {
+        positions[rows[k]] = k - offsets[g];
+      }
+    }
+    return positions;
+  }
+
+  // Compatibility view for code that still walks a string-keyed map
+  std::map<std::string, std::vector<int>> to_map() const {
+    std::map<std::string, std::vector<int>> out;
+    for (size_t g = 0; g < labels.size(); ++g) {
+      out.emplace_hint(out.end(), labels[g], group_rows(g));
+    }
+    return out;
+  }
+};
+
+struct KeepAllRows {
+  bool operator()(R_xlen_t) const { return true; }
+};
+
+namespace detail {
+
+// Convert per-row local codes into sorted, merged CSR groups. code_labels[c]
+// is the label of local code c; different codes may share a label (e.g. the
+// same bytes under different declared encodings) and are merged.
+inline void finalize_groups(IdGroups& groups,
+                            const std::vector<int>& row_code,
+                            const std::vector<std::string>& code_labels) {
+  const size_t n_codes = code_labels.size();
+  std::vector<int> order(n_codes);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](int lhs, int rhs) {
+    return code_labels[lhs] < code_labels[rhs];
+  });
+
+  std::vector<int> code_group(n_codes, -1);
+  groups.labels.clear();
+  groups.labels.reserve(n_codes);
+  for (size_t k = 0; k < n_codes; ++k) {
+    const int code = order[k];
+    if (groups.labels.empty() || groups.labels.back() != code_labels[code]) {
+      groups.labels.push_back(code_labels[code]);
+    }
+    code_group[code] = static_cast<int>(groups.labels.size()) - 1;
+  }
+
+  const size_t n = row_code.size();
+  const size_t n_groups = groups.labels.size();
+  groups.row_group.assign(n, -1);
+  groups.offsets.assign(n_groups + 1, 0);
+  for (size_t i = 0; i < n; ++i) {
+    if (row_code[i] < 0) continue;
+    const int g = code_group[row_code[i]];
+    groups.row_group[i] = g;
+    ++groups.offsets[g + 1];
+  }
+  for (size_t g = 0; g < n_groups; ++g) {
+    groups.offsets[g + 1] += groups.offsets[g];
+  }
+
+  groups.rows.assign(static_cast<size_t>(groups.offsets[n_groups]), 0);
+  std::vector<int> cursor(groups.offsets.begin(), groups.offsets.end() - 1);
+  groups.contiguous = true;
+  int previous_row = -1;
+  int previous_group = -1;
+  for (size_t i = 0; i < n; ++i) {
+    const int g = groups.row_group[i];
+    if (g < 0) continue;
+    groups.rows[cursor[g]++] = static_cast<int>(i);
+    if (groups.contiguous &&
+        ((previous_row >= 0 && static_cast<int>(i) != previous_row + 1) ||
+         g < previous_group)) {
+      groups.contiguous = false;
+    }
+    previous_row = static_cast<int>(i);
+    previous_group = g;
+  }
+}
+
+} // namespace detail
+
+// Group the first n rows of id. keep(i) may drop rows (missing time/glucose,
+// filtered rows, ...). NA ids are dropped when drop_na_ids is true; otherwise
+// they form their own "NA" group, matching as<std::string>(NA_STRING).
+template <typename Keep>
+IdGroups group_rows_by_id(SEXP id, R_xlen_t n, bool drop_na_ids, Keep keep) {
+  IdGroups groups;
+  std::vector<int> row_code(static_cast<size_t>(n), -1);
+  std::vector<std::string> code_labels;
+
+  if (Rf_isFactor(id)) {
+    const int* codes = INTEGER(id);
+    SEXP levels = Rf_getAttrib(id, R_LevelsSymbol);
+    const R_xlen_t n_levels = Rf_xlength(levels);
+    std::vector<int> level_code(static_cast<size_t>(n_levels) + 1, -1);
+    int na_code = -1;
+    for (R_xlen_t i = 0; i < n; ++i) {
+      if (!keep(i)) continue;
+      const int level = codes[i];
+      if (level == NA_INTEGER || level < 1 || level > n_levels) {
+        if (drop_na_ids) continue;
+        if (na_code < 0) {
+          na_code = static_cast<int>(code_labels.size());
+          code_labels.push_back("NA");
+        }
+        row_code[i] = na_code;
+        continue;
+      }
+      int& code = level_code[level];
+      if (code < 0) {
+        code = static_cast<int>(code_labels.size());
+        code_labels.push_back(CHAR(STRING_ELT(levels, level - 1)));
+      }
+      row_code[i] = code;
+    }
+    detail::finalize_groups(groups, row_code, code_labels);
+    return groups;
+  }
+
+  if (TYPEOF(id) != STRSXP) {
+    Rcpp::Shield<SEXP> id_chr(Rf_coerceVector(id, STRSXP));
+    return group_rows_by_id(id_chr, n, drop_na_ids, keep);
+  }
+
+  std::unordered_map<SEXP, int> code_of;
+  SEXP previous = nullptr;
+  int previous_code = -1;
+  for (R_xlen_t i = 0; i < n; ++i) {
+    if (!keep(i)) continue;
+    SEXP current = STRING_ELT(id, i);
+    if (current == NA_STRING && drop_na_ids) continue;
+    if (current != previous) {
+      auto found = code_of.find(current);
+      if (found == code_of.end()) {
+        previous_code = static_cast<int>(code_labels.size());
+        code_of.emplace(current, previous_code);
+        code_labels.push_back(current == NA_STRING ? "NA" : CHAR(current));
+      } else {
+        previous_code = found->second;
+      }
+      previous = current;
+    }
+    row_code[i] = previous_code;
+  }
+  detail::finalize_groups(groups, row_code, code_labels);
+  return groups;
+}
+
+inline IdGroups group_rows_by_id(SEXP id, R_xlen_t n, bool drop_na_ids = false) {
+  return group_rows_by_id(id, n, drop_na_ids, KeepAllRows());
+}
+
+} // namespace cgmguru_ids
+
+#endif // CGMGURU_ID_GROUPING_H
@@ -1,4 +1,5 @@
 #include "event_preprocessing.h"
+#include "id_grouping.h"
 
 #include <Rcpp.h>
 #include <map>
@@ -50,25 +51,23 @@ DataFrame interpolate_cgm_cpp(DataFrame df,
   NumericVector glucose = df["gl"];
   const std::string tzone = timezone_from_time(time);
 
-  std::map<std::string, std::vector<int>> id_indices;
-  for (int i = 0; i < n; ++i) {
-    if (StringVector::is_na(id[i])) {
-      continue;
-    }
-    id_indices[as<std::string>(id[i])].push_back(i);
-  }
+  std::map<std::string, std::vector<int>> id_indices =
+    cgmguru_ids::group_rows_by_id(id, n, true).to_map();
 
   cgmguru_events::sort_or_validate_id_indices(id_indices, time, sort_time);
 
   cgmguru_events::InterpolatedDataStore interpolated_data;
   interpolated_data.reserve_rows(static_cast<size_t>(n), id_indices.size(), false);
 
+  // Reused by every subject to infer its reading interval
+  std::vector<double> interval_scratch;
   for (auto const& id_pair : id_indices) {
     const std::string& current_id = id_pair.first;
     const std::vector<int>& indices = id_pair.second;
 
     double id_reading_minutes =
-      cgmguru_events::reading_minutes_for_id(reading_minutes, time, indices, n);
+      cgmguru_events::reading_minutes_for_id(reading_minutes, time, indices, n,
+                                             interval_scratch);
 
     if (id_reading_minutes > inter_gap + 1e-7) {
       stop("reading_minutes must be less than or equal to inter_gap");
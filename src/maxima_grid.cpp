@@ -1,5 +1,6 @@
 #include <Rcpp.h>
-#include <map>
+#include "grid_context.h"
+#include "stage_profiler.h"
 #include <vector>
 #include <algorithm>
 #include <string>
@@ -7,384 +8,263 @@
 using namespace Rcpp;
 using namespace std;
 
-// [[Rcpp::export]]
-List maxima_grid(DataFrame df, double threshold = 130, double gap = 60, double hours = 2) {
-    // Ultra-optimized implementation that combines all algorithm steps in a single function
-    // Eliminates function call overhead and optimizes memory allocation
-
-    // --- STEP 0: Pre-allocate and extract data ---
-    const int n = df.nrows();
-    if (n == 0) {
-        DataFrame empty_results = DataFrame::create();
-        empty_results.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
-        DataFrame empty_counts = DataFrame::create();
-        empty_counts.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
-        return List::create(_["results"] = empty_results, _["episode_counts"] = empty_counts);
+// Episodes of one subject, in the order maxima_grid() returns them. Indices
+// are 1-based rows of the full data frame.
+struct SubjectMaxima {
+    vector<double> grid_times;
+    vector<double> grid_gls;
+    vector<double> maxima_times;
+    vector<double> maxima_gls;
+    vector<double> time_to_peak;
+    vector<int> grid_indices;
+    vector<int> maxima_indices;
+
+    size_t size() const { return grid_times.size(); }
+
+    void reserve(size_t n) {
+        grid_times.reserve(n);
+        grid_gls.reserve(n);
+        maxima_times.reserve(n);
+        maxima_gls.reserve(n);
+        time_to_peak.reserve(n);
+        grid_indices.reserve(n);
+        maxima_indices.reserve(n);
     }
 
-    const StringVector id = df["id"];
-    const NumericVector time = df["time"];
-    const NumericVector gl = df["gl"];
-
-    // Optional timezone column and default tz from time attr
-    bool has_tz_col = df.containsElementNamed("tz");
-    CharacterVector tz_col;
-    if (has_tz_col) {
-        tz_col = df["tz"];
+    void append(const SubjectMaxima& other) {
+        grid_times.insert(grid_times.end(), other.grid_times.begin(), other.grid_times.end());
+        grid_gls.insert(grid_gls.end(), other.grid_gls.begin(), other.grid_gls.end());
+        maxima_times.insert(maxima_times.end(), other.maxima_times.begin(), other.maxima_times.end());
+        maxima_gls.insert(maxima_gls.end(), other.maxima_gls.begin(), other.maxima_gls.end());
+        time_to_peak.insert(time_to_peak.end(), other.time_to_peak.begin(), other.time_to_peak.end());
+        grid_indices.insert(grid_indices.end(), other.grid_indices.begin(), other.grid_indices.end());
+        maxima_indices.insert(maxima_indices.end(), other.maxima_indices.begin(),
+                              other.maxima_indices.end());
     }
-    std::string default_tz = "UTC";
-    RObject tz_attr = time.attr("tzone");
-    if (!tz_attr.isNULL()) {
-        CharacterVector tz_attr_cv = as<CharacterVector>(tz_attr);
-        if (tz_attr_cv.size() > 0 && !CharacterVector::is_na(tz_attr_cv[0])) {
-            default_tz = as<std::string>(tz_attr_cv[0]);
+};
+
+// Algorithm steps 1-9 for one subject given its GRID and local maxima marks.
+// indices maps the subject's readings to rows of the data frame. Nothing here
+// calls the R API, so parameter sweeps run it on worker threads.
+static void maxima_grid_subject(cgmguru_columns::DoubleSpan id_times,
+                                cgmguru_columns::DoubleSpan id_gls,
+                                const int* indices,
+                                const vector<int>& grid_binary,
+                                const vector<int>& local_maxima_binary,
+                                double gap, double hours,
+                                SubjectMaxima& out) {
+    const int id_size = static_cast<int>(id_times.size());
+    if (id_size < 4) return; // Need at least 4 points for GRID
+
+    // --- STEP 1: GRID Detection (shared engine, cached per gap/threshold) ---
+    vector<int> grid_start_indices;
+    grid_start_indices.reserve(id_size / 10); // Estimate
+
+    // Find GRID start points (optimized)
+    for (int i = 0; i < id_size; ++i) {
+        if (grid_binary[i] == 1 && (i == 0 || grid_binary[i-1] == 0)) {
+            grid_start_indices.push_back(i);
         }
     }
 
-    // Pre-allocate vectors with reserve for better memory performance
-    vector<string> result_ids;
-    vector<double> result_grid_times;
-    vector<double> result_grid_gls;
-    vector<double> result_maxima_times;
-    vector<double> result_maxima_gls;
-    vector<double> result_time_to_peak;
-    vector<int> result_grid_indices;  // Store original GRID indices
-    vector<int> result_maxima_indices; // Store maxima indices
+    if (grid_start_indices.empty()) return;
 
-    // Estimate output size based on input size and reserve memory
-    const int estimated_output = max(10, n / 50); // Conservative estimate
-    result_ids.reserve(estimated_output);
-    result_grid_times.reserve(estimated_output);
-    result_grid_gls.reserve(estimated_output);
-    result_maxima_times.reserve(estimated_output);
-    result_maxima_gls.reserve(estimated_output);
-    result_time_to_peak.reserve(estimated_output);
-    result_grid_indices.reserve(estimated_output);
-    result_maxima_indices.reserve(estimated_output);
-
-    // Use map to preserve ID order (instead of unordered_map for consistent ordering)
-    map<string, vector<int>> id_indices;
-    map<string, int> episode_counts;
-    map<string, string> id_timezones;
-
-    // --- STEP 1: Group by ID (optimized) ---
-    for (int i = 0; i < n; ++i) {
-        const string current_id = as<string>(id[i]);
-        id_indices[current_id].push_back(i);
-    }
-
-    // --- STEP 2: Process each ID independently (algorithm steps 1-9 combined) ---
-    for (const auto& id_pair : id_indices) {
-        const string& current_id = id_pair.first;
-        const vector<int>& indices = id_pair.second;
-        const int id_size = indices.size();
-
-        // Keep every subject represented in episode_counts, even when no
-        // GRID/maxima episode is detected for that subject.
-        episode_counts[current_id] = 0;
-
-        // Determine tz for this id (first row's tz if provided; else default)
-        std::string tz_for_id = default_tz;
-        if (has_tz_col && !indices.empty()) {
-            int idx0 = indices.front();
-            if (idx0 >= 0 && idx0 < tz_col.size() && !CharacterVector::is_na(tz_col[idx0])) {
-                tz_for_id = as<std::string>(tz_col[idx0]);
-            }
-        }
-        if (tz_for_id.empty()) tz_for_id = default_tz;
-        id_timezones[current_id] = tz_for_id;
+    // --- STEP 2: Modified GRID (inline optimized) ---
+    cgmguru_grid::RangeMarks mod_grid_marks(id_size);
+    vector<int> mod_grid_start_indices;
+    mod_grid_start_indices.reserve(grid_start_indices.size());
 
-        if (id_size < 4) continue; // Need at least 4 points for GRID
+    const double hours_seconds = hours * 3600;
+    const double gap_seconds = gap * 60;
+    const bool time_sorted = cgmguru_window::is_nondecreasing(id_times);
 
-        // Extract data for this ID (pre-allocated vectors)
-        vector<double> id_times(id_size);
-        vector<double> id_gls(id_size);
+    for (int grid_idx : grid_start_indices) {
+        const double end_time = id_times[grid_idx];
+        const double window_start_time = end_time - hours_seconds;
 
-        for (int i = 0; i < id_size; ++i) {
-            id_times[i] = time[indices[i]];
-            id_gls[i] = gl[indices[i]];
+        // Binary search for start index (optimization)
+        int start_idx = grid_idx;
+        while (start_idx > 0 && id_times[start_idx-1] >= window_start_time) {
+            start_idx--;
         }
 
-        // --- STEP 1: GRID Detection (inline optimized) ---
-        vector<int> grid_binary(id_size, 0);
-        vector<int> grid_start_indices;
-        grid_start_indices.reserve(id_size / 10); // Estimate
-
-        for (int j = 3; j < id_size; ++j) {
-            // Skip NA values
-            if (NumericVector::is_na(id_gls[j]) || NumericVector::is_na(id_gls[j-1]) ||
-                NumericVector::is_na(id_gls[j-2]) || NumericVector::is_na(id_gls[j-3])) {
-                continue;
-            }
-
-            // Calculate rates (optimized)
-            const double dt1 = (id_times[j] - id_times[j-1]) / 3600;
-            const double dt2 = (id_times[j-1] - id_times[j-2]) / 3600;
-            const double dt3 = (id_times[j-2] - id_times[j-3]) / 3600;
-
-            if (dt1 <= 0 || dt2 <= 0 || dt3 <= 0) continue;
-
-            const double rate1 = (id_gls[j] - id_gls[j-1]) / dt1;
-            const double rate2 = (id_gls[j-1] - id_gls[j-2]) / dt2;
-            const double rate3 = (id_gls[j-2] - id_gls[j-3]) / dt3;
-
-            // Apply GRID criteria
-            bool grid_triggered = false;
-            int mark_start_idx = -1;
-
-            if (rate1 >= 95 && rate2 >= 95 && threshold <= id_gls[j-2]) {
-                grid_triggered = true;
-                mark_start_idx = j-2;
-            } else if ((rate2 >= 90 && rate3 >= 90 && threshold <= id_gls[j-3]) ||
-                      (rate3 >= 90 && rate1 >= 90 && threshold <= id_gls[j-3])) {
-                grid_triggered = true;
-                mark_start_idx = j-3;
-            }
+        // Find minimum in window
+        double min_value = R_PosInf;
+        int min_idx = start_idx;
 
-            if (grid_triggered && mark_start_idx >= 0) {
-                const double gap_seconds = gap * 60;
-
-                // Mark points within gap window - EXACT match to original GRID logic
-                for (int k = j; k < id_size && (id_times[k] - id_times[j]) <= gap_seconds; ++k) {
-                    if (mark_start_idx == j-2) {
-                        // Match original: if (k >= 2) GRID_subset[k-2] = 1;
-                        if (k >= 2) {
-                            grid_binary[k-2] = 1;
-                        }
-                    } else { // mark_start_idx == j-3
-                        // Match original: if (k >= 3) GRID_subset[k-3] = 1;
-                        if (k >= 3) {
-                            grid_binary[k-3] = 1;
-                        }
-                    }
-                }
+        for (int j = start_idx; j <= grid_idx; ++j) {
+            if (!NumericVector::is_na(id_gls[j]) && id_gls[j] < min_value) {
+                min_value = id_gls[j];
+                min_idx = j;
             }
         }
 
-        // Find GRID start points (optimized)
-        for (int i = 0; i < id_size; ++i) {
-            if (grid_binary[i] == 1 && (i == 0 || grid_binary[i-1] == 0)) {
-                grid_start_indices.push_back(i);
-            }
-        }
-
-        if (grid_start_indices.empty()) continue;
-
-        // --- STEP 2: Modified GRID (inline optimized) ---
-        vector<int> mod_grid_binary(id_size, 0);
-        vector<int> mod_grid_start_indices;
-        mod_grid_start_indices.reserve(grid_start_indices.size());
-
-        const double hours_seconds = hours * 3600;
-        const double gap_seconds = gap * 60;
-
-        for (int grid_idx : grid_start_indices) {
-            const double end_time = id_times[grid_idx];
-            const double window_start_time = end_time - hours_seconds;
+        // Mark gap period from minimum
+        const double gap_end_time = id_times[min_idx] + gap_seconds;
+        mod_grid_marks.mark(min_idx, cgmguru_window::forward_window_end(
+            id_times, min_idx, gap_end_time, time_sorted));
+    }
+    const vector<int> mod_grid_binary = mod_grid_marks.fill();
 
-            // Binary search for start index (optimization)
-            int start_idx = grid_idx;
-            while (start_idx > 0 && id_times[start_idx-1] >= window_start_time) {
-                start_idx--;
-            }
+    // Find mod_GRID start points
+    for (int i = 0; i < id_size; ++i) {
+        if (mod_grid_binary[i] == 1 && (i == 0 || mod_grid_binary[i-1] == 0)) {
+            mod_grid_start_indices.push_back(i);
+        }
+    }
 
-            // Find minimum in window
-            double min_value = R_PosInf;
-            int min_idx = start_idx;
+    if (mod_grid_start_indices.empty()) return;
 
-            for (int j = start_idx; j <= grid_idx; ++j) {
-                if (!NumericVector::is_na(id_gls[j]) && id_gls[j] < min_value) {
-                    min_value = id_gls[j];
-                    min_idx = j;
-                }
-            }
-
-            // Mark gap period from minimum
-            const double gap_end_time = id_times[min_idx] + gap_seconds;
-            for (int k = min_idx; k < id_size && id_times[k] <= gap_end_time; ++k) {
-                mod_grid_binary[k] = 1;
-            }
-        }
+    // --- STEP 3: Find maxima after hours (inline optimized) ---
+    vector<int> max_after_hours_indices;
+    max_after_hours_indices.reserve(mod_grid_start_indices.size());
 
-        // Find mod_GRID start points
-        for (int i = 0; i < id_size; ++i) {
-            if (mod_grid_binary[i] == 1 && (i == 0 || mod_grid_binary[i-1] == 0)) {
-                mod_grid_start_indices.push_back(i);
-            }
-        }
+    for (size_t i = 0; i < mod_grid_start_indices.size(); ++i) {
+        const int start_idx = mod_grid_start_indices[i];
+        const double window_end_time = id_times[start_idx] + hours_seconds;
 
-        if (mod_grid_start_indices.empty()) continue;
-
-        // --- STEP 3: Find maxima after hours (inline optimized) ---
-        vector<int> max_after_hours_indices;
-        max_after_hours_indices.reserve(mod_grid_start_indices.size());
-
-        for (size_t i = 0; i < mod_grid_start_indices.size(); ++i) {
-            const int start_idx = mod_grid_start_indices[i];
-            const double window_end_time = id_times[start_idx] + hours_seconds;
-
-            int end_idx;
-            if (i + 1 < mod_grid_start_indices.size()) {
-                const int next_start = mod_grid_start_indices[i + 1];
-                const double next_time = id_times[next_start];
-                if ((next_time - id_times[start_idx]) < hours_seconds) {
-                    end_idx = next_start;
-                } else {
-                    int j = start_idx;
-                    while (j < id_size && id_times[j] <= window_end_time) {
-                        j++;
-                    }
-                    end_idx = j - 1;
-                }
-            } else { // Last start point
+        int end_idx;
+        if (i + 1 < mod_grid_start_indices.size()) {
+            const int next_start = mod_grid_start_indices[i + 1];
+            const double next_time = id_times[next_start];
+            if ((next_time - id_times[start_idx]) < hours_seconds) {
+                end_idx = next_start;
+            } else {
                 int j = start_idx;
                 while (j < id_size && id_times[j] <= window_end_time) {
                     j++;
                 }
                 end_idx = j - 1;
             }
+        } else { // Last start point
+            int j = start_idx;
+            while (j < id_size && id_times[j] <= window_end_time) {
+                j++;
+            }
+            end_idx = j - 1;
+        }
 
-            // Find maximum in range
-            double max_value = R_NegInf;
-            int max_idx = start_idx;
+        // Find maximum in range
+        double max_value = R_NegInf;
+        int max_idx = start_idx;
 
-            for (int j = start_idx; j <= end_idx && j < id_size; ++j) {
-                if (!NumericVector::is_na(id_gls[j]) && id_gls[j] > max_value) {
-                    max_value = id_gls[j];
-                    max_idx = j;
-                }
+        for (int j = start_idx; j <= end_idx && j < id_size; ++j) {
+            if (!NumericVector::is_na(id_gls[j]) && id_gls[j] > max_value) {
+                max_value = id_gls[j];
+                max_idx = j;
             }
-
-            max_after_hours_indices.push_back(max_idx);
         }
 
-        // --- STEP 4: Find local maxima (inline optimized) ---
-        vector<int> local_maxima_indices;
-        local_maxima_indices.reserve(id_size / 20); // Estimate
-
-        if (id_size >= 5) {
-            // Pre-calculate differences for efficiency
-            vector<double> diff_gl(id_size - 1);
-            for (int i = 0; i < id_size - 1; ++i) {
-                if (NumericVector::is_na(id_gls[i]) || NumericVector::is_na(id_gls[i+1])) {
-                    diff_gl[i] = NA_REAL;
-                } else {
-                    diff_gl[i] = id_gls[i+1] - id_gls[i];
-                }
-            }
+        max_after_hours_indices.push_back(max_idx);
+    }
 
-            // Find local maxima
-            for (int i = 3; i < id_size - 2; ++i) {
-                if (!NumericVector::is_na(diff_gl[i-2]) && !NumericVector::is_na(diff_gl[i-1]) &&
-                    !NumericVector::is_na(diff_gl[i]) && !NumericVector::is_na(diff_gl[i+1])) {
+    // --- STEP 4: Find local maxima (shared engine, cached per subject) ---
+    vector<int> local_maxima_indices;
+    local_maxima_indices.reserve(id_size / 20); // Estimate
+    for (int i = 0; i < id_size; ++i) {
+        if (local_maxima_binary[i] == 1) {
+            local_maxima_indices.push_back(i);
+        }
+    }
 
-                    if (diff_gl[i-2] >= 0 && diff_gl[i-1] >= 0 &&
-                        diff_gl[i] <= 0 && diff_gl[i+1] <= 0) {
-                        local_maxima_indices.push_back(i);
-                    }
-                }
+    // --- STEP 5: Find new maxima (inline optimized) ---
+    vector<int> final_maxima_indices;
+    final_maxima_indices.reserve(max_after_hours_indices.size());
+
+    for (int mod_idx : max_after_hours_indices) {
+        const double mod_time = id_times[mod_idx];
+        const double window_start = mod_time;
+        const double window_end = mod_time + 2 * 3600; // 2 hours
+
+        // Find local maxima in window (using binary search for efficiency)
+        vector<int> candidates_in_window;
+        for (int local_idx : local_maxima_indices) {
+            const double local_time = id_times[local_idx];
+            if (local_time >= window_start && local_time <= window_end) {
+                candidates_in_window.push_back(local_idx);
             }
         }
 
-        // --- STEP 5: Find new maxima (inline optimized) ---
-        vector<int> final_maxima_indices;
-        final_maxima_indices.reserve(max_after_hours_indices.size());
-
-        for (int mod_idx : max_after_hours_indices) {
-            const double mod_time = id_times[mod_idx];
-            const double window_start = mod_time;
-            const double window_end = mod_time + 2 * 3600; // 2 hours
-
-            // Find local maxima in window (using binary search for efficiency)
-            vector<int> candidates_in_window;
-            for (int local_idx : local_maxima_indices) {
-                const double local_time = id_times[local_idx];
-                if (local_time >= window_start && local_time <= window_end) {
-                    candidates_in_window.push_back(local_idx);
+        if (candidates_in_window.empty()) {
+            final_maxima_indices.push_back(mod_idx);
+        } else {
+            // Find maximum among candidates
+            double max_gl = id_gls[mod_idx];
+            int best_idx = mod_idx;
+
+            for (int candidate_idx : candidates_in_window) {
+                if (id_gls[candidate_idx] > max_gl) {
+                    max_gl = id_gls[candidate_idx];
+                    best_idx = candidate_idx;
                 }
             }
 
-            if (candidates_in_window.empty()) {
-                final_maxima_indices.push_back(mod_idx);
-            } else {
-                // Find maximum among candidates
-                double max_gl = id_gls[mod_idx];
-                int best_idx = mod_idx;
-
-                for (int candidate_idx : candidates_in_window) {
-                    if (id_gls[candidate_idx] > max_gl) {
-                        max_gl = id_gls[candidate_idx];
-                        best_idx = candidate_idx;
-                    }
-                }
-
-                final_maxima_indices.push_back(best_idx);
-            }
+            final_maxima_indices.push_back(best_idx);
         }
+    }
 
-        // --- STEP 6-9: Transform summary and detect between maxima (inline optimized) ---
-        // CRITICAL FIX: Use ORIGINAL GRID episode starts, not modified GRID starts
-        // The original maxima_GRID uses grid_result$episode_start_total which comes from
-        // the original GRID detection, NOT the modified GRID!
+    // --- STEP 6-9: Transform summary and detect between maxima (inline optimized) ---
+    // CRITICAL FIX: Use ORIGINAL GRID episode starts, not modified GRID starts
+    // The original maxima_GRID uses grid_result$episode_start_total which comes from
+    // the original GRID detection, NOT the modified GRID!
 
-        // Step 6A: Find original GRID episode starts (different from modified GRID)
-        vector<int> original_grid_start_indices;
+    // Step 6A: Find original GRID episode starts (different from modified GRID)
+    vector<int> original_grid_start_indices;
 
-        // Use the same GRID detection logic as the original but collect episode starts
-        for (int i = 0; i < id_size; ++i) {
-            if (grid_binary[i] == 1 && (i == 0 || grid_binary[i-1] == 0)) {
-                original_grid_start_indices.push_back(i);
-            }
+    // Use the same GRID detection logic as the original but collect episode starts
+    for (int i = 0; i < id_size; ++i) {
+        if (grid_binary[i] == 1 && (i == 0 || grid_binary[i-1] == 0)) {
+            original_grid_start_indices.push_back(i);
         }
+    }
 
-        // Match original transformSummaryDf logic exactly
-        vector<double> transform_grid_times;
-        vector<double> transform_grid_gls;
-        vector<double> transform_maxima_times;
-        vector<double> transform_maxima_gls;
-        vector<int> transform_grid_indices;  // Store GRID indices
-        vector<int> transform_maxima_indices; // Store maxima indices
-        double max_gl;
-        int max_gl_index;
-
-        // Process each ORIGINAL GRID start episode to find its best maxima within 4 hours
-        for (int grid_idx : original_grid_start_indices) {
-            const double grid_time = id_times[grid_idx];
-            const double grid_gl = id_gls[grid_idx];
-
-            max_gl = -1;
-            max_gl_index = -1;
-
-            // Find best maxima within 4 hours for this GRID episode
-            for (size_t j = 0; j < final_maxima_indices.size(); ++j) {
-                const int maxima_idx = final_maxima_indices[j];
-                const double maxima_time = id_times[maxima_idx];
-                const double maxima_gl = id_gls[maxima_idx];
-
-                const double potential_max_points = maxima_time - grid_time;
-
-                if (potential_max_points >= 0 && potential_max_points <= 4 * 3600) {
-                    if (maxima_gl > max_gl) {
-                        max_gl = maxima_gl;
-                        max_gl_index = static_cast<int>(j);
-                    }
+    // Match original transformSummaryDf logic exactly
+    vector<double> transform_grid_times;
+    vector<double> transform_grid_gls;
+    vector<double> transform_maxima_times;
+    vector<double> transform_maxima_gls;
+    vector<int> transform_grid_indices;  // Store GRID indices
+    vector<int> transform_maxima_indices; // Store maxima indices
+    double max_gl;
+    int max_gl_index;
+
+    // Process each ORIGINAL GRID start episode to find its best maxima within 4 hours
+    for (int grid_idx : original_grid_start_indices) {
+        const double grid_time = id_times[grid_idx];
+        const double grid_gl = id_gls[grid_idx];
+
+        max_gl = -1;
+        max_gl_index = -1;
+
+        // Find best maxima within 4 hours for this GRID episode
+        for (size_t j = 0; j < final_maxima_indices.size(); ++j) {
+            const int maxima_idx = final_maxima_indices[j];
+            const double maxima_time = id_times[maxima_idx];
+            const double maxima_gl = id_gls[maxima_idx];
+
+            const double potential_max_points = maxima_time - grid_time;
+
+            if (potential_max_points >= 0 && potential_max_points <= 4 * 3600) {
+                if (maxima_gl > max_gl) {
+                    max_gl = maxima_gl;
+                    max_gl_index = static_cast<int>(j);
                 }
             }
+        }
 
-            // Only include episodes where a valid maxima was found (original logic: max_gl_index != -1)
-            if (max_gl_index != -1) {
-                const int best_maxima_idx = final_maxima_indices[max_gl_index];
-                transform_grid_times.push_back(grid_time);
-                transform_grid_gls.push_back(grid_gl);
-                transform_maxima_times.push_back(id_times[best_maxima_idx]);
-                transform_maxima_gls.push_back(max_gl);
-                transform_grid_indices.push_back(grid_idx);  // Store GRID index
-                transform_maxima_indices.push_back(best_maxima_idx);  // Store maxima index
-            }
+        // Only include episodes where a valid maxima was found (original logic: max_gl_index != -1)
+        if (max_gl_index != -1) {
+            const int best_maxima_idx = final_maxima_indices[max_gl_index];
+            transform_grid_times.push_back(grid_time);
+            transform_grid_gls.push_back(grid_gl);
+            transform_maxima_times.push_back(id_times[best_maxima_idx]);
+            transform_maxima_gls.push_back(max_gl);
+            transform_grid_indices.push_back(grid_idx);  // Store GRID index
+            transform_maxima_indices.push_back(best_maxima_idx);  // Store maxima index
         }
+    }
 
     // Detect between maxima (FIXED to match detectBetweenMaxima logic exactly)
-    int current_episode_count = 0;
     const int n = transform_grid_times.size();
 
     // Process consecutive pairs (i from 1 to n-1) - ALWAYS process all pairs
@@ -463,16 +343,14 @@ List maxima_grid(DataFrame df, double threshold = 130, double gap = 60, double h
         }
 
         // ALWAYS store result for episode i-1 (not conditional)
-        result_ids.push_back(current_id);
-        result_grid_times.push_back(prev_grid_time);
-        result_grid_gls.push_back(prev_grid_gl);
-        result_maxima_times.push_back(result_time);
-        result_maxima_gls.push_back(result_value);
-        result_time_to_peak.push_back(time_to_peak);
+        out.grid_times.push_back(prev_grid_time);
+        out.grid_gls.push_back(prev_grid_gl);
+        out.maxima_times.push_back(result_time);
+        out.maxima_gls.push_back(result_value);
+        out.time_to_peak.push_back(time_to_peak);
         // Convert within-subject indices to full dataset indices (1-based for R)
-        result_grid_indices.push_back(indices[transform_grid_indices[i-1]] + 1);
-        result_maxima_indices.push_back(indices[transform_maxima_indices[i-1]] + 1);
-        current_episode_count++;
+        out.grid_indices.push_back(indices[transform_grid_indices[i-1]] + 1);
+        out.maxima_indices.push_back(indices[transform_maxima_indices[i-1]] + 1);
     }
 
     // Handle last element (index n-1) - matching second code's logic
@@ -508,27 +386,100 @@ List maxima_grid(DataFrame df, double threshold = 130, double gap = 60, double h
         }
 
         // Store the last result
-        result_ids.push_back(current_id);
-        result_grid_times.push_back(n-1 < static_cast<int>(transform_grid_times.size()) ?
+        out.grid_times.push_back(n-1 < static_cast<int>(transform_grid_times.size()) ?
                                     transform_grid_times[n-1] : NA_REAL);
-        result_grid_gls.push_back(n-1 < static_cast<int>(transform_grid_gls.size()) ?
+        out.grid_gls.push_back(n-1 < static_cast<int>(transform_grid_gls.size()) ?
                                 transform_grid_gls[n-1] : NA_REAL);
-        result_maxima_times.push_back(last_result_time);
-        result_maxima_gls.push_back(last_result_value);
-        result_time_to_peak.push_back(last_time_to_peak);
+        out.maxima_times.push_back(last_result_time);
+        out.maxima_gls.push_back(last_result_value);
+        out.time_to_peak.push_back(last_time_to_peak);
         // Convert within-subject indices to full dataset indices (1-based for R)
-        result_grid_indices.push_back(n-1 < static_cast<int>(transform_grid_indices.size()) ?
+        out.grid_indices.push_back(n-1 < static_cast<int>(transform_grid_indices.size()) ?
                                     indices[transform_grid_indices[n-1]] + 1 : -1);
-        result_maxima_indices.push_back(n-1 < static_cast<int>(transform_maxima_indices.size()) ?
+        out.maxima_indices.push_back(n-1 < static_cast<int>(transform_maxima_indices.size()) ?
                                       indices[transform_maxima_indices[n-1]] + 1 : -1);
-        current_episode_count++;
+    }
+}
+
+// POSIXct column of episode times
+static NumericVector maxima_time_column(const vector<double>& times, const std::string& tz) {
+    NumericVector out = wrap(times);
+    out.attr("class") = "POSIXct";
+    out.attr("tzone") = tz;
+    return out;
+}
+
+// Per-id timezone map attached to the result tables
+static CharacterVector maxima_tzone_by_id(const cgmguru_grid::GridContext& context) {
+    const std::vector<std::string>& id_list = context.groups().labels;
+    CharacterVector tz_map(id_list.size());
+    CharacterVector name_vec(id_list.size());
+    for (size_t g = 0; g < id_list.size(); ++g) {
+        name_vec[g] = id_list[g];
+        tz_map[g] = context.subject_tz(g);
+    }
+    tz_map.attr("names") = name_vec;
+    return tz_map;
+}
+
+// All algorithm steps in one pass per subject. Grouping, GRID marks and local
+// maxima come from the context, so a reused grid_context() skips them.
+static List maxima_grid_from_context(cgmguru_grid::GridContext& context,
+                                     double threshold, double gap, double hours,
+                                     cgmguru_profile::StageProfiler& profiler) {
+    // --- STEP 0: Pre-allocate and extract data ---
+    const int n = context.n_rows();
+    if (n == 0) {
+        DataFrame empty_results = DataFrame::create();
+        empty_results.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+        DataFrame empty_counts = DataFrame::create();
+        empty_counts.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+        return List::create(_["results"] = empty_results, _["episode_counts"] = empty_counts);
     }
 
-        // CORRECTED: Episode count should always equal n (matching second code's behavior)
-        // Second code always produces n results, one for each minima/GRID point
-        episode_counts[current_id] = current_episode_count;  // Changed from current_episode_count to n
+    const std::string& default_tz = context.default_tz();
+
+    // Pre-allocate vectors with reserve for better memory performance
+    vector<string> result_ids;
+    SubjectMaxima results;
+
+    // Estimate output size based on input size and reserve memory
+    const int estimated_output = max(10, n / 50); // Conservative estimate
+    result_ids.reserve(estimated_output);
+    results.reserve(estimated_output);
+
+    // One count per subject, in id order, even when no GRID/maxima episode is
+    // detected for that subject
+    const cgmguru_ids::IdGroups& id_groups = context.groups();
+    vector<int> episode_counts(id_groups.size(), 0);
+
+    // --- STEP 1: Group by ID and run GRID (done once by the context) ---
+    const vector<vector<int>>* marks = nullptr;
+    {
+        cgmguru_profile::ScopedStage stage(profiler, "grid_marks");
+        marks = &context.grid_marks(gap, threshold, true);
+    }
+    const vector<vector<int>>& grid_by_id = *marks;
+
+    // --- STEP 2: Process each ID independently (algorithm steps 1-9 combined) ---
+    for (size_t g = 0; g < id_groups.size(); ++g) {
+        if (id_groups.group_size(g) < 4) continue; // Need at least 4 points for GRID
+
+        cgmguru_profile::ScopedStage stage(profiler, "maxima_subject",
+                                           profiler.subject(id_groups.labels[g]));
+        // This ID's data, viewed in place when its rows are contiguous
+        SubjectMaxima subject;
+        maxima_grid_subject(context.subject_time(g), context.subject_gl(g),
+                            id_groups.group_begin(g), grid_by_id[g],
+                            context.local_maxima(g), gap, hours, subject);
+        result_ids.insert(result_ids.end(), subject.size(), id_groups.labels[g]);
+        results.append(subject);
+        episode_counts[g] = static_cast<int>(subject.size());
     }
 
+    // The output tables run to the end of the call
+    cgmguru_profile::ScopedStage output_stage(profiler, "output_tables");
+
     // --- Create final output (optimized) ---
     DataFrame results_df;
     if (result_ids.empty()) {
@@ -542,61 +493,151 @@ List maxima_grid(DataFrame df, double threshold = 130, double gap = 60, double h
             _["grid_index"] = IntegerVector::create(),
             _["maxima_index"] = IntegerVector::create()
         );
-        results_df.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
     } else {
-        // Create POSIXct time vectors (with proper POSIXt inheritance)
-        NumericVector grid_times_vec = wrap(result_grid_times);
-        grid_times_vec.attr("class") = "POSIXct";
-        grid_times_vec.attr("tzone") = default_tz;
-
-        NumericVector maxima_times_vec = wrap(result_maxima_times);
-        maxima_times_vec.attr("class") = "POSIXct";
-        maxima_times_vec.attr("tzone") = default_tz;
-
         results_df = DataFrame::create(
             _["id"] = wrap(result_ids),
-            _["grid_time"] = grid_times_vec,
-            _["grid_gl"] = wrap(result_grid_gls),
-            _["maxima_time"] = maxima_times_vec,
-            _["maxima_glucose"] = wrap(result_maxima_gls),
-            _["time_to_peak_min"] = wrap(result_time_to_peak),
-            _["grid_index"] = wrap(result_grid_indices),
-            _["maxima_index"] = wrap(result_maxima_indices)
+            _["grid_time"] = maxima_time_column(results.grid_times, default_tz),
+            _["grid_gl"] = wrap(results.grid_gls),
+            _["maxima_time"] = maxima_time_column(results.maxima_times, default_tz),
+            _["maxima_glucose"] = wrap(results.maxima_gls),
+            _["time_to_peak_min"] = wrap(results.time_to_peak),
+            _["grid_index"] = wrap(results.grid_indices),
+            _["maxima_index"] = wrap(results.maxima_indices)
         );
-        results_df.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
-    }
-
-    // Create episode counts DataFrame
-    vector<string> count_ids;
-    vector<int> counts;
-    count_ids.reserve(episode_counts.size());
-    counts.reserve(episode_counts.size());
-
-    for (const auto& pair : episode_counts) {
-        count_ids.push_back(pair.first);
-        counts.push_back(pair.second);
     }
+    results_df.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
 
     DataFrame counts_df = DataFrame::create(
-        _["id"] = wrap(count_ids),
-        _["episode_counts"] = wrap(counts)
+        _["id"] = wrap(id_groups.labels),
+        _["episode_counts"] = wrap(episode_counts)
     );
     counts_df.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
 
     // Attach per-id timezone map to results_df
-    if (!id_timezones.empty()) {
-        std::vector<std::string> id_list;
-        id_list.reserve(id_indices.size());
-        for (const auto& id_pair : id_indices) {
-            id_list.push_back(id_pair.first);
+    if (!id_groups.empty()) {
+        CharacterVector tz_map = maxima_tzone_by_id(context);
+        results_df.attr("tzone_by_id") = tz_map;
+        counts_df.attr("tzone_by_id") = tz_map;
+    }
+
+    return List::create(
+        _["results"] = results_df,
+        _["episode_counts"] = counts_df
+    );
+}
+
+// Every (threshold, gap, hours) combination on one context. The rate classes
+// that do not depend on the parameters and the local maxima are computed once
+// per subject; each combination then only marks its GRID episodes and runs
+// the later steps. Combinations run on worker threads and the tables are
+// built afterwards on the calling thread, in combination order.
+static List maxima_grid_sweep_from_context(cgmguru_grid::GridContext& context,
+                                           const NumericVector& threshold,
+                                           const NumericVector& gap,
+                                           const NumericVector& hours,
+                                           int n_threads) {
+    const R_xlen_t n_sets = threshold.size();
+    if (gap.size() != n_sets || hours.size() != n_sets) {
+        stop("threshold, gap and hours must have the same length");
+    }
+    const cgmguru_ids::IdGroups& id_groups = context.groups();
+    const size_t n_subjects = id_groups.size();
+
+    // --- Shared per-subject inputs ---
+    const vector<vector<int>>& local_maxima = context.local_maxima(n_threads);
+    vector<cgmguru_grid::GridRates> rates(n_subjects);
+    cgmguru_parallel::parallel_for(n_subjects, n_threads, [&](size_t g) {
+        rates[g] = cgmguru_grid::grid_rates(context.subject_time(g), context.subject_gl(g), true);
+    });
+
+    // --- Every combination against the shared inputs ---
+    vector<vector<SubjectMaxima>> by_set(n_sets);
+    const double* threshold_ptr = threshold.begin();
+    const double* gap_ptr = gap.begin();
+    const double* hours_ptr = hours.begin();
+    cgmguru_parallel::parallel_for(static_cast<size_t>(n_sets), n_threads, [&](size_t p) {
+        by_set[p].resize(n_subjects);
+        for (size_t g = 0; g < n_subjects; ++g) {
+            if (id_groups.group_size(g) < 4) continue; // Need at least 4 points for GRID
+            const cgmguru_columns::DoubleSpan id_times = context.subject_time(g);
+            const cgmguru_columns::DoubleSpan id_gls = context.subject_gl(g);
+            const vector<int> grid_binary =
+                cgmguru_grid::grid_marks(rates[g], id_times, id_gls, gap_ptr[p], threshold_ptr[p]);
+            maxima_grid_subject(id_times, id_gls, id_groups.group_begin(g), grid_binary,
+                                local_maxima[g], gap_ptr[p], hours_ptr[p], by_set[p][g]);
         }
-        CharacterVector tz_map(id_list.size());
-        CharacterVector name_vec(id_list.size());
-        for (size_t i = 0; i < id_list.size(); ++i) {
-            name_vec[i] = id_list[i];
-            tz_map[i] = id_timezones[id_list[i]];
+    });
+
+    // --- Long tables keyed by parameter set ---
+    size_t n_results = 0;
+    for (const vector<SubjectMaxima>& set : by_set) {
+        for (const SubjectMaxima& subject : set) n_results += subject.size();
+    }
+    const size_t n_counts = static_cast<size_t>(n_sets) * n_subjects;
+
+    CharacterVector labels = wrap(id_groups.labels);
+    IntegerVector result_set(n_results), count_set(n_counts);
+    NumericVector result_threshold(n_results), result_gap(n_results), result_hours(n_results);
+    NumericVector count_threshold(n_counts), count_gap(n_counts), count_hours(n_counts);
+    CharacterVector result_ids(n_results), count_ids(n_counts);
+    IntegerVector counts(n_counts);
+    SubjectMaxima results;
+    results.reserve(n_results);
+
+    size_t row = 0, count_row = 0;
+    for (R_xlen_t p = 0; p < n_sets; ++p) {
+        for (size_t g = 0; g < n_subjects; ++g) {
+            const SubjectMaxima& subject = by_set[p][g];
+            for (size_t k = 0; k < subject.size(); ++k, ++row) {
+                result_set[row] = static_cast<int>(p) + 1;
+                result_threshold[row] = threshold[p];
+                result_gap[row] = gap[p];
+                result_hours[row] = hours[p];
+                SET_STRING_ELT(result_ids, row, STRING_ELT(labels, g));
+            }
+            results.append(subject);
+
+            count_set[count_row] = static_cast<int>(p) + 1;
+            count_threshold[count_row] = threshold[p];
+            count_gap[count_row] = gap[p];
+            count_hours[count_row] = hours[p];
+            SET_STRING_ELT(count_ids, count_row, STRING_ELT(labels, g));
+            counts[count_row] = static_cast<int>(subject.size());
+            ++count_row;
         }
-        tz_map.attr("names") = name_vec;
+        // Release each combination once it has been copied out
+        vector<SubjectMaxima>().swap(by_set[p]);
+    }
+
+    const std::string& default_tz = context.default_tz();
+    DataFrame results_df = DataFrame::create(
+        _["param_set"] = result_set,
+        _["threshold"] = result_threshold,
+        _["gap"] = result_gap,
+        _["hours"] = result_hours,
+        _["id"] = result_ids,
+        _["grid_time"] = maxima_time_column(results.grid_times, default_tz),
+        _["grid_gl"] = wrap(results.grid_gls),
+        _["maxima_time"] = maxima_time_column(results.maxima_times, default_tz),
+        _["maxima_glucose"] = wrap(results.maxima_gls),
+        _["time_to_peak_min"] = wrap(results.time_to_peak),
+        _["grid_index"] = wrap(results.grid_indices),
+        _["maxima_index"] = wrap(results.maxima_indices)
+    );
+    results_df.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+
+    DataFrame counts_df = DataFrame::create(
+        _["param_set"] = count_set,
+        _["threshold"] = count_threshold,
+        _["gap"] = count_gap,
+        _["hours"] = count_hours,
+        _["id"] = count_ids,
+        _["episode_counts"] = counts
+    );
+    counts_df.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+
+    if (n_subjects > 0) {
+        CharacterVector tz_map = maxima_tzone_by_id(context);
         results_df.attr("tzone_by_id") = tz_map;
         counts_df.attr("tzone_by_id") = tz_map;
     }
@@ -606,3 +647,48 @@ List maxima_grid(DataFrame df, double threshold = 130, double gap = 60, double h
         _["episode_counts"] = counts_df
     );
 }
+
+// [[Rcpp::export]]
+List maxima_grid(DataFrame df, double threshold = 130, double gap = 60, double hours = 2,
+                 bool profile = false) {
+    cgmguru_profile::StageProfiler profiler;
+    profiler.set_enabled(profile);
+    std::unique_ptr<cgmguru_grid::GridContext> context;
+    {
+        cgmguru_profile::ScopedStage stage(profiler, "grid_context");
+        context.reset(new cgmguru_grid::GridContext(df));
+    }
+    List result = maxima_grid_from_context(*context, threshold, gap, hours, profiler);
+    if (profile) {
+        result.attr("profile") = profiler.to_dataframe();
+    }
+    return result;
+}
+
+// [[Rcpp::export]]
+List grid_context_maxima_grid_cpp(SEXP context, double threshold = 130, double gap = 60,
+                                  double hours = 2, bool profile = false) {
+    cgmguru_profile::StageProfiler profiler;
+    profiler.set_enabled(profile);
+    List result = maxima_grid_from_context(*cgmguru_grid::grid_context_from_sexp(context),
+                                           threshold, gap, hours, profiler);
+    if (profile) {
+        result.attr("profile") = profiler.to_dataframe();
+    }
+    return result;
+}
+
+// [[Rcpp::export]]
+List maxima_grid_sweep_cpp(DataFrame df, NumericVector threshold, NumericVector gap,
+                           NumericVector hours, int n_threads = 1) {
+    cgmguru_grid::GridContext context(df);
+    return maxima_grid_sweep_from_context(context, threshold, gap, hours, n_threads);
+}
+
+// [[Rcpp::export]]
+List grid_context_maxima_grid_sweep_cpp(SEXP context, NumericVector threshold,
+                                        NumericVector gap, NumericVector hours,
+                                        int n_threads = 1) {
+    return maxima_grid_sweep_from_context(*cgmguru_grid::grid_context_from_sexp(context),
+                                          threshold, gap, hours, n_threads);
+}
@@ -1,5 +1,11 @@
 #include <Rcpp.h>
+#include "grid_context.h"
+#include "grid_engine.h"
 #include "id_based_calculator.h"
+#include "parallel_executor.h"
+
+#include <memory>
+
 using namespace Rcpp;
 using namespace std;
 
@@ -15,31 +21,19 @@ class ModGridCalculator : public IdBasedCalculator {
     // Store timezone information per ID
     std::map<std::string, std::string> id_timezones;
 
-    // Calculate mod_grid for a single ID
-    IntegerVector calculate_mod_grid_for_id(const NumericVector& time_subset,
-                                         const NumericVector& gl_subset,
-                                         const std::vector<int>& original_indices,
-                                         IntegerVector grid_point,
-                                         double hours,
-                                         double gap) {
-      int n_subset = time_subset.length();
-      IntegerVector mod_grid_subset(n_subset, 0);
-
-      if (n_subset == 0) return mod_grid_subset;
-
-      // Find which GRIDpoint indices belong to this ID subset
-      std::vector<int> relevant_grid_points;
-      for (int i = 0; i < grid_point.size(); ++i) {
-        int grid_point_index = grid_point[i] - 1; // Convert to 0-based
-
-        // Check if this gridpoint belongs to current ID subset
-        for (size_t j = 0; j < original_indices.size(); ++j) {
-          if (original_indices[j] == grid_point_index) {
-            relevant_grid_points.push_back(j); // Store subset index
-            break;
-          }
-        }
-      }
+    // Calculate mod_grid for a single ID (plain buffers only; runs on worker threads)
+    // relevant_grid_points holds the subset positions of this ID's GRID
+    // points, in grid_point order
+    std::vector<int> calculate_mod_grid_for_id(cgmguru_columns::DoubleSpan time_subset,
+                                               cgmguru_columns::DoubleSpan gl_subset,
+                                               const std::vector<int>& relevant_grid_points,
+                                               double hours,
+                                               double gap) const {
+      int n_subset = static_cast<int>(time_subset.size());
+      if (n_subset == 0) return std::vector<int>();
+
+      const bool time_sorted = cgmguru_window::is_nondecreasing(time_subset);
+      cgmguru_grid::RangeMarks mod_grid_marks(n_subset);
 
       // Process each relevant gridpoint for this ID
       for (int grid_point_subset_idx : relevant_grid_points) {
@@ -49,11 +43,8 @@ class ModGridCalculator : public IdBasedCalculator {
         double window_start_time = time_subset[end_index] - hours * 60 * 60;
 
         // Find start_index within the time window
-        int start_index = end_index;
-        while (start_index >= 0 && time_subset[start_index] >= window_start_time) {
-          start_index--;
-        }
-        start_index++; // Move to first valid index
+        int start_index = cgmguru_window::backward_window_begin(
+          time_subset, end_index, window_start_time, time_sorted);
 
         // Find minimum within the time window
         double min_value = R_PosInf;
@@ -68,25 +59,24 @@ class ModGridCalculator : public IdBasedCalculator {
 
         // Mark gap period starting from minimum point
         double gap_end_time = time_subset[mod_grid_min_point] + gap * 60;
-        for (int j = mod_grid_min_point; j < n_subset && time_subset[j] <= gap_end_time; ++j) {
-          mod_grid_subset[j] = 1;
-        }
+        mod_grid_marks.mark(mod_grid_min_point, cgmguru_window::forward_window_end(
+          time_subset, mod_grid_min_point, gap_end_time, time_sorted));
       }
 
-      return mod_grid_subset;
+      return mod_grid_marks.fill();
     }
 
     // Enhanced episode processing that also stores data for total DataFrame
     void process_episodes_with_total(const std::string& current_id,
-                                   const IntegerVector& mod_grid_subset,
-                                   const NumericVector& time_subset,
-                                   const NumericVector& gl_subset) {
+                                   const std::vector<int>& mod_grid_subset,
+                                   cgmguru_columns::DoubleSpan time_subset,
+                                   cgmguru_columns::DoubleSpan gl_subset) {
       // First do the standard episode processing
       process_episodes(current_id, mod_grid_subset, time_subset, gl_subset);
 
       // Then collect data for total DataFrame
       const std::vector<int>& indices = id_indices[current_id];
-      for (int i = 0; i < mod_grid_subset.length(); ++i) {
+      for (size_t i = 0; i < mod_grid_subset.size(); ++i) {
         bool is_episode_start = (mod_grid_subset[i] == 1) &&
                                (i == 0 || mod_grid_subset[i-1] == 0);
 
@@ -124,66 +114,73 @@ class ModGridCalculator : public IdBasedCalculator {
       return df;
     }
 
-  public:
-    List calculate(const DataFrame& df, IntegerVector grid_point, double hours, double gap) {
+    List calculate_mod_grid(const cgmguru_grid::GridContext& context, IntegerVector grid_point,
+                            double hours, double gap, int n_threads) {
       // Clear total episode storage
       total_episode_ids.clear();
       total_episode_times.clear();
       total_episode_gls.clear();
       total_episode_indices.clear();
 
-      // --- Step 1: Extract columns from DataFrame ---
-      int n = df.nrows();
-      StringVector id = df["id"];
-      NumericVector time = df["time"];
-      NumericVector gl = df["gl"];
-
-      // --- Step 1.5: Extract timezone information ---
-      // Get input timezone from time column attributes
-      std::string input_tz = "UTC"; // default
-      if (time.hasAttribute("tzone")) {
-        CharacterVector tz_attr = time.attr("tzone");
-        if (tz_attr.length() > 0) {
-          input_tz = as<std::string>(tz_attr[0]);
-        }
-      }
-      
+      // --- Step 1: Rows and the input timezone come from the context ---
+      int n = context.n_rows();
+      const std::string& input_tz = context.default_tz();
+
       // Set output timezone for base calculator - default to UTC
       set_default_output_tz("UTC");
 
       // --- Step 2: Separate calculation by ID ---
-      group_by_id(id, n);
-      
+      use_id_grouping(context.groups());
+
       // --- Step 2.5: Store timezone information per ID ---
       id_timezones.clear();
       for (auto const& id_pair : id_indices) {
         std::string current_id = id_pair.first;
         id_timezones[current_id] = input_tz; // Use input timezone for each ID
       }
-      std::map<std::string, IntegerVector> id_mod_grid_results;
 
-      // Calculate mod_grid for each ID separately
-      for (auto const& id_pair : id_indices) {
-        std::string current_id = id_pair.first;
-        const std::vector<int>& indices = id_pair.second;
-
-        // Extract subset data for this ID
-        NumericVector time_subset(indices.size());
-        NumericVector gl_subset(indices.size());
-        extract_id_subset(current_id, indices, time, gl, time_subset, gl_subset);
-
-        // Calculate mod_grid for this ID
-        IntegerVector mod_grid_subset = calculate_mod_grid_for_id(time_subset, gl_subset, indices, grid_point, hours, gap);
+      // Calculate mod_grid for each ID separately; the kernels only see the
+      // context's per-subject buffers so they can be spread over worker threads
+      std::vector<const IdGroup*> groups = ordered_id_groups();
+
+      // Route every GRID point to its ID and subset position in one pass
+      // instead of searching each ID's rows for every GRID point
+      std::vector<std::vector<int>> grid_positions(groups.size());
+      {
+        const std::vector<int> row_positions = id_grouping.row_positions();
+        for (int i = 0; i < grid_point.size(); ++i) {
+          if (grid_point[i] == NA_INTEGER) continue;
+          const int row = grid_point[i] - 1; // Convert to 0-based
+          if (row < 0 || row >= n || id_grouping.row_group[row] < 0) continue;
+          grid_positions[id_grouping.row_group[row]].push_back(row_positions[row]);
+        }
+      }
 
-        // Store result
-        id_mod_grid_results[current_id] = mod_grid_subset;
+      std::vector<cgmguru_columns::DoubleSpan> time_subsets(groups.size());
+      std::vector<cgmguru_columns::DoubleSpan> gl_subsets(groups.size());
+      std::vector<std::vector<int>> mod_grid_subsets(groups.size());
+
+      {
+        cgmguru_profile::ScopedStage stage(profiler, "mod_grid_marks");
+        cgmguru_parallel::parallel_for(groups.size(), n_threads, [&](std::size_t k) {
+          time_subsets[k] = context.subject_time(k);
+          gl_subsets[k] = context.subject_gl(k);
+          mod_grid_subsets[k] = calculate_mod_grid_for_id(time_subsets[k], gl_subsets[k],
+                                                          grid_positions[k], hours, gap);
+        });
+      }
 
-        // Process episodes for this ID (both standard and total)
-        process_episodes_with_total(current_id, mod_grid_subset, time_subset, gl_subset);
+      // Process episodes for each ID (both standard and total), in map order
+      for (std::size_t k = 0; k < groups.size(); ++k) {
+        cgmguru_profile::ScopedStage stage(profiler, "episodes", profiler.subject(groups[k]->first));
+        process_episodes_with_total(groups[k]->first, mod_grid_subsets[k], time_subsets[k], gl_subsets[k]);
       }
 
+      // Merging and the output tables run to the end of the call
+      cgmguru_profile::ScopedStage output_stage(profiler, "output_tables");
+
       // --- Step 3: Merge results back to original order ---
-      IntegerVector mod_grid_final = merge_results(id_mod_grid_results, n);
+      IntegerVector mod_grid_final = merge_ordered_results(mod_grid_subsets, n);
 
       // --- Step 4: Create output structures ---
       DataFrame counts_df = create_episode_counts_df();
@@ -200,10 +197,28 @@ class ModGridCalculator : public IdBasedCalculator {
         _["episode_start"] = episode_start_total_df
       );
     }
+
+  public:
+    List calculate(const DataFrame& df, IntegerVector grid_point, double hours, double gap, int n_threads = 1) {
+      profiler.clear();
+      std::unique_ptr<cgmguru_grid::GridContext> context;
+      {
+        cgmguru_profile::ScopedStage stage(profiler, "grid_context");
+        context.reset(new cgmguru_grid::GridContext(df));
+      }
+      return calculate_mod_grid(*context, grid_point, hours, gap, n_threads);
+    }
+
+    List calculate(const cgmguru_grid::GridContext& context, IntegerVector grid_point,
+                   double hours, double gap, int n_threads = 1) {
+      profiler.clear();
+      return calculate_mod_grid(context, grid_point, hours, gap, n_threads);
+    }
   };
 
     // [[Rcpp::export]]
-  List mod_grid(DataFrame df, DataFrame grid_point_df, double hours = 2, double gap = 15) {
+  List mod_grid(DataFrame df, DataFrame grid_point_df, double hours = 2, double gap = 15, int n_threads = 1,
+                bool profile = false) {
       // Check if DataFrame has at least one column
     if (grid_point_df.length() == 0) {
       stop("DataFrame must have at least one column");
@@ -213,5 +228,27 @@ class ModGridCalculator : public IdBasedCalculator {
     IntegerVector grid_point = as<IntegerVector>(grid_point_df[0]);
     
     ModGridCalculator calculator;
-    return calculator.calculate(df, grid_point, hours, gap);
+    calculator.enable_profiling(profile);
+    List result = calculator.calculate(df, grid_point, hours, gap, n_threads);
+    if (profile) {
+      result.attr("profile") = calculator.profile_table();
+    }
+    return result;
+  }
+
+// [[Rcpp::export]]
+List grid_context_mod_grid_cpp(SEXP context, DataFrame grid_point_df, double hours = 2,
+                               double gap = 15, int n_threads = 1, bool profile = false) {
+  if (grid_point_df.length() == 0) {
+    stop("DataFrame must have at least one column");
+  }
+  IntegerVector grid_point = as<IntegerVector>(grid_point_df[0]);
+  ModGridCalculator calculator;
+  calculator.enable_profiling(profile);
+  List result = calculator.calculate(*cgmguru_grid::grid_context_from_sexp(context), grid_point,
+                                     hours, gap, n_threads);
+  if (profile) {
+    result.attr("profile") = calculator.profile_table();
   }
+  return result;
+}
@@ -1,53 +1,24 @@
 #include <Rcpp.h>
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <limits>
 #include <numeric>
-#include <string>
+#include <unordered_map>
 #include <vector>
 
 using namespace Rcpp;
 
 namespace {
 
-struct SortKey {
-  enum class Type {
-    integer,
-    numeric,
-    character
-  };
-
-  Type type;
-  std::vector<int> int_values;
-  std::vector<double> numeric_values;
-  std::vector<std::string> character_values;
-  std::vector<bool> missing;
-
-  int compare(int lhs, int rhs) const {
-    const bool lhs_missing = missing[lhs];
-    const bool rhs_missing = missing[rhs];
-
-    if (lhs_missing || rhs_missing) {
-      if (lhs_missing == rhs_missing) return 0;
-      return lhs_missing ? 1 : -1;
-    }
+// Sort keys are unsigned 64-bit images of each column whose unsigned order
+// matches the column's order, with missing values mapped to the largest key
+// so they sort last. Rows are then ordered by a stable LSD radix sort on
+// (id key, time key), which breaks remaining ties by original row position.
+typedef std::uint64_t SortKey;
 
-    switch (type) {
-      case Type::integer:
-        if (int_values[lhs] < int_values[rhs]) return -1;
-        if (int_values[lhs] > int_values[rhs]) return 1;
-        return 0;
-      case Type::numeric:
-        if (numeric_values[lhs] < numeric_values[rhs]) return -1;
-        if (numeric_values[lhs] > numeric_values[rhs]) return 1;
-        return 0;
-      case Type::character:
-        if (character_values[lhs] < character_values[rhs]) return -1;
-        if (character_values[lhs] > character_values[rhs]) return 1;
-        return 0;
-    }
-
-    return 0;
-  }
-};
+const SortKey missing_key = std::numeric_limits<SortKey>::max();
 
 bool is_factor(SEXP x) {
   return Rf_inherits(x, "factor");
@@ -59,77 +30,135 @@ DataFrame subset_rows(DataFrame df, const IntegerVector& rows) {
   return out;
 }
 
-SortKey integer_key(SEXP x, int n) {
-  SortKey key;
-  key.type = SortKey::Type::integer;
-  key.int_values.resize(n);
-  key.missing.resize(n);
-
-  if (TYPEOF(x) == LGLSXP) {
-    LogicalVector values(x);
-    for (int i = 0; i < n; ++i) {
-      key.missing[i] = LogicalVector::is_na(values[i]);
-      key.int_values[i] = key.missing[i] ? 0 : values[i];
-    }
-  } else {
-    IntegerVector values(x);
-    for (int i = 0; i < n; ++i) {
-      key.missing[i] = IntegerVector::is_na(values[i]);
-      key.int_values[i] = key.missing[i] ? 0 : values[i];
-    }
-  }
+SortKey integer_sort_key(int value) {
+  // Flipping the sign bit turns two's complement order into unsigned order
+  return static_cast<SortKey>(static_cast<std::uint32_t>(value) ^ 0x80000000u);
+}
 
-  return key;
+SortKey double_sort_key(double value) {
+  if (value == 0) value = 0.0; // -0 and 0 compare equal
+  std::uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const std::uint64_t sign = std::uint64_t(1) << 63;
+  return (bits & sign) ? ~bits : (bits | sign);
 }
 
-SortKey numeric_key(SEXP x, int n) {
-  SortKey key;
-  key.type = SortKey::Type::numeric;
-  key.numeric_values.resize(n);
-  key.missing.resize(n);
+std::vector<SortKey> integer_keys(SEXP x, int n) {
+  std::vector<SortKey> keys(n);
+  const int* values = TYPEOF(x) == LGLSXP ? LOGICAL(x) : INTEGER(x);
+  for (int i = 0; i < n; ++i) {
+    keys[i] = values[i] == NA_INTEGER ? missing_key : integer_sort_key(values[i]);
+  }
+  return keys;
+}
 
+std::vector<SortKey> numeric_keys(SEXP x, int n) {
+  std::vector<SortKey> keys(n);
   Shield<SEXP> shield(Rf_coerceVector(x, REALSXP));
-  NumericVector values(shield);
+  const double* values = REAL(shield);
   for (int i = 0; i < n; ++i) {
-    key.missing[i] = NumericVector::is_na(values[i]);
-    key.numeric_values[i] = key.missing[i] ? 0.0 : values[i];
+    keys[i] = ISNAN(values[i]) ? missing_key : double_sort_key(values[i]);
   }
-
-  return key;
+  return keys;
 }
 
-SortKey character_key(SEXP x, int n) {
-  SortKey key;
-  key.type = SortKey::Type::character;
-  key.character_values.resize(n);
-  key.missing.resize(n);
-
+// Strings are replaced by their rank among the distinct values, so only the
+// distinct strings are ever compared. R caches CHARSXPs, which lets repeated
+// ids be recognised by pointer before any bytes are looked at.
+std::vector<SortKey> character_keys(SEXP x, int n) {
+  std::vector<SortKey> keys(n);
   Shield<SEXP> shield(Rf_coerceVector(x, STRSXP));
-  CharacterVector values(shield);
+
+  std::unordered_map<SEXP, std::size_t> slot_of;
+  std::vector<SEXP> distinct;
+  std::vector<std::size_t> slots(n);
   for (int i = 0; i < n; ++i) {
-    SEXP value = STRING_ELT(values, i);
-    key.missing[i] = (value == NA_STRING);
-    key.character_values[i] = key.missing[i] ? std::string() : std::string(CHAR(value));
+    SEXP value = STRING_ELT(shield, i);
+    if (value == NA_STRING) continue;
+    auto inserted = slot_of.emplace(value, distinct.size());
+    if (inserted.second) distinct.push_back(value);
+    slots[i] = inserted.first->second;
   }
 
-  return key;
+  std::vector<std::size_t> by_value(distinct.size());
+  std::iota(by_value.begin(), by_value.end(), 0);
+  std::sort(by_value.begin(), by_value.end(), [&](std::size_t lhs, std::size_t rhs) {
+    return std::strcmp(CHAR(distinct[lhs]), CHAR(distinct[rhs])) < 0;
+  });
+  // Equal bytes in different encodings share a rank
+  std::vector<SortKey> rank(distinct.size());
+  SortKey current = 0;
+  for (std::size_t k = 0; k < by_value.size(); ++k) {
+    if (k > 0 &&
+        std::strcmp(CHAR(distinct[by_value[k - 1]]), CHAR(distinct[by_value[k]])) != 0) {
+      ++current;
+    }
+    rank[by_value[k]] = current;
+  }
+
+  for (int i = 0; i < n; ++i) {
+    keys[i] = STRING_ELT(shield, i) == NA_STRING ? missing_key : rank[slots[i]];
+  }
+  return keys;
 }
 
-SortKey make_id_key(SEXP x, int n) {
-  if (is_factor(x) || TYPEOF(x) == INTSXP || TYPEOF(x) == LGLSXP) {
-    return integer_key(x, n);
+std::vector<SortKey> make_id_keys(SEXP x, int n) {
+  if (TYPEOF(x) == INTSXP || TYPEOF(x) == LGLSXP) {
+    return integer_keys(x, n);
   }
   if (TYPEOF(x) == REALSXP) {
-    return numeric_key(x, n);
+    return numeric_keys(x, n);
   }
-  return character_key(x, n);
+  return character_keys(x, n);
 }
 
-SortKey make_time_key(SEXP x, int n) {
+std::vector<SortKey> make_time_keys(SEXP x, int n) {
   if (TYPEOF(x) == REALSXP || TYPEOF(x) == INTSXP || TYPEOF(x) == LGLSXP) {
-    return numeric_key(x, n);
+    return numeric_keys(x, n);
+  }
+  return character_keys(x, n);
+}
+
+bool rows_already_ordered(const std::vector<SortKey>& id_keys,
+                          const std::vector<SortKey>& time_keys) {
+  for (std::size_t i = 1; i < id_keys.size(); ++i) {
+    if (id_keys[i] < id_keys[i - 1]) return false;
+    if (id_keys[i] == id_keys[i - 1] && time_keys[i] < time_keys[i - 1]) return false;
+  }
+  return true;
+}
+
+// Stable LSD radix sort of order by keys, one byte per pass. Bytes shared by
+// every key (the high bytes of timestamps, say) are skipped.
+void radix_sort_rows(const std::vector<SortKey>& keys,
+                     std::vector<int>& order,
+                     std::vector<int>& buffer) {
+  const std::size_t n = order.size();
+  std::vector<std::array<std::size_t, 256>> counts(sizeof(SortKey));
+  for (auto& pass_counts : counts) pass_counts.fill(0);
+  for (SortKey key : keys) {
+    for (std::size_t pass = 0; pass < sizeof(SortKey); ++pass) {
+      counts[pass][(key >> (8 * pass)) & 0xFF]++;
+    }
+  }
+
+  buffer.resize(n);
+  for (std::size_t pass = 0; pass < sizeof(SortKey); ++pass) {
+    std::array<std::size_t, 256>& pass_counts = counts[pass];
+    const unsigned shift = static_cast<unsigned>(8 * pass);
+    if (pass_counts[(keys[order[0]] >> shift) & 0xFF] == n) continue;
+
+    std::size_t offset = 0;
+    for (std::size_t& count : pass_counts) {
+      const std::size_t bucket = count;
+      count = offset;
+      offset += bucket;
+    }
+    for (int row : order) {
+      buffer[pass_counts[(keys[row] >> shift) & 0xFF]++] = row;
+    }
+    order.swap(buffer);
   }
-  return character_key(x, n);
 }
 
 } // namespace
@@ -159,21 +188,20 @@ DataFrame orderfast_cpp(DataFrame df) {
     return subset_rows(df, rows);
   }
 
-  SortKey id_key = make_id_key(id, n);
-  SortKey time_key = make_time_key(time, n);
+  std::vector<SortKey> id_keys = make_id_keys(id, n);
+  std::vector<SortKey> time_keys = make_time_keys(time, n);
+
+  // Pooled exports are usually written in order already
+  if (rows_already_ordered(id_keys, time_keys)) {
+    return df;
+  }
 
   std::vector<int> order(n);
   std::iota(order.begin(), order.end(), 0);
-
-  std::sort(order.begin(), order.end(), [&](int lhs, int rhs) {
-    const int id_cmp = id_key.compare(lhs, rhs);
-    if (id_cmp != 0) return id_cmp < 0;
-
-    const int time_cmp = time_key.compare(lhs, rhs);
-    if (time_cmp != 0) return time_cmp < 0;
-
-    return lhs < rhs;
-  });
+  std::vector<int> buffer;
+  // Least significant key first; each pass is stable
+  radix_sort_rows(time_keys, order, buffer);
+  radix_sort_rows(id_keys, order, buffer);
 
   IntegerVector rows(n);
   for (int i = 0; i < n; ++i) {
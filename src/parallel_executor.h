@@ -0,0 +1,98 @@
+#ifndef CGMGURU_PARALLEL_EXECUTOR_H
+#define CGMGURU_PARALLEL_EXECUTOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// Minimal worker pool used to run independent per-id kernels concurrently.
+//
+// Tasks executed through parallel_for() must only read and write plain C++
+// memory (std::vector buffers, raw pointers into already-materialised R
+// vectors). Calling the R API from a worker thread -- allocating vectors,
+// touching attributes, Rcpp::stop()/warning(), R_CheckUserInterrupt() -- is
+// not allowed, because R itself is single threaded. Callers collect the
+// per-task results into pre-sized slots and build R objects afterwards on the
+// main thread, in the same order the serial code would have produced them.
+namespace cgmguru_parallel {
+
+// Clamp the requested thread count to [1, min(n_tasks, hardware threads)].
+inline int resolve_thread_count(int n_threads, std::size_t n_tasks) {
+  if (n_threads < 1 || n_tasks < 2) {
+    return 1;
+  }
+  std::size_t workers = static_cast<std::size_t>(n_threads);
+  const unsigned int hardware = std::thread::hardware_concurrency();
+  if (hardware > 0) {
+    workers = std::min<std::size_t>(workers, hardware);
+  }
+  workers = std::min(workers, n_tasks);
+  return static_cast<int>(std::max<std::size_t>(workers, 1));
+}
+
+// Run task(k) for every k in [0, n_tasks). Work is handed out dynamically so
+// that uneven subject lengths still balance across workers. With a single
+// worker the tasks run inline on the calling thread, in order. The first
+// exception raised by any task is rethrown on the calling thread once every
+// worker has stopped.
+template <typename Task>
+void parallel_for(std::size_t n_tasks, int n_threads, Task task) {
+  const int workers = resolve_thread_count(n_threads, n_tasks);
+  if (workers <= 1) {
+    for (std::size_t k = 0; k < n_tasks; ++k) {
+      task(k);
+    }
+    return;
+  }
+
+  std::atomic<std::size_t> next_task(0);
+  std::atomic<bool> failed(false);
+  std::exception_ptr first_error;
+  std::mutex error_mutex;
+
+  auto worker = [&]() {
+    while (!failed.load(std::memory_order_relaxed)) {
+      const std::size_t k = next_task.fetch_add(1, std::memory_order_relaxed);
+      if (k >= n_tasks) {
+        break;
+      }
+      try {
+        task(k);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!first_error) {
+          first_error = std::current_exception();
+        }
+        failed.store(true, std::memory_order_relaxed);
+      }
+    }
+  };
+
+  std::vector<std::thread> pool;
+  pool.reserve(static_cast<std::size_t>(workers - 1));
+  for (int t = 1; t < workers; ++t) {
+    try {
+      pool.emplace_back(worker);
+    } catch (const std::system_error&) {
+      // Could not spawn more threads; continue with the ones we have.
+      break;
+    }
+  }
+  worker();
+  for (std::thread& thread : pool) {
+    thread.join();
+  }
+
+  if (first_error) {
+    std::rethrow_exception(first_error);
+  }
+}
+
+} // namespace cgmguru_parallel
+
+#endif // CGMGURU_PARALLEL_EXECUTOR_H
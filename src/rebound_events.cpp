@@ -102,8 +102,11 @@ cgmguru_events::PreparedIDData prepare_preprocessed_id_data(
 class ReboundEventsCalculator : public IdBasedCalculator {
 private:
   struct DetailedData {
-    std::vector<std::string> ids;
-    std::vector<std::string> types;
+    // Ids and types are interned; each event keeps their codes
+    cgmguru_strings::StringTable id_table;
+    cgmguru_strings::StringTable type_table;
+    std::vector<int> id_codes;
+    std::vector<int> type_codes;
     std::vector<double> start_times;
     std::vector<double> start_glucose;
     std::vector<double> end_times;
@@ -122,8 +125,10 @@ private:
     std::vector<double> minutes_to_rebound;
 
     void clear() {
-      ids.clear();
-      types.clear();
+      id_table.clear();
+      type_table.clear();
+      id_codes.clear();
+      type_codes.clear();
       start_times.clear();
       start_glucose.clear();
       end_times.clear();
@@ -143,8 +148,8 @@ private:
     }
 
     void reserve(size_t capacity) {
-      ids.reserve(capacity);
-      types.reserve(capacity);
+      id_codes.reserve(capacity);
+      type_codes.reserve(capacity);
       start_times.reserve(capacity);
       start_glucose.reserve(capacity);
       end_times.reserve(capacity);
@@ -164,7 +169,7 @@ private:
     }
 
     size_t size() const {
-      return ids.size();
+      return id_codes.size();
     }
   };
 
@@ -190,8 +195,8 @@ private:
       return;
     }
 
-    detailed_data.ids.push_back(current_id);
-    detailed_data.types.push_back(event.type);
+    detailed_data.id_codes.push_back(detailed_data.id_table.intern(current_id));
+    detailed_data.type_codes.push_back(detailed_data.type_table.intern(event.type));
     detailed_data.start_times.push_back(prepared.time[bridge_start_idx]);
     detailed_data.start_glucose.push_back(prepared.glucose[bridge_start_idx]);
     detailed_data.end_times.push_back(prepared.time[rebound_idx]);
@@ -224,8 +229,8 @@ private:
       posixct_vector(detailed_data.rebound_times, output_tzone);
 
     DataFrame df = DataFrame::create(
-      _["id"] = wrap(detailed_data.ids),
-      _["type"] = wrap(detailed_data.types),
+      _["id"] = detailed_data.id_table.character(detailed_data.id_codes),
+      _["type"] = detailed_data.type_table.character(detailed_data.type_codes),
       _["start_time"] = start_time_vec,
       _["start_glucose"] = wrap(detailed_data.start_glucose),
       _["end_time"] = end_time_vec,
@@ -305,7 +310,9 @@ public:
                  bool sort_time,
                  double inter_gap,
                  double rebound_minutes,
-                 bool return_interpolated) {
+                 bool return_interpolated,
+                 bool interpolated_factor_ids) {
+    profiler.clear();
     detailed_data.clear();
     interpolated_data.clear();
     total_days_by_id.clear();
@@ -324,7 +331,10 @@ public:
     output_tzone = timezone_from_time(time);
 
     group_by_id(id, n);
-    cgmguru_events::sort_or_validate_id_indices(id_indices, time, sort_time);
+    {
+      cgmguru_profile::ScopedStage stage(profiler, "sort_or_validate");
+      cgmguru_events::sort_or_validate_id_indices(id_indices, time, sort_time);
+    }
 
     std::vector<std::string> all_ids;
     all_ids.reserve(id_indices.size());
@@ -333,26 +343,33 @@ public:
       interpolated_data.reserve_rows(static_cast<size_t>(n), id_indices.size(), false);
     }
 
+    // Reused by every subject to infer its reading interval
+    std::vector<double> interval_scratch;
     for (const auto& id_pair : id_indices) {
       const std::string current_id = id_pair.first;
       const std::vector<int>& indices = id_pair.second;
       all_ids.push_back(current_id);
 
       double id_reading_minutes =
-        cgmguru_events::reading_minutes_for_id(reading_minutes_sexp, time, indices, n);
+        cgmguru_events::reading_minutes_for_id(reading_minutes_sexp, time, indices, n,
+                                               interval_scratch);
 
+      const int profile_subject = profiler.subject(current_id);
       cgmguru_events::PreparedIDData prepared;
-      if (data_source == "raw") {
-        id_reading_minutes =
-          cgmguru_events::iglu_day_grid_reading_minutes(id_reading_minutes);
-        prepared = cgmguru_events::prepare_id_data(
-          time, glucose, indices, id_reading_minutes, inter_gap, output_tzone,
-          true, true);
-      } else if (data_source == "preprocessed") {
-        prepared = prepare_preprocessed_id_data(
-          time, glucose, indices, id_reading_minutes);
-      } else {
-        stop("data_source must be 'raw' or 'preprocessed'");
+      {
+        cgmguru_profile::ScopedStage stage(profiler, "prepare_id_data", profile_subject);
+        if (data_source == "raw") {
+          id_reading_minutes =
+            cgmguru_events::iglu_day_grid_reading_minutes(id_reading_minutes);
+          prepared = cgmguru_events::prepare_id_data(
+            time, glucose, indices, id_reading_minutes, inter_gap, output_tzone,
+            true, true);
+        } else if (data_source == "preprocessed") {
+          prepared = prepare_preprocessed_id_data(
+            time, glucose, indices, id_reading_minutes);
+        } else {
+          stop("data_source must be 'raw' or 'preprocessed'");
+        }
       }
 
       const int current_row_offset = row_offset;
@@ -362,6 +379,8 @@ public:
         interpolated_data.append(current_id, prepared, false);
       }
 
+      // Detection and episode bookkeeping run to the end of this subject
+      cgmguru_profile::ScopedStage rebound_stage(profiler, "rebound", profile_subject);
       total_days_by_id[current_id] =
         cgmguru_events::recording_days(prepared.glucose, id_reading_minutes);
 
@@ -375,14 +394,19 @@ public:
       }
     }
 
-    List result = List::create(
-      _["events_total"] = create_events_total_df(all_ids, requested_types),
-      _["events_detailed"] = create_events_detailed_df()
-    );
+    List result;
+    {
+      cgmguru_profile::ScopedStage stage(profiler, "summarize_events");
+      result = List::create(
+        _["events_total"] = create_events_total_df(all_ids, requested_types),
+        _["events_detailed"] = create_events_detailed_df()
+      );
+    }
 
     if (return_interpolated) {
+      cgmguru_profile::ScopedStage stage(profiler, "interpolated_data");
       result["interpolated_data"] =
-        interpolated_data.to_dataframe(output_tzone, false);
+        interpolated_data.to_dataframe(output_tzone, false, interpolated_factor_ids);
     }
 
     return result;
@@ -399,8 +423,16 @@ List rebound_events_cpp(DataFrame df,
                         bool sort_time = false,
                         double inter_gap = 45,
                         double rebound_minutes = 120,
-                        bool return_interpolated = true) {
+                        bool return_interpolated = true,
+                        bool interpolated_factor_ids = false,
+                        bool profile = false) {
   ReboundEventsCalculator calculator;
-  return calculator.calculate(df, type, data_source, reading_minutes, sort_time,
-                              inter_gap, rebound_minutes, return_interpolated);
+  calculator.enable_profiling(profile);
+  List result = calculator.calculate(df, type, data_source, reading_minutes, sort_time,
+                                     inter_gap, rebound_minutes, return_interpolated,
+                                     interpolated_factor_ids);
+  if (profile) {
+    result.attr("profile") = calculator.profile_table();
+  }
+  return result;
 }
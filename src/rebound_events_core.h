@@ -38,6 +38,9 @@ inline std::vector<LevelOneEvent> detect_hypo_level1_events(
     const Rcpp::NumericVector& glucose,
     const cgmguru_events::SegmentRange& segment,
     double reading_minutes) {
+  // Level 1 episodes and their recoveries both last 15 minutes
+  const int readings_15 = cgmguru_events::readings_needed(15.0, reading_minutes);
+
   std::vector<LevelOneEvent> events;
 
   bool in_event = false;
@@ -64,7 +67,7 @@ inline std::vector<LevelOneEvent> detect_hypo_level1_events(
       continue;
     }
 
-    if (!duration_met(hypo_count, 15.0, reading_minutes)) {
+    if (hypo_count < readings_15) {
       in_event = false;
       event_start = -1;
       last_hypo_idx = -1;
@@ -79,7 +82,7 @@ inline std::vector<LevelOneEvent> detect_hypo_level1_events(
       if (glucose[k] < 70.0) break;
 
       ++recovery_count;
-      if (duration_met(recovery_count, 15.0, reading_minutes)) {
+      if (recovery_count >= readings_15) {
         recovery_end_idx = k;
         break;
       }
@@ -98,7 +101,7 @@ inline std::vector<LevelOneEvent> detect_hypo_level1_events(
   }
 
   if (in_event && event_start != -1 &&
-      duration_met(hypo_count, 15.0, reading_minutes)) {
+      hypo_count >= readings_15) {
     const int reported_end_idx =
       (last_hypo_idx >= event_start) ? last_hypo_idx : event_start;
     events.push_back({event_start, reported_end_idx});
@@ -111,6 +114,9 @@ inline std::vector<LevelOneEvent> detect_hyper_level1_events(
     const Rcpp::NumericVector& glucose,
     const cgmguru_events::SegmentRange& segment,
     double reading_minutes) {
+  // Level 1 episodes and their recoveries both last 15 minutes
+  const int readings_15 = cgmguru_events::readings_needed(15.0, reading_minutes);
+
   struct CoreEvent {
     int start_idx;
     int end_idx;
@@ -143,7 +149,7 @@ inline std::vector<LevelOneEvent> detect_hyper_level1_events(
       continue;
     }
 
-    if (duration_met(hyper_count, 15.0, reading_minutes)) {
+    if (hyper_count >= readings_15) {
       core_events.push_back({core_start, core_end});
     }
     in_core = false;
@@ -153,7 +159,7 @@ inline std::vector<LevelOneEvent> detect_hyper_level1_events(
   }
 
   if (in_core && core_start != -1 &&
-      duration_met(hyper_count, 15.0, reading_minutes)) {
+      hyper_count >= readings_15) {
     core_events.push_back({core_start, core_end});
   }
 
@@ -189,7 +195,7 @@ inline std::vector<LevelOneEvent> detect_hyper_level1_events(
         if (glucose[k] > 180.0) break;
 
         ++recovery_count;
-        if (duration_met(recovery_count, 15.0, reading_minutes)) {
+        if (recovery_count >= readings_15) {
           recovery_end_idx = k;
           break;
         }
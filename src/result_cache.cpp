@@ -0,0 +1,115 @@
+#include <Rcpp.h>
+#include "id_grouping.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+using namespace Rcpp;
+
+// Fingerprints for the per-subject result cache (R/result_cache.R).
+//
+// Each subject's fingerprint covers its id, its number of rows and the bit
+// patterns of its time and gl values in input order, seeded with the
+// serialized call parameters. Missing values are folded to one pattern and
+// -0 to 0, so integer and double glucose columns holding the same readings
+// fingerprint alike. Two independent 64-bit lanes are kept, so a stale hit
+// needs both to collide; this is a change detector, not a cryptographic hash.
+namespace {
+
+inline std::uint64_t mix64(std::uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+class Fingerprint {
+public:
+  void add(std::uint64_t word) {
+    a_ = (a_ ^ mix64(word + 0x9e3779b97f4a7c15ULL)) * 0x100000001b3ULL;
+    b_ = (b_ + mix64(word ^ 0xc2b2ae3d27d4eb4fULL)) * 0xff51afd7ed558ccdULL;
+    b_ = (b_ << 29) | (b_ >> 35);
+  }
+
+  void add_double(double value) {
+    if (std::isnan(value)) {
+      add(0x7ff8000000000007ULL);
+      return;
+    }
+    if (value == 0.0) value = 0.0;
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    add(bits);
+  }
+
+  void add_bytes(const unsigned char* bytes, std::size_t n) {
+    std::size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+      std::uint64_t word;
+      std::memcpy(&word, bytes + k, sizeof(word));
+      add(word);
+    }
+    if (k < n) {
+      std::uint64_t word = 0;
+      std::memcpy(&word, bytes + k, n - k);
+      add(word);
+    }
+    add(static_cast<std::uint64_t>(n));
+  }
+
+  std::string hex() const {
+    static const char digits[] = "0123456789abcdef";
+    const std::uint64_t lanes[2] = {mix64(a_), mix64(b_ ^ a_)};
+    std::string out(32, '0');
+    for (int lane = 0; lane < 2; ++lane) {
+      for (int k = 0; k < 16; ++k) {
+        out[lane * 16 + k] = digits[(lanes[lane] >> (60 - 4 * k)) & 0xf];
+      }
+    }
+    return out;
+  }
+
+private:
+  std::uint64_t a_ = 0xcbf29ce484222325ULL;
+  std::uint64_t b_ = 0x84222325cbf29ce4ULL;
+};
+
+} // namespace
+
+// One fingerprint per subject, named by id in sorted order. salt holds the
+// serialized parameters of the cached call.
+// [[Rcpp::export]]
+CharacterVector subject_fingerprints_cpp(SEXP id, NumericVector time, NumericVector gl,
+                                         RawVector salt) {
+  const R_xlen_t n = time.size();
+  if (Rf_xlength(id) != n || gl.size() != n) {
+    stop("id, time and gl must have the same length");
+  }
+
+  Fingerprint seeded;
+  seeded.add_bytes(RAW(salt), static_cast<std::size_t>(salt.size()));
+
+  const cgmguru_ids::IdGroups groups = cgmguru_ids::group_rows_by_id(id, n);
+  const double* time_values = REAL(time);
+  const double* gl_values = REAL(gl);
+
+  CharacterVector fingerprints(groups.size());
+  for (size_t g = 0; g < groups.size(); ++g) {
+    Fingerprint fingerprint = seeded;
+    const std::string& label = groups.labels[g];
+    fingerprint.add_bytes(reinterpret_cast<const unsigned char*>(label.data()),
+                          label.size());
+    fingerprint.add(static_cast<std::uint64_t>(groups.group_size(g)));
+    for (const int* row = groups.group_begin(g); row != groups.group_end(g); ++row) {
+      fingerprint.add_double(time_values[*row]);
+      fingerprint.add_double(gl_values[*row]);
+    }
+    fingerprints[g] = fingerprint.hex();
+  }
+  fingerprints.attr("names") = wrap(groups.labels);
+  return fingerprints;
+}
@@ -1,7 +1,10 @@
 #include "event_preprocessing.h"
+#include "id_grouping.h"
+#include "parallel_executor.h"
+#include "sensor_wear.h"
 #include <algorithm>
 #include <cmath>
-#include <map>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -14,10 +17,11 @@ double round_to_two_decimals(double value) {
   return std::round(value * 100.0) / 100.0;
 }
 
-double infer_reading_minutes_from_valid_times(const std::vector<double>& times) {
-  std::vector<double> diffs;
-  diffs.reserve(times.size() > 0 ? times.size() - 1 : 0);
-
+// Median positive interval between valid times, rounded to whole minutes.
+// The median is selected in the reused diffs buffer instead of sorting it.
+double infer_reading_minutes_from_valid_times(const std::vector<double>& times,
+                                              std::vector<double>& diffs) {
+  diffs.clear();
   for (size_t i = 1; i < times.size(); ++i) {
     const double diff_minutes = (times[i] - times[i - 1]) / 60.0;
     if (diff_minutes > 0.0) {
@@ -26,52 +30,56 @@ double infer_reading_minutes_from_valid_times(const std::vector<double>& times)
   }
 
   if (diffs.empty()) {
-    Rcpp::stop("reading_minutes could not be inferred: each id needs at least two distinct valid time points or an explicit reading_minutes value");
+    throw std::runtime_error("reading_minutes could not be inferred: each id needs at least two distinct valid time points or an explicit reading_minutes value");
   }
 
-  std::sort(diffs.begin(), diffs.end());
   const size_t n = diffs.size();
-  const double median = (n % 2 == 1)
-    ? diffs[n / 2]
-    : (diffs[n / 2 - 1] + diffs[n / 2]) / 2.0;
+  std::nth_element(diffs.begin(), diffs.begin() + n / 2, diffs.end());
+  double median = diffs[n / 2];
+  if (n % 2 == 0) {
+    // The lower middle value is the largest one left of the upper
+    const double lower = *std::max_element(diffs.begin(), diffs.begin() + n / 2);
+    median = (lower + median) / 2.0;
+  }
   const double rounded = std::round(median);
   return rounded > 0.0 ? rounded : median;
 }
 
-double reading_minutes_for_sensor_wear(
-    SEXP reading_minutes_sexp,
-    const std::vector<int>& original_indices,
+double calculate_original_span_sensor_wear_percent(
     const std::vector<double>& valid_times,
-    int full_length) {
-  if (reading_minutes_sexp == R_NilValue) {
-    return infer_reading_minutes_from_valid_times(valid_times);
-  }
+    double reading_minutes) {
+  if (valid_times.empty() || reading_minutes <= 0.0) return NA_REAL;
+  if (valid_times.size() == 1) return 100.0;
 
-  if (TYPEOF(reading_minutes_sexp) == INTSXP) {
-    IntegerVector reading_minutes_int = as<IntegerVector>(reading_minutes_sexp);
-    if (reading_minutes_int.length() == 1) {
-      return static_cast<double>(reading_minutes_int[0]);
-    }
-    if (reading_minutes_int.length() != full_length) {
-      Rcpp::stop("reading_minutes vector length must match data length");
-    }
-    return static_cast<double>(reading_minutes_int[original_indices[0]]);
-  }
+  const double total_minutes =
+    std::round((valid_times.back() - valid_times.front()) / 60.0);
+  const double theoretical_gl_values =
+    std::round(total_minutes / reading_minutes) + 1.0;
 
-  if (TYPEOF(reading_minutes_sexp) == REALSXP) {
-    NumericVector reading_minutes_num = as<NumericVector>(reading_minutes_sexp);
-    if (reading_minutes_num.length() == 1) {
-      return reading_minutes_num[0];
-    }
-    if (reading_minutes_num.length() != full_length) {
-      Rcpp::stop("reading_minutes vector length must match data length");
+  if (theoretical_gl_values <= 0.0) return NA_REAL;
+
+  double gap_minutes = 0.0;
+  int gap_count = 0;
+  for (size_t i = 1; i < valid_times.size(); ++i) {
+    const double diff_minutes = (valid_times[i] - valid_times[i - 1]) / 60.0;
+    if (std::round(diff_minutes) > reading_minutes) {
+      gap_minutes += diff_minutes;
+      ++gap_count;
     }
-    return reading_minutes_num[original_indices[0]];
   }
 
-  Rcpp::stop("reading_minutes must be numeric or integer");
+  const double missing_gl_values =
+    std::round((gap_minutes - static_cast<double>(gap_count) *
+      reading_minutes) / reading_minutes);
+
+  return 100.0 * (theoretical_gl_values - missing_gl_values) /
+    theoretical_gl_values;
 }
 
+} // namespace
+
+namespace cgmguru_sensor_wear {
+
 double parse_ndays(SEXP ndays_sexp) {
   if (ndays_sexp == R_NilValue) {
     return NA_REAL;
@@ -103,49 +111,199 @@ double parse_ndays(SEXP ndays_sexp) {
   return ndays;
 }
 
-double calculate_original_span_sensor_wear_percent(
-    const std::vector<double>& valid_times,
-    double reading_minutes) {
-  if (valid_times.empty() || reading_minutes <= 0.0) return NA_REAL;
-  if (valid_times.size() == 1) return 100.0;
+ReadingMinutesArg::ReadingMinutesArg(SEXP reading_minutes, int full_length) {
+  if (reading_minutes == R_NilValue) return;
+  infer_ = false;
 
-  const double total_minutes =
-    std::round((valid_times.back() - valid_times.front()) / 60.0);
-  const double theoretical_gl_values =
-    std::round(total_minutes / reading_minutes) + 1.0;
+  if (TYPEOF(reading_minutes) == INTSXP) {
+    if (Rf_xlength(reading_minutes) == 1) {
+      scalar_ = static_cast<double>(INTEGER(reading_minutes)[0]);
+      return;
+    }
+    if (Rf_xlength(reading_minutes) != full_length) {
+      Rcpp::stop("reading_minutes vector length must match data length");
+    }
+    int_values_ = INTEGER(reading_minutes);
+    return;
+  }
 
-  if (theoretical_gl_values <= 0.0) return NA_REAL;
+  if (TYPEOF(reading_minutes) == REALSXP) {
+    if (Rf_xlength(reading_minutes) == 1) {
+      scalar_ = REAL(reading_minutes)[0];
+      return;
+    }
+    if (Rf_xlength(reading_minutes) != full_length) {
+      Rcpp::stop("reading_minutes vector length must match data length");
+    }
+    real_values_ = REAL(reading_minutes);
+    return;
+  }
 
-  double gap_minutes = 0.0;
-  int gap_count = 0;
-  for (size_t i = 1; i < valid_times.size(); ++i) {
-    const double diff_minutes = (valid_times[i] - valid_times[i - 1]) / 60.0;
-    if (std::round(diff_minutes) > reading_minutes) {
-      gap_minutes += diff_minutes;
-      ++gap_count;
+  Rcpp::stop("reading_minutes must be numeric or integer");
+}
+
+double ReadingMinutesArg::at(int row) const {
+  if (int_values_ != nullptr) return static_cast<double>(int_values_[row]);
+  if (real_values_ != nullptr) return real_values_[row];
+  return scalar_;
+}
+
+SensorWearRow sensor_wear_for_id(const NumericVector& time,
+                                 const NumericVector& glucose,
+                                 const int* begin, const int* end,
+                                 const SensorWearOptions& options,
+                                 const ReadingMinutesArg& reading_minutes,
+                                 SensorWearScratch& scratch) {
+  // Valid readings with near-duplicate times collapsed onto the last one;
+  // only the first kept row is needed for a per-row reading_minutes
+  std::vector<double>& valid_times = scratch.valid_times;
+  valid_times.clear();
+  int first_valid_index = -1;
+
+  for (const int* it = begin; it != end; ++it) {
+    const int idx = *it;
+    if (NumericVector::is_na(time[idx]) || NumericVector::is_na(glucose[idx])) {
+      continue;
+    }
+
+    const double current_time = time[idx];
+    if (!valid_times.empty() &&
+        std::fabs(current_time - valid_times.back()) < 1e-7) {
+      if (valid_times.size() == 1) first_valid_index = idx;
+      valid_times.back() = current_time;
+    } else {
+      if (valid_times.empty()) first_valid_index = idx;
+      valid_times.push_back(current_time);
     }
   }
 
-  const double missing_gl_values =
-    std::round((gap_minutes - static_cast<double>(gap_count) *
-      reading_minutes) / reading_minutes);
+  auto id_reading_minutes = [&]() {
+    const double value = reading_minutes.infer()
+      ? infer_reading_minutes_from_valid_times(valid_times, scratch.diffs)
+      : reading_minutes.at(first_valid_index);
+    if (value <= 0.0) {
+      throw std::runtime_error("reading_minutes must be positive");
+    }
+    return value;
+  };
+
+  double sensor_wear_percent = NA_REAL;
+  double id_ndays = NA_REAL;
+  double start_date_value = NA_REAL;
+  double end_date_value = NA_REAL;
+
+  if (!valid_times.empty()) {
+    if (!NumericVector::is_na(options.ndays)) {
+      const double interval = id_reading_minutes();
+
+      id_ndays = options.ndays;
+      end_date_value = options.has_common_end_date
+        ? options.common_end_date
+        : valid_times.back();
+      start_date_value = end_date_value -
+        options.ndays * 24.0 * 60.0 * 60.0;
+
+      int observed_count = 0;
+      for (double valid_time : valid_times) {
+        if (valid_time >= start_date_value && valid_time <= end_date_value) {
+          ++observed_count;
+        }
+      }
 
-  return 100.0 * (theoretical_gl_values - missing_gl_values) /
-    theoretical_gl_values;
+      const double expected_count =
+        options.ndays * 24.0 * (60.0 / interval);
+      if (expected_count > 0.0) {
+        sensor_wear_percent =
+          100.0 * static_cast<double>(observed_count) / expected_count;
+      }
+    } else {
+      start_date_value = valid_times.front();
+      end_date_value = valid_times.back();
+
+      if (valid_times.size() == 1) {
+        sensor_wear_percent = 100.0;
+      } else {
+        sensor_wear_percent =
+          calculate_original_span_sensor_wear_percent(valid_times,
+                                                      id_reading_minutes());
+      }
+    }
+  }
+
+  SensorWearRow row;
+  row.sensor_wear_percent = round_to_two_decimals(sensor_wear_percent);
+  row.ndays = id_ndays;
+  row.start_date = start_date_value;
+  row.end_date = end_date_value;
+  return row;
 }
 
-} // namespace
+SensorWearRow sensor_wear_for_id(const NumericVector& time,
+                                 const NumericVector& glucose,
+                                 const std::vector<int>& indices,
+                                 const SensorWearOptions& options) {
+  const ReadingMinutesArg reading_minutes(options.reading_minutes, options.full_length);
+  SensorWearScratch scratch;
+  const int* begin = indices.data();
+  try {
+    return sensor_wear_for_id(time, glucose, begin, begin + indices.size(), options,
+                              reading_minutes, scratch);
+  } catch (const std::runtime_error& e) {
+    Rcpp::stop(e.what());
+  }
+}
+
+DataFrame sensor_wear_rows_to_dataframe(const std::vector<std::string>& ids,
+                                        const std::vector<SensorWearRow>& rows,
+                                        const std::string& output_tz) {
+  std::vector<double> out_sensor_wear_percent;
+  std::vector<double> out_ndays;
+  std::vector<double> out_start_dates;
+  std::vector<double> out_end_dates;
+  out_sensor_wear_percent.reserve(rows.size());
+  out_ndays.reserve(rows.size());
+  out_start_dates.reserve(rows.size());
+  out_end_dates.reserve(rows.size());
+  for (const SensorWearRow& row : rows) {
+    out_sensor_wear_percent.push_back(row.sensor_wear_percent);
+    out_ndays.push_back(row.ndays);
+    out_start_dates.push_back(row.start_date);
+    out_end_dates.push_back(row.end_date);
+  }
+
+  NumericVector start_date_vec = wrap(out_start_dates);
+  start_date_vec.attr("class") = CharacterVector::create("POSIXct", "POSIXt");
+  start_date_vec.attr("tzone") = output_tz;
+
+  NumericVector end_date_vec = wrap(out_end_dates);
+  end_date_vec.attr("class") = CharacterVector::create("POSIXct", "POSIXt");
+  end_date_vec.attr("tzone") = output_tz;
+
+  DataFrame out = DataFrame::create(
+    _["id"] = wrap(ids),
+    _["sensor_wear_percent"] = wrap(out_sensor_wear_percent),
+    _["sensor_wear"] = wrap(out_sensor_wear_percent),
+    _["ndays"] = wrap(out_ndays),
+    _["start_date"] = start_date_vec,
+    _["end_date"] = end_date_vec
+  );
+  out.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
+  return out;
+}
+
+} // namespace cgmguru_sensor_wear
 
 // [[Rcpp::export]]
 DataFrame sensor_wear_cpp(DataFrame df,
                           SEXP reading_minutes = R_NilValue,
                           Nullable<NumericVector> end_date = R_NilValue,
-                          SEXP ndays = R_NilValue) {
+                          SEXP ndays = R_NilValue,
+                          int n_threads = 1) {
   const int n = df.nrows();
   StringVector id = df["id"];
   NumericVector time = df["time"];
   NumericVector glucose = df["gl"];
-  const double fixed_window_ndays = parse_ndays(ndays);
+  const double fixed_window_ndays = cgmguru_sensor_wear::parse_ndays(ndays);
   const bool use_fixed_window = !NumericVector::is_na(fixed_window_ndays);
 
   std::string output_tz = "UTC";
@@ -157,10 +315,7 @@ DataFrame sensor_wear_cpp(DataFrame df,
     }
   }
 
-  std::map<std::string, std::vector<int>> id_indices;
-  for (int i = 0; i < n; ++i) {
-    id_indices[as<std::string>(id[i])].push_back(i);
-  }
+  const cgmguru_ids::IdGroups groups = cgmguru_ids::group_rows_by_id(id, n);
 
   const bool has_common_end_date = end_date.isNotNull();
   double common_end_date = NA_REAL;
@@ -175,122 +330,63 @@ DataFrame sensor_wear_cpp(DataFrame df,
     Rcpp::stop("end_date requires ndays");
   }
 
-  std::vector<std::string> out_ids;
-  std::vector<double> out_sensor_wear_percent;
-  std::vector<double> out_sensor_wear_alias;
-  std::vector<double> out_ndays;
-  std::vector<double> out_start_dates;
-  std::vector<double> out_end_dates;
-  out_ids.reserve(id_indices.size());
-  out_sensor_wear_percent.reserve(id_indices.size());
-  out_sensor_wear_alias.reserve(id_indices.size());
-  out_ndays.reserve(id_indices.size());
-  out_start_dates.reserve(id_indices.size());
-  out_end_dates.reserve(id_indices.size());
-
-  for (auto& id_pair : id_indices) {
-    std::string current_id = id_pair.first;
-    std::vector<int>& indices = id_pair.second;
-    std::sort(indices.begin(), indices.end(), [&](int lhs, int rhs) {
-      return time[lhs] < time[rhs];
-    });
-
-    std::vector<int> valid_original_indices;
-    std::vector<double> valid_times;
-    valid_original_indices.reserve(indices.size());
-    valid_times.reserve(indices.size());
-
-    for (int idx : indices) {
-      if (NumericVector::is_na(time[idx]) || NumericVector::is_na(glucose[idx])) {
-        continue;
+  cgmguru_sensor_wear::SensorWearOptions options;
+  options.reading_minutes = reading_minutes;
+  options.ndays = fixed_window_ndays;
+  options.has_common_end_date = has_common_end_date;
+  options.common_end_date = common_end_date;
+  options.full_length = n;
+
+  const cgmguru_sensor_wear::ReadingMinutesArg reading_minutes_arg(reading_minutes, n);
+
+  // Subjects are handed out in contiguous blocks so each block reuses one
+  // set of buffers; errors are kept per subject and the first one in id
+  // order is raised, as a serial run would
+  const size_t n_ids = groups.size();
+  std::vector<cgmguru_sensor_wear::SensorWearRow> out_rows(n_ids);
+  std::vector<std::string> errors(n_ids);
+  const size_t n_blocks = std::min(
+    n_ids, static_cast<size_t>(cgmguru_parallel::resolve_thread_count(n_threads, n_ids)) * 8
+  );
+  const double* time_ptr = time.begin();
+  cgmguru_parallel::parallel_for(n_blocks, n_threads, [&](size_t block) {
+    cgmguru_sensor_wear::SensorWearScratch scratch;
+    std::vector<int> sorted_rows;
+    const size_t first = n_ids * block / n_blocks;
+    const size_t last = n_ids * (block + 1) / n_blocks;
+    for (size_t g = first; g < last; ++g) {
+      const int* begin = groups.group_begin(g);
+      const int* end = groups.group_end(g);
+      // Most inputs are already ordered, so only unordered subjects are sorted
+      bool sorted = true;
+      for (const int* it = begin; it + 1 < end; ++it) {
+        if (time_ptr[*(it + 1)] < time_ptr[*it]) {
+          sorted = false;
+          break;
+        }
       }
-
-      const double current_time = time[idx];
-      if (!valid_times.empty() &&
-          std::fabs(current_time - valid_times.back()) < 1e-7) {
-        valid_original_indices.back() = idx;
-        valid_times.back() = current_time;
-      } else {
-        valid_original_indices.push_back(idx);
-        valid_times.push_back(current_time);
+      if (!sorted) {
+        sorted_rows.assign(begin, end);
+        std::sort(sorted_rows.begin(), sorted_rows.end(), [&](int lhs, int rhs) {
+          return time_ptr[lhs] < time_ptr[rhs];
+        });
+        begin = sorted_rows.data();
+        end = begin + sorted_rows.size();
       }
-    }
-
-    double sensor_wear_percent = NA_REAL;
-    double id_ndays = NA_REAL;
-    double start_date_value = NA_REAL;
-    double end_date_value = NA_REAL;
-
-    if (!valid_times.empty()) {
-      if (use_fixed_window) {
-        double id_reading_minutes = reading_minutes_for_sensor_wear(
-          reading_minutes, valid_original_indices, valid_times, n);
-        if (id_reading_minutes <= 0.0) {
-          Rcpp::stop("reading_minutes must be positive");
-        }
-
-        id_ndays = fixed_window_ndays;
-        end_date_value = has_common_end_date ? common_end_date : valid_times.back();
-        start_date_value = end_date_value -
-          fixed_window_ndays * 24.0 * 60.0 * 60.0;
 
-        int observed_count = 0;
-        for (double valid_time : valid_times) {
-          if (valid_time >= start_date_value && valid_time <= end_date_value) {
-            ++observed_count;
-          }
-        }
-
-        const double expected_count =
-          fixed_window_ndays * 24.0 * (60.0 / id_reading_minutes);
-        if (expected_count > 0.0) {
-          sensor_wear_percent =
-            100.0 * static_cast<double>(observed_count) / expected_count;
-        }
-      } else {
-        start_date_value = valid_times.front();
-        end_date_value = valid_times.back();
-
-        if (valid_times.size() == 1) {
-          sensor_wear_percent = 100.0;
-        } else {
-          double id_reading_minutes = reading_minutes_for_sensor_wear(
-            reading_minutes, valid_original_indices, valid_times, n);
-          if (id_reading_minutes <= 0.0) {
-            Rcpp::stop("reading_minutes must be positive");
-          }
-          sensor_wear_percent =
-            calculate_original_span_sensor_wear_percent(valid_times,
-                                                        id_reading_minutes);
-        }
+      try {
+        out_rows[g] = cgmguru_sensor_wear::sensor_wear_for_id(
+          time, glucose, begin, end, options, reading_minutes_arg, scratch
+        );
+      } catch (const std::exception& e) {
+        errors[g] = e.what();
       }
     }
-
-    out_ids.push_back(current_id);
-    sensor_wear_percent = round_to_two_decimals(sensor_wear_percent);
-    out_sensor_wear_percent.push_back(sensor_wear_percent);
-    out_sensor_wear_alias.push_back(sensor_wear_percent);
-    out_ndays.push_back(id_ndays);
-    out_start_dates.push_back(start_date_value);
-    out_end_dates.push_back(end_date_value);
+  });
+  for (const std::string& error : errors) {
+    if (!error.empty()) Rcpp::stop(error);
   }
 
-  NumericVector start_date_vec = wrap(out_start_dates);
-  start_date_vec.attr("class") = CharacterVector::create("POSIXct", "POSIXt");
-  start_date_vec.attr("tzone") = output_tz;
-
-  NumericVector end_date_vec = wrap(out_end_dates);
-  end_date_vec.attr("class") = CharacterVector::create("POSIXct", "POSIXt");
-  end_date_vec.attr("tzone") = output_tz;
-
-  DataFrame out = DataFrame::create(
-    _["id"] = wrap(out_ids),
-    _["sensor_wear_percent"] = wrap(out_sensor_wear_percent),
-    _["sensor_wear"] = wrap(out_sensor_wear_alias),
-    _["ndays"] = wrap(out_ndays),
-    _["start_date"] = start_date_vec,
-    _["end_date"] = end_date_vec
-  );
-  out.attr("class") = CharacterVector::create("tbl_df", "tbl", "data.frame");
-  return out;
+  return cgmguru_sensor_wear::sensor_wear_rows_to_dataframe(groups.labels, out_rows,
+                                                            output_tz);
 }
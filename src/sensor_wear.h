@@ -0,0 +1,77 @@
+#ifndef CGMGURU_SENSOR_WEAR_H
+#define CGMGURU_SENSOR_WEAR_H
+
+#include <Rcpp.h>
+#include <string>
+#include <vector>
+
+// Per-subject sensor wear, shared by sensor_wear_cpp and the fused metrics
+// entry point.
+namespace cgmguru_sensor_wear {
+
+struct SensorWearOptions {
+  SEXP reading_minutes = R_NilValue;
+  // NA_REAL uses the original timestamp span
+  double ndays = NA_REAL;
+  bool has_common_end_date = false;
+  double common_end_date = NA_REAL;
+  int full_length = 0;
+};
+
+struct SensorWearRow {
+  double sensor_wear_percent = NA_REAL;
+  double ndays = NA_REAL;
+  double start_date = NA_REAL;
+  double end_date = NA_REAL;
+};
+
+// The reading_minutes argument read once on the main thread: NULL (infer
+// per subject), one value, or one value per row. Subjects can then be
+// processed on worker threads without touching the R API.
+class ReadingMinutesArg {
+public:
+  ReadingMinutesArg(SEXP reading_minutes, int full_length);
+
+  bool infer() const { return infer_; }
+  // Value for a subject whose first valid reading is row
+  double at(int row) const;
+
+private:
+  bool infer_ = true;
+  double scalar_ = NA_REAL;
+  const int* int_values_ = nullptr;
+  const double* real_values_ = nullptr;
+};
+
+// Buffers reused across the subjects handled by one thread
+struct SensorWearScratch {
+  std::vector<double> valid_times;
+  std::vector<double> diffs;
+};
+
+// Validated ndays argument, or NA_REAL for NULL
+double parse_ndays(SEXP ndays_sexp);
+
+// Rows [begin, end) of one subject, already sorted by time. Does not call
+// the R API; invalid inputs throw std::runtime_error.
+SensorWearRow sensor_wear_for_id(const Rcpp::NumericVector& time,
+                                 const Rcpp::NumericVector& glucose,
+                                 const int* begin, const int* end,
+                                 const SensorWearOptions& options,
+                                 const ReadingMinutesArg& reading_minutes,
+                                 SensorWearScratch& scratch);
+
+// indices must already be sorted by time
+SensorWearRow sensor_wear_for_id(const Rcpp::NumericVector& time,
+                                 const Rcpp::NumericVector& glucose,
+                                 const std::vector<int>& indices,
+                                 const SensorWearOptions& options);
+
+Rcpp::DataFrame sensor_wear_rows_to_dataframe(
+    const std::vector<std::string>& ids,
+    const std::vector<SensorWearRow>& rows,
+    const std::string& output_tz);
+
+} // namespace cgmguru_sensor_wear
+
+#endif // CGMGURU_SENSOR_WEAR_H
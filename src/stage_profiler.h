@@ -0,0 +1,157 @@
+#ifndef CGMGURU_STAGE_PROFILER_H
+#define CGMGURU_STAGE_PROFILER_H
+
+#include <Rcpp.h>
+#include "string_table.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define CGMGURU_HAVE_MALLINFO2 1
+#endif
+
+// Opt-in per-stage timing for the ID-based calculators.
+//
+// A calculator wraps each stage in a ScopedStage; when profiling is off the
+// guard only tests a flag, so the stages cost nothing extra in normal runs.
+// When it is on, every guarded stage adds one row with its wall time and the
+// change in bytes in use on the C heap across the stage. R allocates vectors
+// through malloc, so that change covers both C++ buffers and R objects kept
+// by the stage; memory allocated and released inside the stage does not
+// show up. The heap figure needs glibc 2.33 or later and is NA elsewhere.
+// Each reading walks every malloc arena, so per-subject stages only read the
+// heap for the first kHeapSamplesPerStage subjects of each stage name and
+// report NA after that; timings are kept for every stage.
+// Stage names and subject ids are interned, so a profile of a large cohort
+// stores four numbers per row. A profiler is not thread-safe: time a stage
+// that runs on worker threads from the thread that starts it.
+namespace cgmguru_profile {
+
+// Bytes in use on the C heap, or -1 when the platform does not report it
+inline double heap_bytes_in_use() {
+#ifdef CGMGURU_HAVE_MALLINFO2
+  const struct mallinfo2 info = mallinfo2();
+  return static_cast<double>(info.uordblks) + static_cast<double>(info.hblkhd);
+#else
+  return -1.0;
+#endif
+}
+
+// Heap readings per per-subject stage name; stages covering every subject
+// are always read
+const int kHeapSamplesPerStage = 16;
+
+class StageProfiler {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  void set_enabled(bool enabled) { enabled_ = enabled; }
+  bool enabled() const { return enabled_; }
+
+  void clear() {
+    stages_.clear();
+    subjects_.clear();
+    stage_codes_.clear();
+    subject_codes_.clear();
+    seconds_.clear();
+    heap_bytes_.clear();
+    heap_samples_.clear();
+  }
+
+  // Code of a subject id for ScopedStage; -1 (no subject) when disabled
+  int subject(const std::string& id) {
+    return enabled_ ? subjects_.intern(id) : -1;
+  }
+
+  // Whether a stage starting now should read the heap
+  bool sample_heap(const char* stage, int subject_code) {
+    if (subject_code < 0) return true;
+    const std::size_t code = static_cast<std::size_t>(stages_.intern(stage));
+    if (code >= heap_samples_.size()) heap_samples_.resize(code + 1, 0);
+    return heap_samples_[code]++ < kHeapSamplesPerStage;
+  }
+
+  void record(const char* stage, int subject_code, double seconds, double heap_bytes) {
+    stage_codes_.push_back(stages_.intern(stage));
+    subject_codes_.push_back(subject_code);
+    seconds_.push_back(seconds);
+    heap_bytes_.push_back(heap_bytes);
+  }
+
+  // One row per recorded stage in the order the stages finished; id is NA
+  // for stages that cover every subject
+  Rcpp::DataFrame to_dataframe() const {
+    const R_xlen_t n = static_cast<R_xlen_t>(stage_codes_.size());
+    Rcpp::CharacterVector subject_labels = subjects_.levels();
+    Rcpp::CharacterVector id(n);
+    Rcpp::NumericVector heap_bytes(n);
+    for (R_xlen_t i = 0; i < n; ++i) {
+      SET_STRING_ELT(id, i, subject_codes_[i] < 0
+                              ? NA_STRING
+                              : STRING_ELT(subject_labels, subject_codes_[i]));
+      heap_bytes[i] = std::isnan(heap_bytes_[i]) ? NA_REAL : heap_bytes_[i];
+    }
+    Rcpp::DataFrame df = Rcpp::DataFrame::create(
+      Rcpp::_["stage"] = stages_.character(stage_codes_),
+      Rcpp::_["id"] = id,
+      Rcpp::_["seconds"] = Rcpp::wrap(seconds_),
+      Rcpp::_["heap_bytes"] = heap_bytes
+    );
+    df.attr("class") = Rcpp::CharacterVector::create("tbl_df", "tbl", "data.frame");
+    return df;
+  }
+
+private:
+  bool enabled_ = false;
+  cgmguru_strings::StringTable stages_;
+  cgmguru_strings::StringTable subjects_;
+  std::vector<int> stage_codes_;
+  std::vector<int> subject_codes_;
+  std::vector<double> seconds_;
+  std::vector<double> heap_bytes_;
+  std::vector<int> heap_samples_;
+};
+
+// Records the enclosing scope as one stage of profiler. stage must outlive
+// the guard (a string literal in practice).
+class ScopedStage {
+public:
+  ScopedStage(StageProfiler& profiler, const char* stage, int subject_code = -1)
+    : profiler_(profiler.enabled() ? &profiler : nullptr),
+      stage_(stage), subject_code_(subject_code) {
+    if (profiler_ != nullptr) {
+      heap_start_ = profiler.sample_heap(stage, subject_code) ? heap_bytes_in_use() : -1.0;
+      start_ = StageProfiler::Clock::now();
+    }
+  }
+
+  ~ScopedStage() {
+    if (profiler_ == nullptr) return;
+    const double seconds =
+      std::chrono::duration<double>(StageProfiler::Clock::now() - start_).count();
+    const double heap_end = heap_start_ < 0 ? -1.0 : heap_bytes_in_use();
+    const double heap_bytes = (heap_start_ < 0 || heap_end < 0)
+      ? NAN
+      : heap_end - heap_start_;
+    profiler_->record(stage_, subject_code_, seconds, heap_bytes);
+  }
+
+  ScopedStage(const ScopedStage&) = delete;
+  ScopedStage& operator=(const ScopedStage&) = delete;
+
+private:
+  StageProfiler* profiler_;
+  const char* stage_;
+  int subject_code_;
+  double heap_start_ = 0.0;
+  StageProfiler::Clock::time_point start_;
+};
+
+} // namespace cgmguru_profile
+
+#endif // CGMGURU_STAGE_PROFILER_H
@@ -0,0 +1,78 @@
+#ifndef CGMGURU_STRING_TABLE_H
+#define CGMGURU_STRING_TABLE_H
+
+#include <Rcpp.h>
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Interned strings for event output columns.
+//
+// Event tables repeat a handful of distinct values (subject ids, "hypo" /
+// "hyper", "lv1" / "lv2" / ...) over every row. Storing a std::string per row
+// copies the same text once per event; a StringTable keeps each distinct
+// string once and rows hold its small integer code instead. When the column
+// is written to R, every label becomes one CHARSXP and rows only point at it,
+// so building a character column of millions of events makes as many R
+// strings as there are distinct labels.
+namespace cgmguru_strings {
+
+class StringTable {
+public:
+  // Code of value, adding it when first seen; codes count up from 0 in
+  // insertion order
+  int intern(const std::string& value) {
+    auto found = codes_.find(value);
+    if (found != codes_.end()) return found->second;
+    const int code = static_cast<int>(labels_.size());
+    labels_.push_back(value);
+    codes_.emplace(value, code);
+    return code;
+  }
+
+  const std::string& label(int code) const { return labels_[code]; }
+  std::size_t size() const { return labels_.size(); }
+
+  void clear() {
+    labels_.clear();
+    codes_.clear();
+  }
+
+  // Labels in code order
+  Rcpp::CharacterVector levels() const { return Rcpp::wrap(labels_); }
+
+  // Character column of codes; rows share the CHARSXP of their label
+  template <typename Codes>
+  Rcpp::CharacterVector character(const Codes& codes) const {
+    Rcpp::CharacterVector labels = levels();
+    Rcpp::CharacterVector out(static_cast<R_xlen_t>(codes.size()));
+    R_xlen_t i = 0;
+    for (auto code : codes) {
+      SET_STRING_ELT(out, i++, STRING_ELT(labels, static_cast<R_xlen_t>(code)));
+    }
+    return out;
+  }
+
+  // Factor of codes with the labels, in code order, as levels
+  template <typename Codes>
+  Rcpp::IntegerVector factor(const Codes& codes) const {
+    Rcpp::IntegerVector out(static_cast<R_xlen_t>(codes.size()));
+    R_xlen_t i = 0;
+    for (auto code : codes) {
+      out[i++] = static_cast<int>(code) + 1;
+    }
+    out.attr("levels") = levels();
+    out.attr("class") = "factor";
+    return out;
+  }
+
+private:
+  std::vector<std::string> labels_;
+  std::unordered_map<std::string, int> codes_;
+};
+
+} // namespace cgmguru_strings
+
+#endif // CGMGURU_STRING_TABLE_H
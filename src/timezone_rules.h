@@ -0,0 +1,418 @@
+#ifndef CGMGURU_TIMEZONE_RULES_H
+#define CGMGURU_TIMEZONE_RULES_H
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Native UTC-offset resolution for Olson time zones.
+//
+// Zones are read from compiled TZif files (RFC 8536) in the same zoneinfo
+// directories R consults, including the POSIX TZ footer rule that covers
+// instants after the last stored transition. Parsed zones are cached for the
+// lifetime of the process, so each zone is loaded once. Nothing in this
+// header touches the R API; lookups are safe from worker threads.
+namespace cgmguru_tz {
+
+struct PosixRule {
+  // Transition date: 'J' (1..365, no Feb 29), 'D' (0..365) or 'M' (Mm.w.d)
+  char kind = 'M';
+  int day = 0;
+  int week = 0;
+  int month = 0;
+  int weekday = 0;
+  long long time_seconds = 7200;
+};
+
+struct PosixTz {
+  bool valid = false;
+  long long std_utoff = 0;
+  bool has_dst = false;
+  long long dst_utoff = 0;
+  PosixRule start;
+  PosixRule end;
+};
+
+class TimeZoneRules {
+public:
+  std::vector<long long> transitions;
+  std::vector<int> transition_types;
+  std::vector<long long> type_utoff;
+  PosixTz footer;
+  bool fixed = false;
+  long long fixed_utoff = 0;
+
+  // UTC offset (seconds east of UTC) in effect at the UTC instant t
+  long long offset_at(double t) const {
+    if (fixed) return fixed_utoff;
+    if (transitions.empty() || t < static_cast<double>(transitions.front())) {
+      if (transitions.empty() && footer.valid) return footer_offset(t);
+      return type_utoff.empty() ? 0 : type_utoff[first_type()];
+    }
+    if (t >= static_cast<double>(transitions.back()) && footer.valid) {
+      return footer_offset(t);
+    }
+    const long long key = static_cast<long long>(std::floor(t));
+    const size_t pos = static_cast<size_t>(
+      std::upper_bound(transitions.begin(), transitions.end(), key) - transitions.begin()
+    ) - 1;
+    return type_utoff[transition_types[pos]];
+  }
+
+private:
+  size_t first_type() const { return 0; }
+
+  static bool is_leap(long long y) {
+    return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+  }
+
+  static int days_in_month(long long y, int m) {
+    static const int days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    return (m == 2 && is_leap(y)) ? 29 : days[m - 1];
+  }
+
+  // Days since 1970-01-01 of a proleptic Gregorian civil date
+  static long long days_from_civil(long long y, int m, int d) {
+    y -= m <= 2;
+    const long long era = (y >= 0 ? y : y - 399) / 400;
+    const long long yoe = y - era * 400;
+    const long long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+  }
+
+  static long long year_from_days(long long z) {
+    z += 719468;
+    const long long era = (z >= 0 ? z : z - 146096) / 146097;
+    const long long doe = z - era * 146097;
+    const long long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const long long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const long long mp = (5 * doy + 2) / 153;
+    const int month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+    return yoe + era * 400 + (month <= 2);
+  }
+
+  // Local wall-clock seconds (relative to 1970-01-01 local) of a rule in year y
+  static long long rule_local_seconds(const PosixRule& rule, long long y) {
+    long long day_index = 0;
+    if (rule.kind == 'J') {
+      day_index = days_from_civil(y, 1, 1) + rule.day - 1;
+      if (is_leap(y) && rule.day >= 60) ++day_index;
+    } else if (rule.kind == 'D') {
+      day_index = days_from_civil(y, 1, 1) + rule.day;
+    } else {
+      const long long first = days_from_civil(y, rule.month, 1);
+      const int first_weekday = static_cast<int>(((first % 7) + 11) % 7);  // 1970-01-01 is Thursday
+      int day = 1 + (rule.weekday - first_weekday + 7) % 7 + (rule.week - 1) * 7;
+      while (day > days_in_month(y, rule.month)) day -= 7;
+      day_index = first + day - 1;
+    }
+    return day_index * 86400 + rule.time_seconds;
+  }
+
+  long long footer_offset(double t) const {
+    if (!footer.has_dst) return footer.std_utoff;
+    const long long local_std = static_cast<long long>(std::floor(t)) + footer.std_utoff;
+    const long long days = local_std >= 0 ? local_std / 86400 : -((-local_std + 86399) / 86400);
+    const long long year = year_from_days(days);
+    const long long tt = static_cast<long long>(std::floor(t));
+    const long long start_utc = rule_local_seconds(footer.start, year) - footer.std_utoff;
+    const long long end_utc = rule_local_seconds(footer.end, year) - footer.dst_utoff;
+    // A rule spanning the whole year (e.g. "EST5EDT,0/0,J365/25") is permanent DST
+    const long long year_seconds = (is_leap(year) ? 366LL : 365LL) * 86400;
+    if (end_utc - start_utc >= year_seconds) return footer.dst_utoff;
+    bool in_dst;
+    if (start_utc < end_utc) {
+      in_dst = tt >= start_utc && tt < end_utc;
+    } else {
+      in_dst = !(tt >= end_utc && tt < start_utc);
+    }
+    return in_dst ? footer.dst_utoff : footer.std_utoff;
+  }
+};
+
+namespace detail {
+
+inline bool parse_posix_name(const std::string& s, size_t& pos) {
+  if (pos < s.size() && s[pos] == '<') {
+    const size_t close = s.find('>', pos);
+    if (close == std::string::npos) return false;
+    pos = close + 1;
+    return true;
+  }
+  const size_t begin = pos;
+  while (pos < s.size() && std::isalpha(static_cast<unsigned char>(s[pos]))) ++pos;
+  return pos - begin >= 3;
+}
+
+// [+-]hh[:mm[:ss]] in seconds; hours up to 167 per RFC 8536
+inline bool parse_posix_clock(const std::string& s, size_t& pos, long long& seconds) {
+  int sign = 1;
+  if (pos < s.size() && (s[pos] == '+' || s[pos] == '-')) {
+    if (s[pos] == '-') sign = -1;
+    ++pos;
+  }
+  long long parts[3] = {0, 0, 0};
+  for (int k = 0; k < 3; ++k) {
+    if (k > 0) {
+      if (pos >= s.size() || s[pos] != ':') break;
+      ++pos;
+    }
+    const size_t begin = pos;
+    while (pos < s.size() && std::isdigit(static_cast<unsigned char>(s[pos]))) {
+      parts[k] = parts[k] * 10 + (s[pos] - '0');
+      ++pos;
+    }
+    if (pos == begin) return false;
+  }
+  seconds = sign * (parts[0] * 3600 + parts[1] * 60 + parts[2]);
+  return true;
+}
+
+inline bool parse_posix_int(const std::string& s, size_t& pos, int& value) {
+  const size_t begin = pos;
+  value = 0;
+  while (pos < s.size() && std::isdigit(static_cast<unsigned char>(s[pos]))) {
+    value = value * 10 + (s[pos] - '0');
+    ++pos;
+  }
+  return pos > begin;
+}
+
+inline bool parse_posix_rule(const std::string& s, size_t& pos, PosixRule& rule) {
+  if (pos < s.size() && s[pos] == 'J') {
+    ++pos;
+    rule.kind = 'J';
+    if (!parse_posix_int(s, pos, rule.day) || rule.day < 1 || rule.day > 365) return false;
+  } else if (pos < s.size() && s[pos] == 'M') {
+    ++pos;
+    rule.kind = 'M';
+    if (!parse_posix_int(s, pos, rule.month) || pos >= s.size() || s[pos++] != '.') return false;
+    if (!parse_posix_int(s, pos, rule.week) || pos >= s.size() || s[pos++] != '.') return false;
+    if (!parse_posix_int(s, pos, rule.weekday)) return false;
+    if (rule.month < 1 || rule.month > 12 || rule.week < 1 || rule.week > 5 ||
+        rule.weekday < 0 || rule.weekday > 6) {
+      return false;
+    }
+  } else {
+    rule.kind = 'D';
+    if (!parse_posix_int(s, pos, rule.day) || rule.day > 365) return false;
+  }
+  rule.time_seconds = 7200;
+  if (pos < s.size() && s[pos] == '/') {
+    ++pos;
+    if (!parse_posix_clock(s, pos, rule.time_seconds)) return false;
+  }
+  return true;
+}
+
+// POSIX TZ string, e.g. "CET-1CEST,M3.5.0,M10.5.0/3" or "<+0330>-3:30"
+inline PosixTz parse_posix_tz(const std::string& s) {
+  PosixTz tz;
+  size_t pos = 0;
+  long long offset = 0;
+  if (!parse_posix_name(s, pos) || !parse_posix_clock(s, pos, offset)) return tz;
+  tz.std_utoff = -offset;
+  if (pos == s.size()) {
+    tz.valid = true;
+    return tz;
+  }
+  if (!parse_posix_name(s, pos)) return tz;
+  tz.has_dst = true;
+  tz.dst_utoff = tz.std_utoff + 3600;
+  if (pos < s.size() && s[pos] != ',') {
+    if (!parse_posix_clock(s, pos, offset)) return tz;
+    tz.dst_utoff = -offset;
+  }
+  if (pos == s.size()) {
+    // No rule given: tzcode's default (US rules)
+    tz.start.kind = 'M'; tz.start.month = 3; tz.start.week = 2; tz.start.weekday = 0;
+    tz.end.kind = 'M'; tz.end.month = 11; tz.end.week = 1; tz.end.weekday = 0;
+    tz.valid = true;
+    return tz;
+  }
+  if (s[pos++] != ',' || !parse_posix_rule(s, pos, tz.start)) return tz;
+  if (pos >= s.size() || s[pos++] != ',' || !parse_posix_rule(s, pos, tz.end)) return tz;
+  tz.valid = pos == s.size();
+  return tz;
+}
+
+inline long long read_be(const unsigned char* p, int width) {
+  unsigned long long v = 0;
+  for (int k = 0; k < width; ++k) v = (v << 8) | p[k];
+  if (width == 4) return static_cast<long long>(static_cast<int32_t>(static_cast<uint32_t>(v)));
+  return static_cast<long long>(v);
+}
+
+// Parse a TZif image; returns false for malformed data or leap-second zones
+inline bool parse_tzif(const std::string& data, TimeZoneRules& rules) {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data.data());
+  const size_t size = data.size();
+  if (size < 44 || data.compare(0, 4, "TZif") != 0) return false;
+
+  auto counts_at = [&](size_t offset, long long counts[6]) {
+    for (int k = 0; k < 6; ++k) counts[k] = read_be(bytes + offset + 20 + 4 * k, 4);
+  };
+
+  long long counts[6];
+  counts_at(0, counts);
+  int time_width = 4;
+  size_t block = 44;
+  const char version = data[4];
+  if (version >= '2') {
+    // Skip the 32-bit block and use the 64-bit one
+    const size_t v1_size = counts[3] * 5 + counts[4] * 6 + counts[5] +
+      counts[2] * 8 + counts[1] + counts[0];
+    const size_t header2 = 44 + v1_size;
+    if (size < header2 + 44 || data.compare(header2, 4, "TZif") != 0) return false;
+    counts_at(header2, counts);
+    time_width = 8;
+    block = header2 + 44;
+  }
+
+  const long long isutcnt = counts[0], isstdcnt = counts[1], leapcnt = counts[2];
+  const long long timecnt = counts[3], typecnt = counts[4], charcnt = counts[5];
+  if (leapcnt != 0 || typecnt < 1) return false;
+  const size_t needed = block + timecnt * time_width + timecnt + typecnt * 6 +
+    charcnt + leapcnt * (time_width + 4) + isstdcnt + isutcnt;
+  if (size < needed) return false;
+
+  const unsigned char* p = bytes + block;
+  rules.transitions.resize(static_cast<size_t>(timecnt));
+  for (long long k = 0; k < timecnt; ++k) {
+    rules.transitions[k] = read_be(p, time_width);
+    p += time_width;
+  }
+  rules.transition_types.resize(static_cast<size_t>(timecnt));
+  for (long long k = 0; k < timecnt; ++k) {
+    rules.transition_types[k] = *p++;
+    if (rules.transition_types[k] >= typecnt) return false;
+  }
+  rules.type_utoff.resize(static_cast<size_t>(typecnt));
+  for (long long k = 0; k < typecnt; ++k) {
+    rules.type_utoff[k] = read_be(p, 4);
+    p += 6;
+  }
+
+  if (time_width == 8) {
+    const size_t footer_start = needed;
+    if (footer_start < size && data[footer_start] == '\n') {
+      const size_t footer_end = data.find('\n', footer_start + 1);
+      if (footer_end != std::string::npos && footer_end > footer_start + 1) {
+        rules.footer = parse_posix_tz(data.substr(footer_start + 1, footer_end - footer_start - 1));
+      }
+    }
+  }
+  return true;
+}
+
+inline bool read_file(const std::string& path, std::string& out) {
+  std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+  if (!in) return false;
+  out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  return true;
+}
+
+inline std::vector<std::string> zoneinfo_dirs() {
+  std::vector<std::string> dirs;
+  const char* tzdir = std::getenv("TZDIR");
+  if (tzdir != nullptr && *tzdir != '\0') dirs.push_back(tzdir);
+  const char* r_home = std::getenv("R_HOME");
+  if (r_home != nullptr && *r_home != '\0') {
+    dirs.push_back(std::string(r_home) + "/share/zoneinfo");
+  }
+  dirs.push_back("/usr/share/zoneinfo");
+  dirs.push_back("/usr/lib/zoneinfo");
+  dirs.push_back("/usr/share/lib/zoneinfo");
+  dirs.push_back("/etc/zoneinfo");
+  return dirs;
+}
+
+inline std::shared_ptr<const TimeZoneRules> load_zone(const std::string& tz) {
+  auto rules = std::make_shared<TimeZoneRules>();
+  if (tz.empty() || tz == "UTC" || tz == "GMT" || tz == "Etc/UTC" ||
+      tz == "Etc/GMT" || tz == "UCT" || tz == "Zulu" || tz == "Etc/Zulu") {
+    rules->fixed = true;
+    return rules;
+  }
+
+  const std::string name = tz[0] == ':' ? tz.substr(1) : tz;
+  if (!name.empty() && name[0] != '/' && name.find("..") == std::string::npos) {
+    std::string data;
+    for (const std::string& dir : zoneinfo_dirs()) {
+      if (read_file(dir + "/" + name, data) && parse_tzif(data, *rules)) {
+        return rules;
+      }
+      *rules = TimeZoneRules();
+    }
+  }
+
+  // Not a zone file: accept a bare POSIX TZ string such as "EST5EDT" or "<+03>-3"
+  PosixTz posix = parse_posix_tz(name);
+  if (posix.valid) {
+    if (!posix.has_dst) {
+      rules->fixed = true;
+      rules->fixed_utoff = posix.std_utoff;
+    } else {
+      rules->footer = posix;
+    }
+    return rules;
+  }
+  return nullptr;
+}
+
+} // namespace detail
+
+// Cached zone lookup; returns nullptr when the zone cannot be resolved natively.
+inline std::shared_ptr<const TimeZoneRules> find_zone(const std::string& tz) {
+  static std::mutex cache_mutex;
+  static std::map<std::string, std::shared_ptr<const TimeZoneRules>> cache;
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  auto found = cache.find(tz);
+  if (found != cache.end()) return found->second;
+  std::shared_ptr<const TimeZoneRules> rules = detail::load_zone(tz);
+  cache.emplace(tz, rules);
+  return rules;
+}
+
+// Start of the local calendar day containing the UTC instant t. Returns false
+// when local midnight is skipped or repeated by a DST transition on that day;
+// callers then defer to R's own conversion.
+inline bool local_midnight(const TimeZoneRules& zone, double t, double& midnight) {
+  if (!std::isfinite(t)) return false;
+  const long long offset = zone.offset_at(t);
+  const double local = t + static_cast<double>(offset);
+  const double local_midnight = std::floor(local / 86400.0) * 86400.0;
+
+  const double probes[4] = {
+    local_midnight - static_cast<double>(offset),
+    local_midnight - 26.0 * 3600.0,
+    local_midnight + 26.0 * 3600.0,
+    t
+  };
+  bool found = false;
+  double candidate = 0.0;
+  for (double probe : probes) {
+    const long long probe_offset = zone.offset_at(probe);
+    const double u = local_midnight - static_cast<double>(probe_offset);
+    if (zone.offset_at(u) != probe_offset) continue;
+    if (found && u != candidate) return false;
+    found = true;
+    candidate = u;
+  }
+  if (!found) return false;
+  midnight = candidate;
+  return true;
+}
+
+} // namespace cgmguru_tz
+
+#endif // CGMGURU_TIMEZONE_RULES_H
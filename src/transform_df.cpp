@@ -1,4 +1,5 @@
 #include "id_based_calculator.h"
+#include "window_search.h"
 
 using namespace Rcpp;
 using namespace std;
@@ -10,12 +11,13 @@ class TransformDfCalculator : public IdBasedCalculator {
     std::map<std::string, std::string> id_timezones;
     // Calculate transform summary for a single ID
   DataFrame calculate_transform_summary_for_id(const std::string& current_id,
-                                               const NumericVector& grid_time_subset,
-                                               const NumericVector& grid_gl_subset,
-                                               const NumericVector& maxima_time_subset,
-                                               const NumericVector& maxima_gl_subset) {
+                                               cgmguru_columns::DoubleSpan grid_time_subset,
+                                               cgmguru_columns::DoubleSpan grid_gl_subset,
+                                               cgmguru_columns::DoubleSpan maxima_time_subset,
+                                               cgmguru_columns::DoubleSpan maxima_gl_subset) {
     int n = grid_time_subset.size();
     int m = maxima_time_subset.size();
+    const double window_seconds = 4 * 3600;
 
     std::vector<std::string> id_results;
     std::vector<double> grid_time_results;
@@ -23,21 +25,44 @@ class TransformDfCalculator : public IdBasedCalculator {
     std::vector<double> maxima_time_results;
     std::vector<double> maxima_gl_results;
 
+    // Maxima with a time, in input order; NA maxima points can never match
+    std::vector<double> candidate_time;
+    std::vector<double> candidate_gl;
+    candidate_time.reserve(m);
+    candidate_gl.reserve(m);
+    for (int j = 0; j < m; ++j) {
+      if (NumericVector::is_na(maxima_time_subset[j])) continue;
+      candidate_time.push_back(maxima_time_subset[j]);
+      candidate_gl.push_back(maxima_gl_subset[j]);
+    }
+    const int n_candidates = static_cast<int>(candidate_time.size());
+    const bool maxima_sorted = cgmguru_window::is_nondecreasing(candidate_time);
+    // A maximum must beat -1, and ties keep the earliest maxima point
+    cgmguru_window::WindowExtreme<cgmguru_window::Greater> extreme(candidate_gl, -1, true);
+
     for (int i = 0; i < n; ++i) {
       if (NumericVector::is_na(grid_time_subset[i])) continue; // Skip NA grid points
+      const double grid_time = grid_time_subset[i];
 
-      double max_gl = -1;
       int max_gl_index = -1;
-
-      for (int j = 0; j < m; ++j) {
-        if (NumericVector::is_na(maxima_time_subset[j])) continue; // Skip NA maxima points
-
-        double potential_max_points = maxima_time_subset[j] - grid_time_subset[i];
-
-        if (potential_max_points >= 0 && potential_max_points <= 4 * 3600) {
-          if (maxima_gl_subset[j] > max_gl) {
-            max_gl = maxima_gl_subset[j];
-            max_gl_index = j;
+      if (maxima_sorted) {
+        // The window is the run of maxima 0 to 4 hours after this GRID point
+        auto first = std::partition_point(candidate_time.begin(), candidate_time.end(),
+          [grid_time](double t) { return !(t - grid_time >= 0); });
+        auto last = std::partition_point(first, candidate_time.end(),
+          [grid_time, window_seconds](double t) { return t - grid_time <= window_seconds; });
+        max_gl_index = extreme.query(static_cast<int>(first - candidate_time.begin()),
+                                     static_cast<int>(last - candidate_time.begin()) - 1);
+      } else {
+        double max_gl = -1;
+        for (int j = 0; j < n_candidates; ++j) {
+          double potential_max_points = candidate_time[j] - grid_time;
+
+          if (potential_max_points >= 0 && potential_max_points <= window_seconds) {
+            if (candidate_gl[j] > max_gl) {
+              max_gl = candidate_gl[j];
+              max_gl_index = j;
+            }
           }
         }
       }
@@ -45,10 +70,10 @@ class TransformDfCalculator : public IdBasedCalculator {
       // If a valid maximum point is found
       if (max_gl_index != -1) {
         id_results.push_back(current_id);
-        grid_time_results.push_back(grid_time_subset[i]);
+        grid_time_results.push_back(grid_time);
         grid_gl_results.push_back(grid_gl_subset[i]);
-        maxima_time_results.push_back(maxima_time_subset[max_gl_index]);
-        maxima_gl_results.push_back(max_gl);
+        maxima_time_results.push_back(candidate_time[max_gl_index]);
+        maxima_gl_results.push_back(candidate_gl[max_gl_index]);
       }
     }
 
@@ -84,6 +109,8 @@ class TransformDfCalculator : public IdBasedCalculator {
 
   public:
     DataFrame calculate(const DataFrame& grid_df, const DataFrame& maxima_df) {
+      profiler.clear();
+
       // Extract columns from GRID DataFrame
       StringVector grid_id = grid_df["id"];
       NumericVector grid_time = grid_df["time"];
@@ -128,33 +155,35 @@ class TransformDfCalculator : public IdBasedCalculator {
 
       // Store all results to combine later
       std::vector<DataFrame> all_results;
+      // Reused across ids; only touched when an id's rows are not contiguous
+      std::vector<double> grid_time_scratch;
+      std::vector<double> grid_gl_scratch;
+      std::vector<double> maxima_time_subset;
+      std::vector<double> maxima_gl_subset;
+      std::size_t group_pos = 0;
 
       // Calculate transform summary for each ID separately
       for (auto const& id_pair : id_indices) {
         std::string current_id = id_pair.first;
-        const std::vector<int>& grid_indices = id_pair.second;
+        const std::size_t k = group_pos++;
+        cgmguru_profile::ScopedStage stage(profiler, "transform_summary",
+                                           profiler.subject(current_id));
 
-        // Extract GRID subset data for this ID
-        NumericVector grid_time_subset(grid_indices.size());
-        NumericVector grid_gl_subset(grid_indices.size());
-        extract_id_subset(current_id, grid_indices, grid_time, grid_gl,
-                          grid_time_subset, grid_gl_subset);
+        // View this ID's GRID data in place when its rows are contiguous
+        cgmguru_columns::DoubleSpan grid_time_subset =
+          id_column_rows(k, grid_time.begin(), grid_time_scratch);
+        cgmguru_columns::DoubleSpan grid_gl_subset =
+          id_column_rows(k, grid_gl.begin(), grid_gl_scratch);
 
         // Extract maxima subset data for this ID (if exists)
-        NumericVector maxima_time_subset, maxima_gl_subset;
-        if (maxima_id_indices.count(current_id) > 0) {
-          const std::vector<int>& maxima_indices = maxima_id_indices[current_id];
-          maxima_time_subset = NumericVector(maxima_indices.size());
-          maxima_gl_subset = NumericVector(maxima_indices.size());
-
-          for (size_t i = 0; i < maxima_indices.size(); ++i) {
-            maxima_time_subset[i] = maxima_time[maxima_indices[i]];
-            maxima_gl_subset[i] = maxima_gl[maxima_indices[i]];
+        maxima_time_subset.clear();
+        maxima_gl_subset.clear();
+        auto maxima_found = maxima_id_indices.find(current_id);
+        if (maxima_found != maxima_id_indices.end()) {
+          for (int row : maxima_found->second) {
+            maxima_time_subset.push_back(maxima_time[row]);
+            maxima_gl_subset.push_back(maxima_gl[row]);
           }
-        } else {
-          // No maxima data for this ID
-          maxima_time_subset = NumericVector(0);
-          maxima_gl_subset = NumericVector(0);
         }
 
         // Calculate transform summary for this ID
@@ -169,6 +198,9 @@ class TransformDfCalculator : public IdBasedCalculator {
         }
       }
 
+      // Combining and the output table run to the end of the call
+      cgmguru_profile::ScopedStage output_stage(profiler, "output_tables");
+
       // Combine all results into a single DataFrame
       if (all_results.empty()) {
         // Return empty DataFrame with correct structure as tibble
@@ -252,7 +284,12 @@ class TransformDfCalculator : public IdBasedCalculator {
 };
 
 // [[Rcpp::export]]
-DataFrame transform_df(DataFrame grid_df, DataFrame maxima_df) {
+DataFrame transform_df(DataFrame grid_df, DataFrame maxima_df, bool profile = false) {
   TransformDfCalculator calculator;
-  return calculator.calculate(grid_df, maxima_df);
+  calculator.enable_profiling(profile);
+  DataFrame result = calculator.calculate(grid_df, maxima_df);
+  if (profile) {
+    result.attr("profile") = calculator.profile_table();
+  }
+  return result;
 }
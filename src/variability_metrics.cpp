@@ -1,4 +1,7 @@
 #include "event_preprocessing.h"
+#include "id_grouping.h"
+#include "stage_profiler.h"
+#include "variability_metrics.h"
 
 #include <Rcpp.h>
 #include <algorithm>
@@ -11,20 +14,7 @@
 
 using namespace Rcpp;
 
-namespace {
-
-struct MageRow {
-  double start;
-  double end;
-  double mage;
-  std::string plus_or_minus;
-  int first_excursion;
-};
-
-struct SegmentBounds {
-  int start;
-  int end;
-};
+namespace cgmguru_variability {
 
 std::string timezone_from_time_or_arg(const NumericVector& time,
                                       const std::string& tz_arg) {
@@ -47,6 +37,44 @@ std::string timezone_from_time_or_arg(const NumericVector& time,
   return tzone;
 }
 
+std::map<std::string, std::vector<int>> valid_id_indices(const DataFrame& df) {
+  const int n = df.nrows();
+  StringVector id = df["id"];
+  NumericVector time = df["time"];
+  NumericVector glucose = df["gl"];
+
+  std::map<std::string, std::vector<int>> id_indices =
+    cgmguru_ids::group_rows_by_id(id, n, true, [&](R_xlen_t i) {
+      return !cgmguru_events::is_na(time[i]) && !cgmguru_events::is_na(glucose[i]);
+    }).to_map();
+
+  for (auto& id_pair : id_indices) {
+    std::vector<int>& indices = id_pair.second;
+    std::sort(indices.begin(), indices.end(), [&](int lhs, int rhs) {
+      return time[lhs] < time[rhs];
+    });
+  }
+
+  return id_indices;
+}
+
+} // namespace cgmguru_variability
+
+namespace {
+
+struct MageRow {
+  double start;
+  double end;
+  double mage;
+  std::string plus_or_minus;
+  int first_excursion;
+};
+
+struct SegmentBounds {
+  int start;
+  int end;
+};
+
 void set_posixct_attributes(NumericVector& x, const std::string& tzone) {
   x.attr("class") = CharacterVector::create("POSIXct", "POSIXt");
   x.attr("tzone") = tzone.empty() ? "UTC" : tzone;
@@ -111,32 +139,6 @@ double mean_or_na(const std::vector<double>& values) {
   return sum / static_cast<double>(n);
 }
 
-std::map<std::string, std::vector<int>> valid_id_indices(const DataFrame& df) {
-  const int n = df.nrows();
-  StringVector id = df["id"];
-  NumericVector time = df["time"];
-  NumericVector glucose = df["gl"];
-
-  std::map<std::string, std::vector<int>> id_indices;
-  for (int i = 0; i < n; ++i) {
-    if (StringVector::is_na(id[i]) ||
-        cgmguru_events::is_na(time[i]) ||
-        cgmguru_events::is_na(glucose[i])) {
-      continue;
-    }
-    id_indices[as<std::string>(id[i])].push_back(i);
-  }
-
-  for (auto& id_pair : id_indices) {
-    std::vector<int>& indices = id_pair.second;
-    std::sort(indices.begin(), indices.end(), [&](int lhs, int rhs) {
-      return time[lhs] < time[rhs];
-    });
-  }
-
-  return id_indices;
-}
-
 double calculate_conga_for_id(const NumericVector& time,
                               const NumericVector& glucose,
                               const std::vector<int>& indices,
@@ -148,36 +150,13 @@ double calculate_conga_for_id(const NumericVector& time,
     return NA_REAL;
   }
 
-  double reading_minutes =
-    cgmguru_events::reading_minutes_for_id(R_NilValue, time, indices, full_length);
-  if (reading_minutes > inter_gap + 1e-7) {
-    stop("identified measurement frequency is above inter_gap");
-  }
-  reading_minutes = cgmguru_events::iglu_day_grid_reading_minutes(reading_minutes);
-
+  const double reading_minutes = cgmguru_variability::day_grid_reading_minutes(
+    time, indices, inter_gap, full_length
+  );
   cgmguru_events::PreparedIDData prepared =
     cgmguru_events::prepare_id_data(time, glucose, indices, reading_minutes,
                                     inter_gap, tzone, true, false);
-  const int lag = static_cast<int>(
-    std::round(60.0 / prepared.reading_minutes)
-  ) * hours;
-
-  if (lag <= 0 || prepared.glucose.length() <= lag) {
-    return NA_REAL;
-  }
-
-  std::vector<double> differences;
-  differences.reserve(prepared.glucose.length() - lag);
-  for (int i = lag; i < prepared.glucose.length(); ++i) {
-    const double current = prepared.glucose[i];
-    const double previous = prepared.glucose[i - lag];
-    if (is_missing(current) || is_missing(previous)) {
-      continue;
-    }
-    differences.push_back(current - previous);
-  }
-
-  return sample_sd(differences);
+  return cgmguru_variability::conga_from_prepared(prepared, hours);
 }
 
 double calculate_modd_for_id(const NumericVector& time,
@@ -191,61 +170,76 @@ double calculate_modd_for_id(const NumericVector& time,
     return R_NaN;
   }
 
-  double reading_minutes =
-    cgmguru_events::reading_minutes_for_id(R_NilValue, time, indices, full_length);
-  if (reading_minutes > inter_gap + 1e-7) {
-    stop("identified measurement frequency is above inter_gap");
-  }
-  reading_minutes = cgmguru_events::iglu_day_grid_reading_minutes(reading_minutes);
-
+  const double reading_minutes = cgmguru_variability::day_grid_reading_minutes(
+    time, indices, inter_gap, full_length
+  );
   cgmguru_events::PreparedIDData prepared =
     cgmguru_events::prepare_id_data(time, glucose, indices, reading_minutes,
                                     inter_gap, tzone, true, false);
-  const int readings_per_day = static_cast<int>(
-    std::round((24.0 * 60.0) / prepared.reading_minutes)
-  );
-  const int lag_offset = readings_per_day * day_lag;
-
-  if (readings_per_day <= 0 || prepared.glucose.length() <= lag_offset) {
-    return R_NaN;
-  }
+  return cgmguru_variability::modd_from_prepared(prepared, day_lag);
+}
 
-  std::vector<double> absolute_differences;
-  absolute_differences.reserve(prepared.glucose.length() - lag_offset);
-  for (int i = lag_offset; i < prepared.glucose.length(); ++i) {
-    const double current = prepared.glucose[i];
-    const double previous = prepared.glucose[i - lag_offset];
-    if (is_missing(current) || is_missing(previous)) {
-      continue;
-    }
-    absolute_differences.push_back(std::fabs(current - previous));
+// True when every reading is a whole number small enough that any sum of
+// them is exact in double precision
+bool exact_integer_sums(const std::vector<double>& glucose) {
+  const double limit = 9007199254740992.0 /  // 2^53
+    static_cast<double>(std::max<std::size_t>(glucose.size(), 1));
+  for (double value : glucose) {
+    if (is_missing(value)) continue;
+    if (value != std::floor(value) || std::fabs(value) > limit) return false;
   }
-
-  return mean_or_nan(absolute_differences);
+  return true;
 }
 
-std::vector<double> rolling_mean_right(const std::vector<double>& glucose,
-                                       int width) {
+// Right-aligned, NA-skipping moving averages for several window widths.
+// Every mean is bit-identical to summing its window left to right, because
+// MAGE compares the short and long averages by sign and a last-bit
+// difference can move a crossing. Whole-number readings (raw CGM values)
+// have exact sums, so there each width keeps a running sum and count and
+// costs O(n); other readings, such as interpolated ones, are summed per
+// window. The first width - 1 positions repeat the first complete window,
+// and widths outside [1, n] are all NA.
+std::vector<std::vector<double>> rolling_means_right(const std::vector<double>& glucose,
+                                                     const std::vector<int>& widths) {
   const int n = static_cast<int>(glucose.size());
-  std::vector<double> out(n, NA_REAL);
-  if (width <= 0 || n == 0 || width > n) {
-    return out;
-  }
-
-  for (int i = width - 1; i < n; ++i) {
-    double sum = 0.0;
-    int count = 0;
-    for (int j = i - width + 1; j <= i; ++j) {
-      if (is_missing(glucose[j])) continue;
-      sum += glucose[j];
-      ++count;
+  const bool running = exact_integer_sums(glucose);
+  std::vector<std::vector<double>> out(widths.size(), std::vector<double>(n, NA_REAL));
+
+  for (std::size_t w = 0; w < widths.size(); ++w) {
+    const int width = widths[w];
+    if (width <= 0 || width > n) continue;
+    std::vector<double>& mean = out[w];
+
+    if (running) {
+      double sum = 0.0;
+      int count = 0;
+      for (int i = 0; i < n; ++i) {
+        if (!is_missing(glucose[i])) {
+          sum += glucose[i];
+          ++count;
+        }
+        if (i >= width && !is_missing(glucose[i - width])) {
+          sum -= glucose[i - width];
+          --count;
+        }
+        if (i >= width - 1) {
+          mean[i] = count == 0 ? NA_REAL : sum / static_cast<double>(count);
+        }
+      }
+    } else {
+      for (int i = width - 1; i < n; ++i) {
+        double sum = 0.0;
+        int count = 0;
+        for (int j = i - width + 1; j <= i; ++j) {
+          if (is_missing(glucose[j])) continue;
+          sum += glucose[j];
+          ++count;
+        }
+        mean[i] = count == 0 ? NA_REAL : sum / static_cast<double>(count);
+      }
     }
-    out[i] = count == 0 ? NA_REAL : sum / static_cast<double>(count);
-  }
 
-  const double first_complete = out[width - 1];
-  for (int i = 0; i < width && i < n; ++i) {
-    out[i] = first_complete;
+    std::fill(mean.begin(), mean.begin() + (width - 1), mean[width - 1]);
   }
 
   return out;
@@ -257,36 +251,76 @@ MageRow na_mage_row(const std::vector<double>& time) {
   return {start, end, NA_REAL, "", NA_LOGICAL};
 }
 
-std::pair<double, int> interval_extreme(const std::vector<double>& glucose,
-                                        int start,
-                                        int end,
-                                        bool find_minimum) {
-  start = std::max(start, 0);
-  end = std::min(end, static_cast<int>(glucose.size()) - 1);
-  if (start > end) {
-    return {NA_REAL, start};
+// Sparse tables of range argmin and argmax over one segment's glucose, built
+// once so each crossing interval is answered in O(1) however long it is.
+// A query returns the first index holding the extreme non-missing value of
+// glucose[start..end], exactly like a left-to-right scan; ranges with no
+// value give {NA, start}.
+class RangeExtremes {
+public:
+  explicit RangeExtremes(const std::vector<double>& glucose)
+    : glucose_(glucose), floor_log2_(glucose.size() + 1, 0) {
+    const int n = static_cast<int>(glucose.size());
+    for (int len = 2; len <= n; ++len) {
+      floor_log2_[len] = floor_log2_[len / 2] + 1;
+    }
+    const int levels = n == 0 ? 0 : floor_log2_[n] + 1;
+    min_table_.resize(levels);
+    max_table_.resize(levels);
+    if (levels == 0) return;
+
+    min_table_[0].resize(n);
+    for (int i = 0; i < n; ++i) {
+      min_table_[0][i] = is_missing(glucose[i]) ? -1 : i;
+    }
+    max_table_[0] = min_table_[0];
+    for (int k = 1; k < levels; ++k) {
+      const int half = 1 << (k - 1);
+      const int count = n - (1 << k) + 1;
+      min_table_[k].resize(count);
+      max_table_[k].resize(count);
+      for (int i = 0; i < count; ++i) {
+        min_table_[k][i] = better(min_table_[k - 1][i], min_table_[k - 1][i + half], true);
+        max_table_[k][i] = better(max_table_[k - 1][i], max_table_[k - 1][i + half], false);
+      }
+    }
   }
 
-  double best = find_minimum
-    ? std::numeric_limits<double>::infinity()
-    : -std::numeric_limits<double>::infinity();
-  int best_index = -1;
-
-  for (int i = start; i <= end; ++i) {
-    const double value = glucose[i];
-    if (is_missing(value)) continue;
-    if (best_index < 0 ||
-        (find_minimum ? value < best : value > best)) {
-      best = value;
-      best_index = i;
+  std::pair<double, int> query(int start, int end, bool find_minimum) const {
+    start = std::max(start, 0);
+    end = std::min(end, static_cast<int>(glucose_.size()) - 1);
+    if (start > end) {
+      return {NA_REAL, start};
     }
-  }
 
-  if (best_index < 0) {
-    return {NA_REAL, start};
-  }
-  return {best, best_index};
-}
+    const int k = floor_log2_[end - start + 1];
+    const std::vector<std::vector<int>>& table = find_minimum ? min_table_ : max_table_;
+    const int best_index =
+      better(table[k][start], table[k][end - (1 << k) + 1], find_minimum);
+    if (best_index < 0) {
+      return {NA_REAL, start};
+    }
+    return {glucose_[best_index], best_index};
+  }
+
+private:
+  // The more extreme of two candidate indices (-1 is none); ties keep the
+  // earlier index, which keeps overlapping halves consistent with a scan
+  int better(int lhs, int rhs, bool find_minimum) const {
+    if (lhs < 0) return rhs;
+    if (rhs < 0) return lhs;
+    const double lhs_value = glucose_[lhs];
+    const double rhs_value = glucose_[rhs];
+    if (find_minimum ? lhs_value < rhs_value : lhs_value > rhs_value) return lhs;
+    if (find_minimum ? rhs_value < lhs_value : rhs_value > lhs_value) return rhs;
+    return std::min(lhs, rhs);
+  }
+
+  const std::vector<double>& glucose_;
+  std::vector<int> floor_log2_;
+  std::vector<std::vector<int>> min_table_;
+  std::vector<std::vector<int>> max_table_;
+};
 
 double extrema_difference(const std::vector<double>& minmax,
                           int row,
@@ -300,10 +334,13 @@ double extrema_difference(const std::vector<double>& minmax,
   return minmax[col] - minmax[row];
 }
 
+// short_mean and long_mean are the short_ma and long_ma moving averages of
+// glucose (see rolling_means_right)
 std::vector<MageRow> mage_atomic(const std::vector<double>& time,
                                  const std::vector<double>& glucose,
-                                 int short_ma,
-                                 int long_ma) {
+                                 int long_ma,
+                                 const std::vector<double>& short_mean,
+                                 const std::vector<double>& long_mean) {
   const int n = static_cast<int>(glucose.size());
   if (n == 0) {
     return std::vector<MageRow>{na_mage_row(time)};
@@ -328,9 +365,6 @@ std::vector<MageRow> mage_atomic(const std::vector<double>& time,
     return std::vector<MageRow>{na_mage_row(time)};
   }
 
-  const std::vector<double> short_mean = rolling_mean_right(glucose, short_ma);
-  const std::vector<double> long_mean = rolling_mean_right(glucose, long_ma);
-
   std::vector<double> delta(n, NA_REAL);
   for (int i = 0; i < n; ++i) {
     if (!is_missing(short_mean[i]) && !is_missing(long_mean[i])) {
@@ -378,13 +412,14 @@ std::vector<MageRow> mage_atomic(const std::vector<double>& time,
 
   std::vector<double> minmax(num_extrema, NA_REAL);
   std::vector<int> extrema_indexes(num_extrema, 0);
+  const RangeExtremes extremes(glucose);
 
   for (int i = 0; i < num_extrema; ++i) {
     const int s1 = i == 0 ? cross_pos[i] : extrema_indexes[i - 1];
     const int s2 = cross_pos[i + 1];
     const bool find_minimum = cross_type[i] == rel_min;
     const std::pair<double, int> extreme =
-      interval_extreme(glucose, s1, s2, find_minimum);
+      extremes.query(s1, s2, find_minimum);
     minmax[i] = extreme.first;
     extrema_indexes[i] = extreme.second;
   }
@@ -541,18 +576,13 @@ std::vector<SegmentBounds> mage_segments(const std::vector<double>& glucose,
   return segments;
 }
 
-std::vector<MageRow> calculate_mage_ma_for_id(const NumericVector& time,
-                                              const NumericVector& glucose,
-                                              const std::vector<int>& indices,
-                                              int short_ma,
-                                              int long_ma,
-                                              double inter_gap,
-                                              double max_gap,
-                                              const std::string& tzone) {
-  cgmguru_events::PreparedIDData prepared =
-    cgmguru_events::prepare_id_data(time, glucose, indices, 5.0,
-                                    inter_gap, tzone, true, false);
-
+// MAGE-ma rows for each (short_ma, long_ma) pair in windows. Trimming and
+// gap segmentation do not depend on the windows, so each segment is cut once
+// and the moving averages of every distinct width come from a single pass.
+std::vector<std::vector<MageRow>> mage_ma_rows_for_windows(
+    const cgmguru_events::PreparedIDData& prepared,
+    std::vector<std::pair<int, int>> windows,
+    double max_gap) {
   const int n = prepared.glucose.length();
   int first_valid = -1;
   int last_valid = -1;
@@ -564,7 +594,9 @@ std::vector<MageRow> calculate_mage_ma_for_id(const NumericVector& time,
   }
 
   if (first_valid < 0 || last_valid < first_valid) {
-    return std::vector<MageRow>{na_mage_row(std::vector<double>())};
+    return std::vector<std::vector<MageRow>>(
+      windows.size(), std::vector<MageRow>{na_mage_row(std::vector<double>())}
+    );
   }
 
   std::vector<double> trimmed_time;
@@ -576,23 +608,47 @@ std::vector<MageRow> calculate_mage_ma_for_id(const NumericVector& time,
     trimmed_glucose.push_back(prepared.glucose[i]);
   }
 
+  std::vector<std::vector<MageRow>> rows(windows.size());
   if (static_cast<int>(trimmed_glucose.size()) < 7) {
-    return std::vector<MageRow>{na_mage_row(trimmed_time)};
-  }
-
-  if (short_ma >= long_ma) {
-    warning("The short moving average window size should be smaller than the long moving average window size for correct MAGE calculation. Swapping automatically.");
-    std::swap(short_ma, long_ma);
-  }
+    for (std::vector<MageRow>& window_rows : rows) {
+      window_rows.push_back(na_mage_row(trimmed_time));
+    }
+    return rows;
+  }
+
+  // Windows that still need the segment pass, and the widths they use
+  std::vector<std::size_t> active;
+  std::vector<int> widths;
+  for (std::size_t w = 0; w < windows.size(); ++w) {
+    int& short_ma = windows[w].first;
+    int& long_ma = windows[w].second;
+    if (short_ma >= long_ma) {
+      warning("The short moving average window size should be smaller than the long moving average window size for correct MAGE calculation. Swapping automatically.");
+      std::swap(short_ma, long_ma);
+    }
 
-  if (static_cast<int>(trimmed_glucose.size()) < long_ma) {
-    return std::vector<MageRow>{na_mage_row(trimmed_time)};
-  }
+    if (static_cast<int>(trimmed_glucose.size()) < long_ma) {
+      rows[w].push_back(na_mage_row(trimmed_time));
+      continue;
+    }
+    active.push_back(w);
+    widths.push_back(short_ma);
+    widths.push_back(long_ma);
+  }
+  if (active.empty()) {
+    return rows;
+  }
+  std::sort(widths.begin(), widths.end());
+  widths.erase(std::unique(widths.begin(), widths.end()), widths.end());
+  auto width_slot = [&widths](int width) {
+    return static_cast<std::size_t>(
+      std::lower_bound(widths.begin(), widths.end(), width) - widths.begin()
+    );
+  };
 
   const std::vector<SegmentBounds> segments =
     mage_segments(trimmed_glucose, 5.0, max_gap);
 
-  std::vector<MageRow> rows;
   for (const SegmentBounds& segment : segments) {
     std::vector<double> segment_time;
     std::vector<double> segment_glucose;
@@ -603,14 +659,44 @@ std::vector<MageRow> calculate_mage_ma_for_id(const NumericVector& time,
       segment_glucose.push_back(trimmed_glucose[i]);
     }
 
-    std::vector<MageRow> segment_rows =
-      mage_atomic(segment_time, segment_glucose, short_ma, long_ma);
-    rows.insert(rows.end(), segment_rows.begin(), segment_rows.end());
+    const std::vector<std::vector<double>> means =
+      rolling_means_right(segment_glucose, widths);
+    for (std::size_t w : active) {
+      std::vector<MageRow> segment_rows = mage_atomic(
+        segment_time, segment_glucose, windows[w].second,
+        means[width_slot(windows[w].first)], means[width_slot(windows[w].second)]
+      );
+      rows[w].insert(rows[w].end(), segment_rows.begin(), segment_rows.end());
+    }
   }
 
   return rows;
 }
 
+std::vector<MageRow> mage_ma_rows_from_prepared(
+    const cgmguru_events::PreparedIDData& prepared,
+    int short_ma,
+    int long_ma,
+    double max_gap) {
+  return mage_ma_rows_for_windows(
+    prepared, std::vector<std::pair<int, int>>{{short_ma, long_ma}}, max_gap
+  ).front();
+}
+
+std::vector<MageRow> calculate_mage_ma_for_id(const NumericVector& time,
+                                              const NumericVector& glucose,
+                                              const std::vector<int>& indices,
+                                              int short_ma,
+                                              int long_ma,
+                                              double inter_gap,
+                                              double max_gap,
+                                              const std::string& tzone) {
+  cgmguru_events::PreparedIDData prepared =
+    cgmguru_events::prepare_id_data(time, glucose, indices, 5.0,
+                                    inter_gap, tzone, true, false);
+  return mage_ma_rows_from_prepared(prepared, short_ma, long_ma, max_gap);
+}
+
 DataFrame mage_rows_to_dataframe(const std::vector<MageRow>& rows,
                                  const std::string& tzone) {
   const int n = static_cast<int>(rows.size());
@@ -772,6 +858,91 @@ double calculate_mage_naive_for_id(const NumericVector& glucose,
 
 } // namespace
 
+namespace cgmguru_variability {
+
+double day_grid_reading_minutes(const NumericVector& time,
+                                const std::vector<int>& indices,
+                                double inter_gap,
+                                int full_length) {
+  return day_grid_reading_minutes(
+    cgmguru_events::reading_minutes_for_id(R_NilValue, time, indices, full_length),
+    inter_gap
+  );
+}
+
+double day_grid_reading_minutes(double reading_minutes, double inter_gap) {
+  if (reading_minutes > inter_gap + 1e-7) {
+    stop("identified measurement frequency is above inter_gap");
+  }
+  return cgmguru_events::iglu_day_grid_reading_minutes(reading_minutes);
+}
+
+double conga_from_prepared(const cgmguru_events::PreparedIDData& prepared,
+                           int hours) {
+  const int lag = static_cast<int>(
+    std::round(60.0 / prepared.reading_minutes)
+  ) * hours;
+
+  if (lag <= 0 || prepared.glucose.length() <= lag) {
+    return NA_REAL;
+  }
+
+  std::vector<double> differences;
+  differences.reserve(prepared.glucose.length() - lag);
+  for (int i = lag; i < prepared.glucose.length(); ++i) {
+    const double current = prepared.glucose[i];
+    const double previous = prepared.glucose[i - lag];
+    if (is_missing(current) || is_missing(previous)) {
+      continue;
+    }
+    differences.push_back(current - previous);
+  }
+
+  return sample_sd(differences);
+}
+
+double modd_from_prepared(const cgmguru_events::PreparedIDData& prepared,
+                          int day_lag) {
+  if (day_lag <= 0) {
+    return R_NaN;
+  }
+
+  const int readings_per_day = static_cast<int>(
+    std::round((24.0 * 60.0) / prepared.reading_minutes)
+  );
+  const int lag_offset = readings_per_day * day_lag;
+
+  if (readings_per_day <= 0 || prepared.glucose.length() <= lag_offset) {
+    return R_NaN;
+  }
+
+  std::vector<double> absolute_differences;
+  absolute_differences.reserve(prepared.glucose.length() - lag_offset);
+  for (int i = lag_offset; i < prepared.glucose.length(); ++i) {
+    const double current = prepared.glucose[i];
+    const double previous = prepared.glucose[i - lag_offset];
+    if (is_missing(current) || is_missing(previous)) {
+      continue;
+    }
+    absolute_differences.push_back(std::fabs(current - previous));
+  }
+
+  return mean_or_nan(absolute_differences);
+}
+
+double mage_ma_from_prepared(const cgmguru_events::PreparedIDData& prepared,
+                             int short_ma,
+                             int long_ma,
+                             double max_gap,
+                             const std::string& direction) {
+  return summarize_mage_rows(
+    mage_ma_rows_from_prepared(prepared, short_ma, long_ma, max_gap),
+    direction
+  );
+}
+
+} // namespace cgmguru_variability
+
 // [[Rcpp::export]]
 DataFrame conga_rcpp_cpp(DataFrame df,
                          int n = 24,
@@ -785,8 +956,10 @@ DataFrame conga_rcpp_cpp(DataFrame df,
 
   NumericVector time = df["time"];
   NumericVector glucose = df["gl"];
-  const std::string tzone = timezone_from_time_or_arg(time, tz);
-  std::map<std::string, std::vector<int>> id_indices = valid_id_indices(df);
+  const std::string tzone =
+    cgmguru_variability::timezone_from_time_or_arg(time, tz);
+  std::map<std::string, std::vector<int>> id_indices =
+    cgmguru_variability::valid_id_indices(df);
 
   CharacterVector out_id(id_indices.size());
   NumericVector out_conga(id_indices.size());
@@ -821,8 +994,10 @@ DataFrame modd_rcpp_cpp(DataFrame df,
 
   NumericVector time = df["time"];
   NumericVector glucose = df["gl"];
-  const std::string tzone = timezone_from_time_or_arg(time, tz);
-  std::map<std::string, std::vector<int>> id_indices = valid_id_indices(df);
+  const std::string tzone =
+    cgmguru_variability::timezone_from_time_or_arg(time, tz);
+  std::map<std::string, std::vector<int>> id_indices =
+    cgmguru_variability::valid_id_indices(df);
 
   CharacterVector out_id(id_indices.size());
   NumericVector out_modd(id_indices.size());
@@ -854,46 +1029,58 @@ DataFrame mage_rcpp_cpp(DataFrame df,
                         std::string direction = "avg",
                         std::string tz = "",
                         double inter_gap = 45,
-                        double max_gap = 180) {
+                        double max_gap = 180,
+                        bool profile = false) {
   if (!df.containsElementNamed("id") ||
       !df.containsElementNamed("time") ||
       !df.containsElementNamed("gl")) {
     stop("mage_rcpp requires columns 'id', 'time', and 'gl'");
   }
+  if (version != "naive" && version != "ma") {
+    stop("version must be 'ma' or 'naive'");
+  }
+  if (version == "ma" && return_type != "df" && return_type != "num") {
+    stop("return_type must be 'num' or 'df'");
+  }
+
+  cgmguru_profile::StageProfiler profiler;
+  profiler.set_enabled(profile);
 
   NumericVector time = df["time"];
   NumericVector glucose = df["gl"];
-  const std::string tzone = timezone_from_time_or_arg(time, tz);
-  std::map<std::string, std::vector<int>> id_indices = valid_id_indices(df);
+  const std::string tzone =
+    cgmguru_variability::timezone_from_time_or_arg(time, tz);
+  std::map<std::string, std::vector<int>> id_indices;
+  {
+    cgmguru_profile::ScopedStage stage(profiler, "group_by_id");
+    id_indices = cgmguru_variability::valid_id_indices(df);
+  }
 
   CharacterVector out_id(id_indices.size());
+  DataFrame out;
 
   if (version == "naive") {
     NumericVector out_mage(id_indices.size());
     int out_pos = 0;
     for (const auto& id_pair : id_indices) {
+      cgmguru_profile::ScopedStage stage(profiler, "mage_naive",
+                                         profiler.subject(id_pair.first));
       out_id[out_pos] = id_pair.first;
       out_mage[out_pos] =
         calculate_mage_naive_for_id(glucose, id_pair.second, sd_multiplier);
       ++out_pos;
     }
 
-    DataFrame out = DataFrame::create(
+    out = DataFrame::create(
       _["id"] = out_id,
       _["MAGE"] = out_mage
     );
-    set_tibble_class(out);
-    return out;
-  }
-
-  if (version != "ma") {
-    stop("version must be 'ma' or 'naive'");
-  }
-
-  if (return_type == "df") {
+  } else if (return_type == "df") {
     List out_mage(id_indices.size());
     int out_pos = 0;
     for (const auto& id_pair : id_indices) {
+      cgmguru_profile::ScopedStage stage(profiler, "mage_ma",
+                                         profiler.subject(id_pair.first));
       out_id[out_pos] = id_pair.first;
       std::vector<MageRow> rows = calculate_mage_ma_for_id(
         time, glucose, id_pair.second, short_ma, long_ma,
@@ -904,32 +1091,100 @@ DataFrame mage_rcpp_cpp(DataFrame df,
     }
     out_mage.attr("class") = "AsIs";
 
-    DataFrame out = DataFrame::create(
+    out = DataFrame::create(
+      _["id"] = out_id,
+      _["MAGE"] = out_mage
+    );
+  } else {
+    NumericVector out_mage(id_indices.size());
+    int out_pos = 0;
+    for (const auto& id_pair : id_indices) {
+      cgmguru_profile::ScopedStage stage(profiler, "mage_ma",
+                                         profiler.subject(id_pair.first));
+      out_id[out_pos] = id_pair.first;
+      std::vector<MageRow> rows = calculate_mage_ma_for_id(
+        time, glucose, id_pair.second, short_ma, long_ma,
+        inter_gap, max_gap, tzone
+      );
+      out_mage[out_pos] = summarize_mage_rows(rows, direction);
+      ++out_pos;
+    }
+
+    out = DataFrame::create(
       _["id"] = out_id,
       _["MAGE"] = out_mage
     );
-    set_tibble_class(out);
-    return out;
   }
 
-  if (return_type != "num") {
-    stop("return_type must be 'num' or 'df'");
+  set_tibble_class(out);
+  if (profile) {
+    out.attr("profile") = profiler.to_dataframe();
   }
+  return out;
+}
 
-  NumericVector out_mage(id_indices.size());
-  int out_pos = 0;
+// [[Rcpp::export]]
+DataFrame mage_ma_sweep_cpp(DataFrame df,
+                            IntegerVector short_ma,
+                            IntegerVector long_ma,
+                            std::string direction = "avg",
+                            std::string tz = "",
+                            double inter_gap = 45,
+                            double max_gap = 180) {
+  if (!df.containsElementNamed("id") ||
+      !df.containsElementNamed("time") ||
+      !df.containsElementNamed("gl")) {
+    stop("mage_ma_sweep requires columns 'id', 'time', and 'gl'");
+  }
+  if (short_ma.size() != long_ma.size() || short_ma.size() == 0) {
+    stop("short_ma and long_ma must be non-empty and of equal length");
+  }
+
+  std::vector<std::pair<int, int>> windows;
+  windows.reserve(short_ma.size());
+  for (R_xlen_t w = 0; w < short_ma.size(); ++w) {
+    if (IntegerVector::is_na(short_ma[w]) || IntegerVector::is_na(long_ma[w]) ||
+        short_ma[w] < 1 || long_ma[w] < 1) {
+      stop("short_ma and long_ma must be positive whole numbers");
+    }
+    windows.push_back(std::make_pair(short_ma[w], long_ma[w]));
+  }
+
+  NumericVector time = df["time"];
+  NumericVector glucose = df["gl"];
+  const std::string tzone =
+    cgmguru_variability::timezone_from_time_or_arg(time, tz);
+  std::map<std::string, std::vector<int>> id_indices =
+    cgmguru_variability::valid_id_indices(df);
+
+  const std::size_t n_out = id_indices.size() * windows.size();
+  CharacterVector out_id(n_out);
+  IntegerVector out_short(n_out);
+  IntegerVector out_long(n_out);
+  NumericVector out_mage(n_out);
+
+  std::size_t out_pos = 0;
   for (const auto& id_pair : id_indices) {
-    out_id[out_pos] = id_pair.first;
-    std::vector<MageRow> rows = calculate_mage_ma_for_id(
-      time, glucose, id_pair.second, short_ma, long_ma,
-      inter_gap, max_gap, tzone
-    );
-    out_mage[out_pos] = summarize_mage_rows(rows, direction);
-    ++out_pos;
+    // One interpolation and one moving-average pass per subject serve every
+    // window pair
+    cgmguru_events::PreparedIDData prepared =
+      cgmguru_events::prepare_id_data(time, glucose, id_pair.second, 5.0,
+                                      inter_gap, tzone, true, false);
+    const std::vector<std::vector<MageRow>> rows =
+      mage_ma_rows_for_windows(prepared, windows, max_gap);
+    for (std::size_t w = 0; w < windows.size(); ++w) {
+      out_id[out_pos] = id_pair.first;
+      out_short[out_pos] = windows[w].first;
+      out_long[out_pos] = windows[w].second;
+      out_mage[out_pos] = summarize_mage_rows(rows[w], direction);
+      ++out_pos;
+    }
   }
 
   DataFrame out = DataFrame::create(
     _["id"] = out_id,
+    _["short_ma"] = out_short,
+    _["long_ma"] = out_long,
     _["MAGE"] = out_mage
   );
   set_tibble_class(out);
@@ -0,0 +1,50 @@
+#ifndef CGMGURU_VARIABILITY_METRICS_H
+#define CGMGURU_VARIABILITY_METRICS_H
+
+#include <Rcpp.h>
+#include "event_preprocessing.h"
+#include <map>
+#include <string>
+#include <vector>
+
+// Variability kernels that work on an already prepared (interpolated,
+// day-grid aligned) subject, so callers that need several metrics can
+// interpolate each subject once and share the grid.
+namespace cgmguru_variability {
+
+// Time zone used for day-grid alignment: tz_arg when supplied, otherwise the
+// tzone attribute of time, otherwise "UTC"
+std::string timezone_from_time_or_arg(const Rcpp::NumericVector& time,
+                                      const std::string& tz_arg);
+
+// Rows with non-missing id, time and gl grouped by id, sorted by time
+std::map<std::string, std::vector<int>> valid_id_indices(const Rcpp::DataFrame& df);
+
+// Day-grid reading interval for CONGA/MODD, inferred from the subject's
+// timestamps; stops when it exceeds inter_gap
+double day_grid_reading_minutes(const Rcpp::NumericVector& time,
+                                const std::vector<int>& indices,
+                                double inter_gap,
+                                int full_length);
+
+// Same, for an interval the caller has already inferred for the subject
+double day_grid_reading_minutes(double reading_minutes, double inter_gap);
+
+// Sample SD of differences separated by hours (prepared without compaction)
+double conga_from_prepared(const cgmguru_events::PreparedIDData& prepared,
+                           int hours);
+
+// Mean absolute same-time-of-day difference day_lag days apart
+double modd_from_prepared(const cgmguru_events::PreparedIDData& prepared,
+                          int day_lag);
+
+// MAGE-ma summarised with direction; prepared must be the 5-minute grid
+double mage_ma_from_prepared(const cgmguru_events::PreparedIDData& prepared,
+                             int short_ma,
+                             int long_ma,
+                             double max_gap,
+                             const std::string& direction);
+
+} // namespace cgmguru_variability
+
+#endif // CGMGURU_VARIABILITY_METRICS_H
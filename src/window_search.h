@@ -0,0 +1,165 @@
+#ifndef CGMGURU_WINDOW_SEARCH_H
+#define CGMGURU_WINDOW_SEARCH_H
+
+#include "column_view.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <deque>
+
+// Time-window search over one subject's time-sorted readings.
+//
+// find_{max,min}_{after,before}_hours and transform_df look for the
+// extreme glucose value in a time window around each anchor point. Scanning
+// every window from scratch costs O(N * K) once windows overlap. With sorted
+// times the window bounds can be located by binary search and, since the
+// bounds of consecutive anchors only move forward, the extreme can be kept
+// in a monotonic deque so each reading is pushed and popped at most once.
+// Unsorted input keeps the original linear scans so results never change.
+namespace cgmguru_window {
+
+// True when values never decrease; any NA makes the answer false
+inline bool is_nondecreasing(cgmguru_columns::DoubleSpan values) {
+  for (std::size_t i = 0; i < values.size(); ++i) {
+    if (std::isnan(values[i])) return false;
+    if (i > 0 && values[i] < values[i - 1]) return false;
+  }
+  return true;
+}
+
+// Last index j >= start reached by scanning forward while time[j] <= limit
+// (start - 1 when time[start] already exceeds it)
+inline int forward_window_end(cgmguru_columns::DoubleSpan time, int start,
+                              double limit, bool sorted) {
+  const int n = static_cast<int>(time.size());
+  if (sorted && !std::isnan(limit)) {
+    return static_cast<int>(std::upper_bound(time.begin() + start, time.end(), limit) -
+                            time.begin()) - 1;
+  }
+  int j = start;
+  while (j < n && time[j] <= limit) {
+    j++;
+  }
+  return j - 1;
+}
+
+// First index j <= start reached by scanning backward while time[j] >= limit
+// (start + 1 when time[start] is already below it)
+inline int backward_window_begin(cgmguru_columns::DoubleSpan time, int start,
+                                 double limit, bool sorted) {
+  if (sorted && !std::isnan(limit)) {
+    return static_cast<int>(std::lower_bound(time.begin(), time.begin() + start + 1, limit) -
+                            time.begin());
+  }
+  int j = start;
+  while (j >= 0 && time[j] >= limit) {
+    j--;
+  }
+  return j + 1;
+}
+
+// Last index reached by scanning forward from first while the time elapsed
+// since time[origin] is at most seconds (first - 1 when time[first] is
+// already past it). The elapsed time is tested as "time[i] - time[origin] <=
+// seconds", exactly like the loops this replaces, so rounding cannot move a
+// window edge. With sorted time and increasing origins each scan resumes
+// where the previous one stopped, since a later origin reaches at least as
+// far; otherwise every call scans from first.
+class ElapsedWindowEnd {
+public:
+  ElapsedWindowEnd(cgmguru_columns::DoubleSpan time, double seconds, bool sorted)
+    : time_(time), seconds_(seconds), sorted_(sorted) {}
+
+  int operator()(int origin, int first) {
+    const int n = static_cast<int>(time_.size());
+    const bool resume = sorted_ && origin >= last_origin_;
+    int i = resume ? std::max(first, resume_) : first;
+    while (i < n && (time_[i] - time_[origin]) <= seconds_) {
+      ++i;
+    }
+    last_origin_ = origin;
+    resume_ = i;
+    return i - 1;
+  }
+
+private:
+  cgmguru_columns::DoubleSpan time_;
+  double seconds_;
+  bool sorted_;
+  int last_origin_ = 0;
+  int resume_ = 0;
+};
+
+// Index of the extreme value over [lo, hi] for a sequence of windows.
+//
+// Matches a linear scan that starts from `sentinel` and only accepts strictly
+// better, non-NA values: readings that are not better than the sentinel are
+// never reported. Ties go to the earliest index when keep_earlier_ties is
+// true (a forward scan) and to the latest one otherwise (a backward scan).
+// Windows whose bounds only move forward, or repeat, cost amortised O(1)
+// each; a window that moves backwards rebuilds the deque, so any order stays
+// correct.
+template <typename Better>
+class WindowExtreme {
+public:
+  WindowExtreme(cgmguru_columns::DoubleSpan values, double sentinel,
+                bool keep_earlier_ties, Better better = Better())
+    : values_(values), sentinel_(sentinel),
+      keep_earlier_ties_(keep_earlier_ties), better_(better) {}
+
+  // Returns -1 when the window holds no acceptable value
+  int query(int lo, int hi) {
+    const int n = static_cast<int>(values_.size());
+    lo = std::max(lo, 0);
+    hi = std::min(hi, n - 1);
+    if (lo > hi) return -1;
+
+    // next_ is one past the last reading pushed, so a window ending there
+    // again reuses the deque
+    if (lo < lo_ || hi + 1 < next_) {
+      candidates_.clear();
+      next_ = lo;
+    }
+    lo_ = lo;
+    next_ = std::max(next_, lo);
+    for (; next_ <= hi; ++next_) {
+      const double v = values_[next_];
+      if (std::isnan(v) || !better_(v, sentinel_)) continue;
+      while (!candidates_.empty() && dominated(values_[candidates_.back()], v)) {
+        candidates_.pop_back();
+      }
+      candidates_.push_back(next_);
+    }
+    while (!candidates_.empty() && candidates_.front() < lo) {
+      candidates_.pop_front();
+    }
+    return candidates_.empty() ? -1 : candidates_.front();
+  }
+
+private:
+  // Whether an earlier candidate can never win once `incoming` is in the window
+  bool dominated(double earlier, double incoming) const {
+    return keep_earlier_ties_ ? better_(incoming, earlier) : !better_(earlier, incoming);
+  }
+
+  cgmguru_columns::DoubleSpan values_;
+  double sentinel_;
+  bool keep_earlier_ties_;
+  Better better_;
+  std::deque<int> candidates_;
+  int lo_ = 0;
+  int next_ = 0;
+};
+
+struct Greater {
+  bool operator()(double a, double b) const { return a > b; }
+};
+
+struct Less {
+  bool operator()(double a, double b) const { return a < b; }
+};
+
+} // namespace cgmguru_window
+
+#endif // CGMGURU_WINDOW_SEARCH_H